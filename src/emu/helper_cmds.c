@@ -321,7 +321,7 @@ static int cmd_st(int argc, char *argv[])
 	uffs_Device *dev;
 	const char *mount = "/";
 	uffs_FlashStat *s;
-	TreeNode *node;
+	int block;
 
 	if (argc > 1) {
 		mount = argv[1];
@@ -354,9 +354,50 @@ static int cmd_st(int argc, char *argv[])
 	MSG("Write Spare:           %d" TENDSTR, s->spare_write_count);
 	MSG("Read Page:             %d" TENDSTR, s->page_read_count - s->page_header_read_count);
 	MSG("Read Header:           %d" TENDSTR, s->page_header_read_count);
+#ifdef CONFIG_ENABLE_DIRECT_READ
+	MSG("Read Direct:           %d" TENDSTR, s->page_direct_read_count);
+#endif
+#ifdef CONFIG_ENABLE_DIRECT_WRITE
+	MSG("Write Direct:          %d" TENDSTR, s->page_direct_write_count);
+#endif
 	MSG("Read Spare:            %d" TENDSTR, s->spare_read_count);
 	MSG("I/O Read:              %lu" TENDSTR, s->io_read);
 	MSG("I/O Write:             %lu" TENDSTR, s->io_write);
+#ifdef CONFIG_ENABLE_NAME_CACHE
+	MSG("Name Cache:            %d" TENDSTR, dev->nc.count);
+	MSG("Name Cache Hit:        %u" TENDSTR, (unsigned int)dev->nc.hit);
+	MSG("Name Cache Miss:       %u" TENDSTR, (unsigned int)dev->nc.miss);
+#endif
+#ifdef CONFIG_ENABLE_DENTRY_CACHE
+	MSG("Dentry Cache:          %d" TENDSTR, dev->dc.count);
+	MSG("Dentry Cache Hit:      %u" TENDSTR, (unsigned int)dev->dc.hit);
+	MSG("Dentry Cache Neg Hit:  %u" TENDSTR, (unsigned int)dev->dc.neg_hit);
+	MSG("Dentry Cache Miss:     %u" TENDSTR, (unsigned int)dev->dc.miss);
+#endif
+#ifdef CONFIG_ENABLE_ERASE_COUNT_ALLOC
+	{
+		u32 min, max, total;
+		if (uffs_WearGetStat(dev, &min, &max, &total) == U_SUCC) {
+			MSG("Block Erase Count Min: %u" TENDSTR, (unsigned int)min);
+			MSG("Block Erase Count Max: %u" TENDSTR, (unsigned int)max);
+			MSG("Block Erase Count Sum: %u" TENDSTR, (unsigned int)total);
+		}
+	}
+#endif
+#ifdef CONFIG_ENABLE_STATIC_WEAR_LEVELING
+	MSG("Static WL Moves:       %u" TENDSTR, (unsigned int)dev->wear.wl_moves);
+#endif
+	MSG("Dirty Groups:          %d" TENDSTR, dev->cfg.dirty_groups);
+	MSG("Evict For Group Slot:  %u" TENDSTR, (unsigned int)dev->buf.evict_slot);
+	MSG("Evict For Page Buf:    %u" TENDSTR, (unsigned int)dev->buf.evict_buf);
+#ifdef CONFIG_ENABLE_BG_FLUSH
+	MSG("Write Back Expired:    %u" TENDSTR, (unsigned int)dev->buf.wb_expire);
+	MSG("Write Back Watermark:  %u" TENDSTR, (unsigned int)dev->buf.wb_water);
+#endif
+#ifdef CONFIG_ENABLE_READ_AHEAD
+	MSG("Read Ahead Pages:      %u" TENDSTR, (unsigned int)dev->buf.ra_pages);
+	MSG("Read Ahead Hits:       %u" TENDSTR, (unsigned int)dev->buf.ra_hits);
+#endif
 
 	MSG("--------- partition info for '%s' ---------" TENDSTR, mount);
 	MSG("Space total:           %d" TENDSTR, uffs_GetDeviceTotal(dev));
@@ -367,12 +408,11 @@ static int cmd_st(int argc, char *argv[])
 	MSG("Pages Per Block:       %d" TENDSTR, dev->attr->pages_per_block);
 	MSG("Block size:            %d" TENDSTR, dev->attr->page_data_size * dev->attr->pages_per_block);
 	MSG("Total blocks:          %d of %d" TENDSTR, (dev->par.end - dev->par.start + 1), dev->attr->total_blocks);
-	if (dev->tree.bad) {
+	if (dev->tree.bad_count > 0) {
 		MSG("Bad blocks: ");
-		node = dev->tree.bad;
-		while(node) {
-			MSG("%d, ", node->u.list.block);
-			node = node->u.list.next;
+		for (block = dev->par.start; block <= dev->par.end; block++) {
+			if (uffs_TreeIsBadBlock(dev, block))
+				MSG("%d, ", block);
 		}
 		MSG(TENDSTR);
 	}
@@ -606,6 +646,122 @@ static int cmd_inspb(int argc, char *argv[])
 
 }
 
+/** save tree checkpoint
+ *		ckpt [<mount>]
+ */
+static int cmd_ckpt(int argc, char *argv[])
+{
+	const char *mount = "/";
+
+	CHK_ARGC(1, 2);
+
+	if (argc > 1)
+		mount = argv[1];
+
+	if (uffs_checkpoint(mount) < 0) {
+		MSGLN("Save checkpoint for %s fail", mount);
+		return -1;
+	}
+
+	return 0;
+}
+
+/** continue deferred tree building
+ *		scan [<mount>] [<blocks>]
+ */
+static int cmd_scan(int argc, char *argv[])
+{
+	const char *mount = "/";
+	int blocks = 0;
+	int remain;
+
+	CHK_ARGC(1, 3);
+
+	if (argc > 1)
+		mount = argv[1];
+	if (argc > 2)
+		blocks = strtol(argv[2], NULL, 10);
+
+	remain = uffs_scan_step(mount, blocks);
+	if (remain < 0) {
+		MSGLN("Scan %s fail", mount);
+		return -1;
+	}
+	MSGLN("%d blocks remain", remain);
+
+	return 0;
+}
+
+/** write back expired or over watermark dirty groups
+ *		flush [<mount>] [<n>]
+ */
+static int cmd_flush(int argc, char *argv[])
+{
+	const char *mount = "/";
+	int n = 0;
+	int ret, count = 0;
+
+	CHK_ARGC(1, 3);
+
+	if (argc > 1)
+		mount = argv[1];
+	if (argc > 2)
+		n = strtol(argv[2], NULL, 10);
+
+	while ((ret = uffs_flush_step(mount)) > 0) {
+		count++;
+		if (n > 0 && count >= n)
+			break;
+	}
+	if (ret < 0) {
+		MSGLN("Flush %s fail", mount);
+		return -1;
+	}
+	MSGLN("%d groups flushed", count);
+
+	return 0;
+}
+
+/** start/stop the flusher thread
+ *		flusher start [<interval_ms>] | stop
+ */
+static int cmd_flusher(int argc, char *argv[])
+{
+	int interval = 500;
+
+	CHK_ARGC(2, 3);
+
+	if (strcmp(argv[1], "start") == 0) {
+		if (argc > 2)
+			interval = strtol(argv[2], NULL, 10);
+		if (uffs_flusher_start(interval) < 0) {
+			MSGLN("Start flusher fail");
+			return -1;
+		}
+	}
+	else if (strcmp(argv[1], "stop") == 0) {
+		if (uffs_flusher_stop() < 0) {
+			MSGLN("Flusher is not running");
+			return -1;
+		}
+	}
+	else {
+		return CLI_INVALID_ARG;
+	}
+
+	return 0;
+}
+
+/* erase count of block, from uffs erase counters if available */
+static u32 _BlockEraseCount(uffs_Device *dev, int block)
+{
+#ifdef CONFIG_ENABLE_ERASE_COUNT_ALLOC
+	if (dev->wear.erase_count)
+		return uffs_WearGetEraseCount(dev, block);
+#endif
+	return ((uffs_FileEmu *)(dev->attr->_private))->em_monitor_block[block];
+}
+
 /** print block wear-leveling information
  *		wl [<mount>]
  */
@@ -614,7 +770,6 @@ static int cmd_wl(int argc, char *argv[])
 	const char *mount = "/";
 	uffs_Device *dev;
 	struct uffs_PartitionSt *par;
-	uffs_FileEmu *emu;
 	int i, max;
 	u32 n;
 
@@ -633,7 +788,6 @@ static int cmd_wl(int argc, char *argv[])
 	}
 
 	par = &dev->par;
-	emu = (uffs_FileEmu *)(dev->attr->_private);
 	max = -1;
 
 	for (i = 0; i < par->end - par->start; i++) {
@@ -642,12 +796,12 @@ static int cmd_wl(int argc, char *argv[])
 		}
 		n = i + par->start;
 		max = (max == -1 ? n :
-				(emu->em_monitor_block[n] > emu->em_monitor_block[max] ? n : max)
+				(_BlockEraseCount(dev, n) > _BlockEraseCount(dev, max) ? n : max)
 			   );
-		MSG(" %4d", emu->em_monitor_block[n]);
-		if (uffs_TreeFindBadNodeByBlock(dev, n))
+		MSG(" %4d", _BlockEraseCount(dev, n));
+		if (uffs_TreeIsBadBlock(dev, n))
 			MSG("%c", 'x');
-		else if (uffs_TreeFindErasedNodeByBlock(dev, n))
+		else if (uffs_TreeIsErasedBlock(dev, n))
 			MSG("%c", ' ');
 		else
 			MSG("%c", '.');
@@ -656,7 +810,7 @@ static int cmd_wl(int argc, char *argv[])
 	}
 	MSG("\n");
 	MSG("Total blocks %d, peak erase count %d at block %d\n",
-		par->end - par->start, max == -1 ? 0 : emu->em_monitor_block[max], max);
+		par->end - par->start, max == -1 ? 0 : _BlockEraseCount(dev, max), max);
 
 	uffs_PutDevice(dev);
 
@@ -681,6 +835,10 @@ static const struct cli_command helper_cmds[] =
 	{ cmd_dump,		"dump",			"[<mount>]",		"dump file system", },
 	{ cmd_wl,		"wl",			"[<mount>]",		"show block wear-leveling info", },
 	{ cmd_inspb,	"inspb",		"[<mount>]",		"inspect buffer", },
+	{ cmd_ckpt,		"ckpt",			"[<mount>]",		"save tree checkpoint", },
+	{ cmd_scan,		"scan",			"[<mount>] [<n>]",	"scan n blocks for deferred tree building", },
+	{ cmd_flush,	"flush",		"[<mount>] [<n>]",	"write back up to n expired or over watermark dirty groups", },
+	{ cmd_flusher,	"flusher",		"start [<ms>]|stop",	"start/stop background flusher thread", },
     { NULL, NULL, NULL, NULL }
 };
 
@@ -38,6 +38,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <time.h>
 #include "uffs_config.h"
 #include "uffs/uffs_public.h"
 #include "uffs/uffs_fd.h"
@@ -637,7 +639,7 @@ static int cmd_TestPageReadWrite(int argc, char *argv[])
 	uffs_Tags local_tag;
 	uffs_Tags *tag = &local_tag;
 	int ret;
-	u16 block;
+	UBLOCK block;
 	u16 page;
 	uffs_Buf *buf = NULL;
 
@@ -667,10 +669,10 @@ static int cmd_TestPageReadWrite(int argc, char *argv[])
 
 	TAG_DIRTY_BIT(tag) = TAG_DIRTY;
 	TAG_VALID_BIT(tag) = TAG_VALID;
-	TAG_DATA_LEN(tag) = dev->com.pg_data_size;
+	TAG_SET_DATA_LEN(tag, dev->com.pg_data_size);
 	TAG_TYPE(tag) = UFFS_TYPE_DATA;
 	TAG_PAGE_ID(tag) = 3;
-	TAG_PARENT(tag) = 100;
+	TAG_SET_PARENT(tag, 100);
 	TAG_SERIAL(tag) = 10;
 	TAG_BLOCK_TS(tag) = 1;
 	SEAL_TAG(tag);
@@ -1100,8 +1102,9 @@ static int cmd_tcheck_seq(int argc, char *argv[])
 	pos = uffs_tell(fd);
 	while (len > 0) {
 		size = (len > sizeof(buf) ? sizeof(buf) : len);
-		if ((r_ret = uffs_read(fd, buf, size)) < 0) {
-			MSGLN("Read fail! fd = %d, size = %d, pos = %ld", fd, size, pos);
+		if ((r_ret = uffs_read(fd, buf, size)) <= 0) {
+			// 0: unexpected end of file or read error, don't loop forever
+			MSGLN("Read fail! fd = %d, size = %d, pos = %ld, ret = %d", fd, size, pos, r_ret);
 			ret = -1;
 			break;
 		}
@@ -1172,8 +1175,8 @@ static int cmd_twrite_seq(int argc, char *argv[])
 	while (len > 0) {
 		size = (len < sizeof(buf) ? len : sizeof(buf));
 		memcp_seq(buf, size, pos);
-		if ((w_ret = uffs_write(fd, buf, size)) < 0) {
-			MSGLN("write fail! fd = %d, size = %d, pos = %ld", fd, size, pos);
+		if ((w_ret = uffs_write(fd, buf, size)) <= 0) {
+			MSGLN("write fail! fd = %d, size = %d, pos = %ld, ret = %d", fd, size, pos, w_ret);
 			ret = -1;
 			break;
 		}
@@ -1252,8 +1255,8 @@ static void do_dump_tag(uffs_Device *dev, uffs_Tags *tag)
 			MSG("    dirty = %d\n", tag->s.dirty);
 			MSG("    page_id = %d\n", tag->s.page_id);
 			MSG("    serial = %d\n", tag->s.serial);
-			MSG("    parent = %d\n", tag->s.parent);
-			MSG("    data_len = %d\n", tag->s.data_len);
+			MSG("    parent = %d\n", TAG_PARENT(tag));
+			MSG("    data_len = %d\n", TAG_DATA_LEN(tag));
 		}
 		else {
 			MSG("  tag is GOOD but NOT DIRTY !!!???\n");
@@ -1264,6 +1267,18 @@ static void do_dump_tag(uffs_Device *dev, uffs_Tags *tag)
 	}
 }
 
+static void do_dump_msg(struct uffs_DeviceSt *dev, const char *fmt, ...)
+{
+	char buf[256];
+	va_list args;
+
+	va_start(args, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+
+	MSG("%s", buf);
+}
+
 static void do_dump_device(uffs_Device *dev)
 {
 	URET ret;
@@ -1300,6 +1315,8 @@ static void do_dump_device(uffs_Device *dev)
 		}
 	}
 	uffs_BufFreeClone(dev, buf);
+
+	uffs_DumpTreeHash(dev, do_dump_msg);
 }
 
 static int cmd_dump(int argc, char *argv[])
@@ -1325,6 +1342,262 @@ static int cmd_dump(int argc, char *argv[])
 	return 0;
 }
 
+#ifdef CONFIG_ENABLE_ERASE_COUNT_ALLOC
+
+#define WLBENCH_HIST	8
+
+/* print erase count distribution of partition */
+static void do_wl_distribution(uffs_Device *dev, const char *title)
+{
+	u32 min, max, total, n;
+	int hist[WLBENCH_HIST];
+	int i, block, num;
+
+	if (uffs_WearGetStat(dev, &min, &max, &total) != U_SUCC)
+		return;
+
+	num = dev->par.end - dev->par.start + 1;
+	memset(hist, 0, sizeof(hist));
+	for (block = dev->par.start; block <= dev->par.end; block++) {
+		n = uffs_WearGetEraseCount(dev, block);
+		i = (int)((double)(n - min) * WLBENCH_HIST / (max - min + 1));
+		hist[i]++;
+	}
+
+	MSGLN("%s: erase count min %u, max %u, avg %u.%02u, spread %u",
+			title, (unsigned int)min, (unsigned int)max,
+			(unsigned int)(total / num), (unsigned int)((total % num) * 100 / num),
+			(unsigned int)(max - min));
+	MSG("  histogram:");
+	for (i = 0; i < WLBENCH_HIST; i++)
+		MSG(" %d", hist[i]);
+	MSG(TENDSTR);
+#ifdef CONFIG_ENABLE_STATIC_WEAR_LEVELING
+	MSGLN("  static wear leveling moves: %u", (unsigned int)dev->wear.wl_moves);
+#endif
+}
+
+/**
+ * wear leveling benchmark: write a static (cold) file, then keep rewriting
+ * a hot file, print the erase count distribution before and after.
+ *
+ *		t_wlbench <threshold> <rounds> [<static_kb> [<hot_kb>]]
+ *
+ * <threshold> is the static wear leveling threshold, -1 to disable it.
+ *
+ * for example, compare:
+ *		t_wlbench -1 2000
+ *		t_wlbench 8 2000
+ */
+static int cmd_TestWearLevel(int argc, char *argv[])
+{
+	const char *cold = "/wlbench_cold";
+	const char *hot = "/wlbench_hot";
+	uffs_Device *dev;
+	int threshold, rounds, static_kb = 256, hot_kb = 16;
+	int i, n, fd, ret = 0;
+	char buf[1024];
+#ifdef CONFIG_ENABLE_STATIC_WEAR_LEVELING
+	int old_threshold;
+#endif
+
+	CHK_ARGC(3, 5);
+
+	threshold = strtol(argv[1], NULL, 10);
+	rounds = strtol(argv[2], NULL, 10);
+	if (argc > 3)
+		static_kb = strtol(argv[3], NULL, 10);
+	if (argc > 4)
+		hot_kb = strtol(argv[4], NULL, 10);
+
+	dev = uffs_GetDeviceFromMountPoint("/");
+	if (dev == NULL) {
+		MSGLN("Can't get device from mount point.");
+		return -1;
+	}
+
+#ifdef CONFIG_ENABLE_STATIC_WEAR_LEVELING
+	old_threshold = dev->cfg.static_wl_threshold;
+	dev->cfg.static_wl_threshold = threshold;
+#else
+	if (threshold >= 0)
+		MSGLN("static wear leveling is not enabled, threshold ignored.");
+#endif
+
+	memset(buf, 'C', sizeof(buf));
+	fd = uffs_open(cold, UO_RDWR|UO_CREATE|UO_TRUNC);
+	if (fd < 0) {
+		MSGLN("Can't create %s", cold);
+		ret = -1;
+		goto ext;
+	}
+	for (i = 0; i < static_kb; i++) {
+		if (uffs_write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+			MSGLN("Write %s failed", cold);
+			ret = -1;
+			break;
+		}
+	}
+	uffs_close(fd);
+	if (ret < 0)
+		goto ext;
+
+	do_wl_distribution(dev, "before");
+
+	memset(buf, 'H', sizeof(buf));
+	for (i = 0; i < rounds && ret == 0; i++) {
+		fd = uffs_open(hot, UO_RDWR|UO_CREATE|UO_TRUNC);
+		if (fd < 0) {
+			MSGLN("Can't create %s", hot);
+			ret = -1;
+			break;
+		}
+		for (n = 0; n < hot_kb; n++) {
+			if (uffs_write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+				MSGLN("Write %s failed", hot);
+				ret = -1;
+				break;
+			}
+		}
+		uffs_close(fd);
+	}
+
+	do_wl_distribution(dev, "after");
+
+ext:
+	uffs_remove(hot);
+	uffs_remove(cold);
+#ifdef CONFIG_ENABLE_STATIC_WEAR_LEVELING
+	dev->cfg.static_wl_threshold = old_threshold;
+#endif
+	uffs_PutDevice(dev);
+
+	MSGLN("Wear leveling benchmark %s !", ret == 0 ? "SUCC" : "FAILED");
+
+	return ret;
+}
+#endif
+
+#define OBJBENCH_DIR	"/objbench/"
+
+/* stat and open <samples> random files of the first <n> files, print cost per lookup */
+static void do_lookup_cost(uffs_Device *dev, int n, int samples)
+{
+	char name[64];
+	struct uffs_stat sb;
+	clock_t t_stat = 0, t_open = 0, t;
+	u32 reads;
+	int i, fd, fails = 0;
+
+	reads = dev->st.page_read_count + dev->st.page_header_read_count;
+	for (i = 0; i < samples; i++) {
+		sprintf(name, OBJBENCH_DIR "f%05d", rand() % n);
+
+		t = clock();
+		if (uffs_stat(name, &sb) < 0)
+			fails++;
+		t_stat += clock() - t;
+
+		t = clock();
+		fd = uffs_open(name, UO_RDONLY);
+		t_open += clock() - t;
+		if (fd < 0)
+			fails++;
+		else
+			uffs_close(fd);
+	}
+	reads = dev->st.page_read_count + dev->st.page_header_read_count - reads;
+
+	MSGLN("%6d objects: stat %.1f us, open %.1f us, %.2f page reads per lookup%s",
+			n + 1,
+			(double)t_stat * 1000000 / CLOCKS_PER_SEC / samples,
+			(double)t_open * 1000000 / CLOCKS_PER_SEC / samples,
+			(double)reads / (samples * 2),
+			fails ? ", LOOKUP FAILED" : "");
+}
+
+/**
+ * lookup cost benchmark: create <n> files under /objbench/, measure
+ * stat/open cost of random files every <step> files.
+ *
+ *		t_objbench <n> [<step> [<samples> [keep]]]
+ *
+ * files are deleted at the end unless 'keep' is given.
+ *
+ * each file takes a block, the partition needs more than <n> blocks.
+ * for example, with CONFIG_ENABLE_EXT_SERIAL:
+ *		mkuffs -f bench.img -p 512 -s 16 -b 4 -t 20000 -c
+ *		t_objbench 16000 2000
+ */
+static int cmd_TestLookupBench(int argc, char *argv[])
+{
+	uffs_Device *dev;
+	char name[64];
+	int n, step = 1000, samples = 1000;
+	int i, fd, ret = 0;
+	UBOOL keep = U_FALSE;
+
+	CHK_ARGC(2, 5);
+
+	n = strtol(argv[1], NULL, 10);
+	if (argc > 2)
+		step = strtol(argv[2], NULL, 10);
+	if (argc > 3)
+		samples = strtol(argv[3], NULL, 10);
+	if (argc > 4)
+		keep = (strcmp(argv[4], "keep") == 0 ? U_TRUE : U_FALSE);
+
+	if (n <= 0 || step <= 0 || samples <= 0)
+		return CLI_INVALID_ARG;
+
+	if (n >= MAX_UFFS_FSN) {
+		MSGLN("at most %d dirs/files in a partition.", MAX_UFFS_FSN);
+		n = MAX_UFFS_FSN - 1;
+	}
+
+	dev = uffs_GetDeviceFromMountPoint("/");
+	if (dev == NULL) {
+		MSGLN("Can't get device from mount point.");
+		return -1;
+	}
+
+	if (uffs_mkdir(OBJBENCH_DIR) < 0) {
+		MSGLN("Can't create dir %s", OBJBENCH_DIR);
+		uffs_PutDevice(dev);
+		return -1;
+	}
+
+	srand(1);
+	for (i = 0; i < n; i++) {
+		sprintf(name, OBJBENCH_DIR "f%05d", i);
+		fd = uffs_open(name, UO_RDWR|UO_CREATE|UO_TRUNC);
+		if (fd < 0) {
+			MSGLN("Create file %s failed", name);
+			ret = -1;
+			break;
+		}
+		uffs_close(fd);
+
+		if ((i + 1) % step == 0 || i + 1 == n)
+			do_lookup_cost(dev, i + 1, samples);
+	}
+
+	for (i--; !keep && i >= 0; i--) {
+		sprintf(name, OBJBENCH_DIR "f%05d", i);
+		if (uffs_remove(name) < 0) {
+			MSGLN("Delete file %s failed", name);
+			ret = -1;
+		}
+	}
+	if (!keep)
+		uffs_rmdir(OBJBENCH_DIR);
+	uffs_PutDevice(dev);
+
+	MSGLN("Lookup benchmark %s !", ret == 0 ? "SUCC" : "FAILED");
+
+	return ret;
+}
+
 static int cmd_apisrv(int argc, char *argv[])
 {
 	return api_server_start();
@@ -1351,6 +1624,10 @@ static const struct cli_command test_cmds[] =
 	{ cmd_tclose,				"t_close",		"<fd>",				"close <fd>", },
 	{ cmd_truncate,				"t_truncate",	"<fd> <remain>",	"change <fd> size to <remain>", },
 	{ cmd_dump,					"dump",			"<mount>",			"dump <mount>", },
+#ifdef CONFIG_ENABLE_ERASE_COUNT_ALLOC
+	{ cmd_TestWearLevel,		"t_wlbench",	"<threshold> <rounds> [<static_kb> [<hot_kb>]]",	"wear leveling benchmark", },
+#endif
+	{ cmd_TestLookupBench,		"t_objbench",	"<n> [<step> [<samples> [keep]]]",	"lookup cost benchmark with <n> files", },
 
 	{ cmd_apisrv,				"apisrv",		NULL,				"start API test server", },
 
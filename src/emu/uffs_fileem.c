@@ -86,6 +86,10 @@ URET femu_InitDevice(uffs_Device *dev)
 			break;
 		case UFFS_ECC_HW_AUTO:
 			dev->ops = &g_femu_ops_ecc_hw_auto;
+#ifdef CONFIG_MOUNT_SCAN_THREADS
+			// there is only one serial data buffer, can't be read from multiple threads.
+			dev->cfg.scan_threads = 1;
+#endif
 			break;
 		default:
 			break;
@@ -47,6 +47,8 @@
 
 #define UFFS_FEMU_ENABLE_INJECTION		// enable bad block & ecc error injection
 
+//#define UFFS_FEMU_READ_DELAY_US	50		// emulate flash read latency (micro seconds per read), for benchmark
+
 extern struct uffs_FlashOpsSt g_femu_ops_ecc_soft;		// for software ECC or no ECC.
 extern struct uffs_FlashOpsSt g_femu_ops_ecc_hw;		// for hardware ECC
 extern struct uffs_FlashOpsSt g_femu_ops_ecc_hw_auto;	// for auto hardware ECC
@@ -83,6 +85,7 @@ void femu_setup_wrapper_functions(uffs_Device *dev);
 int femu_InitFlash(uffs_Device *dev);
 int femu_ReleaseFlash(uffs_Device *dev);
 int femu_EraseBlock(uffs_Device *dev, u32 blockNumber);
+int femu_ReadAt(uffs_FileEmu *emu, void *buf, int len, long ofs);
 
 #endif
 
@@ -169,8 +169,7 @@ static URET femu_hw_ReadPageWithLayout(uffs_Device *dev, u32 block, u32 page, u8
 		if (data_len > attr->page_data_size)
 			goto err;
 
-		fseek(emu->fp, abs_page * full_page_size, SEEK_SET);
-		nread = fread(data, 1, data_len, emu->fp);
+		nread = femu_ReadAt(emu, data, data_len, abs_page * full_page_size);
 
 		if (nread != data_len) {
 			MSG("read page I/O error ?");
@@ -188,8 +187,7 @@ static URET femu_hw_ReadPageWithLayout(uffs_Device *dev, u32 block, u32 page, u8
 	if (ts) {
 
 		spare_len = dev->mem.spare_data_size;
-		fseek(emu->fp, abs_page * full_page_size + attr->page_data_size, SEEK_SET);
-		nread = fread(spare, 1, spare_len, emu->fp);
+		nread = femu_ReadAt(emu, spare, spare_len, abs_page * full_page_size + attr->page_data_size);
 
 		if (nread != spare_len) {
 			MSG("read page spare I/O error ?");
@@ -205,8 +203,7 @@ static URET femu_hw_ReadPageWithLayout(uffs_Device *dev, u32 block, u32 page, u8
 
 	if (data == NULL && ts == NULL) {
 		// read bad block mark
-		fseek(emu->fp, abs_page * full_page_size + attr->page_data_size + attr->block_status_offs, SEEK_SET);
-		nread = fread(&status, 1, 1, emu->fp);
+		nread = femu_ReadAt(emu, &status, 1, abs_page * full_page_size + attr->page_data_size + attr->block_status_offs);
 
 		if (nread != 1) {
 			MSG("read badblock mark I/O error ?");
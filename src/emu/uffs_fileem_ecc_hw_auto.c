@@ -118,8 +118,7 @@ static int load_sdata(uffs_Device *dev, int block, int page)
 
 	abs_page = attr->pages_per_block * block + page;
 
-	fseek(emu->fp, abs_page * PAGE_FULL_SIZE, SEEK_SET);
-	nread = fread(g_sdata_buf, 1, PAGE_FULL_SIZE, emu->fp);
+	nread = femu_ReadAt(emu, g_sdata_buf, PAGE_FULL_SIZE, abs_page * PAGE_FULL_SIZE);
 	g_sdata_buf_pointer = 0;
 
 	ret = ((nread == PAGE_FULL_SIZE) ? UFFS_FLASH_NO_ERR : UFFS_FLASH_IO_ERR);
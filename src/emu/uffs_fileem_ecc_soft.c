@@ -130,6 +130,55 @@ err:
 }
 
 
+static int femu_WritePageVec(uffs_Device *dev, u32 block, u32 page_num,
+							const u8 *header, int header_len, const u8 *data, int data_len,
+							const u8 *spare, int spare_len)
+{
+	int written;
+	int abs_page;
+	int full_page_size;
+	uffs_FileEmu *emu;
+	struct uffs_StorageAttrSt *attr = dev->attr;
+
+	emu = (uffs_FileEmu *)(dev->attr->_private);
+
+	if (!emu || !(emu->fp) || header == NULL || data == NULL) {
+		goto err;
+	}
+
+	abs_page = attr->pages_per_block * block + page_num;
+	full_page_size = attr->page_data_size + attr->spare_size;
+
+	if (header_len + data_len > attr->page_data_size)
+		goto err;
+
+	emu->em_monitor_page[abs_page]++;
+	if (emu->em_monitor_page[abs_page] > PAGE_DATA_WRITE_COUNT_LIMIT) {
+		MSGLN("Warrning: block %d page %d exceed it's maximum write time!", block, page_num);
+		goto err;
+	}
+
+	fseek(emu->fp, abs_page * full_page_size, SEEK_SET);
+
+	written = fwrite(header, 1, header_len, emu->fp);
+	written += fwrite(data, 1, data_len, emu->fp);
+
+	if (written != header_len + data_len) {
+		MSGLN("write page I/O error ?");
+		goto err;
+	}
+
+	dev->st.page_write_count++;
+	dev->st.io_write += written;
+
+	// spare is written the same way as WritePage()
+	return femu_WritePage(dev, block, page_num, NULL, 0, spare, spare_len);
+err:
+	fflush(emu->fp);
+	return UFFS_FLASH_IO_ERR;
+}
+
+
 static URET femu_ReadPage(uffs_Device *dev, u32 block, u32 page_num, u8 *data, int data_len, u8 *ecc,
 							u8 *spare, int spare_len)
 {
@@ -153,8 +202,7 @@ static URET femu_ReadPage(uffs_Device *dev, u32 block, u32 page_num, u8 *data, i
 		if (data_len > attr->page_data_size)
 			goto err;
 
-		fseek(emu->fp, abs_page * full_page_size, SEEK_SET);
-		nread = fread(data, 1, data_len, emu->fp);
+		nread = femu_ReadAt(emu, data, data_len, abs_page * full_page_size);
 
 		if (nread != data_len) {
 			MSGLN("read page I/O error ?");
@@ -168,8 +216,7 @@ static URET femu_ReadPage(uffs_Device *dev, u32 block, u32 page_num, u8 *data, i
 		if (spare_len > attr->spare_size)
 			goto err;
 
-		fseek(emu->fp, abs_page * full_page_size + attr->page_data_size, SEEK_SET);
-		nread = fread(spare, 1, spare_len, emu->fp);
+		nread = femu_ReadAt(emu, spare, spare_len, abs_page * full_page_size + attr->page_data_size);
 
 		if (nread != spare_len) {
 			MSGLN("read page spare I/O error ?");
@@ -181,8 +228,7 @@ static URET femu_ReadPage(uffs_Device *dev, u32 block, u32 page_num, u8 *data, i
 
 	if (data == NULL && spare == NULL) {
 		// read bad block mark
-		fseek(emu->fp, abs_page * full_page_size + attr->page_data_size + attr->block_status_offs, SEEK_SET);
-		nread = fread(&status, 1, 1, emu->fp);
+		nread = femu_ReadAt(emu, &status, 1, abs_page * full_page_size + attr->page_data_size + attr->block_status_offs);
 
 		if (nread != 1) {
 			MSGLN("read badblock mark I/O error ?");
@@ -198,6 +244,51 @@ err:
 	return UFFS_FLASH_IO_ERR;
 }
 
+static int femu_ReadBlockTags(uffs_Device *dev, u32 block, u32 page, int n,
+							uffs_TagStore *ts, u8 *seal)
+{
+	int nread;
+	uffs_FileEmu *emu;
+	int abs_page;
+	int full_page_size;
+	struct uffs_StorageAttrSt *attr = dev->attr;
+	u8 *buf, *spare;
+	int len, i;
+
+	emu = (uffs_FileEmu *)(dev->attr->_private);
+
+	if (!emu || !(emu->fp) || n <= 0 || page + n > attr->pages_per_block) {
+		return UFFS_FLASH_IO_ERR;
+	}
+
+	abs_page = attr->pages_per_block * block + page;
+	full_page_size = attr->page_data_size + attr->spare_size;
+
+	// stream spare areas of n pages with one read
+	len = (n - 1) * full_page_size + attr->spare_size;
+	buf = (u8 *) malloc(len);
+	if (buf == NULL)
+		return UFFS_FLASH_IO_ERR;
+
+	nread = femu_ReadAt(emu, buf, len, abs_page * full_page_size + attr->page_data_size);
+	if (nread != len) {
+		MSGLN("read block spares I/O error ?");
+		free(buf);
+		return UFFS_FLASH_IO_ERR;
+	}
+
+	for (i = 0; i < n; i++) {
+		spare = buf + i * full_page_size;
+		uffs_FlashUnloadSpare(dev, spare, &ts[i], NULL);
+		seal[i] = uffs_FlashGetSealByte(dev, spare);
+		dev->st.io_read += dev->mem.spare_data_size;
+		dev->st.spare_read_count++;
+	}
+
+	free(buf);
+
+	return UFFS_FLASH_NO_ERR;
+}
 
 uffs_FlashOps g_femu_ops_ecc_soft = {
 	femu_InitFlash,		// InitFlash()
@@ -209,4 +300,7 @@ uffs_FlashOps g_femu_ops_ecc_soft = {
 	NULL,				// IsBadBlock(), let UFFS take care of it.
 	NULL,				// MarkBadBlock(), let UFFS take care of it.
 	femu_EraseBlock,	// EraseBlock()
+	NULL,				// CheckErasedBlock()
+	femu_ReadBlockTags,	// ReadBlockTags()
+	femu_WritePageVec,	// WritePageVec()
 };
@@ -41,6 +41,11 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#ifdef _MSC_VER
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
 #include "uffs_config.h"
 #include "uffs/uffs_device.h"
 #include "uffs_fileem.h"
@@ -228,3 +233,25 @@ err:
 	
 }
 
+/*
+ * Read emulator file at given offset, without moving file position.
+ * It's safe to read from multiple threads (except on Windows).
+ */
+int femu_ReadAt(uffs_FileEmu *emu, void *buf, int len, long ofs)
+{
+#ifdef UFFS_FEMU_READ_DELAY_US
+# ifdef _MSC_VER
+	Sleep((UFFS_FEMU_READ_DELAY_US + 999) / 1000);
+# else
+	usleep(UFFS_FEMU_READ_DELAY_US);
+# endif
+#endif
+
+#ifdef _MSC_VER
+	fseek(emu->fp, ofs, SEEK_SET);
+	return fread(buf, 1, len, emu->fp);
+#else
+	return pread(fileno(emu->fp), buf, len, ofs);
+#endif
+}
+
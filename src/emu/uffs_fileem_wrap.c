@@ -98,6 +98,11 @@ static int femu_WritePage_wrap(uffs_Device *dev, u32 block, u32 page,
 static int femu_WritePageWithLayout_wrap(uffs_Device *dev, u32 block, u32 page, const u8* data, int data_len, const u8 *ecc,
 									const uffs_TagStore *ts);
 static int femu_EraseBlock_wrap(uffs_Device *dev, u32 blockNumber);
+static int femu_ReadBlockTags_wrap(uffs_Device *dev, u32 block, u32 page, int n,
+									uffs_TagStore *ts, u8 *seal);
+static int femu_WritePageVec_wrap(uffs_Device *dev, u32 block, u32 page,
+							const u8 *header, int header_len, const u8 *data, int data_len,
+							const u8 *spare, int spare_len);
 
 
 /////////////////////////////////////////////////////////////////////////////////
@@ -123,6 +128,10 @@ void femu_setup_wrapper_functions(uffs_Device *dev)
 		dev->ops->WritePage = femu_WritePage_wrap;
 	if (dev->ops->WritePageWithLayout)
 		dev->ops->WritePageWithLayout = femu_WritePageWithLayout_wrap;
+	if (dev->ops->ReadBlockTags)
+		dev->ops->ReadBlockTags = femu_ReadBlockTags_wrap;
+	if (dev->ops->WritePageVec)
+		dev->ops->WritePageVec = femu_WritePageVec_wrap;
 }
 
 static int femu_InitFlash_wrap(uffs_Device *dev)
@@ -150,6 +159,7 @@ static int femu_InitFlash_wrap(uffs_Device *dev)
 					fwrite(&x, 1, 1, emu->fp);
 				}
 			}
+			fflush(emu->fp);	// marks are read by femu_ReadAt(), not from stdio buffer
 		}
 #endif
 	}
@@ -196,6 +206,16 @@ static int femu_ReadPageWithLayout_wrap(uffs_Device *dev, u32 block, u32 page, u
 	return emu->ops_orig.ReadPageWithLayout(dev, block, page, data, data_len, ecc, ts, ecc_store);
 }
 
+static int femu_ReadBlockTags_wrap(uffs_Device *dev, u32 block, u32 page, int n,
+									uffs_TagStore *ts, u8 *seal)
+{
+	uffs_FileEmu *emu = (uffs_FileEmu *)(dev->attr->_private);
+
+#ifdef UFFS_FEMU_SHOW_FLASH_IO
+	MSG(PFX " Read block %d page %d - %d TS" TENDSTR, block, page, page + n - 1);
+#endif
+	return emu->ops_orig.ReadBlockTags(dev, block, page, n, ts, seal);
+}
 
 ////////////////////// wraper functions ///////////////////////////
 
@@ -271,6 +291,7 @@ static void InjectBitFlip(uffs_Device *dev, u32 block, u32 page)
 	if (p) {
 		fseek(emu->fp, page_offset, SEEK_SET);
 		fwrite(buf, 1, full_page_size, emu->fp);
+		fflush(emu->fp);	// page is read by femu_ReadAt(), not from stdio buffer
 	}
 
     if (power_cut_enable) {
@@ -330,6 +351,27 @@ static int femu_WritePageWithLayout_wrap(uffs_Device *dev, u32 block, u32 page,
 	return ret;
 }
 
+static int femu_WritePageVec_wrap(uffs_Device *dev, u32 block, u32 page,
+							const u8 *header, int header_len, const u8 *data, int data_len,
+							const u8 *spare, int spare_len)
+{
+	uffs_FileEmu *emu = (uffs_FileEmu *)(dev->attr->_private);
+	int ret;
+
+#ifdef UFFS_FEMU_SHOW_FLASH_IO
+	MSG(PFX " Write block %d page %d HEADER[%d] DATA[%d]", block, page, header_len, data_len);
+	if (spare)
+		MSG(" SPARE[%d]", spare_len);
+	MSG(TENDSTR);
+#endif
+
+	ret = emu->ops_orig.WritePageVec(dev, block, page, header, header_len, data, data_len, spare, spare_len);
+
+	InjectBitFlip(dev, block, page);
+
+	return ret;
+}
+
 
 static int femu_EraseBlock_wrap(uffs_Device *dev, u32 blockNumber)
 {
@@ -58,6 +58,9 @@ void uffs_BadBlockProcessNode(uffs_Device *dev, TreeNode *node);
 /** try to recover data from a new discovered bad block */
 void uffs_BadBlockRecover(uffs_Device *dev);
 
+/** move data of a good block to the given erased block, and erase the block */
+URET uffs_BadBlockRefresh(uffs_Device *dev, int block, TreeNode *good);
+
 /** put a new block to the bad block waiting list */
 void uffs_BadBlockAdd(uffs_Device *dev, int block, u8 mark);
 
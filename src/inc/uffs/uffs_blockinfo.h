@@ -62,7 +62,7 @@ struct uffs_PageSpareSt {
 struct uffs_BlockInfoSt {
 	struct uffs_BlockInfoSt *next;
 	struct uffs_BlockInfoSt *prev;
-	u16 block;							//!< block number
+	UBLOCK block;						//!< block number
 	struct uffs_PageSpareSt *spares;	//!< page spare info array
 	int expired_count;					//!< how many pages expired in this block ? 
 	int ref_count;						//!< reference counter, it's safe to reuse this block memory when the counter is 0.
@@ -71,6 +71,26 @@ struct uffs_BlockInfoSt {
 /** get tag from block info */
 #define GET_TAG(bc, page) (&(bc)->spares[page].tag)
 
+#ifdef CONFIG_ENABLE_BLOCK_SUMMARY
+/** magic number of block summary */
+#define UFFS_BLOCK_SUMMARY_MAGIC	0x5342
+
+/** 
+ * \struct uffs_BlockSummaryHeadSt
+ * \brief head of block summary page data, followed by tag stores of summarized pages.
+ */
+struct uffs_BlockSummaryHeadSt {
+	u16 magic;		//!< #UFFS_BLOCK_SUMMARY_MAGIC
+	u16 pages;		//!< number of summarized pages, from page 0
+	u16 crc;		//!< crc16 of tag stores
+	u16 reserved;
+};
+
+/** size of block summary data for n pages */
+#define UFFS_BLOCK_SUMMARY_SIZE(n) \
+			(sizeof(struct uffs_BlockSummaryHeadSt) + sizeof(uffs_TagStore) * (n))
+#endif
+
 
 /** initialize block info caches */
 URET uffs_BlockInfoInitCache(uffs_Device *dev, int maxCachedBlocks);
@@ -81,6 +101,11 @@ URET uffs_BlockInfoReleaseCache(uffs_Device *dev);
 /** load page spare to block info cache */
 URET uffs_BlockInfoLoad(uffs_Device *dev, uffs_BlockInfo *work, int page);
 
+#ifdef CONFIG_MOUNT_SCAN_THREADS
+/** fill page spare of block info cache with a tag read by caller */
+void uffs_BlockInfoFill(uffs_Device *dev, uffs_BlockInfo *work, int page, const uffs_Tags *tag);
+#endif
+
 /** find block info cache */
 uffs_BlockInfo * uffs_BlockInfoFindInCache(uffs_Device *dev, int block);
 
@@ -102,6 +127,11 @@ void uffs_BlockInfoExpireAll(uffs_Device *dev);
 /** This will init block info cache for an erased block - all '0xFF' */
 void uffs_BlockInfoInitErased(uffs_Device *dev, uffs_BlockInfo *p);
 
+#ifdef CONFIG_ENABLE_BLOCK_SUMMARY
+/** does the last page of block carry block summary ? */
+UBOOL uffs_BlockInfoHasSummary(uffs_Device *dev, uffs_BlockInfo *work);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
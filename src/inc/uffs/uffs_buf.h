@@ -57,6 +57,7 @@ extern "C"{
 
 /** for uffs_BufSt::ext_mark */
 #define UFFS_BUF_EXT_MARK_TRUNC_TAIL 1	//!< the last page of file (when truncating a file)
+#define UFFS_BUF_EXT_MARK_READ_AHEAD 2	//!< loaded by read ahead, not used yet
 
 /** uffs page buffer */
 struct uffs_BufSt{
@@ -64,6 +65,9 @@ struct uffs_BufSt{
 	struct uffs_BufSt *prev;			//!< link to previous buffer
 	struct uffs_BufSt *next_dirty;		//!< link to next dirty buffer
 	struct uffs_BufSt *prev_dirty;		//!< link to previous dirty buffer
+	struct uffs_BufSt *next_free;		//!< link to next clean unreferenced buffer
+	struct uffs_BufSt *prev_free;		//!< link to previous clean unreferenced buffer
+	struct uffs_BufSt *next_hash;		//!< link to next buffer in the same hash bucket
 	u8 type;							//!< #UFFS_TYPE_DIR or #UFFS_TYPE_FILE or #UFFS_TYPE_DATA
 	u8 ext_mark;						//!< extension mark. 
 	u16 parent;							//!< parent serial
@@ -89,12 +93,21 @@ URET uffs_BufReleaseAll(struct uffs_DeviceSt *dev);
 uffs_Buf * uffs_BufGet(struct uffs_DeviceSt *dev, u16 parent, u16 serial, u16 page_id);
 uffs_Buf *uffs_BufGetEx(struct uffs_DeviceSt *dev, u8 type, TreeNode *node, u16 page_id, int oflag);
 
+/** load pages of a block into free page buffers in advance */
+int uffs_BufReadAhead(struct uffs_DeviceSt *dev, u8 type, TreeNode *node, u16 page_id, int count, int oflag);
+
+/** let an unreferenced clean page buffer be reused first */
+void uffs_BufDropBehind(struct uffs_DeviceSt *dev, uffs_Buf *buf);
+
 /** alloc a new page buffer */
 uffs_Buf *uffs_BufNew(struct uffs_DeviceSt *dev, u8 type, u16 parent, u16 serial, u16 page_id);
 
 /** find the page buffer (not affect the reference counter) */
 uffs_Buf * uffs_BufFind(uffs_Device *dev, u16 parent, u16 serial, u16 page_id);
 
+/** change parent serial of the page buffer, e.g. when renaming an object */
+void uffs_BufSetParent(uffs_Device *dev, uffs_Buf *buf, u16 parent);
+
 /** find the page buffer from #start (not affect the reference counter) */
 uffs_Buf * uffs_BufFindFrom(uffs_Device *dev, uffs_Buf *start,
 						u16 parent, u16 serial, u16 page_id);
@@ -125,6 +138,11 @@ URET uffs_BufFlushEx(struct uffs_DeviceSt *dev, UBOOL force_block_recover);
 URET uffs_BufFlushGroup(struct uffs_DeviceSt *dev, u16 parent, u16 serial);
 URET uffs_BufFlushGroupEx(struct uffs_DeviceSt *dev, u16 parent, u16 serial, UBOOL force_block_recover);
 
+#ifdef CONFIG_ENABLE_DIRECT_WRITE
+/** write whole pages of a new data block from caller's buffer, bypass page buffers */
+URET uffs_BufWriteBlockDirect(struct uffs_DeviceSt *dev, u16 parent, u16 serial, const u8 *data, int pages);
+#endif
+
 /** find free dirty group slot */
 int uffs_BufFindFreeGroupSlot(struct uffs_DeviceSt *dev);
 
@@ -137,12 +155,17 @@ URET uffs_BufLockGroup(struct uffs_DeviceSt *dev, int slot);
 /** unlock dirty group */
 URET uffs_BufUnLockGroup(struct uffs_DeviceSt *dev, int slot);
 
-/** flush most dirty group */
+/** flush a dirty group (picked by age, completeness and flush cost) to free page buffers */
 URET uffs_BufFlushMostDirtyGroup(struct uffs_DeviceSt *dev);
 
 /** flush all groups under the same parent number */
 URET uffs_BufFlushGroupMatchParent(struct uffs_DeviceSt *dev, u16 parent);
 
+#ifdef CONFIG_ENABLE_BG_FLUSH
+/** write back one expired or over watermark dirty group, 1: flushed, 0: nothing to flush, -1: fail */
+int uffs_BufFlushStep(struct uffs_DeviceSt *dev);
+#endif
+
 /** flush all page buffers */
 URET uffs_BufFlushAll(struct uffs_DeviceSt *dev);
 
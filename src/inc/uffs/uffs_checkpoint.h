@@ -0,0 +1,79 @@
+/*
+  This file is part of UFFS, the Ultra-low-cost Flash File System.
+  
+  Copyright (C) 2005-2009 Ricky Zheng <ricky_gz_zheng@yahoo.co.nz>
+
+  UFFS is free software; you can redistribute it and/or modify it under
+  the GNU Library General Public License as published by the Free Software 
+  Foundation; either version 2 of the License, or (at your option) any
+  later version.
+
+  UFFS is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+  or GNU Library General Public License, as applicable, for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  and GNU Library General Public License along with UFFS; if not, write
+  to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA  02110-1301, USA.
+
+  As a special exception, if other files instantiate templates or use
+  macros or inline functions from this file, or you compile this file
+  and link it with other works to produce a work based on this file,
+  this file does not by itself cause the resulting work to be covered
+  by the GNU General Public License. However the source code for this
+  file must still be made available in accordance with section (3) of
+  the GNU General Public License v2.
+ 
+  This exception does not invalidate any other reasons why a work based
+  on this file might be covered by the GNU General Public License.
+*/
+/** 
+ * \file uffs_checkpoint.h
+ * \brief tree checkpoint, save/load the tree to/from reserved blocks
+ * \author Ricky Zheng
+ */
+
+#ifndef _UFFS_CHECKPOINT_H_
+#define _UFFS_CHECKPOINT_H_
+
+#include "uffs/uffs_public.h"
+#include "uffs/uffs_device.h"
+#include "uffs/uffs_core.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef CONFIG_ENABLE_TREE_CHECKPOINT
+
+/** reserve checkpoint blocks from the end of partition */
+URET uffs_CheckpointInit(uffs_Device *dev);
+
+/** give back checkpoint blocks to partition */
+void uffs_CheckpointRelease(uffs_Device *dev);
+
+/** save the tree to checkpoint blocks */
+URET uffs_CheckpointSave(uffs_Device *dev);
+
+/** build the tree from checkpoint, the tree must be initialized and empty */
+URET uffs_CheckpointLoad(uffs_Device *dev);
+
+/** discard checkpoint, called before the partition is modified */
+void uffs_CheckpointDiscard(uffs_Device *dev);
+
+#define CHECKPOINT_DISCARD(dev) \
+	do { if ((dev)->ckpt.valid) uffs_CheckpointDiscard(dev); } while (0)
+
+#else
+
+#define CHECKPOINT_DISCARD(dev)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
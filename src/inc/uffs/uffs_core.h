@@ -33,10 +33,77 @@
 #ifndef _UFFS_CORE_H_
 #define _UFFS_CORE_H_
 
+#include "uffs_config.h"
+#include "uffs/uffs_types.h"
+
 #ifdef __cplusplus
 extern "C"{
 #endif
 
+/** \typedef UBLOCK
+ * \brief block number, 32 bit if CONFIG_ENABLE_WIDE_BLOCK is enabled, 16 bit otherwise
+ */
+#ifdef CONFIG_ENABLE_WIDE_BLOCK
+typedef u32 UBLOCK;
+#else
+typedef u16 UBLOCK;
+#endif
+
+/** \typedef UNODE
+ * \brief tree node index, 32 bit if CONFIG_ENABLE_WIDE_BLOCK is enabled, 16 bit otherwise
+ */
+#ifdef CONFIG_ENABLE_WIDE_BLOCK
+typedef u32 UNODE;
+#else
+typedef u16 UNODE;
+#endif
+
+/**
+ * \def UFFS_TAG_PAGE_ID_SIZE_BITS
+ * \brief define number of bits used for page_id in tag,
+ *        this defines the maximum pages per block you can have.
+ *        e.g. '9' ==> maximum 512 pages per block
+ **/
+#define UFFS_TAG_PAGE_ID_SIZE_BITS  6
+
+/**
+ * \def UFFS_TAG_DATA_LEN_HI_BITS
+ * \brief number of extra data length bits in tag for page larger than 4K,
+ *        taken from the reserved bits.
+ *        These bits are stored inverted, so tags written by 12-bit
+ *        data length version (reserved bits left '1') read the same.
+ **/
+#if UFFS_MAX_PAGE_SIZE > 4096
+#define UFFS_TAG_DATA_LEN_HI_BITS	2
+#else
+#define UFFS_TAG_DATA_LEN_HI_BITS	0
+#endif
+
+#if UFFS_TAG_PAGE_ID_SIZE_BITS + UFFS_TAG_DATA_LEN_HI_BITS > 10
+#error "UFFS_TAG_PAGE_ID_SIZE_BITS too big !"
+#endif
+
+/**
+ * \def UFFS_TAG_PARENT_HI_BITS
+ * \brief number of extra parent bits in tag with #CONFIG_ENABLE_EXT_SERIAL,
+ *        taken from the reserved bits (up to 4, parent is then as wide as serial).
+ *        Stored inverted as data_len_hi.
+ **/
+#if !defined(CONFIG_ENABLE_EXT_SERIAL)
+#define UFFS_TAG_PARENT_HI_BITS		0
+#elif 10 - UFFS_TAG_PAGE_ID_SIZE_BITS - UFFS_TAG_DATA_LEN_HI_BITS > 4
+#define UFFS_TAG_PARENT_HI_BITS		4
+#else
+#define UFFS_TAG_PARENT_HI_BITS		(10 - UFFS_TAG_PAGE_ID_SIZE_BITS - UFFS_TAG_DATA_LEN_HI_BITS)
+#endif
+
+/**
+ * \def UFFS_TAG_RESERVED_BITS
+ * \brief the number of bits left to be used for the furture (UFFS2).
+ **/
+#define UFFS_TAG_RESERVED_BITS \
+			(10 - UFFS_TAG_PAGE_ID_SIZE_BITS - UFFS_TAG_DATA_LEN_HI_BITS - UFFS_TAG_PARENT_HI_BITS)
+
 /** \typedef uffs_Device */
 typedef struct uffs_DeviceSt		uffs_Device;
 /** \typedef uffs_FlashOps */
@@ -0,0 +1,124 @@
+/*
+  This file is part of UFFS, the Ultra-low-cost Flash File System.
+  
+  Copyright (C) 2005-2009 Ricky Zheng <ricky_gz_zheng@yahoo.co.nz>
+
+  UFFS is free software; you can redistribute it and/or modify it under
+  the GNU Library General Public License as published by the Free Software 
+  Foundation; either version 2 of the License, or (at your option) any
+  later version.
+
+  UFFS is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+  or GNU Library General Public License, as applicable, for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  and GNU Library General Public License along with UFFS; if not, write
+  to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA  02110-1301, USA.
+
+  As a special exception, if other files instantiate templates or use
+  macros or inline functions from this file, or you compile this file
+  and link it with other works to produce a work based on this file,
+  this file does not by itself cause the resulting work to be covered
+  by the GNU General Public License. However the source code for this
+  file must still be made available in accordance with section (3) of
+  the GNU General Public License v2.
+ 
+  This exception does not invalidate any other reasons why a work based
+  on this file might be covered by the GNU General Public License.
+*/
+/** 
+ * \file uffs_dentry.h
+ * \brief path lookup (dentry) cache, (parent dir, name) -> tree node
+ * \author Ricky Zheng
+ */
+
+#ifndef _UFFS_DENTRY_H_
+#define _UFFS_DENTRY_H_
+
+#include "uffs_config.h"
+#include "uffs/uffs_types.h"
+#include "uffs/uffs_core.h"
+#include "uffs/uffs_tree.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef CONFIG_ENABLE_DENTRY_CACHE
+
+#define DENTRY_CACHE_HASH_MASK		0x1f
+#define DENTRY_CACHE_ENTRY_LEN		(DENTRY_CACHE_HASH_MASK + 1)
+#define GET_DENTRY_CACHE_HASH(parent, sum)	(((parent) ^ (sum)) & DENTRY_CACHE_HASH_MASK)
+
+/** 
+ * \struct uffs_DentryEntrySt
+ * \brief cached result of looking up a name under a dir
+ */
+typedef struct uffs_DentryEntrySt {
+	UNODE node;							//!< tree node index, EMPTY_NODE for negative entry
+	u16 hash_next;						//!< next entry in hash chain
+	u16 prev;							//!< previous entry in LRU list
+	u16 next;							//!< next entry in LRU list
+	u16 parent;							//!< parent dir serial num
+	u16 sum;							//!< name checksum
+	u8 type;							//!< UFFS_TYPE_DIR or UFFS_TYPE_FILE, UFFS_TYPE_INVALID if not used
+	u8 name_len;						//!< name length
+	char name[CONFIG_DENTRY_CACHE_NAME_LEN];
+} uffs_DentryEntry;
+
+/** 
+ * \struct uffs_DentryCacheSt
+ * \brief dentry cache descriptor
+ */
+struct uffs_DentryCacheSt {
+	uffs_DentryEntry *entries;			//!< cache entries, NULL if cache is disabled
+	int count;							//!< number of entries
+	u16 head;							//!< most recently used entry
+	u16 tail;							//!< least recently used entry
+	u16 bucket[DENTRY_CACHE_ENTRY_LEN];	//!< entries hashed by parent dir and name checksum
+	u32 hit;							//!< lookups answered by an existing node
+	u32 neg_hit;						//!< lookups answered by a negative entry
+	u32 miss;							//!< lookups searched in tree
+};
+
+/** allocate dentry cache entries */
+URET uffs_DentryCacheInit(uffs_Device *dev, int max_entries);
+
+/** release dentry cache entries */
+URET uffs_DentryCacheRelease(uffs_Device *dev);
+
+/** drop all entries */
+void uffs_DentryCacheFlush(uffs_Device *dev);
+
+/** look up name under parent dir from cache */
+UBOOL uffs_DentryCacheLookup(uffs_Device *dev, u8 type, u16 parent, u16 sum,
+								const char *name, u32 len, TreeNode **node);
+
+/** put the result of looking up name under parent dir to cache */
+void uffs_DentryCachePut(uffs_Device *dev, u8 type, u16 parent, u16 sum,
+							const char *name, u32 len, TreeNode *node);
+
+/** drop entries of tree node */
+void uffs_DentryCacheRemoveNode(uffs_Device *dev, TreeNode *node);
+
+/** drop negative entries which may match a new dir/file */
+void uffs_DentryCacheNewName(uffs_Device *dev, u16 parent, u16 sum);
+
+#else
+
+#define uffs_DentryCacheFlush(dev)
+#define uffs_DentryCacheLookup(dev, type, parent, sum, name, len, node)	U_FALSE
+#define uffs_DentryCachePut(dev, type, parent, sum, name, len, node)
+#define uffs_DentryCacheRemoveNode(dev, node)
+#define uffs_DentryCacheNewName(dev, parent, sum)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -48,17 +48,14 @@
 #include "uffs/uffs_mem.h"
 #include "uffs/uffs_core.h"
 #include "uffs/uffs_flash.h"
+#include "uffs/uffs_namecache.h"
+#include "uffs/uffs_dentry.h"
+#include "uffs/uffs_wear.h"
 
 #ifdef __cplusplus
 extern "C"{
 #endif
 
-/**
- * \def MAX_DIRTY_BUF_GROUPS
- */
-#define MAX_DIRTY_BUF_GROUPS    3
-
-
 /** 
  * \struct uffs_BlockInfoCacheSt
  * \brief block information structure, used to manager block information caches
@@ -74,8 +71,8 @@ struct uffs_BlockInfoCacheSt {
  * \brief partition basic information
  */
 struct uffs_PartitionSt {
-	u16 start;		//!< start block number of partition
-	u16 end;		//!< end block number of partition
+	UBLOCK start;		//!< start block number of partition
+	UBLOCK end;			//!< end block number of partition
 };
 
 /** 
@@ -96,6 +93,10 @@ struct uffs_DirtyGroupSt {
 	int count;					//!< dirty buffers count
 	int lock;					//!< dirty group lock (0: unlocked, >0: locked)
 	uffs_Buf *dirty;			//!< dirty buffer list
+	u32 stamp;					//!< dirty_seq when the group was last written
+#ifdef CONFIG_ENABLE_BG_FLUSH
+	u32 dirty_time;				//!< uffs_GetTickMs() when the first page of the group got dirty
+#endif
 };
 
 /** 
@@ -106,7 +107,22 @@ struct uffs_PageBufDescSt {
 	uffs_Buf *head;			//!< head of buffers (double linked list)
 	uffs_Buf *tail;			//!< tail of buffers (double linked list)
 	uffs_Buf *clone;		//!< head of clone buffers (single linked list)
-	struct uffs_DirtyGroupSt dirtyGroup[MAX_DIRTY_BUF_GROUPS];	//!< dirty buffer groups
+	uffs_Buf *free_head;	//!< most recently released clean buffer (double linked list)
+	uffs_Buf *free_tail;	//!< least recently released clean buffer, reused first
+	uffs_Buf *hash[CONFIG_PAGE_BUFFER_HASH_BUCKETS];	//!< buffers hashed by (parent, serial, page_id)
+#ifdef CONFIG_ENABLE_READ_AHEAD
+	u32 ra_pages;			//!< pages loaded by read ahead
+	u32 ra_hits;			//!< read ahead pages used by reading
+#endif
+	struct uffs_DirtyGroupSt *dirtyGroup;	//!< dirty buffer groups, dev->cfg.dirty_groups of them
+	u32 dirty_seq;			//!< counts writes to dirty buffers, for dirty group age
+	u32 evict_slot;			//!< groups flushed for no free dirty group slot
+	u32 evict_buf;			//!< groups flushed for no free page buffer
+#ifdef CONFIG_ENABLE_BG_FLUSH
+	UBOOL wb_draining;		//!< dirty buffers went above high watermark, flushing down to low watermark
+	u32 wb_expire;			//!< groups written back by uffs_BufFlushStep() for being expired
+	u32 wb_water;			//!< groups written back by uffs_BufFlushStep() for dirty watermark
+#endif
 	int buf_max;			//!< maximum buffers
 	int dirty_buf_max;		//!< maximum dirty buffer allowed
 	void *pool;				//!< memory pool for buffers
@@ -135,6 +151,8 @@ typedef struct uffs_FlashStatSt {
 	int page_write_count;
 	int page_read_count;
 	int page_header_read_count;
+	int page_direct_read_count;		//!< pages read directly to caller's buffer
+	int page_direct_write_count;	//!< pages written directly from caller's buffer
 	int spare_write_count;
 	int spare_read_count;
 	unsigned long io_read;
@@ -153,6 +171,34 @@ typedef struct uffs_ConfigSt {
 	int dirty_pages;
 	int dirty_groups;
 	int reserved_free_blocks;
+	int dir_hash_buckets;		//!< tree dir node hash buckets, power of 2, 0: derived from partition size
+	int file_hash_buckets;		//!< tree file node hash buckets, power of 2, 0: derived from partition size
+	int data_hash_buckets;		//!< tree data node hash buckets, power of 2, 0: derived from partition size
+	u16 (*data_hash)(u16 parent, u16 serial);	//!< tree data node hash function, NULL: uffs_TreeDataHash()
+#ifdef CONFIG_MOUNT_SCAN_THREADS
+	int scan_threads;
+#endif
+#ifdef CONFIG_ENABLE_NAME_CACHE
+	int name_caches;
+#endif
+#ifdef CONFIG_ENABLE_DENTRY_CACHE
+	int dentry_caches;
+#endif
+#ifdef CONFIG_ENABLE_ERASE_COUNT_TABLE
+	int erase_count_save_interval;	//!< save erase count table after this many erasures
+#endif
+#ifdef CONFIG_ENABLE_STATIC_WEAR_LEVELING
+	int static_wl_threshold;	//!< erase count difference to move a cold block, 0: default, -1: disabled
+	int static_wl_interval;		//!< erasures between static wear leveling passes, 0: default
+#endif
+#ifdef CONFIG_ENABLE_READ_AHEAD
+	int read_ahead_pages;		//!< maximum read ahead window in pages, 0: default, -1: disabled
+#endif
+#ifdef CONFIG_ENABLE_BG_FLUSH
+	int flush_expire_ms;		//!< write back dirty groups older than this, 0: default, -1: disabled
+	int flush_high_water;		//!< start writing back when dirty buffers above this, 0: default, -1: disabled
+	int flush_low_water;		//!< stop writing back when dirty buffers at or below this, 0: default
+#endif
 } uffs_Config;
 
 
@@ -170,7 +216,7 @@ typedef struct uffs_ConfigSt {
  * \brief Pending block descriptor
  */
 typedef struct uffs_PendingBlockSt {
-	u16 block;			//!< pending block number
+	UBLOCK block;		//!< pending block number
 	u8 mark;			//!< pending block mark
 } uffs_PendingBlock;
 
@@ -181,7 +227,17 @@ typedef struct uffs_PendingBlockSt {
 struct uffs_PendingListSt {
 	int count;											//!< pending block counter
 	uffs_PendingBlock list[CONFIG_MAX_PENDING_BLOCKS];	//!< pending block list
-	u16 block_in_recovery;                              //!< pending block being recovered
+	UBLOCK block_in_recovery;                           //!< pending block being recovered
+};
+
+/**
+ * \struct uffs_CheckpointSt
+ * \brief tree checkpoint information
+ */
+struct uffs_CheckpointSt {
+	UBLOCK start;		//!< first block reserved for checkpoint
+	u16 blocks;			//!< number of blocks reserved for checkpoint
+	UBOOL valid;		//!< U_TRUE if checkpoint on flash matches the tree
 };
 
 /** 
@@ -206,6 +262,18 @@ struct uffs_DeviceSt {
 	struct uffs_FlashStatSt			st;			//!< statistic (counters)
 	struct uffs_memAllocatorSt		mem;		//!< uffs memory allocator
 	struct uffs_ConfigSt			cfg;		//!< uffs config
+#ifdef CONFIG_ENABLE_TREE_CHECKPOINT
+	struct uffs_CheckpointSt		ckpt;		//!< tree checkpoint
+#endif
+#ifdef CONFIG_ENABLE_NAME_CACHE
+	struct uffs_NameCacheSt			nc;			//!< dir/file name cache
+#endif
+#ifdef CONFIG_ENABLE_DENTRY_CACHE
+	struct uffs_DentryCacheSt		dc;			//!< path lookup cache
+#endif
+#ifdef CONFIG_ENABLE_ERASE_COUNT_ALLOC
+	struct uffs_WearSt				wear;		//!< erase counters, free block heap
+#endif
 	u32	ref_count;								//!< device reference count
 	int	dev_num;								//!< device number (partition number)	
 };
@@ -58,6 +58,12 @@ extern "C"{
  */
 int uffs_EccMake(const void *data, int data_len, void *ecc);
 
+/**
+ * calculate ECC of data in two pieces, as if they were contiguous.
+ * \return length of generated ECC.
+ */
+int uffs_EccMakeEx(const void *head, int head_len, const void *data, int data_len, void *ecc);
+
 /** 
  * correct data by ECC.
  *
@@ -141,6 +141,13 @@ long uffs_space_used(const char *mount_point);
 long uffs_space_free(const char *mount_point);
 
 void uffs_flush_all(const char *mount_point);
+int uffs_checkpoint(const char *mount_point);
+long uffs_erase_count(const char *mount_point, int block);
+int uffs_wear_level(const char *mount_point);
+int uffs_scan_step(const char *mount_point, int blocks);
+int uffs_flush_step(const char *mount_point);
+int uffs_flusher_start(int interval_ms);
+int uffs_flusher_stop(void);
 
 #ifdef __cplusplus
 }
@@ -103,7 +103,7 @@ struct uffs_StorageAttrSt {
 	u32 total_blocks;		//!< total blocks in this chip
 	u16 page_data_size;		//!< page data size (physical page data size, e.g. 512)
 	u16 pages_per_block;	//!< pages per block
-	u8 spare_size;			//!< page spare size (physical page spare size, e.g. 16)
+	u16 spare_size;			//!< page spare size (physical page spare size, e.g. 16)
 	u8 block_status_offs;	//!< block status byte offset in spare
 	int ecc_opt;			//!< ecc option ( #UFFS_ECC_[NONE|SOFT|HW|HW_AUTO] )
 	int layout_opt;			//!< layout option (#UFFS_LAYOUT_UFFS or #UFFS_LAYOUT_FLASH)
@@ -265,6 +265,50 @@ struct uffs_FlashOpsSt {
 	 * \return 0 if all pages are clean, otherwise return -1.
 	 */
 	int (*CheckErasedBlock)(uffs_Device *dev, u32 block);
+
+	/**
+	 * Read tags of n pages in a block, start from given page.
+	 *
+	 * \param[out] ts tag store array of n pages
+	 * \param[out] seal seal byte array of n pages: 0 if the page spare is sealed, 0xFF if not sealed.
+	 *
+	 * \note This function is optional. Flash driver which is able to stream spare areas, or read OOB
+	 *		of a whole block in one command should implement this function to speed up block info loading.
+	 *		If this function is not implemented, UFFS reads tags page by page.
+	 *
+	 * \note if layout_opt is UFFS_LAYOUT_UFFS, use uffs_FlashUnloadSpare() and uffs_FlashGetSealByte()
+	 *		to unload tag store and seal byte from spare.
+	 *
+	 * \note flash driver DO NOT need to do ecc correction for tag, UFFS will take care of tag ecc.
+	 *
+	 * \return	#UFFS_FLASH_NO_ERR: success, no flip bits on any page
+	 *			#UFFS_FLASH_ECC_OK: some page has flip bits and corrected by driver (e.g. hardware spare ECC)
+	 *			#UFFS_FLASH_IO_ERR: I/O error, expect retry ?
+	 *			#UFFS_FLASH_BAD_BLK: if the block is a bad block.
+	 *
+	 * \note if anything other than #UFFS_FLASH_NO_ERR is returned, UFFS read tags of these pages
+	 *		one by one again, so that the result of each page is known.
+	 */
+	int (*ReadBlockTags)(uffs_Device *dev, u32 block, u32 page, int n, uffs_TagStore *ts, u8 *seal);
+
+	/**
+	 * Write a full page from separated header and data buffers, UFFS do the layout for spare area.
+	 *
+	 * \param[in] header mini header, written to the beginning of the page
+	 * \param[in] data page data, written right after the header
+	 *
+	 * \note This function is optional. It's the same as WritePage() except that the page data
+	 *		is passed in two pieces, so that UFFS is able to program file pages from caller's
+	 *		buffer without copying them to a page buffer (see CONFIG_ENABLE_DIRECT_WRITE).
+	 *		UFFS uses this function only if WritePageWithLayout() is not implemented.
+	 *
+	 * \return	#UFFS_FLASH_NO_ERR: success
+	 *			#UFFS_FLASH_IO_ERR: I/O error, expect retry ?
+	 *			#UFFS_FLASH_BAD_BLK: a bad block detected.
+	 */
+	int (*WritePageVec)(uffs_Device *dev, u32 block, u32 page,
+							const u8 *header, int header_len, const u8 *data, int data_len,
+							const u8 *spare, int spare_len);
 };
 
 /** make spare from tag store and ecc */
@@ -273,15 +317,41 @@ void uffs_FlashMakeSpare(uffs_Device *dev, const uffs_TagStore *ts, const u8 *ec
 /** unload tag and ecc from spare */
 void uffs_FlashUnloadSpare(uffs_Device *dev, const u8 *spare, struct uffs_TagStoreSt *ts, u8 *ecc);
 
+/** get seal byte from spare */
+u8 uffs_FlashGetSealByte(uffs_Device *dev, const u8 *spare);
+
+/** read tag stores and seal bytes of n pages in a block */
+int uffs_FlashReadBlockTags(uffs_Device *dev, int block, int page, int n, uffs_TagStore *ts, u8 *seal);
+
+/** fill tag with tag store and seal byte, do tag ECC correct */
+int uffs_FlashUnpackTag(uffs_Device *dev, int block, int page, const uffs_TagStore *ts, u8 seal, uffs_Tags *tag);
+
 /** read page spare and fill to tag */
 int uffs_FlashReadPageTag(uffs_Device *dev, int block, int page, uffs_Tags *tag);
 
+/** read page spare with caller's spare buffer, fill tag */
+int uffs_FlashReadPageTagEx(uffs_Device *dev, int block, int page, uffs_Tags *tag, u8 *spare_buf);
+
 /** read page data to page buf and do ECC correct */
 int uffs_FlashReadPage(uffs_Device *dev, int block, int page, uffs_Buf *buf, UBOOL skip_ecc);
 
+#ifdef CONFIG_ENABLE_DIRECT_READ
+/** read page data directly to caller's buffer */
+int uffs_FlashReadPageData(uffs_Device *dev, int block, int page, u8 *data, UBOOL skip_ecc);
+#endif
+
 /** write page data and spare */
 int uffs_FlashWritePageCombine(uffs_Device *dev, int block, int page, uffs_Buf *buf, uffs_Tags *tag);
 
+#ifdef CONFIG_ENABLE_DIRECT_WRITE
+/** can the flash driver write page data directly from caller's buffer ? */
+#define uffs_FlashCanWriteDirect(dev) \
+	((dev)->ops->WritePageVec != NULL && (dev)->ops->WritePageWithLayout == NULL)
+
+/** write page data directly from caller's buffer, and spare */
+int uffs_FlashWritePageData(uffs_Device *dev, int block, int page, const u8 *data, uffs_Tags *tag);
+#endif
+
 /** Mark this block as bad block */
 int uffs_FlashMarkBadBlock(uffs_Device *dev, int block);
 
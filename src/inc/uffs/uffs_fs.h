@@ -73,6 +73,15 @@ struct uffs_ObjectSt {
 
 	/******* current *******/
 	u32 pos;							//!< current position in file
+#ifdef CONFIG_ENABLE_OBJECT_DNODE_CACHE
+	TreeNode *dnode;					//!< last accessed data node, NULL if not cached
+	u16 dnode_fdn;						//!< file data block num of dnode
+	u32 dnode_gen;						//!< dev->tree.data_gen when dnode was cached
+#endif
+#ifdef CONFIG_ENABLE_READ_AHEAD
+	u32 ra_pos;							//!< file position where sequential reading continues
+	u16 ra_pages;						//!< read ahead window in pages, 0: not sequential
+#endif
 
 	/***** others *******/
 	UBOOL attr_loaded;					//!< attributes loaded ?
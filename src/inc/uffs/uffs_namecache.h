@@ -0,0 +1,117 @@
+/*
+  This file is part of UFFS, the Ultra-low-cost Flash File System.
+  
+  Copyright (C) 2005-2009 Ricky Zheng <ricky_gz_zheng@yahoo.co.nz>
+
+  UFFS is free software; you can redistribute it and/or modify it under
+  the GNU Library General Public License as published by the Free Software 
+  Foundation; either version 2 of the License, or (at your option) any
+  later version.
+
+  UFFS is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+  or GNU Library General Public License, as applicable, for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  and GNU Library General Public License along with UFFS; if not, write
+  to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA  02110-1301, USA.
+
+  As a special exception, if other files instantiate templates or use
+  macros or inline functions from this file, or you compile this file
+  and link it with other works to produce a work based on this file,
+  this file does not by itself cause the resulting work to be covered
+  by the GNU General Public License. However the source code for this
+  file must still be made available in accordance with section (3) of
+  the GNU General Public License v2.
+ 
+  This exception does not invalidate any other reasons why a work based
+  on this file might be covered by the GNU General Public License.
+*/
+/** 
+ * \file uffs_namecache.h
+ * \brief dir/file name cache, compare object names without reading flash
+ * \author Ricky Zheng
+ */
+
+#ifndef _UFFS_NAMECACHE_H_
+#define _UFFS_NAMECACHE_H_
+
+#include "uffs_config.h"
+#include "uffs/uffs_types.h"
+#include "uffs/uffs_core.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef CONFIG_ENABLE_NAME_CACHE
+
+#define NAME_CACHE_HASH_MASK	0x1f
+#define NAME_CACHE_ENTRY_LEN	(NAME_CACHE_HASH_MASK + 1)
+#define GET_NAME_CACHE_HASH(node)	((node) & NAME_CACHE_HASH_MASK)
+
+/** 
+ * \struct uffs_NameCacheEntrySt
+ * \brief cached name of a dir/file tree node
+ */
+typedef struct uffs_NameCacheEntrySt {
+	UNODE node;							//!< tree node index, EMPTY_NODE if not used
+	u16 hash_next;						//!< next entry in hash chain
+	u16 prev;							//!< previous entry in LRU list
+	u16 next;							//!< next entry in LRU list
+	u32 hash;							//!< FNV-1a hash of name
+	u16 sum;							//!< name checksum of the node
+	u8 type;							//!< UFFS_TYPE_DIR or UFFS_TYPE_FILE
+	u8 name_len;						//!< name length
+	char name[CONFIG_NAME_CACHE_NAME_LEN];
+} uffs_NameCacheEntry;
+
+/** 
+ * \struct uffs_NameCacheSt
+ * \brief name cache descriptor
+ */
+struct uffs_NameCacheSt {
+	uffs_NameCacheEntry *entries;		//!< cache entries, NULL if cache is disabled
+	int count;							//!< number of entries
+	u16 head;							//!< most recently used entry
+	u16 tail;							//!< least recently used entry
+	u16 bucket[NAME_CACHE_ENTRY_LEN];	//!< entries hashed by tree node index
+	u32 hit;							//!< names compared in RAM
+	u32 miss;							//!< names loaded from flash
+};
+
+/** allocate name cache entries */
+URET uffs_NameCacheInit(uffs_Device *dev, int max_entries);
+
+/** release name cache entries */
+URET uffs_NameCacheRelease(uffs_Device *dev);
+
+/** drop all cached names */
+void uffs_NameCacheFlush(uffs_Device *dev);
+
+/** compare name with cached name of tree node */
+UBOOL uffs_NameCacheCompare(uffs_Device *dev, UNODE node, u8 type, u16 sum,
+							const char *name, u32 len, UBOOL *matched);
+
+/** put name of tree node to cache */
+void uffs_NameCachePut(uffs_Device *dev, UNODE node, u8 type, u16 sum,
+						const char *name, u32 len);
+
+/** drop cached name of tree node */
+void uffs_NameCacheRemove(uffs_Device *dev, UNODE node);
+
+#else
+
+#define uffs_NameCacheFlush(dev)
+#define uffs_NameCachePut(dev, node, type, sum, name, len)
+#define uffs_NameCacheRemove(dev, node)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -44,6 +44,8 @@ extern "C"{
 typedef void * OSSEM;
 #define OSSEM_NOT_INITED	(NULL)
 
+typedef void * OSTASK;
+
 struct uffs_DebugMsgOutputSt {
 	void (*output)(const char *msg);
 	void (*vprintf)(const char *fmt, va_list args);
@@ -58,6 +60,15 @@ int uffs_SemSignal(OSSEM sem);
 int uffs_SemDelete(OSSEM *sem);
 
 int uffs_OSGetTaskId(void);	//get current task id
+
+/* only required by CONFIG_MOUNT_SCAN_THREADS */
+int uffs_TaskCreate(OSTASK *task, void (*entry)(void *arg), void *arg);	//start a new task
+int uffs_TaskJoin(OSTASK task);		//wait for task exit and release it
+
+/* only required by CONFIG_ENABLE_BG_FLUSH / CONFIG_BG_FLUSH_THREAD */
+unsigned int uffs_GetTickMs(void);	//monotonic time in ms, wraps around
+void uffs_TaskSleep(unsigned int ms);	//suspend current task for ms
+
 unsigned int uffs_GetCurDateTime(void);
 
 #ifdef __cplusplus
@@ -103,25 +103,6 @@ typedef struct uffs_ObjectInfoSt {
 } uffs_ObjectInfo;
 
 
-/**
- * \def UFFS_TAG_PAGE_ID_SIZE_BITS
- * \brief define number of bits used for page_id in tag,
- *        this defines the maximum pages per block you can have.
- *        e.g. '9' ==> maximum 512 pages per block
- **/
-#define UFFS_TAG_PAGE_ID_SIZE_BITS  6
-
-#if UFFS_TAG_RESERVED_BITS > 10
-#error "UFFS_TAG_PAGE_ID_SIZE_BITS can not bigger than 10 !"
-#endif
-
-/**
- * \def UFFS_TAG_RESERVED_BITS
- * \brief the number of bits left to be used for the furture (UFFS2).
- **/
-#define UFFS_TAG_RESERVED_BITS (10 - UFFS_TAG_PAGE_ID_SIZE_BITS)
-
-
 /**
  * \struct uffs_TagStoreSt
  * \brief uffs tag, 8 bytes, will be store in page spare area.
@@ -136,6 +117,12 @@ struct uffs_TagStoreSt {
 
 	u32 parent:10;		//!< parent's serial number
 	u32 page_id:UFFS_TAG_PAGE_ID_SIZE_BITS;		//!< page id
+#if UFFS_TAG_DATA_LEN_HI_BITS != 0
+	u32 data_len_hi:UFFS_TAG_DATA_LEN_HI_BITS;	//!< inverted high bits of data length
+#endif
+#if UFFS_TAG_PARENT_HI_BITS != 0
+	u32 parent_hi:UFFS_TAG_PARENT_HI_BITS;		//!< inverted high bits of parent's serial number
+#endif
 #if UFFS_TAG_RESERVED_BITS != 0
 	u32 reserved:UFFS_TAG_RESERVED_BITS;		//!< reserved, for UFFS2
 #endif
@@ -186,9 +173,33 @@ struct uffs_MiniHeaderSt {
 #define TAG_VALID_BIT(tag) (tag)->s.valid
 #define TAG_DIRTY_BIT(tag) (tag)->s.dirty
 #define TAG_SERIAL(tag) (tag)->s.serial
+#if UFFS_TAG_PARENT_HI_BITS != 0
+#define TAG_PARENT_HI_MASK ((1 << UFFS_TAG_PARENT_HI_BITS) - 1)
+#define TAG_PARENT(tag) \
+			((tag)->s.parent | ((~(u32)(tag)->s.parent_hi & TAG_PARENT_HI_MASK) << 10))
+#define TAG_SET_PARENT(tag, v) \
+			do { \
+				(tag)->s.parent = (v) & 0x3FF; \
+				(tag)->s.parent_hi = ~((u32)(v) >> 10) & TAG_PARENT_HI_MASK; \
+			} while (0)
+#else
 #define TAG_PARENT(tag) (tag)->s.parent
+#define TAG_SET_PARENT(tag, v) do { (tag)->s.parent = (v); } while (0)
+#endif
 #define TAG_PAGE_ID(tag) (tag)->s.page_id
+#if UFFS_TAG_DATA_LEN_HI_BITS != 0
+#define TAG_DATA_LEN_HI_MASK ((1 << UFFS_TAG_DATA_LEN_HI_BITS) - 1)
+#define TAG_DATA_LEN(tag) \
+			((tag)->s.data_len | ((~(u32)(tag)->s.data_len_hi & TAG_DATA_LEN_HI_MASK) << 12))
+#define TAG_SET_DATA_LEN(tag, len) \
+			do { \
+				(tag)->s.data_len = (len) & 0xFFF; \
+				(tag)->s.data_len_hi = ~((u32)(len) >> 12) & TAG_DATA_LEN_HI_MASK; \
+			} while (0)
+#else
 #define TAG_DATA_LEN(tag) (tag)->s.data_len
+#define TAG_SET_DATA_LEN(tag, len) do { (tag)->s.data_len = (len); } while (0)
+#endif
 #define TAG_TYPE(tag) (tag)->s.type
 #define TAG_BLOCK_TS(tag) (tag)->s.block_ts
 #define SEAL_TAG(tag) (tag)->seal_byte = 0
@@ -272,11 +283,15 @@ UBOOL uffs_IsBlockBad(uffs_Device *dev, uffs_BlockInfo *bc);
  * \def UFFS_INVALID_BLOCK
  * \brief macro for invalid block number
  */
+#ifdef CONFIG_ENABLE_WIDE_BLOCK
+#define UFFS_INVALID_BLOCK	(0xfffffffe)
+#else
 #define UFFS_INVALID_BLOCK	(0xfffe)
+#endif
 
 
-URET uffs_NewBlock(uffs_Device *dev, u16 block, uffs_Tags *tag, uffs_Buf *buf);
-URET uffs_BlockRecover(uffs_Device *dev, uffs_BlockInfo *old, u16 newBlock);
+URET uffs_NewBlock(uffs_Device *dev, UBLOCK block, uffs_Tags *tag, uffs_Buf *buf);
+URET uffs_BlockRecover(uffs_Device *dev, uffs_BlockInfo *old, UBLOCK newBlock);
 URET uffs_PageRecover(uffs_Device *dev, 
 					  uffs_BlockInfo *bc, 
 					  u16 oldPage, 
@@ -64,7 +64,7 @@ struct uffs_NodeTypeNameMapSt {
 struct BlockListSt {	/* 12 bytes */
 	struct uffs_TreeNodeSt * next;
 	struct uffs_TreeNodeSt * prev;
-	u16 block;
+	UBLOCK block;
 	union {
 		u16 serial;			/* for suspended block list */
 		u8 need_check;		/* for erased block list */
@@ -72,7 +72,7 @@ struct BlockListSt {	/* 12 bytes */
 };
 
 struct DirhSt {		/* 8 bytes */
-	u16 block;
+	UBLOCK block;
 	u16 checksum;	/* check sum of dir name */
 	u16 parent;
 	u16 serial;
@@ -80,7 +80,7 @@ struct DirhSt {		/* 8 bytes */
 
 
 struct FilehSt {	/* 12 bytes */
-	u16 block;
+	UBLOCK block;
 	u16 checksum;	/* check sum of file name */
 	u16 parent;
 	u16 serial;
@@ -88,13 +88,13 @@ struct FilehSt {	/* 12 bytes */
 };
 
 struct FdataSt {	/* 10 bytes */
-	u16 block;
+	UBLOCK block;
 	u16 parent;
-	u32 len;		/* file data length on this block */
 	u16 serial;
+	u32 len;		/* file data length on this block */
 };
 
-//UFFS TreeNode (14 or 16 bytes)
+//UFFS TreeNode (14 or 16 bytes, 24 bytes with CONFIG_ENABLE_WIDE_BLOCK)
 typedef struct uffs_TreeNodeSt {
 	union {
 		struct BlockListSt list;
@@ -102,8 +102,8 @@ typedef struct uffs_TreeNodeSt {
 		struct FilehSt file;
 		struct FdataSt data;
 	} u;
-	u16 hash_next;		
-	u16 hash_prev;			
+	UNODE hash_next;
+	UNODE hash_prev;
 } TreeNode;
 
 
@@ -140,45 +140,125 @@ typedef struct uffs_TreeNodeSt {
 */
 
 
+#ifdef CONFIG_ENABLE_WIDE_BLOCK
+#define EMPTY_NODE 0xffffffff			//!< special index num of empty node.
+#else
 #define EMPTY_NODE 0xffff				//!< special index num of empty node.
+#endif
 
 #define ROOT_DIR_SERIAL	0				//!< serial num of root dir
-#define MAX_UFFS_FSN			0x3ff	//!< maximum dir|file serial number (uffs_TagStore#parent: 10 bits)
+#define MAX_UFFS_FSN			((1 << (10 + UFFS_TAG_PARENT_HI_BITS)) - 1)	//!< maximum dir|file serial number (uffs_TagStore#parent: 10 bits, 14 bits with CONFIG_ENABLE_EXT_SERIAL)
 #define MAX_UFFS_FDN			0x3fff	//!< maximum file data block serial numbers (uffs_TagStore#serial: 14 bits)
 #define PARENT_OF_ROOT			0xfffd	//!< parent of ROOT ? kidding me ...
 #define INVALID_UFFS_SERIAL		0xffff	//!< invalid serial num
 
-#define DIR_NODE_HASH_MASK		0x1f
-#define DIR_NODE_ENTRY_LEN		(DIR_NODE_HASH_MASK + 1)
+/* hash bucket numbers are chosen at run time, see uffs_Config */
+#define DIR_NODE_HASH_MASK(dev)		((dev)->tree.dir_mask)
+#define DIR_NODE_ENTRY_LEN(dev)		(DIR_NODE_HASH_MASK(dev) + 1)
 
-#define FILE_NODE_HASH_MASK		0x3f
-#define FILE_NODE_ENTRY_LEN		(FILE_NODE_HASH_MASK + 1)
+#define FILE_NODE_HASH_MASK(dev)	((dev)->tree.file_mask)
+#define FILE_NODE_ENTRY_LEN(dev)	(FILE_NODE_HASH_MASK(dev) + 1)
 
-#define DATA_NODE_HASH_MASK		0x1ff
-#define DATA_NODE_ENTRY_LEN		(DATA_NODE_HASH_MASK + 1)
+#define DATA_NODE_HASH_MASK(dev)	((dev)->tree.data_mask)
+#define DATA_NODE_ENTRY_LEN(dev)	(DATA_NODE_HASH_MASK(dev) + 1)
 #define FROM_IDX(idx, pool)		((TreeNode *)uffs_PoolGetBufByIndex(pool, idx))
-#define TO_IDX(p, pool)			((u16)uffs_PoolGetIndex(pool, (void *) p))
+#define TO_IDX(p, pool)			((UNODE)uffs_PoolGetIndex(pool, (void *) p))
+
 
+#define GET_FILE_HASH(dev, serial)			((serial) & FILE_NODE_HASH_MASK(dev))
+#define GET_DIR_HASH(dev, serial)			((serial) & DIR_NODE_HASH_MASK(dev))
+#define GET_DATA_HASH(dev, parent, serial)	((dev)->tree.data_hash(parent, serial) & DATA_NODE_HASH_MASK(dev))
 
-#define GET_FILE_HASH(serial)			(serial & FILE_NODE_HASH_MASK)
-#define GET_DIR_HASH(serial)			(serial & DIR_NODE_HASH_MASK)
-#define GET_DATA_HASH(parent, serial)	((parent + serial) & DATA_NODE_HASH_MASK)
+#ifdef CONFIG_ENABLE_TREE_CHILD_INDEX
+#ifdef CONFIG_ENABLE_EXT_SERIAL
+#define CHILD_NODE_HASH_MASK	0xff
+#else
+#define CHILD_NODE_HASH_MASK	0x3f
+#endif
+#define CHILD_NODE_ENTRY_LEN	(CHILD_NODE_HASH_MASK + 1)
+#define GET_CHILD_HASH(parent)	(parent & CHILD_NODE_HASH_MASK)
+#endif
+
+
+/** 
+ * \struct BlockTypeStatSt
+ * \brief statistic of scanned blocks
+ */
+struct BlockTypeStatSt {
+	int dir;
+	int file;
+	int data;
+};
+
+#ifdef CONFIG_ENABLE_LAZY_MOUNT
+/** 
+ * \struct uffs_TreeScanSt
+ * \brief lazy mount block scanning state
+ */
+struct uffs_TreeScanSt {
+	UBLOCK next;				//!< next block to be scanned
+	u8 busy;					//!< scanning in progress, lookups should not trigger scanning
+	u8 done;					//!< all blocks are scanned, the tree is completed
+	u8 failed;					//!< scanning failed, no more blocks will be scanned
+	struct BlockTypeStatSt st;	//!< statistic of scanned blocks
+};
+#endif
 
+#ifdef CONFIG_ENABLE_TREE_BLOCK_BITMAP
+/** bit operations on erased/bad block bitmaps, <i> is block offset in partition */
+#define TREE_MAP_SET(map, i)	((map)[(i) >> 3] |= (u8)(1 << ((i) & 7)))
+#define TREE_MAP_CLR(map, i)	((map)[(i) >> 3] &= (u8)~(1 << ((i) & 7)))
+#define TREE_MAP_TEST(map, i)	(((map)[(i) >> 3] >> ((i) & 7)) & 1)
+#define TREE_MAP_BYTES(n)		(((n) + 7) / 8)
+#endif
 
 struct uffs_TreeSt {
+#ifdef CONFIG_ENABLE_TREE_BLOCK_BITMAP
+	u8 *erased_map;						//!< erased block bitmap
+	u8 *check_map;						//!< erased blocks need to be checked before use
+	UBLOCK erased_next;					//!< block offset to look for next erased block from
+#else
 	TreeNode *erased;					//!< erased block list head
 	TreeNode *erased_tail;				//!< erased block list tail
+#endif
 	int erased_count;					//!< erased block counter
 
 	TreeNode *suspend;					//!< suspended block list, this is just a staging zone
 										//   that prevent the serial number of the block be re-used.
+#ifdef CONFIG_ENABLE_TREE_BLOCK_BITMAP
+	u8 *bad_map;						//!< bad block bitmap
+#else
 	TreeNode *bad;						//!< bad block list
+#endif
 	int bad_count;						//!< bad block counter
 
-	u16 dir_entry[DIR_NODE_ENTRY_LEN];
-	u16 file_entry[FILE_NODE_ENTRY_LEN];
-	u16 data_entry[DATA_NODE_ENTRY_LEN];
+	UNODE *dir_entry;					//!< dir node hash buckets
+	UNODE *file_entry;					//!< file node hash buckets
+	UNODE *data_entry;					//!< data node hash buckets
+	u16 dir_mask;						//!< dir node hash mask (bucket number - 1)
+	u16 file_mask;						//!< file node hash mask (bucket number - 1)
+	u16 data_mask;						//!< data node hash mask (bucket number - 1)
+	u16 (*data_hash)(u16 parent, u16 serial);	//!< data node hash function
 	u16 max_serial;
+#ifdef CONFIG_ENABLE_OBJECT_DNODE_CACHE
+	u32 data_gen;						//!< increased when any data node is removed from tree
+#endif
+#ifdef CONFIG_ENABLE_TREE_BLOCK_INDEX
+	UNODE *block_node;					//!< block -> node index map, EMPTY_NODE if not indexed
+	u8 *block_region;					//!< block -> SEARCH_REGION_XXX of the indexed node
+#endif
+#ifdef CONFIG_ENABLE_TREE_CHILD_INDEX
+	UNODE dir_child[CHILD_NODE_ENTRY_LEN];	//!< dir nodes chained by parent serial
+	UNODE file_child[CHILD_NODE_ENTRY_LEN];	//!< file nodes chained by parent serial
+	UNODE *child_next;					//!< node index -> next node index in child chain
+#endif
+#ifdef CONFIG_ENABLE_FSN_BITMAP
+	u8 fsn_bitmap[(MAX_UFFS_FSN + 1) / 8];	//!< used dir/file serial num bitmap
+	u16 fsn_hint;						//!< serial nums below this are all used
+#endif
+#ifdef CONFIG_ENABLE_LAZY_MOUNT
+	struct uffs_TreeScanSt scan;		//!< lazy mount scanning state
+#endif
 };
 
 
@@ -186,6 +266,7 @@ URET uffs_TreeInit(uffs_Device *dev);
 URET uffs_TreeRelease(uffs_Device *dev);
 URET uffs_BuildTree(uffs_Device *dev);
 u16 uffs_FindFreeFsnSerial(uffs_Device *dev);
+u16 uffs_TreeDataHash(u16 parent, u16 serial);
 TreeNode * uffs_TreeFindFileNode(uffs_Device *dev, u16 serial);
 TreeNode * uffs_TreeFindFileNodeWithParent(uffs_Device *dev, u16 parent);
 TreeNode * uffs_TreeFindDirNode(uffs_Device *dev, u16 serial);
@@ -195,11 +276,15 @@ TreeNode * uffs_TreeFindDirNodeByName(uffs_Device *dev, const char *name, u32 le
 TreeNode * uffs_TreeFindDataNode(uffs_Device *dev, u16 parent, u16 serial);
 
 
-TreeNode * uffs_TreeFindDirNodeByBlock(uffs_Device *dev, u16 block);
-TreeNode * uffs_TreeFindFileNodeByBlock(uffs_Device *dev, u16 block);
-TreeNode * uffs_TreeFindDataNodeByBlock(uffs_Device *dev, u16 block);
-TreeNode * uffs_TreeFindErasedNodeByBlock(uffs_Device *dev, u16 block);
-TreeNode * uffs_TreeFindBadNodeByBlock(uffs_Device *dev, u16 block);
+TreeNode * uffs_TreeFindDirNodeByBlock(uffs_Device *dev, UBLOCK block);
+TreeNode * uffs_TreeFindFileNodeByBlock(uffs_Device *dev, UBLOCK block);
+TreeNode * uffs_TreeFindDataNodeByBlock(uffs_Device *dev, UBLOCK block);
+#ifndef CONFIG_ENABLE_TREE_BLOCK_BITMAP
+TreeNode * uffs_TreeFindErasedNodeByBlock(uffs_Device *dev, UBLOCK block);
+TreeNode * uffs_TreeFindBadNodeByBlock(uffs_Device *dev, UBLOCK block);
+#endif
+UBOOL uffs_TreeIsErasedBlock(uffs_Device *dev, UBLOCK block);
+UBOOL uffs_TreeIsBadBlock(uffs_Device *dev, UBLOCK block);
 
 void uffs_TreeSuspendAdd(uffs_Device *dev, TreeNode *node);
 TreeNode * uffs_TreeFindSuspendNode(uffs_Device *dev, u16 serial);
@@ -210,13 +295,18 @@ void uffs_TreeRemoveSuspendNode(uffs_Device *dev, TreeNode *node);
 #define SEARCH_REGION_DATA		4
 #define SEARCH_REGION_BAD		8
 #define SEARCH_REGION_ERASED	16
-TreeNode * uffs_TreeFindNodeByBlock(uffs_Device *dev, u16 block, int *region);
+/* note: erased and bad blocks have no tree node when CONFIG_ENABLE_TREE_BLOCK_BITMAP
+	is enabled, use uffs_TreeIsErasedBlock()/uffs_TreeIsBadBlock() instead. */
+TreeNode * uffs_TreeFindNodeByBlock(uffs_Device *dev, UBLOCK block, int *region);
 
 
 
 UBOOL uffs_TreeCompareFileName(uffs_Device *dev, const char *name, u32 len, u16 sum, TreeNode *node, int type);
 
 TreeNode * uffs_TreeGetErasedNode(uffs_Device *dev);
+#ifdef CONFIG_ENABLE_ERASE_COUNT_ALLOC
+TreeNode * uffs_TreeTakeErasedNode(uffs_Device *dev, UBLOCK block);
+#endif
 URET uffs_TreeEraseNode(uffs_Device *dev, TreeNode *node);
 
 void uffs_InsertNodeToTree(uffs_Device *dev, u8 type, TreeNode *node);
@@ -227,7 +317,28 @@ void uffs_TreeInsertToBadBlockList(uffs_Device *dev, TreeNode *node);
 
 void uffs_BreakFromEntry(uffs_Device *dev, u8 type, TreeNode *node);
 
-void uffs_TreeSetNodeBlock(u8 type, TreeNode *node, u16 block);
+void uffs_TreeSetNodeBlock(u8 type, TreeNode *node, UBLOCK block);
+void uffs_TreeSetNodeParent(uffs_Device *dev, u8 type, TreeNode *node, u16 parent);
+
+#ifdef CONFIG_ENABLE_TREE_BLOCK_INDEX
+void uffs_TreeIndexNode(uffs_Device *dev, u8 type, TreeNode *node);
+#else
+#define uffs_TreeIndexNode(dev, type, node)
+#endif
+
+#ifdef CONFIG_ENABLE_TREE_CHILD_INDEX
+UNODE uffs_TreeChildFirst(uffs_Device *dev, u8 type, u16 parent);
+UNODE uffs_TreeChildNext(uffs_Device *dev, TreeNode *node);
+#endif
+
+#ifdef CONFIG_ENABLE_LAZY_MOUNT
+URET uffs_TreeLazyScan(uffs_Device *dev, int blocks);
+URET uffs_TreeLazyComplete(uffs_Device *dev);
+URET uffs_TreeLazyLoadFile(uffs_Device *dev, TreeNode *node);
+#else
+#define uffs_TreeLazyComplete(dev)			U_SUCC
+#define uffs_TreeLazyLoadFile(dev, node)	U_SUCC
+#endif
 
 
 #ifdef __cplusplus
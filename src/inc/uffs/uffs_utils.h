@@ -59,6 +59,7 @@ URET uffs_FormatDeviceEx(uffs_Device *dev, UBOOL force, UBOOL lock);
 typedef void dump_msg_cb(struct uffs_DeviceSt *dev, const char *fmt, ...);
 
 void uffs_DumpDevice(struct uffs_DeviceSt *dev, dump_msg_cb *dump);
+void uffs_DumpTreeHash(struct uffs_DeviceSt *dev, dump_msg_cb *dump);
 
 #endif
 
@@ -0,0 +1,142 @@
+/*
+  This file is part of UFFS, the Ultra-low-cost Flash File System.
+  
+  Copyright (C) 2005-2009 Ricky Zheng <ricky_gz_zheng@yahoo.co.nz>
+
+  UFFS is free software; you can redistribute it and/or modify it under
+  the GNU Library General Public License as published by the Free Software 
+  Foundation; either version 2 of the License, or (at your option) any
+  later version.
+
+  UFFS is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+  or GNU Library General Public License, as applicable, for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  and GNU Library General Public License along with UFFS; if not, write
+  to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA  02110-1301, USA.
+
+  As a special exception, if other files instantiate templates or use
+  macros or inline functions from this file, or you compile this file
+  and link it with other works to produce a work based on this file,
+  this file does not by itself cause the resulting work to be covered
+  by the GNU General Public License. However the source code for this
+  file must still be made available in accordance with section (3) of
+  the GNU General Public License v2.
+ 
+  This exception does not invalidate any other reasons why a work based
+  on this file might be covered by the GNU General Public License.
+*/
+/** 
+ * \file uffs_wear.h
+ * \brief block erase counters and erase-count ordered free block allocator
+ * \author Ricky Zheng
+ */
+
+#ifndef _UFFS_WEAR_H_
+#define _UFFS_WEAR_H_
+
+#include "uffs_config.h"
+#include "uffs/uffs_types.h"
+#include "uffs/uffs_core.h"
+#include "uffs/uffs_tree.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/** empty heap position, or no entry is taken from heap */
+#define WEAR_HEAP_NONE	((UBLOCK)~0)
+
+#ifdef CONFIG_ENABLE_ERASE_COUNT_ALLOC
+
+/** 
+ * \struct uffs_WearSt
+ * \brief erase counters of blocks, and a min-heap of erased blocks
+ *        ordered by erase count.
+ *
+ * heap entries are tree node indexes, or block offsets in partition when
+ * erased blocks are kept in bitmap (CONFIG_ENABLE_TREE_BLOCK_BITMAP).
+ */
+struct uffs_WearSt {
+	u32 *erase_count;		//!< erase count of each block, NULL if disabled
+	UBLOCK *heap;			//!< erased block entries, least worn first
+	UBLOCK *heap_pos;		//!< position in heap of each block, WEAR_HEAP_NONE if not in heap
+	UBLOCK heap_len;		//!< number of nodes in heap
+	UBLOCK num;				//!< number of blocks of partition
+	UBLOCK rot;				//!< rotation of block order, to pick blocks with same erase count
+#ifdef CONFIG_ENABLE_ERASE_COUNT_TABLE
+	int table_start;		//!< first block of erase count table
+	int table_blocks;		//!< number of blocks reserved for erase count table
+	int slot;				//!< slot of latest saved table, -1 if none
+	u32 seq;				//!< sequence number of latest saved table
+	u32 unsaved;			//!< erasures since the table is saved
+#endif
+#ifdef CONFIG_ENABLE_STATIC_WEAR_LEVELING
+	u32 wl_erases;			//!< erasures since last static wear leveling pass
+	u32 wl_moves;			//!< cold blocks moved by static wear leveling since mount
+#endif
+};
+
+/** reserve erase count table blocks, allocate erase counters and heap */
+URET uffs_WearInit(uffs_Device *dev);
+
+/** release erase counters and heap */
+URET uffs_WearRelease(uffs_Device *dev);
+
+/** empty the heap, call this when the tree is re-initialized */
+void uffs_WearHeapReset(uffs_Device *dev);
+
+/** put an erased block entry to heap */
+void uffs_WearHeapPush(uffs_Device *dev, UBLOCK entry);
+
+/** take the least worn erased block entry from heap */
+UBLOCK uffs_WearHeapPop(uffs_Device *dev);
+
+/** take the erased block out of heap */
+void uffs_WearHeapRemove(uffs_Device *dev, UBLOCK block);
+
+/** increase erase count of block */
+void uffs_WearNoteErase(uffs_Device *dev, int block);
+
+/** get erase count of block */
+u32 uffs_WearGetEraseCount(uffs_Device *dev, int block);
+
+/** get min/max/total erase counts of partition */
+URET uffs_WearGetStat(uffs_Device *dev, u32 *min, u32 *max, u32 *total);
+
+#ifdef CONFIG_ENABLE_ERASE_COUNT_TABLE
+/** save erase counters to erase count table */
+URET uffs_WearSave(uffs_Device *dev);
+
+/** save erase counters if there are enough erasures since last save, or force */
+void uffs_WearSync(uffs_Device *dev, UBOOL force);
+#else
+#define uffs_WearSync(dev, force)	do {} while (0)
+#endif
+
+#ifdef CONFIG_ENABLE_STATIC_WEAR_LEVELING
+/** move the coldest block to the most worn erased block if they are too far apart */
+URET uffs_WearLevelStatic(uffs_Device *dev, UBOOL force);
+#else
+#define uffs_WearLevelStatic(dev, force)	do {} while (0)
+#endif
+
+#else
+
+#define uffs_WearHeapReset(dev)	do {} while (0)
+#define uffs_WearHeapPush(dev, entry)	do {} while (0)
+#define uffs_WearHeapPop(dev)	WEAR_HEAP_NONE
+#define uffs_WearNoteErase(dev, block)	do {} while (0)
+#define uffs_WearSync(dev, force)	do {} while (0)
+#define uffs_WearLevelStatic(dev, force)	do {} while (0)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -96,6 +96,72 @@ int uffs_OSGetTaskId(void)
 	return 0;
 }
 
+#if defined(CONFIG_MOUNT_SCAN_THREADS) || defined(CONFIG_BG_FLUSH_THREAD)
+struct TaskSt {
+	pthread_t thread;
+	void (*entry)(void *arg);
+	void *arg;
+};
+
+static void * task_entry(void *p)
+{
+	struct TaskSt *task = (struct TaskSt *)p;
+
+	task->entry(task->arg);
+
+	return NULL;
+}
+
+int uffs_TaskCreate(OSTASK *task, void (*entry)(void *arg), void *arg)
+{
+	struct TaskSt *t = (struct TaskSt *) malloc(sizeof(struct TaskSt));
+	int ret = -1;
+
+	if (t) {
+		t->entry = entry;
+		t->arg = arg;
+		ret = pthread_create(&t->thread, NULL, task_entry, t);
+		if (ret == 0) {
+			*task = (OSTASK)t;
+		}
+		else {
+			free(t);
+		}
+	}
+
+	return ret;
+}
+
+int uffs_TaskJoin(OSTASK task)
+{
+	struct TaskSt *t = (struct TaskSt *)task;
+	int ret;
+
+	ret = pthread_join(t->thread, NULL);
+	free(t);
+
+	return ret;
+}
+#endif
+
+unsigned int uffs_GetTickMs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (unsigned int)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+void uffs_TaskSleep(unsigned int ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000L;
+	nanosleep(&ts, NULL);
+}
+
 unsigned int uffs_GetCurDateTime(void)
 {
 	// FIXME: return system time, please modify this for your platform ! 
@@ -41,12 +41,18 @@
 
 /**
  * \def UFFS_MAX_PAGE_SIZE
- * \note maximum page size UFFS support
+ * \note maximum page size UFFS support, up to 16384.
+ *       spare and ECC buffers are sized from the device's storage
+ *       attributes when the device is initialised, this value only
+ *       bounds the page size accepted by uffs_InitDevice().
+ *       Set it above 4096 for 8K or 16K page NAND, two more bits of
+ *       page data length are then kept in tag.
  */
 #define UFFS_MAX_PAGE_SIZE		2048
 
 /**
  * \def UFFS_MAX_SPARE_SIZE
+ * \note used for sizing static spare buffers, see #UFFS_SPARE_BUFFER_SIZE
  */
 #define UFFS_MAX_SPARE_SIZE ((UFFS_MAX_PAGE_SIZE / 256) * 8)
 
@@ -70,6 +76,15 @@
  */
 #define MAX_PAGE_BUFFERS		40
 
+/**
+ * \def CONFIG_PAGE_BUFFER_HASH_BUCKETS
+ * \note page buffers are indexed by (parent, serial, page_id) in a hash
+ *       table of this many buckets (power of 2), so finding a buffer does not
+ *       walk the whole buffer list. Each bucket takes a pointer, a value
+ *       around MAX_PAGE_BUFFERS is good; raise it with MAX_PAGE_BUFFERS.
+ */
+#define CONFIG_PAGE_BUFFER_HASH_BUCKETS	64
+
 
 /** 
  * \def CLONE_BUFFER_THRESHOLD
@@ -104,6 +119,17 @@
  */
 #define MAX_DIRTY_PAGES_IN_A_BLOCK	32
 
+/**
+ * \def MAX_DIRTY_BUF_GROUPS
+ * \note dirty page buffers are grouped by block, this is the default number
+ *       of groups (blocks having dirty pages at the same time).
+ *       It can be changed for each device by uffs_Config.dirty_groups, up to
+ *       (page buffers - CLONE_BUFFERS_THRESHOLD). When all groups are in use,
+ *       a group is picked by age, pages completeness and flush cost and
+ *       flushed. Static memory allocator always uses this value.
+ */
+#define MAX_DIRTY_BUF_GROUPS	3
+
 /**
  * \def CONFIG_ENABLE_UFFS_DEBUG_MSG
  * \note Enable debug message output. You must call uffs_InitDebugMessageOutput()
@@ -247,6 +273,331 @@
 //#define CONFIG_ENABLE_PAGE_DATA_CRC
 
 
+/**
+ * \def CONFIG_ENABLE_TREE_CHECKPOINT
+ * \note If this is enabled, UFFS save the tree to checkpoint blocks when unmount
+ *       (or by uffs_checkpoint()), the next mount load the tree from checkpoint
+ *       instead of scanning all blocks. The checkpoint is discarded when the
+ *       partition is modified, UFFS do the full scan if checkpoint is not valid.
+ *
+ * \note The last CONFIG_TREE_CHECKPOINT_BLOCKS blocks of partition are reserved
+ *       for checkpoint, this changes the partition layout so you need to format
+ *       the partition after enable/disable this option.
+ */
+//#define CONFIG_ENABLE_TREE_CHECKPOINT
+
+/**
+ * \def CONFIG_TREE_CHECKPOINT_BLOCKS
+ * \note number of blocks reserved for tree checkpoint.
+ *       checkpoint needs 12 bytes for each block of partition.
+ */
+#define CONFIG_TREE_CHECKPOINT_BLOCKS	2
+
+/**
+ * \def CONFIG_ENABLE_BLOCK_SUMMARY
+ * \note If this is enabled, block recovery writes a summary of page tags to
+ *       the last page of the new block when the last page is not used.
+ *       Mount scan and block info loader then take the tags from the summary
+ *       page instead of reading spare of every page.
+ *
+ * \note Pages are programmed in sequence within a block, nothing is written
+ *       below the summary page. A block with summary has no free pages, it's
+ *       recovered to a new block when more pages are written to it.
+ *
+ * \note Blocks with summary can't be recognized by UFFS without this option,
+ *       you need to format the partition after enable/disable this option.
+ */
+//#define CONFIG_ENABLE_BLOCK_SUMMARY
+
+
+/**
+ * \def CONFIG_ENABLE_LAZY_MOUNT
+ * \note If this is enabled, mount does not scan the whole partition.
+ *       Blocks are scanned on demand when a tree lookup can't find the node,
+ *       or step by step by calling uffs_scan_step(). Writing, directory
+ *       listing and opening a file which may have data blocks finish the
+ *       scan first.
+ */
+//#define CONFIG_ENABLE_LAZY_MOUNT
+
+/**
+ * \def CONFIG_MOUNT_SCAN_THREADS
+ * \note If this is defined, mount reads bad block marks and block tags with
+ *       up to CONFIG_MOUNT_SCAN_THREADS threads, each thread reads a separated
+ *       range of blocks. The tree is then built from the result in block order.
+ *       Number of threads of a device can be changed by uffs_Config.scan_threads,
+ *       1 for reading blocks in sequence.
+ *
+ * \note Flash driver read functions must be safe to be called from multiple
+ *       threads, and uffs_TaskCreate()/uffs_TaskJoin() need to be implemented.
+ *       Not used when CONFIG_ENABLE_LAZY_MOUNT is enabled.
+ */
+//#define CONFIG_MOUNT_SCAN_THREADS	4
+
+/**
+ * \def CONFIG_ENABLE_TREE_BLOCK_INDEX
+ * \note If this is enabled, the tree keeps a block number to tree node map,
+ *       finding tree node by block number (bad block recovery, etc.) does not
+ *       need to walk through all tree nodes. The map takes 3 bytes for each
+ *       block of partition, see UFFS_TREE_BUFFER_SIZE().
+ */
+#define CONFIG_ENABLE_TREE_BLOCK_INDEX
+
+/**
+ * \def CONFIG_ENABLE_TREE_BLOCK_BITMAP
+ * \note If this is enabled, erased blocks and bad blocks are kept in bitmaps
+ *       (3 bits for each block) instead of lists of tree nodes, tree nodes
+ *       are only taken for blocks in use. Taking an erased block scans the
+ *       bitmap from where the last one was found, unless erase counters are
+ *       available (CONFIG_ENABLE_ERASE_COUNT_ALLOC).
+ *
+ * \note The tree node pool is still sized for the whole partition,
+ *       since all blocks could be in use.
+ */
+//#define CONFIG_ENABLE_TREE_BLOCK_BITMAP
+
+/**
+ * \def CONFIG_ENABLE_WIDE_BLOCK
+ * \note If this is enabled, block numbers (UBLOCK) and tree node indexes
+ *       (UNODE) are 32 bit, so a partition can have more than 65534 blocks.
+ *       Each tree node and each hash/child/block index entry takes 4 more
+ *       bytes, enable CONFIG_ENABLE_TREE_BLOCK_BITMAP to save the nodes of
+ *       erased and bad blocks on large partitions.
+ *
+ * \note Checkpoint and erase count table records are not compatible with
+ *       the 16 bit block number build.
+ */
+//#define CONFIG_ENABLE_WIDE_BLOCK
+
+/**
+ * \def CONFIG_ENABLE_EXT_SERIAL
+ * \note If this is enabled, the reserved tag bits carry the high bits of
+ *       parent serial number, so a partition can have up to 16383 dirs/files
+ *       (MAX_UFFS_FSN) instead of 1023. Each dir/file takes at least one block.
+ *       With UFFS_MAX_PAGE_SIZE above 4096 two of these bits carry the page
+ *       data length, the limit is then 4095.
+ *
+ * \note Serial numbers are taken from the lowest free one, the partition
+ *       stays readable by 1023 dirs/files build until more dirs/files than
+ *       that are created.
+ */
+//#define CONFIG_ENABLE_EXT_SERIAL
+
+/**
+ * \def CONFIG_ENABLE_TREE_CHILD_INDEX
+ * \note If this is enabled, dir and file tree nodes are also chained by
+ *       their parent dir serial, so looking up an object by name, checking
+ *       whether a dir is empty and listing a dir only visit the nodes
+ *       belonging to (or colliding with) that dir instead of all dirs/files.
+ *       The chain link takes 2 bytes for each block of partition.
+ */
+#define CONFIG_ENABLE_TREE_CHILD_INDEX
+
+/**
+ * \def CONFIG_ENABLE_FSN_BITMAP
+ * \note If this is enabled, the tree keeps a bitmap of used dir/file serial
+ *       numbers, creating a new dir/file picks a free serial number from the
+ *       bitmap instead of searching the tree for each candidate.
+ *       The bitmap takes (MAX_UFFS_FSN + 1) / 8 bytes.
+ */
+#define CONFIG_ENABLE_FSN_BITMAP
+
+/**
+ * \def CONFIG_TREE_DIR_HASH_BUCKETS
+ * \def CONFIG_TREE_FILE_HASH_BUCKETS
+ * \def CONFIG_TREE_DATA_HASH_BUCKETS
+ * \note tree hash bucket numbers (power of 2) used with the static memory
+ *       allocator. With dynamic allocator they are set by uffs_Config, or
+ *       derived from the partition size if not set.
+ *       Each bucket takes 2 bytes, see UFFS_TREE_BUFFER_SIZE().
+ */
+#define CONFIG_TREE_DIR_HASH_BUCKETS	32
+#define CONFIG_TREE_FILE_HASH_BUCKETS	64
+#define CONFIG_TREE_DATA_HASH_BUCKETS	512
+
+/**
+ * \def CONFIG_ENABLE_NAME_CACHE
+ * \note If this is enabled, UFFS keeps names of recently used dirs/files in RAM,
+ *       looking up an object by name compares the name in cache instead of
+ *       reading page 0 of the object from flash.
+ */
+#define CONFIG_ENABLE_NAME_CACHE
+
+/**
+ * \def MAX_CACHED_NAMES
+ * \note maximum number of names in cache, can be changed by uffs_Config.name_caches.
+ *       see UFFS_NAME_CACHE_BUFFER_SIZE for memory usage.
+ */
+#define MAX_CACHED_NAMES	64
+
+/**
+ * \def CONFIG_NAME_CACHE_NAME_LEN
+ * \note names longer than this are not stored in cache, only their hash is kept
+ *       to reject mismatched names.
+ */
+#define CONFIG_NAME_CACHE_NAME_LEN	32
+
+/**
+ * \def CONFIG_ENABLE_DENTRY_CACHE
+ * \note If this is enabled, UFFS remembers recent results of looking up a
+ *       name under a dir, including names which do not exist, resolving the
+ *       same path again does not need to search the tree.
+ */
+#define CONFIG_ENABLE_DENTRY_CACHE
+
+/**
+ * \def MAX_CACHED_DENTRIES
+ * \note maximum number of lookup results in cache, can be changed by
+ *       uffs_Config.dentry_caches. see UFFS_DENTRY_CACHE_BUFFER_SIZE for memory usage.
+ */
+#define MAX_CACHED_DENTRIES	64
+
+/**
+ * \def CONFIG_DENTRY_CACHE_NAME_LEN
+ * \note lookups of names longer than this are not cached.
+ */
+#define CONFIG_DENTRY_CACHE_NAME_LEN	32
+
+/**
+ * \def CONFIG_ENABLE_OBJECT_DNODE_CACHE
+ * \note If this is enabled, each opened file remembers the last accessed
+ *       data node, sequential reading/writing does not need to search the
+ *       tree for every page.
+ */
+#define CONFIG_ENABLE_OBJECT_DNODE_CACHE
+
+/**
+ * \def CONFIG_ENABLE_READ_AHEAD
+ * \note If this is enabled, sequential reading of a file loads the following
+ *       pages of the same block into page buffers when it misses a page, so
+ *       the block info is looked up once for a window of pages. The window
+ *       starts from 2 pages and doubles on each sequential read, up to
+ *       uffs_Config.read_ahead_pages and 1/4 of page buffers. Pages consumed
+ *       by sequential reading are reused first, so a long read does not push
+ *       other cached pages (e.g. dir/file info) out of page buffers.
+ */
+#define CONFIG_ENABLE_READ_AHEAD
+
+/**
+ * \def CONFIG_READ_AHEAD_MAX_PAGES
+ * \note default maximum read ahead window, in pages.
+ */
+#define CONFIG_READ_AHEAD_MAX_PAGES		16
+
+/**
+ * \def CONFIG_ENABLE_DIRECT_READ
+ * \note If this is enabled, reading a whole page of a file which is not in
+ *       page buffers goes from flash straight to the caller's buffer (ECC
+ *       and CRC checked in place), skipping page buffers, except for the
+ *       first page of each read call.
+ *
+ * \note The mini header is read into the bytes in front of the page data in
+ *       the caller's buffer (they are restored after the read), so the buffer
+ *       passed to flash driver 'ReadPage()'/'ReadPageWithLayout()' is not
+ *       aligned and is not a page buffer. Enable this only if your driver
+ *       accepts any buffer address (e.g. no DMA alignment requirement).
+ */
+//#define CONFIG_ENABLE_DIRECT_READ
+
+/**
+ * \def CONFIG_ENABLE_DIRECT_WRITE
+ * \note If this is enabled, appending whole pages to a new data block of a
+ *       file programs the pages straight from the caller's buffer and puts
+ *       the block in the tree, skipping page buffers and dirty groups.
+ *       The flash driver must implement 'WritePageVec()' (the mini header
+ *       and page data are passed separately) and must not implement
+ *       'WritePageWithLayout()', otherwise writes go through page buffers.
+ */
+#define CONFIG_ENABLE_DIRECT_WRITE
+
+/**
+ * \def CONFIG_ENABLE_BG_FLUSH
+ * \note If this is enabled, dirty groups can be written back out of the
+ *       application's write path by calling uffs_flush_step() periodically
+ *       (or by the flusher thread, see CONFIG_BG_FLUSH_THREAD).
+ *       Each call flushes at most one dirty group: when dirty page buffers are
+ *       above uffs_Config.flush_high_water, groups are flushed until they are
+ *       down to uffs_Config.flush_low_water; otherwise the oldest group which
+ *       has been dirty longer than uffs_Config.flush_expire_ms is flushed.
+ *
+ * \note uffs_GetTickMs() needs to be implemented.
+ */
+#define CONFIG_ENABLE_BG_FLUSH
+
+/**
+ * \def CONFIG_BG_FLUSH_EXPIRE_MS
+ * \note default time (ms) dirty pages may stay in page buffers before
+ *       they are written back by uffs_flush_step().
+ */
+#define CONFIG_BG_FLUSH_EXPIRE_MS	3000
+
+/**
+ * \def CONFIG_BG_FLUSH_THREAD
+ * \note If this is enabled, uffs_flusher_start() creates a thread which runs
+ *       uffs_flush_step() on all mounted partitions every given interval.
+ *       The thread takes the global fs lock for each step, so
+ *       CONFIG_USE_GLOBAL_FS_LOCK is required, and uffs_TaskCreate(),
+ *       uffs_TaskJoin() and uffs_TaskSleep() need to be implemented.
+ *       Stop the flusher by uffs_flusher_stop() before unmounting partitions.
+ */
+#define CONFIG_BG_FLUSH_THREAD
+
+/**
+ * \def CONFIG_ENABLE_ERASE_COUNT_ALLOC
+ * \note If this is enabled, UFFS counts erasures of each block since mount,
+ *       and erased blocks are kept in a min-heap ordered by erase count,
+ *       new blocks are always taken from the least worn ones instead of
+ *       rotating the erased block list at mount time.
+ *       see UFFS_WEAR_BUFFER_SIZE for memory usage.
+ */
+#define CONFIG_ENABLE_ERASE_COUNT_ALLOC
+
+/**
+ * \def CONFIG_ENABLE_ERASE_COUNT_TABLE
+ * \note If this is enabled (requires CONFIG_ENABLE_ERASE_COUNT_ALLOC), erase
+ *       counters are saved to an erase count table when unmount, and when
+ *       a file is flushed/closed after CONFIG_ERASE_COUNT_SAVE_INTERVAL erasures.
+ *       The table is loaded at mount, so counters survive reboot. A power loss
+ *       only loses erasures since the last save.
+ *
+ * \note Two copies of the table (4 bytes for each block) are kept in blocks
+ *       reserved from the end of partition, this changes the partition layout
+ *       so you need to format the partition after enable/disable this option.
+ */
+//#define CONFIG_ENABLE_ERASE_COUNT_TABLE
+
+/**
+ * \def CONFIG_ERASE_COUNT_SAVE_INTERVAL
+ * \note default number of erasures before erase count table is saved again,
+ *       can be changed by uffs_Config.erase_count_save_interval.
+ */
+#define CONFIG_ERASE_COUNT_SAVE_INTERVAL	256
+
+/**
+ * \def CONFIG_ENABLE_STATIC_WEAR_LEVELING
+ * \note If this is enabled (requires CONFIG_ENABLE_ERASE_COUNT_ALLOC), blocks
+ *       holding static data are moved to the most worn erased blocks when
+ *       their erase counts fall CONFIG_STATIC_WL_THRESHOLD behind, so the
+ *       least worn blocks are put back to use. At most one block is moved
+ *       every CONFIG_STATIC_WL_INTERVAL erasures, at file flush/close.
+ */
+#define CONFIG_ENABLE_STATIC_WEAR_LEVELING
+
+/**
+ * \def CONFIG_STATIC_WL_THRESHOLD
+ * \note default erase count difference to trigger a static wear leveling move,
+ *       can be changed by uffs_Config.static_wl_threshold (-1: disabled).
+ */
+#define CONFIG_STATIC_WL_THRESHOLD		32
+
+/**
+ * \def CONFIG_STATIC_WL_INTERVAL
+ * \note default number of erasures between static wear leveling passes,
+ *       can be changed by uffs_Config.static_wl_interval.
+ */
+#define CONFIG_STATIC_WL_INTERVAL		64
+
+
 /** micros for calculating buffer sizes */
 
 /**
@@ -269,17 +620,78 @@
 			(								\
 				(							\
 					sizeof(uffs_Buf) + n_page_size	\
-				) * MAX_PAGE_BUFFERS		\
+				) * MAX_PAGE_BUFFERS +		\
+				sizeof(struct uffs_DirtyGroupSt) * MAX_DIRTY_BUF_GROUPS	\
 			)
 
 /**
  *	\def UFFS_TREE_BUFFER_SIZE
  *	\brief calculate memory bytes for tree nodes
  */
-#define UFFS_TREE_BUFFER_SIZE(n_blocks) (sizeof(TreeNode) * n_blocks)
+#ifdef CONFIG_ENABLE_TREE_BLOCK_INDEX
+#define UFFS_TREE_BLOCK_INDEX_SIZE	(sizeof(UNODE) + sizeof(u8))
+#else
+#define UFFS_TREE_BLOCK_INDEX_SIZE	0
+#endif
 
+#ifdef CONFIG_ENABLE_TREE_CHILD_INDEX
+#define UFFS_TREE_CHILD_INDEX_SIZE	sizeof(UNODE)
+#else
+#define UFFS_TREE_CHILD_INDEX_SIZE	0
+#endif
 
-#define UFFS_SPARE_BUFFER_SIZE (MAX_SPARE_BUFFERS * UFFS_MAX_SPARE_SIZE)
+#ifdef CONFIG_ENABLE_TREE_BLOCK_BITMAP
+#define UFFS_TREE_BLOCK_BITMAP_SIZE(n_blocks)	((((n_blocks) + 7) / 8) * 3)
+#else
+#define UFFS_TREE_BLOCK_BITMAP_SIZE(n_blocks)	0
+#endif
+
+#define UFFS_TREE_HASH_SIZE	\
+			(sizeof(UNODE) * (CONFIG_TREE_DIR_HASH_BUCKETS + CONFIG_TREE_FILE_HASH_BUCKETS + CONFIG_TREE_DATA_HASH_BUCKETS))
+
+#define UFFS_TREE_BUFFER_SIZE(n_blocks) \
+			((sizeof(TreeNode) + UFFS_TREE_BLOCK_INDEX_SIZE + UFFS_TREE_CHILD_INDEX_SIZE) * n_blocks + \
+				UFFS_TREE_BLOCK_BITMAP_SIZE(n_blocks) + UFFS_TREE_HASH_SIZE)
+
+
+/**
+ *	\def UFFS_SPARE_BUFFER_SIZE
+ *	\brief maximum memory bytes for spare buffers,
+ *			each buffer holds page spare and two page ECC
+ */
+#define UFFS_SPARE_BUFFER_SIZE \
+			(MAX_SPARE_BUFFERS * \
+				(((UFFS_MAX_SPARE_SIZE + 7) & ~7) + ((UFFS_MAX_ECC_SIZE + 7) & ~7) * 2))
+
+/**
+ *	\def UFFS_NAME_CACHE_BUFFER_SIZE
+ *	\brief calculate memory bytes for name cache
+ */
+#ifdef CONFIG_ENABLE_NAME_CACHE
+#define UFFS_NAME_CACHE_BUFFER_SIZE	(sizeof(uffs_NameCacheEntry) * MAX_CACHED_NAMES)
+#else
+#define UFFS_NAME_CACHE_BUFFER_SIZE	0
+#endif
+
+/**
+ *	\def UFFS_DENTRY_CACHE_BUFFER_SIZE
+ *	\brief calculate memory bytes for dentry cache
+ */
+#ifdef CONFIG_ENABLE_DENTRY_CACHE
+#define UFFS_DENTRY_CACHE_BUFFER_SIZE	(sizeof(uffs_DentryEntry) * MAX_CACHED_DENTRIES)
+#else
+#define UFFS_DENTRY_CACHE_BUFFER_SIZE	0
+#endif
+
+/**
+ *	\def UFFS_WEAR_BUFFER_SIZE
+ *	\brief calculate memory bytes for erase counters and free block heap
+ */
+#ifdef CONFIG_ENABLE_ERASE_COUNT_ALLOC
+#define UFFS_WEAR_BUFFER_SIZE(n_blocks)	((sizeof(u32) + sizeof(UBLOCK) * 2) * n_blocks)
+#else
+#define UFFS_WEAR_BUFFER_SIZE(n_blocks)	0
+#endif
 
 
 /**
@@ -291,16 +703,45 @@
 				UFFS_BLOCK_INFO_BUFFER_SIZE(n_pages_per_block) + \
 				UFFS_PAGE_BUFFER_SIZE(n_page_size) + \
 				UFFS_TREE_BUFFER_SIZE(n_blocks) + \
-				UFFS_SPARE_BUFFER_SIZE \
+				UFFS_SPARE_BUFFER_SIZE + \
+				UFFS_NAME_CACHE_BUFFER_SIZE + \
+				UFFS_DENTRY_CACHE_BUFFER_SIZE + \
+				UFFS_WEAR_BUFFER_SIZE(n_blocks) \
 			 )
 
 
 
 /* config check */
+#if UFFS_MAX_PAGE_SIZE > 16384
+#error "UFFS_MAX_PAGE_SIZE can not bigger than 16384 !"
+#endif
+
+#if (CONFIG_TREE_DIR_HASH_BUCKETS & (CONFIG_TREE_DIR_HASH_BUCKETS - 1)) || \
+	(CONFIG_TREE_FILE_HASH_BUCKETS & (CONFIG_TREE_FILE_HASH_BUCKETS - 1)) || \
+	(CONFIG_TREE_DATA_HASH_BUCKETS & (CONFIG_TREE_DATA_HASH_BUCKETS - 1))
+#error "tree hash bucket numbers must be power of 2"
+#endif
+
+#if (CONFIG_PAGE_BUFFER_HASH_BUCKETS & (CONFIG_PAGE_BUFFER_HASH_BUCKETS - 1))
+#error "CONFIG_PAGE_BUFFER_HASH_BUCKETS must be power of 2"
+#endif
+
+#if defined(CONFIG_ENABLE_ERASE_COUNT_TABLE) && !defined(CONFIG_ENABLE_ERASE_COUNT_ALLOC)
+#error "CONFIG_ENABLE_ERASE_COUNT_TABLE requires CONFIG_ENABLE_ERASE_COUNT_ALLOC"
+#endif
+
+#if defined(CONFIG_ENABLE_STATIC_WEAR_LEVELING) && !defined(CONFIG_ENABLE_ERASE_COUNT_ALLOC)
+#error "CONFIG_ENABLE_STATIC_WEAR_LEVELING requires CONFIG_ENABLE_ERASE_COUNT_ALLOC"
+#endif
+
 #if (MAX_PAGE_BUFFERS - CLONE_BUFFERS_THRESHOLD) < 3
 #error "MAX_PAGE_BUFFERS is too small"
 #endif
 
+#if (MAX_DIRTY_BUF_GROUPS < 1) || (MAX_DIRTY_BUF_GROUPS > MAX_PAGE_BUFFERS - CLONE_BUFFERS_THRESHOLD)
+#error "MAX_DIRTY_BUF_GROUPS should be between 1 and (MAX_PAGE_BUFFERS - CLONE_BUFFERS_THRESHOLD)"
+#endif
+
 #if (MAX_DIRTY_PAGES_IN_A_BLOCK < 2)
 #error "MAX_DIRTY_PAGES_IN_A_BLOCK should >= 2"
 #endif
@@ -337,6 +778,22 @@
 #error "CONFIG_UFFS_REFRESH_BLOCK conflict with CONFIG_BAD_BLOCK_POLICY_STRICT !"
 #endif
 
+#if defined(CONFIG_ENABLE_TREE_CHECKPOINT) && (CONFIG_TREE_CHECKPOINT_BLOCKS < 1)
+#error "CONFIG_TREE_CHECKPOINT_BLOCKS should >= 1"
+#endif
+
+#if defined(CONFIG_MOUNT_SCAN_THREADS) && (CONFIG_MOUNT_SCAN_THREADS < 2)
+#error "CONFIG_MOUNT_SCAN_THREADS should >= 2"
+#endif
+
+#if defined(CONFIG_BG_FLUSH_THREAD) && !defined(CONFIG_ENABLE_BG_FLUSH)
+#error "CONFIG_BG_FLUSH_THREAD requires CONFIG_ENABLE_BG_FLUSH"
+#endif
+
+#if defined(CONFIG_BG_FLUSH_THREAD) && !defined(CONFIG_USE_GLOBAL_FS_LOCK)
+#error "CONFIG_BG_FLUSH_THREAD requires CONFIG_USE_GLOBAL_FS_LOCK"
+#endif
+
 
 #ifdef _MSC_VER 
 # pragma warning(disable : 4996)
@@ -96,6 +96,65 @@ int uffs_OSGetTaskId(void)
 	return 0;
 }
 
+#if defined(CONFIG_MOUNT_SCAN_THREADS) || defined(CONFIG_BG_FLUSH_THREAD)
+struct TaskSt {
+	HANDLE thread;
+	void (*entry)(void *arg);
+	void *arg;
+};
+
+static DWORD WINAPI task_entry(LPVOID p)
+{
+	struct TaskSt *task = (struct TaskSt *)p;
+
+	task->entry(task->arg);
+
+	return 0;
+}
+
+int uffs_TaskCreate(OSTASK *task, void (*entry)(void *arg), void *arg)
+{
+	struct TaskSt *t = (struct TaskSt *) malloc(sizeof(struct TaskSt));
+
+	if (t == NULL)
+		return -1;
+
+	t->entry = entry;
+	t->arg = arg;
+	t->thread = CreateThread(NULL, 0, task_entry, t, 0, NULL);
+	if (t->thread == NULL) {
+		printf("Create thread failed !\n");
+		free(t);
+		return -1;
+	}
+	*task = (OSTASK)t;
+
+	return 0;
+}
+
+int uffs_TaskJoin(OSTASK task)
+{
+	struct TaskSt *t = (struct TaskSt *)task;
+	int ret;
+
+	ret = (WaitForSingleObject(t->thread, INFINITE) == WAIT_OBJECT_0 ? 0 : -1);
+	CloseHandle(t->thread);
+	free(t);
+
+	return ret;
+}
+#endif
+
+unsigned int uffs_GetTickMs(void)
+{
+	return (unsigned int)GetTickCount();
+}
+
+void uffs_TaskSleep(unsigned int ms)
+{
+	Sleep(ms);
+}
+
 unsigned int uffs_GetCurDateTime(void)
 {
 	// FIXME: return system time, please modify this for your platform ! 
@@ -0,0 +1,70 @@
+# background write back test, build with CONFIG_ENABLE_BG_FLUSH, start the emulator with:
+#   mkuffs -f wb.img -t 1024 -c
+# then run 'script test_bg_flush.ts' from this directory.
+# 3 files get 8 dirty pages each, above the default high watermark (19 dirty
+# buffers), 'flush' writes back groups until dirty buffers are down to the
+# low watermark, 'Write Back Watermark' in statistics shows 2.
+
+format /
+! abort --- format failed.
+mkdir /wb/
+! abort --- mkdir /wb/ failed.
+
+t_open cw /wb/f1
+! abort --- create file /wb/f1 failed.
+set 3 $1
+t_open cw /wb/f2
+! abort --- create file /wb/f2 failed.
+set 4 $1
+t_open cw /wb/f3
+! abort --- create file /wb/f3 failed.
+set 5 $1
+
+t_write_seq $3 4000
+! abort
+t_write_seq $4 4000
+! abort
+t_write_seq $5 4000
+! abort
+
+flush /
+! abort --- flush / failed.
+st /
+
+# nothing over watermark, groups are not expired yet
+flush /
+! abort --- flush / failed.
+
+t_write_seq $3 20000
+! abort
+t_close $3
+t_close $4
+t_close $5
+
+echo --- remount ---
+umount /
+mount /
+! abort --- mount failed.
+ls /wb/
+
+t_open r /wb/f1
+! abort --- open file /wb/f1 failed.
+set 3 $1
+t_check_seq $3 24000
+! abort
+t_close $3
+
+t_open r /wb/f2
+! abort --- open file /wb/f2 failed.
+set 4 $1
+t_check_seq $4 4000
+! abort
+t_close $4
+
+t_open r /wb/f3
+! abort --- open file /wb/f3 failed.
+set 5 $1
+t_check_seq $5 4000
+! abort
+t_close $5
+st /
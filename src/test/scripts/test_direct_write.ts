@@ -0,0 +1,57 @@
+# direct write test, build with CONFIG_ENABLE_DIRECT_WRITE, start the emulator with:
+#   mkuffs -f dw.img -t 1024 -c
+# then run 'script test_direct_write.ts' from this directory.
+# whole pages of new data blocks are written from caller's buffer,
+# 'Write Direct' in statistics shows how many pages bypassed page buffers.
+
+format /
+! abort --- format failed.
+mkdir /dw/
+! abort --- mkdir /dw/ failed.
+
+t_open cw /dw/f1
+! abort --- create file /dw/f1 failed.
+set 9 $1
+t_write_seq $9 1000000
+! abort
+t_close $9
+
+# append to a file ending in the middle of a data block
+t_open cw /dw/f2
+! abort --- create file /dw/f2 failed.
+set 9 $1
+t_write_seq $9 20000
+! abort
+t_close $9
+t_open w /dw/f2
+! abort --- open file /dw/f2 failed.
+set 9 $1
+t_seek $9 20000
+t_write_seq $9 180000
+! abort
+t_close $9
+st /
+
+echo --- remount ---
+umount /
+mount /
+! abort --- mount failed.
+ls /dw/
+
+t_open r /dw/f1
+! abort --- open file /dw/f1 failed.
+set 9 $1
+t_check_seq $9 1000000
+! abort
+t_close $9
+
+t_open r /dw/f2
+! abort --- open file /dw/f2 failed.
+set 9 $1
+t_check_seq $9 200000
+! abort
+t_close $9
+
+rm /dw/f1
+! abort --- rm /dw/f1 failed.
+st /
@@ -0,0 +1,147 @@
+# dirty groups test, start the emulator with more dirty groups than default, e.g.:
+#   mkuffs -f dg.img -t 1024 -g 6 -c
+# then run 'script test_dirty_groups.ts' from this directory.
+# files are written in turn, each file keeps a dirty group. 'Evict For Group Slot'
+# in statistics shows how many times a group was flushed for a free slot.
+
+format /
+! abort --- format failed.
+mkdir /dg/
+! abort --- mkdir /dg/ failed.
+
+t_open cw /dg/f0
+! abort --- create file /dg/f0 failed.
+set 3 $1
+t_open cw /dg/f1
+! abort --- create file /dg/f1 failed.
+set 4 $1
+t_open cw /dg/f2
+! abort --- create file /dg/f2 failed.
+set 5 $1
+t_open cw /dg/f3
+! abort --- create file /dg/f3 failed.
+set 6 $1
+t_open cw /dg/f4
+! abort --- create file /dg/f4 failed.
+set 7 $1
+
+t_write_seq $3 200
+t_write_seq $4 350
+t_write_seq $5 500
+t_write_seq $6 650
+t_write_seq $7 800
+! abort
+t_write_seq $3 200
+t_write_seq $4 350
+t_write_seq $5 500
+t_write_seq $6 650
+t_write_seq $7 800
+! abort
+t_write_seq $3 200
+t_write_seq $4 350
+t_write_seq $5 500
+t_write_seq $6 650
+t_write_seq $7 800
+! abort
+t_write_seq $3 200
+t_write_seq $4 350
+t_write_seq $5 500
+t_write_seq $6 650
+t_write_seq $7 800
+! abort
+t_write_seq $3 200
+t_write_seq $4 350
+t_write_seq $5 500
+t_write_seq $6 650
+t_write_seq $7 800
+! abort
+t_write_seq $3 200
+t_write_seq $4 350
+t_write_seq $5 500
+t_write_seq $6 650
+t_write_seq $7 800
+! abort
+t_write_seq $3 200
+t_write_seq $4 350
+t_write_seq $5 500
+t_write_seq $6 650
+t_write_seq $7 800
+! abort
+t_write_seq $3 200
+t_write_seq $4 350
+t_write_seq $5 500
+t_write_seq $6 650
+t_write_seq $7 800
+! abort
+t_write_seq $3 200
+t_write_seq $4 350
+t_write_seq $5 500
+t_write_seq $6 650
+t_write_seq $7 800
+! abort
+t_write_seq $3 200
+t_write_seq $4 350
+t_write_seq $5 500
+t_write_seq $6 650
+t_write_seq $7 800
+! abort
+t_write_seq $3 200
+t_write_seq $4 350
+t_write_seq $5 500
+t_write_seq $6 650
+t_write_seq $7 800
+! abort
+t_write_seq $3 200
+t_write_seq $4 350
+t_write_seq $5 500
+t_write_seq $6 650
+t_write_seq $7 800
+! abort
+
+t_close $3
+t_close $4
+t_close $5
+t_close $6
+t_close $7
+st /
+
+echo --- remount ---
+umount /
+mount /
+! abort --- mount failed.
+ls /dg/
+
+t_open r /dg/f0
+! abort --- open file /dg/f0 failed.
+set 9 $1
+t_check_seq $9 2400
+! abort
+t_close $9
+
+t_open r /dg/f1
+! abort --- open file /dg/f1 failed.
+set 9 $1
+t_check_seq $9 4200
+! abort
+t_close $9
+
+t_open r /dg/f2
+! abort --- open file /dg/f2 failed.
+set 9 $1
+t_check_seq $9 6000
+! abort
+t_close $9
+
+t_open r /dg/f3
+! abort --- open file /dg/f3 failed.
+set 9 $1
+t_check_seq $9 7800
+! abort
+t_close $9
+
+t_open r /dg/f4
+! abort --- open file /dg/f4 failed.
+set 9 $1
+t_check_seq $9 9600
+! abort
+t_close $9
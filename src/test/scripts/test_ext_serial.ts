@@ -0,0 +1,40 @@
+# more than 1023 dirs/files test, build with CONFIG_ENABLE_EXT_SERIAL,
+# start the emulator with:
+#   mkuffs -f ext.img -p 512 -s 16 -b 4 -t 20000 -c
+# then run 'script test_ext_serial.ts' from this directory.
+# each file takes a block, 20000 blocks hold all 16383 serial numbers.
+
+format /
+! abort --- format failed.
+t_objbench 3000 1000 500 keep
+! abort
+mkdir /objbench/sub/
+! abort --- mkdir /objbench/sub/ failed.
+t_open cw /objbench/sub/f
+! abort --- create file /objbench/sub/f failed.
+set 9 $1
+t_write_seq $9 10000
+! abort
+t_close $9
+st /
+
+echo --- remount ---
+umount /
+mount /
+! abort --- mount failed.
+t_open r /objbench/sub/f
+! abort --- open file /objbench/sub/f failed.
+set 9 $1
+t_check_seq $9 10000
+! abort
+t_close $9
+rm /objbench/f02999
+! abort --- rm /objbench/f02999 failed.
+rm /objbench/f01500
+! abort --- rm /objbench/f01500 failed.
+
+format /
+! abort --- format failed.
+t_objbench 16000 2000
+! abort
+st /
@@ -0,0 +1,61 @@
+# large page test, build with UFFS_MAX_PAGE_SIZE 16384, start the emulator with:
+#   mkuffs -f large.img -p 16384 -s 512 -b 32 -t 256 -c
+# then run 'script test_large_page.ts' from this directory.
+# page data length above 4095 is kept with the extra tag bits.
+
+format /
+! abort --- format failed.
+mkdir /lp/
+! abort --- mkdir /lp/ failed.
+
+t_open cw /lp/f1
+! abort --- create file /lp/f1 failed.
+set 9 $1
+t_write_seq $9 10000
+! abort
+t_close $9
+
+t_open cw /lp/f2
+! abort --- create file /lp/f2 failed.
+set 9 $1
+t_write_seq $9 300000
+! abort
+t_close $9
+
+t_open cw /lp/f3
+! abort --- create file /lp/f3 failed.
+set 9 $1
+t_write_seq $9 7000
+! abort
+t_close $9
+
+echo --- remount ---
+umount /
+mount /
+! abort --- mount failed.
+ls /lp/
+
+t_open r /lp/f1
+! abort --- open file /lp/f1 failed.
+set 9 $1
+t_check_seq $9 10000
+! abort
+t_close $9
+
+t_open r /lp/f2
+! abort --- open file /lp/f2 failed.
+set 9 $1
+t_check_seq $9 300000
+! abort
+t_close $9
+
+t_open r /lp/f3
+! abort --- open file /lp/f3 failed.
+set 9 $1
+t_check_seq $9 7000
+! abort
+t_close $9
+
+rm /lp/f2
+! abort --- rm /lp/f2 failed.
+st /
@@ -0,0 +1,87 @@
+# large geometry test, build with CONFIG_ENABLE_WIDE_BLOCK, start the emulator with:
+#   mkuffs -f large.img -t 131072 -b 4 -c
+# then run 'script test_wide_block.ts' from this directory.
+# 131072 blocks of 4 pages, blocks beyond 65535 are taken for data and more
+# than 65535 blocks are in use at the same time.
+
+format /
+! abort --- format failed.
+mkdir /big/
+! abort --- mkdir /big/ failed.
+t_pfs /big/ 20
+! abort
+
+t_open cw /big/f1
+! abort --- create file /big/f1 failed.
+set 9 $1
+t_write_seq $9 24000000
+! abort
+t_close $9
+
+t_open cw /big/f2
+! abort --- create file /big/f2 failed.
+set 9 $1
+t_write_seq $9 24000000
+! abort
+t_close $9
+
+t_open cw /big/f3
+! abort --- create file /big/f3 failed.
+set 9 $1
+t_write_seq $9 24000000
+! abort
+t_close $9
+
+t_open cw /big/f4
+! abort --- create file /big/f4 failed.
+set 9 $1
+t_write_seq $9 24000000
+! abort
+t_close $9
+
+t_open cw /big/f5
+! abort --- create file /big/f5 failed.
+set 9 $1
+t_write_seq $9 24000000
+! abort
+t_close $9
+
+t_open cw /big/f6
+! abort --- create file /big/f6 failed.
+set 9 $1
+t_write_seq $9 24000000
+! abort
+t_close $9
+
+st /
+
+echo --- remount ---
+umount /
+mount /
+! abort --- mount failed.
+ls /big/
+
+t_open r /big/f1
+! abort --- open file /big/f1 failed.
+set 9 $1
+t_check_seq $9 24000000
+! abort
+t_close $9
+
+t_open r /big/f4
+! abort --- open file /big/f4 failed.
+set 9 $1
+t_check_seq $9 24000000
+! abort
+t_close $9
+
+t_open r /big/f6
+! abort --- open file /big/f6 failed.
+set 9 $1
+t_check_seq $9 24000000
+! abort
+t_close $9
+
+rm /big/f2
+! abort --- rm /big/f2 failed.
+st /
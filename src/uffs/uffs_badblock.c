@@ -79,9 +79,11 @@ void uffs_BadBlockProcessNode(uffs_Device *dev, TreeNode *node)
 }
 
 
-static void process_pending_recover(uffs_Device *dev, uffs_PendingBlock *s)
+/* copy pending block to <good> erased block (or a new erased block if <good> is NULL),
+	return U_TRUE if the block is recovered. */
+static UBOOL process_pending_recover(uffs_Device *dev, uffs_PendingBlock *s, TreeNode *good)
 {
-	TreeNode *good, *bad;
+	TreeNode *bad;
 	uffs_Buf *buf;
 	u16 i;
 	u16 page;
@@ -98,7 +100,9 @@ static void process_pending_recover(uffs_Device *dev, uffs_PendingBlock *s)
 	bc = uffs_BlockInfoGet(dev, s->block);
 	if (bc == NULL) {
 		uffs_Perror(UFFS_MSG_SERIOUS, "can't get bad block info");
-		return;
+		if (good)
+			uffs_TreeInsertToErasedListTail(dev, good);
+		return U_FALSE;
 	}
 
 	region = SEARCH_REGION_DIR|SEARCH_REGION_FILE|SEARCH_REGION_DATA;
@@ -108,16 +112,19 @@ static void process_pending_recover(uffs_Device *dev, uffs_PendingBlock *s)
 					"can't find the reported bad block(%d) in the tree ? probably already been processed.",
 					s->block);
 		uffs_BlockInfoPut(dev, bc);
-		return;
+		if (good)
+			uffs_TreeInsertToErasedListTail(dev, good);
+		return U_FALSE;
 	}
 
 retry:
 	// pick up an erased good block
-	good = uffs_TreeGetErasedNode(dev);
+	if (good == NULL)
+		good = uffs_TreeGetErasedNode(dev);
 	if (good == NULL) {
 		uffs_Perror(UFFS_MSG_SERIOUS, "no free block to replace bad block!");
 		uffs_BlockInfoPut(dev, bc);
-		return;
+		return U_FALSE;
 	}
 
 	goodBlockIsDirty = U_FALSE;
@@ -204,6 +211,7 @@ retry:
 			// we have a new bad block ? mark it and retry.
 			uffs_Perror(UFFS_MSG_NOISY, "A new bad block is discovered during bad block recover ...");
 			uffs_BadBlockProcessNode(dev, good);
+			good = NULL;
 			goto retry;
 		}
 
@@ -237,6 +245,7 @@ retry:
 			bad->u.data.block = good->u.list.block;
 			type = UFFS_TYPE_DATA;
 		}
+		uffs_TreeIndexNode(dev, type, bad);
 			
 		//from now, the 'bad' is actually good block :)))
 		uffs_Perror(UFFS_MSG_NOISY,
@@ -269,7 +278,8 @@ retry:
 	}
 
 	uffs_BlockInfoPut(dev, bc);
-	
+
+	return succRecov;
 }
 
 /** 
@@ -280,17 +290,52 @@ void uffs_BadBlockRecover(uffs_Device *dev)
 {
 	uffs_PendingBlock *s;
 
+	// recovery needs the whole tree (erased blocks, node of pending block)
+	if (dev->pending.count > 0 && uffs_TreeLazyComplete(dev) != U_SUCC)
+		return;
+
 	while (dev->pending.count > 0) {
 		dev->pending.count--;
 		s = &dev->pending.list[dev->pending.count];
 		uffs_Perror(UFFS_MSG_NOISY, "Process pending block %d - %s", 
 						s->block, uffs_BadBlockPendingTypeName(s->mark));
 		dev->pending.block_in_recovery = s->block;
-		process_pending_recover(dev, s);
+		process_pending_recover(dev, s, NULL);
 	}
 	dev->pending.block_in_recovery = UFFS_INVALID_BLOCK;
 }
 
+/** 
+ * \brief move data of a good block to another erased block, then erase
+ *        the block and put it back to erased list, as refreshing a block.
+ *        The tree node of the block is kept, only its block number changes.
+ * \param[in] dev uffs device
+ * \param[in] block the block to be moved
+ * \param[in] good erased block to move to, taken out of erased list by caller,
+ *            another erased block is used if it turns out to be bad.
+ * \return U_SUCC if the block is moved, otherwise <good> is back to erased list.
+ */
+URET uffs_BadBlockRefresh(uffs_Device *dev, int block, TreeNode *good)
+{
+	uffs_PendingBlock s;
+	UBOOL succ;
+
+	if (uffs_BadBlockPendingNodeGet(dev, block) != NULL) {
+		// leave it to uffs_BadBlockRecover()
+		uffs_TreeInsertToErasedListTail(dev, good);
+		return U_FAIL;
+	}
+
+	s.block = block;
+	s.mark = UFFS_PENDING_BLK_REFRESH;
+
+	dev->pending.block_in_recovery = block;
+	succ = process_pending_recover(dev, &s, good);
+	dev->pending.block_in_recovery = UFFS_INVALID_BLOCK;
+
+	return succ == U_TRUE ? U_SUCC : U_FAIL;
+}
+
 
 /** put a new block to the bad block pending list */
 void uffs_BadBlockAdd(uffs_Device *dev, int block, u8 mark)
@@ -41,6 +41,9 @@
 #include "uffs/uffs_public.h"
 #include "uffs/uffs_os.h"
 #include "uffs/uffs_badblock.h"
+#include "uffs/uffs_buf.h"
+#include "uffs/uffs_flash.h"
+#include "uffs/uffs_crc.h"
 
 #include <string.h>
 
@@ -48,6 +51,8 @@
 
 #define UFFS_CLONE_BLOCK_INFO_NEXT ((uffs_BlockInfo *)(-2))
 
+#define BLOCK_TAGS_BATCH	32		//!< maximum pages of reading tags in one flash call
+
 /**
  * \brief before block info cache is enable,
  *			this function should be called to initialize it
@@ -201,6 +206,166 @@ static void _MoveBcToTail(uffs_Device *dev, uffs_BlockInfo *bc)
 }
 
 
+#ifdef CONFIG_ENABLE_BLOCK_SUMMARY
+/** is this tag a (loaded) block summary page tag ? */
+static UBOOL _IsSummaryTag(uffs_Device *dev, uffs_Tags *tag)
+{
+	return (TAG_IS_SEALED(tag) && !TAG_IS_VALID(tag) &&
+			TAG_TYPE(tag) == UFFS_TYPE_RESV &&
+			TAG_PAGE_ID(tag) == dev->attr->pages_per_block - 1) ? U_TRUE : U_FALSE;
+}
+
+/** 
+ * \brief fill page tags from block summary if the last page carries one
+ * \param[in] dev uffs device
+ * \param[in] work block info, the last page tag just loaded
+ * \note the summary page is not a data page, its tag is marked as 'invalid'
+ *		 so it won't be picked up by any page searching.
+ * \note summary is written after all other pages and no page is appended
+ *		 to the block later, pages after the summarized pages are erased.
+ */
+static void _LoadBlockSummary(uffs_Device *dev, uffs_BlockInfo *work)
+{
+	u16 lastPage = dev->attr->pages_per_block - 1;
+	uffs_Tags *tag = GET_TAG(work, lastPage);
+	struct uffs_BlockSummaryHeadSt head;
+	uffs_TagStore *ts;
+	uffs_PageSpare *spare;
+	uffs_Buf *buf;
+	int i, ret;
+
+	if (!TAG_IS_GOOD(tag) ||
+		TAG_TYPE(tag) != UFFS_TYPE_RESV ||
+		TAG_PAGE_ID(tag) != lastPage)
+		return;
+
+	TAG_VALID_BIT(tag) = TAG_INVALID;
+
+	buf = uffs_BufClone(dev, NULL);
+	if (buf == NULL)
+		return;
+
+	ret = uffs_FlashReadPage(dev, work->block, lastPage, buf, U_FALSE);
+	uffs_BadBlockAddByFlashResult(dev, work->block, ret);
+
+	if (UFFS_FLASH_HAVE_ERR(ret)) {
+		uffs_Perror(UFFS_MSG_NORMAL,
+					"read block %d summary fail.", work->block);
+		goto ext;
+	}
+
+	memcpy(&head, buf->data, sizeof(head));
+	ts = (uffs_TagStore *)(buf->data + sizeof(head));
+
+	if (head.magic != UFFS_BLOCK_SUMMARY_MAGIC ||
+		head.pages == 0 || head.pages > lastPage ||
+		UFFS_BLOCK_SUMMARY_SIZE(head.pages) != TAG_DATA_LEN(tag) ||
+		head.crc != uffs_crc16sum(ts, sizeof(uffs_TagStore) * head.pages)) {
+		uffs_Perror(UFFS_MSG_NORMAL,
+					"block %d summary corrupted.", work->block);
+		goto ext;
+	}
+
+	for (i = 0; i < lastPage; i++) {
+		spare = &(work->spares[i]);
+		if (spare->expired) {
+			if (i < head.pages) {
+				memcpy(&(spare->tag.s), &ts[i], sizeof(uffs_TagStore));
+				SEAL_TAG(&(spare->tag));
+			}
+			else {
+				memset(&(spare->tag), 0xFF, sizeof(struct uffs_TagsSt));
+			}
+			spare->expired = 0;
+			work->expired_count--;
+		}
+	}
+
+ext:
+	uffs_BufFreeClone(dev, buf);
+}
+
+/** 
+ * \brief does the last page of block carry block summary ?
+ * \param[in] dev uffs device
+ * \param[in] work block info
+ * \retval U_TRUE the last page is a block summary page
+ * \retval U_FALSE the last page is not a block summary page
+ */
+UBOOL uffs_BlockInfoHasSummary(uffs_Device *dev, uffs_BlockInfo *work)
+{
+	u16 lastPage = dev->attr->pages_per_block - 1;
+
+	if (uffs_BlockInfoLoad(dev, work, lastPage) != U_SUCC)
+		return U_FALSE;
+
+	return _IsSummaryTag(dev, GET_TAG(work, lastPage));
+}
+#endif
+
+/** 
+ * \brief update block info of a page with the result of reading tag
+ * \param[in|out] nfailed failed pages counter
+ */
+static void _LoadTagResult(uffs_Device *dev, uffs_BlockInfo *work, int page, int ret, int *nfailed)
+{
+	uffs_PageSpare *spare = &(work->spares[page]);
+
+	uffs_BadBlockAddByFlashResult(dev, work->block, ret);
+
+	if (UFFS_FLASH_HAVE_ERR(ret)) {
+		uffs_Perror(UFFS_MSG_SERIOUS,
+					"load block %d page %d spare fail.",
+					work->block, page);
+		TAG_VALID_BIT(&(spare->tag)) = TAG_INVALID;	
+		(*nfailed)++;	
+	}
+
+	spare->expired = 0;
+	work->expired_count--;
+}
+
+/** 
+ * \brief load tags of expired pages start from given page in one flash call
+ * \param[in] dev uffs device
+ * \param[in] work block info to be filled with
+ * \param[in] page first page, should be expired
+ * \param[in|out] nfailed failed pages counter
+ * \return number of pages loaded, 0 if flash driver doesn't read tags in bulk,
+ *			less than two expired pages or any page is not read cleanly
+ *			(flash error, flip bits corrected by driver ...), pages should
+ *			be loaded one by one then.
+ */
+static int _LoadExpiredTags(uffs_Device *dev, uffs_BlockInfo *work, int page, int *nfailed)
+{
+	uffs_TagStore ts[BLOCK_TAGS_BATCH];
+	u8 seal[BLOCK_TAGS_BATCH];
+	int i, n, ret;
+
+	if (dev->ops->ReadBlockTags == NULL)
+		return 0;
+
+	for (n = 0; n < BLOCK_TAGS_BATCH && page + n < dev->attr->pages_per_block; n++) {
+		if (work->spares[page + n].expired == 0)
+			break;
+	}
+
+	if (n < 2)
+		return 0;
+
+	ret = uffs_FlashReadBlockTags(dev, work->block, page, n, ts, seal);
+	if (ret != UFFS_FLASH_NO_ERR)
+		return 0;	// result of each page is needed, e.g. UFFS_FLASH_ECC_OK to schedule refresh
+
+	for (i = 0; i < n; i++) {
+		ret = uffs_FlashUnpackTag(dev, work->block, page + i, &ts[i], seal[i],
+									&(work->spares[page + i].tag));
+		_LoadTagResult(dev, work, page + i, ret, nfailed);
+	}
+
+	return n;
+}
+
 /** 
  * \brief load page spare data to given block info structure
  *			with given page number
@@ -216,31 +381,28 @@ static void _MoveBcToTail(uffs_Device *dev, uffs_BlockInfo *bc)
  */
 URET uffs_BlockInfoLoad(uffs_Device *dev, uffs_BlockInfo *work, int page)
 {
-	int i, ret, nfailed;
+	int i, n, ret, nfailed;
 	uffs_PageSpare *spare;
 
 	if (page == UFFS_ALL_PAGES) {
 		nfailed = 0;
-		for (i = 0; i < dev->attr->pages_per_block; i++) {
+#ifdef CONFIG_ENABLE_BLOCK_SUMMARY
+		// load the last page first, other pages may be filled from block summary
+		uffs_BlockInfoLoad(dev, work, dev->attr->pages_per_block - 1);
+#endif
+		for (i = 0; i < dev->attr->pages_per_block; i += n) {
+			n = _LoadExpiredTags(dev, work, i, &nfailed);
+			if (n > 0)
+				continue;
+
+			n = 1;
 			spare = &(work->spares[i]);
 			if (spare->expired == 0)
 				continue;
 
 			ret = uffs_FlashReadPageTag(dev, work->block, i,
 											&(spare->tag));
-
-			uffs_BadBlockAddByFlashResult(dev, work->block, ret);
-
-			if (UFFS_FLASH_HAVE_ERR(ret)) {
-				uffs_Perror(UFFS_MSG_SERIOUS,
-							"load block %d page %d spare fail.",
-							work->block, i);
-				TAG_VALID_BIT(&(spare->tag)) = TAG_INVALID;	
-				nfailed++;	
-			}
-
-			spare->expired = 0;
-			work->expired_count--;
+			_LoadTagResult(dev, work, i, ret, &nfailed);
 		}
 		if (nfailed > 0)
 			return U_FAIL;
@@ -265,11 +427,42 @@ URET uffs_BlockInfoLoad(uffs_Device *dev, uffs_BlockInfo *work, int page)
 			}
 			spare->expired = 0;
 			work->expired_count--;
+
+#ifdef CONFIG_ENABLE_BLOCK_SUMMARY
+			if (page == dev->attr->pages_per_block - 1)
+				_LoadBlockSummary(dev, work);
+#endif
 		}
 	}
 	return U_SUCC;
 }
 
+#ifdef CONFIG_MOUNT_SCAN_THREADS
+/** 
+ * \brief fill block info of given page with a tag already read from flash
+ * \param[in] dev uffs device
+ * \param[in] work given block info to be filled with
+ * \param[in] page page number of the tag
+ * \param[in] tag the tag read from given page without error
+ * \note if the page is not expired, the tag in block info is kept.
+ */
+void uffs_BlockInfoFill(uffs_Device *dev, uffs_BlockInfo *work, int page, const uffs_Tags *tag)
+{
+	uffs_PageSpare *spare = &(work->spares[page]);
+
+	if (spare->expired) {
+		memcpy(&(spare->tag), tag, sizeof(uffs_Tags));
+		spare->expired = 0;
+		work->expired_count--;
+
+#ifdef CONFIG_ENABLE_BLOCK_SUMMARY
+		if (page == dev->attr->pages_per_block - 1)
+			_LoadBlockSummary(dev, work);
+#endif
+	}
+}
+#endif
+
 
 /** 
  * \brief find a block cache with given block number
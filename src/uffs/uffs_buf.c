@@ -44,6 +44,7 @@
 #include "uffs/uffs_pool.h"
 #include "uffs/uffs_ecc.h"
 #include "uffs/uffs_badblock.h"
+#include "uffs/uffs_crc.h"
 #include <string.h>
 
 #define PFX "pbuf: "
@@ -60,7 +61,7 @@ void uffs_BufInspect(uffs_Device *dev)
 {
 	struct uffs_PageBufDescSt *pb = &dev->buf;
 	uffs_Buf *buf;
-	int count = 0, empty_count = 0;
+	int count = 0, empty_count = 0, free_count = 0;
 
 	uffs_PerrorRaw(UFFS_MSG_NORMAL,
 					"------------- page buffer inspect ---------" TENDSTR);
@@ -79,7 +80,10 @@ void uffs_BufInspect(uffs_Device *dev)
 			empty_count++;
 		}
 	}
-	uffs_PerrorRaw(UFFS_MSG_NORMAL, "\ttotal: %d, empty: %d" TENDSTR, count, empty_count);
+	for (buf = pb->free_head; buf; buf = buf->next_free)
+		free_count++;
+	uffs_PerrorRaw(UFFS_MSG_NORMAL, "\ttotal: %d, empty: %d, free: %d" TENDSTR,
+					count, empty_count, free_count);
 	uffs_PerrorRaw(UFFS_MSG_NORMAL,
 					"--------------------------------------------"  TENDSTR);
 }
@@ -168,6 +172,135 @@ static void _MoveNodeToHead(uffs_Device *dev, uffs_Buf *p)
 	_LinkToBufListHead(dev, p);
 }
 
+/**
+ * \brief hash bucket of page buffer
+ * \param[in] parent parent serial num
+ * \param[in] serial serial num
+ * \param[in] page_id page id
+ * \return bucket index, pages of the same block go to consecutive buckets
+ */
+static u32 _BufHash(u16 parent, u16 serial, u16 page_id)
+{
+	u32 h = (((u32)parent << 16) | serial) * 0x9E3779B1;
+
+	return ((h >> 16) + page_id) & (CONFIG_PAGE_BUFFER_HASH_BUCKETS - 1);
+}
+
+/**
+ * \brief take a buf out of its hash bucket, if it's hashed
+ * \param[in] dev uffs device
+ * \param[in] buf buffer to be taken out
+ */
+static void _BreakFromHash(uffs_Device *dev, uffs_Buf *buf)
+{
+	uffs_Buf **p = &dev->buf.hash[_BufHash(buf->parent, buf->serial, buf->page_id)];
+
+	while (*p) {
+		if (*p == buf) {
+			*p = buf->next_hash;
+			break;
+		}
+		p = &(*p)->next_hash;
+	}
+	buf->next_hash = NULL;
+}
+
+/**
+ * \brief set parent/serial/page_id of a buf and rehash it
+ * \param[in] dev uffs device
+ * \param[in] buf buffer in buffer pool list (not a cloned one)
+ */
+static void _SetBufKey(uffs_Device *dev, uffs_Buf *buf,
+						u16 parent, u16 serial, u16 page_id)
+{
+	u32 h;
+
+	_BreakFromHash(dev, buf);
+
+	buf->ext_mark &= ~UFFS_BUF_EXT_MARK_READ_AHEAD;
+	buf->parent = parent;
+	buf->serial = serial;
+	buf->page_id = page_id;
+
+	h = _BufHash(parent, serial, page_id);
+	buf->next_hash = dev->buf.hash[h];
+	dev->buf.hash[h] = buf;
+}
+
+/**
+ * \brief break a buf from free buffer list
+ * \param[in] dev uffs device
+ * \param[in] buf buffer to be broke
+ */
+static void _BreakFromFreeList(uffs_Device *dev, uffs_Buf *buf)
+{
+	if (buf->next_free)
+		buf->next_free->prev_free = buf->prev_free;
+	else
+		dev->buf.free_tail = buf->prev_free;
+
+	if (buf->prev_free)
+		buf->prev_free->next_free = buf->next_free;
+	else
+		dev->buf.free_head = buf->next_free;
+
+	buf->next_free = buf->prev_free = NULL;
+}
+
+static UBOOL _IsBufInFreeList(uffs_Device *dev, uffs_Buf *buf)
+{
+	return (buf->prev_free || dev->buf.free_head == buf) ? U_TRUE : U_FALSE;
+}
+
+/**
+ * \brief put a buf in free buffer list
+ * \param[in] dev uffs device
+ * \param[in] buf buffer to be put
+ * \param[in] reuse_first #U_TRUE: put to tail so that it will be reused first,
+ *				#U_FALSE: put to head as the most recently used one.
+ */
+static void _LinkToFreeList(uffs_Device *dev, uffs_Buf *buf, UBOOL reuse_first)
+{
+	if (reuse_first) {
+		buf->next_free = NULL;
+		buf->prev_free = dev->buf.free_tail;
+		if (dev->buf.free_tail)
+			dev->buf.free_tail->next_free = buf;
+		else
+			dev->buf.free_head = buf;
+		dev->buf.free_tail = buf;
+	}
+	else {
+		buf->prev_free = NULL;
+		buf->next_free = dev->buf.free_head;
+		if (dev->buf.free_head)
+			dev->buf.free_head->prev_free = buf;
+		else
+			dev->buf.free_tail = buf;
+		dev->buf.free_head = buf;
+	}
+}
+
+/**
+ * \brief keep free buffer list in step with buf's ref_count and mark,
+ *		should be called whenever ref_count or mark is changed.
+ *		unreferenced and non-dirty buffers are free to be reused.
+ * \param[in] dev uffs device
+ * \param[in] buf buffer in buffer pool list (not a cloned one)
+ */
+static void _UpdateFreeList(uffs_Device *dev, uffs_Buf *buf)
+{
+	UBOOL in_list = _IsBufInFreeList(dev, buf);
+
+	if (buf->ref_count == 0 && buf->mark != UFFS_BUF_DIRTY) {
+		if (!in_list)
+			_LinkToFreeList(dev, buf, U_FALSE);
+	}
+	else if (in_list) {
+		_BreakFromFreeList(dev, buf);
+	}
+}
+
 
 /**
  * \brief put the buffer in clone buffers list
@@ -213,7 +346,7 @@ URET uffs_BufInit(uffs_Device *dev, int buf_max, int dirty_buf_max)
 	u8 *data;
 	uffs_Buf *buf;
 	int size;
-	int i, slot;
+	int i;
 
 	if (!dev)
 		return U_FAIL;
@@ -229,7 +362,9 @@ URET uffs_BufInit(uffs_Device *dev, int buf_max, int dirty_buf_max)
 		return U_FAIL;
 	}
 	
-	size = (sizeof(uffs_Buf) + dev->com.pg_size) * buf_max;
+	// dirty groups go first, then buffers, then page data
+	size = sizeof(struct uffs_DirtyGroupSt) * dev->cfg.dirty_groups;
+	size += (sizeof(uffs_Buf) + dev->com.pg_size) * buf_max;
 	if (dev->mem.pagebuf_pool_size == 0) {
 		if (dev->mem.malloc) {
 			dev->mem.pagebuf_pool_buf = dev->mem.malloc(dev, size);
@@ -248,6 +383,10 @@ URET uffs_BufInit(uffs_Device *dev, int buf_max, int dirty_buf_max)
 	uffs_Perror(UFFS_MSG_NOISY, "alloc %d bytes.", size);
 	dev->buf.pool = pool;
 
+	dev->buf.dirtyGroup = (struct uffs_DirtyGroupSt *)pool;
+	memset(dev->buf.dirtyGroup, 0, sizeof(struct uffs_DirtyGroupSt) * dev->cfg.dirty_groups);
+	pool = (u8 *)pool + sizeof(struct uffs_DirtyGroupSt) * dev->cfg.dirty_groups;
+
 	for (i = 0; i < buf_max; i++) {
 		buf = (uffs_Buf *)((u8 *)pool + (sizeof(uffs_Buf) * i));
 		memset(buf, 0, sizeof(uffs_Buf));
@@ -277,10 +416,14 @@ URET uffs_BufInit(uffs_Device *dev, int buf_max, int dirty_buf_max)
 	dev->buf.dirty_buf_max = (dirty_buf_max > dev->attr->pages_per_block ?
 								dev->attr->pages_per_block : dirty_buf_max);
 
-	for (slot = 0; slot < dev->cfg.dirty_groups; slot++) {
-		dev->buf.dirtyGroup[slot].dirty = NULL;
-		dev->buf.dirtyGroup[slot].count = 0;
-	}
+	dev->buf.dirty_seq = 0;
+	dev->buf.evict_slot = 0;
+	dev->buf.evict_buf = 0;
+#ifdef CONFIG_ENABLE_BG_FLUSH
+	dev->buf.wb_draining = U_FALSE;
+	dev->buf.wb_expire = 0;
+	dev->buf.wb_water = 0;
+#endif
 
 	// prepare clone buffers
 	dev->buf.clone = NULL;
@@ -290,6 +433,17 @@ URET uffs_BufInit(uffs_Device *dev, int buf_max, int dirty_buf_max)
 		_InsertToCloneBufList(dev, buf);
 	}
 
+	// all the others are free, none of them is hashed yet
+	memset(dev->buf.hash, 0, sizeof(dev->buf.hash));
+	dev->buf.free_head = dev->buf.free_tail = NULL;
+	for (buf = dev->buf.head; buf; buf = buf->next)
+		_LinkToFreeList(dev, buf, U_TRUE);
+
+#ifdef CONFIG_ENABLE_READ_AHEAD
+	dev->buf.ra_pages = 0;
+	dev->buf.ra_hits = 0;
+#endif
+
 	return U_SUCC;
 }
 
@@ -347,7 +501,10 @@ URET uffs_BufReleaseAll(uffs_Device *dev)
 	}
 
 	dev->buf.pool = NULL;
+	dev->buf.dirtyGroup = NULL;
 	dev->buf.head = dev->buf.tail = NULL;
+	dev->buf.free_head = dev->buf.free_tail = NULL;
+	memset(dev->buf.hash, 0, sizeof(dev->buf.hash));
 
 	return U_SUCC;
 }
@@ -376,6 +533,7 @@ static void _LinkToDirtyList(uffs_Device *dev, int slot, uffs_Buf *buf)
 	}
 
 	buf->mark = UFFS_BUF_DIRTY;
+	_UpdateFreeList(dev, buf);
 	buf->prev_dirty = NULL;
 	buf->next_dirty = dev->buf.dirtyGroup[slot].dirty;
 
@@ -388,19 +546,24 @@ static void _LinkToDirtyList(uffs_Device *dev, int slot, uffs_Buf *buf)
 
 static uffs_Buf * _FindFreeBuf(uffs_Device *dev)
 {
-	uffs_Buf *buf;
+	uffs_Buf *buf, *prev;
 
-#if 0
-	buf = dev->buf.head;
+	// take the least recently released one from free list
+	buf = dev->buf.free_tail;
 	while (buf) {
 
-		if (buf->ref_count == 0 && 
+		if (buf->ref_count == 0 &&
 			buf->mark != UFFS_BUF_DIRTY)
 			return buf;
 
-		buf = buf->next;
+		// referenced by uffs_BufIncRef(), drop it from free list
+		prev = buf->prev_free;
+		_BreakFromFreeList(dev, buf);
+		buf = prev;
 	}
-#else
+
+	// buffers released by uffs_BufDecRef() are not in free list,
+	// search the whole buffer list before giving up.
 	buf = dev->buf.tail;
 	while (buf) {
 
@@ -410,7 +573,6 @@ static uffs_Buf * _FindFreeBuf(uffs_Device *dev)
 
 		buf = buf->prev;
 	}
-#endif
 
 	return buf;
 }
@@ -455,9 +617,38 @@ uffs_Buf * uffs_BufFindFrom(uffs_Device *dev, uffs_Buf *start,
 uffs_Buf * uffs_BufFind(uffs_Device *dev,
 						u16 parent, u16 serial, u16 page_id)
 {
-	uffs_Buf *p = dev->buf.head;
+	uffs_Buf *p;
+
+	if (page_id == UFFS_ALL_PAGES)
+		return uffs_BufFindFrom(dev, dev->buf.head, parent, serial, page_id);
 
-	return uffs_BufFindFrom(dev, p, parent, serial, page_id);
+	p = dev->buf.hash[_BufHash(parent, serial, page_id)];
+	while (p) {
+		if (p->parent == parent &&
+			p->serial == serial &&
+			p->page_id == page_id &&
+			p->mark != UFFS_BUF_EMPTY)
+		{
+			return p;
+		}
+		p = p->next_hash;
+	}
+
+	return NULL; //buffer not found
+}
+
+/**
+ * change parent serial num of a buffer
+ * \param[in] dev uffs device
+ * \param[in] buf page buffer
+ * \param[in] parent new parent serial num
+ */
+void uffs_BufSetParent(uffs_Device *dev, uffs_Buf *buf, u16 parent)
+{
+	if (buf->ref_count == CLONE_BUF_MARK)
+		buf->parent = parent;	// cloned buffer is not hashed
+	else
+		_SetBufKey(dev, buf, parent, buf->serial, buf->page_id);
 }
 
 
@@ -577,6 +768,64 @@ uffs_Buf * _FindMinimunPageIdFromDirtyList(uffs_Buf *dirtyList)
 	return buf;
 }
 
+#ifdef CONFIG_ENABLE_BLOCK_SUMMARY
+/** 
+ * \brief write block summary to the last page of a new recovered block
+ * \param[in] dev uffs device
+ * \param[in] bc block info of the new block
+ * \param[in] pages number of pages to be summarized, from page 0
+ * \return flash operation result of writing summary page,
+ *			#UFFS_FLASH_NO_ERR if summary is not written.
+ */
+static int _WriteBlockSummary(uffs_Device *dev, uffs_BlockInfo *bc, u16 pages)
+{
+	u16 lastPage = dev->attr->pages_per_block - 1;
+	struct uffs_BlockSummaryHeadSt head;
+	uffs_TagStore *ts;
+	uffs_Tags *tag;
+	uffs_Buf *buf;
+	int i, ret;
+
+	// summarize only when the last page is not used and summary fits in one page
+	if (pages == 0 || pages >= lastPage ||
+		UFFS_BLOCK_SUMMARY_SIZE(pages) > dev->com.pg_data_size)
+		return UFFS_FLASH_NO_ERR;
+
+	buf = uffs_BufClone(dev, NULL);
+	if (buf == NULL)
+		return UFFS_FLASH_NO_ERR;
+
+	memset(buf->data, 0xFF, dev->com.pg_data_size);
+	ts = (uffs_TagStore *)(buf->data + sizeof(head));
+	for (i = 0; i < pages; i++)
+		memcpy(&ts[i], &(GET_TAG(bc, i)->s), sizeof(uffs_TagStore));
+
+	head.magic = UFFS_BLOCK_SUMMARY_MAGIC;
+	head.pages = pages;
+	head.crc = uffs_crc16sum(ts, sizeof(uffs_TagStore) * pages);
+	head.reserved = 0xFFFF;
+	memcpy(buf->data, &head, sizeof(head));
+
+	buf->data_len = UFFS_BLOCK_SUMMARY_SIZE(pages);
+
+	tag = GET_TAG(bc, lastPage);
+	memcpy(tag, GET_TAG(bc, 0), sizeof(uffs_Tags));
+	TAG_TYPE(tag) = UFFS_TYPE_RESV;
+	TAG_PAGE_ID(tag) = lastPage;
+	TAG_SET_DATA_LEN(tag, buf->data_len);
+
+	ret = uffs_FlashWritePageCombine(dev, bc->block, lastPage, buf, tag);
+	if (UFFS_FLASH_HAVE_ERR(ret))
+		uffs_BlockInfoExpire(dev, bc, lastPage);
+	else
+		TAG_VALID_BIT(tag) = TAG_INVALID;	// summary page is not a data page
+
+	uffs_BufFreeClone(dev, buf);
+
+	return ret;
+}
+#endif
+
 
 /** 
  * \brief flush buffer with block recover
@@ -605,7 +854,7 @@ static URET uffs_BufFlush_Exist_With_BlockRecover(
 	TreeNode *newNode;
 	uffs_BlockInfo *newBc;
 	uffs_Tags *tag, *oldTag;
-	u16 newBlock;
+	UBLOCK newBlock;
 	UBOOL succRecover;			// U_TRUE: recover successful, erase old block,
 								// U_FALSE: fail to recover, erase new block
 	int flash_op_new;			// flash operation (write) result for new block
@@ -661,7 +910,7 @@ retry:
 		TAG_DIRTY_BIT(tag) = TAG_DIRTY;
 		TAG_VALID_BIT(tag) = TAG_VALID;
 		TAG_BLOCK_TS(tag) = timeStamp;
-		TAG_PARENT(tag) = parent;
+		TAG_SET_PARENT(tag, parent);
 		TAG_SERIAL(tag) = serial;
 		TAG_TYPE(tag) = type;
 		TAG_PAGE_ID(tag) = i;	// now, page_id = page.
@@ -673,7 +922,7 @@ retry:
 			if (i == 0)
 				data_sum = _GetDirOrFileNameSum(dev, buf);
 
-			TAG_DATA_LEN(tag) = buf->data_len;
+			TAG_SET_DATA_LEN(tag, buf->data_len);
 
 			if (buf->data_len == 0 || (buf->ext_mark & UFFS_BUF_EXT_MARK_TRUNC_TAIL)) { // this only happen when truncating a file
 
@@ -766,7 +1015,7 @@ retry:
 				// this could be some error on flash ? we can't do more about it for now ...
 			}
 
-			TAG_DATA_LEN(tag) = buf->data_len;
+			TAG_SET_DATA_LEN(tag, buf->data_len);
 
 			if (i == 0)
 				data_sum = _GetDirOrFileNameSum(dev, buf);
@@ -801,6 +1050,11 @@ retry:
 		uffs_BlockInfoExpire(dev, newBc, i);
 	}
 
+#ifdef CONFIG_ENABLE_BLOCK_SUMMARY
+	if (succRecover == U_TRUE && flash_op_new == UFFS_FLASH_NO_ERR)
+		flash_op_new = _WriteBlockSummary(dev, newBc, i);
+#endif
+
 	if (UFFS_FLASH_IS_BAD_BLOCK(flash_op_new)) {
 		// bad block ? mark and retry.
 		uffs_Perror(UFFS_MSG_NORMAL,
@@ -846,6 +1100,7 @@ retry:
 					buf->mark = UFFS_BUF_VALID;
 					buf->ext_mark &= ~UFFS_BUF_EXT_MARK_TRUNC_TAIL;
 					_MoveNodeToHead(dev, buf);
+					_UpdateFreeList(dev, buf);
 				}
 			}
 		}
@@ -855,13 +1110,13 @@ retry:
 		// so that allowing someone hold the node pointer unawared.
 		switch (type) {
 		case UFFS_TYPE_DIR:
-			node->u.dir.parent = parent;
+			uffs_TreeSetNodeParent(dev, type, node, parent);
 			node->u.dir.serial = serial;
 			node->u.dir.block = newBlock;
 			node->u.dir.checksum = data_sum;
 			break;
 		case UFFS_TYPE_FILE:
-			node->u.file.parent = parent;
+			uffs_TreeSetNodeParent(dev, type, node, parent);
 			node->u.file.serial = serial;
 			node->u.file.block = newBlock;
 			node->u.file.checksum = data_sum;
@@ -875,6 +1130,7 @@ retry:
 			uffs_Perror(UFFS_MSG_SERIOUS, "UNKNOW TYPE");
 			break;
 		}
+		uffs_TreeIndexNode(dev, type, node);
 
 		newNode->u.list.block = bc->block;
 
@@ -967,6 +1223,138 @@ ext:
 }
 
 
+#ifdef CONFIG_ENABLE_DIRECT_WRITE
+/** 
+ * \brief write whole pages of a new data block directly from caller's buffer
+ *
+ * Scenario:
+ *		1. get a new block
+ *		2. write pages from caller's buffer to new block, page_id = page
+ *		3. insert new block to tree
+ *
+ * \param[in] dev uffs device
+ * \param[in] parent parent serial num of the data block (file serial)
+ * \param[in] serial serial num of the data block
+ * \param[in] data caller's buffer, pages * dev->com.pg_data_size bytes
+ * \param[in] pages number of pages to be written, from page_id 0
+ *
+ * \return U_SUCC if all pages are written and the block is in the tree,
+ *			U_FAIL if nothing is written, caller should write through
+ *			page buffers instead.
+ *
+ * \note the data block must not exist, and it should have no dirty buffers.
+ */
+URET uffs_BufWriteBlockDirect(struct uffs_DeviceSt *dev,
+							  u16 parent, u16 serial, const u8 *data, int pages)
+{
+	TreeNode *node;
+	uffs_BlockInfo *bc;
+	uffs_Buf *buf;
+	uffs_Tags *tag;
+	UBLOCK block;
+	u8 timeStamp;
+	u16 page;
+	int ret = UFFS_FLASH_NO_ERR;
+
+	if (!uffs_FlashCanWriteDirect(dev) || pages <= 0 ||
+		pages > dev->attr->pages_per_block)
+		return U_FAIL;
+
+	// cached buffers of these pages are stale, they must be discarded.
+	for (page = 0; page < pages; page++) {
+		buf = uffs_BufFind(dev, parent, serial, page);
+		if (buf && (buf->ref_count > 0 || buf->mark == UFFS_BUF_DIRTY))
+			return U_FAIL;
+	}
+
+retry:
+	node = uffs_TreeGetErasedNode(dev);
+	if (node == NULL) {
+		uffs_Perror(UFFS_MSG_NOISY, "no erased block!");
+		return U_FAIL;
+	}
+	block = node->u.list.block;
+	bc = uffs_BlockInfoGet(dev, block);
+	if (bc == NULL) {
+		uffs_Perror(UFFS_MSG_SERIOUS, "get block info fail!");
+		uffs_InsertToErasedListHead(dev, node); //put node back to erased list
+		return U_FAIL;
+	}
+
+	uffs_BlockInfoLoad(dev, bc, UFFS_ALL_PAGES);
+	timeStamp = uffs_GetNextBlockTimeStamp(uffs_GetBlockTimeStamp(dev, bc));
+
+	for (page = 0; page < pages; page++) {
+		tag = GET_TAG(bc, page);
+		TAG_DIRTY_BIT(tag) = TAG_DIRTY;
+		TAG_VALID_BIT(tag) = TAG_VALID;
+		TAG_BLOCK_TS(tag) = timeStamp;
+		TAG_SET_DATA_LEN(tag, dev->com.pg_data_size);
+		TAG_TYPE(tag) = UFFS_TYPE_DATA;
+		TAG_SET_PARENT(tag, parent);
+		TAG_SERIAL(tag) = serial;
+		TAG_PAGE_ID(tag) = page;	// page_id = page.
+
+		SEAL_TAG(tag);
+
+		ret = uffs_FlashWritePageData(dev, block, page,
+						data + page * dev->com.pg_data_size, tag);
+		if (UFFS_FLASH_HAVE_ERR(ret) || UFFS_FLASH_IS_BAD_BLOCK(ret))
+			break;
+
+#ifdef CONFIG_UFFS_REFRESH_BLOCK
+		if (ret == UFFS_FLASH_ECC_OK)
+			break;
+#endif
+		dev->st.page_direct_write_count++;
+	}
+
+	if (page < pages) {
+		// expire last page info cache in case the 'tag' is not written.
+		uffs_BlockInfoExpire(dev, bc, page);
+	}
+#ifdef CONFIG_ENABLE_BLOCK_SUMMARY
+	else {
+		ret = _WriteBlockSummary(dev, bc, pages);
+	}
+#endif
+
+	if (UFFS_FLASH_IS_BAD_BLOCK(ret)) {
+		// bad block ? mark and retry.
+		uffs_Perror(UFFS_MSG_NORMAL, "new bad block %d discovered.", block);
+		uffs_BadBlockProcessNode(dev, node);	// erase, mark 'bad' and put in bad block list
+		uffs_BlockInfoPut(dev, bc);
+		goto retry;
+	}
+
+	if (UFFS_FLASH_HAVE_ERR(ret) || page < pages) {
+		// other error or refresh needed ? give the block back, let caller write it through buffers.
+		uffs_Perror(UFFS_MSG_NORMAL, "write block %d page %d directly fail (%d)", block, page, ret);
+		uffs_BlockInfoExpire(dev, bc, UFFS_ALL_PAGES);
+		uffs_BlockInfoPut(dev, bc);
+		uffs_TreeEraseNode(dev, node);
+		uffs_TreeInsertToErasedListTail(dev, node);
+		return U_FAIL;
+	}
+
+	uffs_BlockInfoPut(dev, bc);
+
+	node->u.data.parent = parent;
+	node->u.data.serial = serial;
+	node->u.data.block = block;
+	uffs_TreeIndexNode(dev, UFFS_TYPE_DATA, node);
+	uffs_InsertNodeToTree(dev, UFFS_TYPE_DATA, node);
+
+	for (page = 0; page < pages; page++) {
+		buf = uffs_BufFind(dev, parent, serial, page);
+		if (buf)
+			uffs_BufMarkEmpty(dev, buf);
+	}
+
+	return U_SUCC;
+}
+#endif
+
 /** 
  * \brief flush buffer to a block with enough free pages 
  *  
@@ -1017,9 +1405,9 @@ URET
 		TAG_DIRTY_BIT(tag) = TAG_DIRTY;
 		TAG_VALID_BIT(tag) = TAG_VALID;
 		TAG_BLOCK_TS(tag) = uffs_GetBlockTimeStamp(dev, bc);
-		TAG_DATA_LEN(tag) = buf->data_len;
+		TAG_SET_DATA_LEN(tag, buf->data_len);
 		TAG_TYPE(tag) = buf->type;
-		TAG_PARENT(tag) = buf->parent;
+		TAG_SET_PARENT(tag, buf->parent);
 		TAG_SERIAL(tag) = buf->serial;
 		TAG_PAGE_ID(tag) = buf->page_id;
 
@@ -1030,16 +1418,22 @@ URET
 			uffs_Perror(UFFS_MSG_NORMAL, "I/O error <1>?");
 			goto ext;
 		}
-		else if (x == UFFS_FLASH_BAD_BLK) {
-			uffs_Perror(UFFS_MSG_NORMAL, "Bad blcok found, start block recover ...");
+		else if (UFFS_FLASH_HAVE_ERR(x)) {
+			// bad block, or write verify failed (e.g. ECC failed when read back tag),
+			// the page may not hold the data: write all pages to a new block.
+			uffs_Perror(UFFS_MSG_NORMAL,
+						"Write block %d page %d fail (%d), start block recover ...",
+						bc->block, page, x);
 
-			ret = uffs_BufFlush_Exist_With_BlockRecover(dev, slot, node, bc, U_TRUE);
+			ret = uffs_BufFlush_Exist_With_BlockRecover(dev, slot, node, bc,
+						UFFS_FLASH_IS_BAD_BLOCK(x) ? U_TRUE : U_FALSE);
 			goto ext;
 		}
 		else {
 			if(_BreakFromDirty(dev, buf) == U_SUCC) {
 				buf->mark = UFFS_BUF_VALID;
 				_MoveNodeToHead(dev, buf);
+				_UpdateFreeList(dev, buf);
 			}
 		}
 	} //end of for
@@ -1142,18 +1536,92 @@ URET _BufFlush(struct uffs_DeviceSt *dev,
 	return ret;
 }
 
-static int _FindMostDirtyGroup(struct uffs_DeviceSt *dev)
+/**
+ * estimate flash page programs of flushing a dirty group now,
+ * use cached block info only, no flash I/O.
+ */
+static int _GetGroupFlushCost(struct uffs_DeviceSt *dev, int slot)
 {
+	struct uffs_DirtyGroupSt *group = &(dev->buf.dirtyGroup[slot]);
+	uffs_Buf *dirty = group->dirty;
+	TreeNode *node;
+	uffs_BlockInfo *bc;
+	int block;
+	int cost = group->count;
+
+	switch (dirty->type) {
+	case UFFS_TYPE_DIR:
+		node = uffs_TreeFindDirNode(dev, dirty->serial);
+		block = (node ? node->u.dir.block : 0);
+		break;
+	case UFFS_TYPE_FILE:
+		node = uffs_TreeFindFileNode(dev, dirty->serial);
+		block = (node ? node->u.file.block : 0);
+		break;
+	case UFFS_TYPE_DATA:
+		node = uffs_TreeFindDataNode(dev, dirty->parent, dirty->serial);
+		block = (node ? node->u.data.block : 0);
+		break;
+	default:
+		return cost;
+	}
+
+	if (node == NULL)
+		return cost;	// new block, dirty pages only
+
+	bc = uffs_BlockInfoFindInCache(dev, block);
+	if (bc == NULL)
+		return cost;	// unknown, assume free pages are enough
+
+	if (bc->expired_count == 0 && uffs_GetFreePagesCount(dev, bc) < group->count) {
+		// block recover: all pages of the block are written to a new block
+		cost = dev->attr->pages_per_block;
+	}
+	uffs_BlockInfoPut(dev, bc);
+
+	return cost;
+}
+
+/**
+ * pick up a dirty group to be flushed when running out of
+ * dirty group slots or page buffers.
+ *
+ * groups not written for a long time, with more dirty pages and less
+ * flush cost are prefered. partially filled pages are likely to be written
+ * again, flushing them now costs one more page program later.
+ *
+ * \return slot of the victim group, -1 if no group can be flushed.
+ */
+static int _FindVictimGroup(struct uffs_DeviceSt *dev)
+{
+	struct uffs_DirtyGroupSt *group;
+	uffs_Buf *buf;
 	int i, slot = -1;
-	int max_count = 0;
+	int partial;
+	u32 age, score, max_score = 0;
 
 	for (i = 0; i < dev->cfg.dirty_groups; i++) {
-		if (dev->buf.dirtyGroup[i].dirty &&
-				dev->buf.dirtyGroup[i].lock == 0) {
-			if (dev->buf.dirtyGroup[i].count > max_count) {
-				max_count = dev->buf.dirtyGroup[i].count;
-				slot = i;
-			}
+		group = &(dev->buf.dirtyGroup[i]);
+		if (group->dirty == NULL || group->count == 0 || group->lock != 0)
+			continue;
+
+		partial = 0;
+		for (buf = group->dirty; buf; buf = buf->next_dirty) {
+			if (buf->data_len < dev->com.pg_data_size &&
+				(buf->type == UFFS_TYPE_DATA || buf->page_id > 0))
+				partial++;
+		}
+
+		age = dev->buf.dirty_seq - group->stamp;
+		if (age > 0xFFFF)
+			age = 0xFFFF;
+
+		score = (age + 1) * group->count * 16 /
+					(_GetGroupFlushCost(dev, i) + partial);
+
+		if (slot < 0 || score > max_score) {
+			max_score = score;
+			slot = i;
 		}
 	}
 
@@ -1188,6 +1656,23 @@ URET uffs_BufUnLockGroup(struct uffs_DeviceSt *dev, int slot)
 }
 
 
+/**
+ * flush the victim group picked by _FindVictimGroup()
+ * \param[in] dev uffs device
+ * \param[out] counter forced eviction counter to be increased
+ */
+static URET _EvictGroup(struct uffs_DeviceSt *dev, u32 *counter)
+{
+	int slot;
+
+	slot = _FindVictimGroup(dev);
+	if (slot >= 0) {
+		(*counter)++;
+		return _BufFlush(dev, U_FALSE, slot);
+	}
+	return U_SUCC;
+}
+
 /** 
  * flush buffers to flash.
  * this will flush all dirty groups.
@@ -1201,27 +1686,21 @@ URET uffs_BufFlush(struct uffs_DeviceSt *dev)
 	if (slot >= 0)
 		return U_SUCC;	// do nothing if there is free slot
 	else
-		return uffs_BufFlushMostDirtyGroup(dev);
+		return _EvictGroup(dev, &(dev->buf.evict_slot));
 }
 
 /** 
- * flush most dirty group
+ * flush a dirty group to free page buffers
  * \param[in] dev uffs device
  */
 URET uffs_BufFlushMostDirtyGroup(struct uffs_DeviceSt *dev)
 {
-	int slot;
-
-	slot = _FindMostDirtyGroup(dev);
-	if (slot >= 0) {
-		return _BufFlush(dev, U_FALSE, slot);
-	}
-	return U_SUCC;
+	return _EvictGroup(dev, &(dev->buf.evict_buf));
 }
 
 /** 
  * flush buffers to flash
- * this will pick up a most dirty group,
+ * this will pick up a victim group (see _FindVictimGroup()),
  * and flush it if there is no free dirty group slot.
  *
  * \param[in] dev uffs device
@@ -1237,7 +1716,7 @@ URET uffs_BufFlushEx(struct uffs_DeviceSt *dev, UBOOL force_block_recover)
 		return U_SUCC;  //there is free slot, do nothing.
 	}
 	else {
-		slot = _FindMostDirtyGroup(dev);
+		slot = _FindVictimGroup(dev);
 		return _BufFlush(dev, force_block_recover, slot);
 	}
 }
@@ -1284,6 +1763,66 @@ URET uffs_BufFlushGroupEx(struct uffs_DeviceSt *dev,
 }
 
 
+#ifdef CONFIG_ENABLE_BG_FLUSH
+/**
+ * write back one dirty group in the background.
+ *
+ * when dirty page buffers go above dev->cfg.flush_high_water, groups picked
+ * by _FindVictimGroup() are flushed, one for each call, until dirty page
+ * buffers are down to dev->cfg.flush_low_water. Otherwise the oldest group
+ * which has been dirty longer than dev->cfg.flush_expire_ms is flushed.
+ *
+ * \param[in] dev uffs device
+ * \return 1 if a group is flushed, 0 if nothing to flush, -1 if flush failed.
+ */
+int uffs_BufFlushStep(struct uffs_DeviceSt *dev)
+{
+	struct uffs_DirtyGroupSt *group;
+	int i, slot = -1;
+	int dirty = 0;
+	u32 now, age, max_age = 0;
+	u32 *counter = NULL;
+
+	for (i = 0; i < dev->cfg.dirty_groups; i++)
+		dirty += dev->buf.dirtyGroup[i].count;
+
+	if (dev->cfg.flush_high_water > 0) {
+		if (dirty > dev->cfg.flush_high_water)
+			dev->buf.wb_draining = U_TRUE;
+		else if (dirty <= dev->cfg.flush_low_water)
+			dev->buf.wb_draining = U_FALSE;
+
+		if (dev->buf.wb_draining) {
+			slot = _FindVictimGroup(dev);
+			counter = &(dev->buf.wb_water);
+		}
+	}
+
+	if (slot < 0 && dev->cfg.flush_expire_ms > 0 && dirty > 0) {
+		now = uffs_GetTickMs();
+		for (i = 0; i < dev->cfg.dirty_groups; i++) {
+			group = &(dev->buf.dirtyGroup[i]);
+			if (group->dirty == NULL || group->count == 0 || group->lock != 0)
+				continue;
+
+			age = now - group->dirty_time;
+			if (age >= (u32)dev->cfg.flush_expire_ms && (slot < 0 || age > max_age)) {
+				max_age = age;
+				slot = i;
+			}
+		}
+		counter = &(dev->buf.wb_expire);
+	}
+
+	if (slot < 0)
+		return 0;
+
+	(*counter)++;
+
+	return _BufFlush(dev, U_FALSE, slot) == U_SUCC ? 1 : -1;
+}
+#endif
+
 /**
  * flush buffer group/groups which match given parent num.
  *
@@ -1356,6 +1895,38 @@ int uffs_BufFindGroupSlot(struct uffs_DeviceSt *dev, u16 parent, u16 serial)
 	return slot;
 }
 
+/**
+ * \brief get parent, serial and block num of a tree node
+ * \param[in] type dir, file or data ?
+ * \param[in] node node on the tree
+ * \return U_FAIL if type is unknown
+ */
+static URET _GetNodeKey(u8 type, TreeNode *node,
+						u16 *parent, u16 *serial, UBLOCK *block)
+{
+	switch (type) {
+	case UFFS_TYPE_DIR:
+		*parent = node->u.dir.parent;
+		*serial = node->u.dir.serial;
+		*block = node->u.dir.block;
+		break;
+	case UFFS_TYPE_FILE:
+		*parent = node->u.file.parent;
+		*serial = node->u.file.serial;
+		*block = node->u.file.block;
+		break;
+	case UFFS_TYPE_DATA:
+		*parent = node->u.data.parent;
+		*serial = node->u.data.serial;
+		*block = node->u.data.block;
+		break;
+	default:
+		return U_FAIL;
+	}
+
+	return U_SUCC;
+}
+
 /** 
  * \brief get a page buffer
  * \param[in] dev uffs device
@@ -1374,6 +1945,7 @@ uffs_Buf * uffs_BufGet(struct uffs_DeviceSt *dev,
 
 	if (p) {
 		p->ref_count++;
+		_UpdateFreeList(dev, p);
 		_MoveNodeToHead(dev, p);
 	}
 
@@ -1414,11 +1986,10 @@ uffs_Buf *uffs_BufNew(struct uffs_DeviceSt *dev,
 
 	buf->mark = UFFS_BUF_EMPTY;
 	buf->type = type;
-	buf->parent = parent;
-	buf->serial = serial;
-	buf->page_id = page_id;
+	_SetBufKey(dev, buf, parent, serial, page_id);
 	buf->data_len = 0;
 	buf->ref_count++;
+	_UpdateFreeList(dev, buf);
 	memset(buf->data, 0xff, dev->com.pg_data_size);
 
 	_MoveNodeToHead(dev, buf);
@@ -1443,34 +2014,26 @@ uffs_Buf *uffs_BufGetEx(struct uffs_DeviceSt *dev,
 						u8 type, TreeNode *node, u16 page_id, int oflag)
 {
 	uffs_Buf *buf;
-	u16 parent, serial, block, page;
+	u16 parent, serial, page;
+	UBLOCK block;
 	uffs_BlockInfo *bc;
 	int ret, pending_type;
 
-	switch (type) {
-	case UFFS_TYPE_DIR:
-		parent = node->u.dir.parent;
-		serial = node->u.dir.serial;
-		block = node->u.dir.block;
-		break;
-	case UFFS_TYPE_FILE:
-		parent = node->u.file.parent;
-		serial = node->u.file.serial;
-		block = node->u.file.block;
-		break;
-	case UFFS_TYPE_DATA:
-		parent = node->u.data.parent;
-		serial = node->u.data.serial;
-		block = node->u.data.block;
-		break;
-	default:
+	if (_GetNodeKey(type, node, &parent, &serial, &block) != U_SUCC) {
 		uffs_Perror(UFFS_MSG_SERIOUS, "unknown type");
 		return NULL;
 	}
 
 	buf = uffs_BufFind(dev, parent, serial, page_id);
 	if (buf) {
+#ifdef CONFIG_ENABLE_READ_AHEAD
+		if (buf->ext_mark & UFFS_BUF_EXT_MARK_READ_AHEAD) {
+			buf->ext_mark &= ~UFFS_BUF_EXT_MARK_READ_AHEAD;
+			dev->buf.ra_hits++;
+		}
+#endif
 		buf->ref_count++;
+		_UpdateFreeList(dev, buf);
 		return buf;
 	}
 
@@ -1487,20 +2050,7 @@ uffs_Buf *uffs_BufGetEx(struct uffs_DeviceSt *dev,
 		 *	the block will be changed to a new one! (and the content of 'node' is changed).
 		 *	So here we need to update block number from the new 'node'.
 		 */
-		switch (type) {
-		case UFFS_TYPE_DIR:
-			block = node->u.dir.block;
-			break;
-		case UFFS_TYPE_FILE:
-			block = node->u.file.block;
-			break;
-		case UFFS_TYPE_DATA:
-			block = node->u.data.block;
-			break;
-		default:
-			uffs_Perror(UFFS_MSG_SERIOUS, "unknown type");
-			return NULL;
-		}
+		_GetNodeKey(type, node, &parent, &serial, &block);
 	}
 
 	bc = uffs_BlockInfoGet(dev, block);
@@ -1523,9 +2073,7 @@ uffs_Buf *uffs_BufGetEx(struct uffs_DeviceSt *dev,
 
 	buf->mark = UFFS_BUF_EMPTY;
 	buf->type = type;
-	buf->parent = parent;
-	buf->serial = serial;
-	buf->page_id = page_id;
+	_SetBufKey(dev, buf, parent, serial, page_id);
 
 	ret = uffs_FlashReadPage(dev, block, page, buf, oflag & UO_NOECC ? U_TRUE : U_FALSE);
 
@@ -1546,6 +2094,7 @@ uffs_Buf *uffs_BufGetEx(struct uffs_DeviceSt *dev,
 	buf->data_len = TAG_DATA_LEN(GET_TAG(bc, page));
 	buf->mark = UFFS_BUF_VALID;
 	buf->ref_count++;
+	_UpdateFreeList(dev, buf);
 
 	_MoveNodeToHead(dev, buf);
 	
@@ -1553,6 +2102,98 @@ uffs_Buf *uffs_BufGetEx(struct uffs_DeviceSt *dev,
 
 }
 
+#ifdef CONFIG_ENABLE_READ_AHEAD
+/**
+ * load pages from <page_id> of the block into free page buffers,
+ * stop at the first page which is already in buffers, not written yet
+ * or can't be read.
+ * it never flushes dirty buffers, and never takes a buffer which is
+ * loaded by read ahead but not used yet.
+ *
+ * \param[in] dev uffs device
+ * \param[in] type dir, file or data ?
+ * \param[in] node node on the tree
+ * \param[in] page_id the first page_id to be loaded
+ * \param[in] count maximum pages to be loaded
+ * \param[in] oflag the open flag of current file/dir object
+ * \return number of pages loaded
+ */
+int uffs_BufReadAhead(struct uffs_DeviceSt *dev,
+						u8 type, TreeNode *node, u16 page_id, int count, int oflag)
+{
+	uffs_Buf *buf;
+	u16 parent, serial, page;
+	UBLOCK block;
+	uffs_BlockInfo *bc;
+	int ret, n = 0;
+
+	if (_GetNodeKey(type, node, &parent, &serial, &block) != U_SUCC)
+		return 0;
+
+	if (uffs_BufFind(dev, parent, serial, page_id))
+		return 0;	// not a miss, no need to read ahead
+
+	bc = uffs_BlockInfoGet(dev, block);
+	if (bc == NULL)
+		return 0;
+
+	for (; n < count && page_id < dev->attr->pages_per_block; n++, page_id++) {
+		if (n > 0 && uffs_BufFind(dev, parent, serial, page_id))
+			break;
+
+		buf = _FindFreeBuf(dev);
+		if (buf == NULL || (buf->ext_mark & UFFS_BUF_EXT_MARK_READ_AHEAD))
+			break;
+
+		page = uffs_FindPageInBlockWithPageId(dev, bc, page_id);
+		if (page == UFFS_INVALID_PAGE)
+			break;
+		page = uffs_FindBestPageInBlock(dev, bc, page);
+		if (page == UFFS_INVALID_PAGE)
+			break;
+
+		buf->mark = UFFS_BUF_EMPTY;
+		buf->type = type;
+		_SetBufKey(dev, buf, parent, serial, page_id);
+
+		ret = uffs_FlashReadPage(dev, block, page, buf, oflag & UO_NOECC ? U_TRUE : U_FALSE);
+		if (uffs_BadBlockAddByFlashResult(dev, block, ret) != UFFS_PENDING_BLK_NONE ||
+			UFFS_FLASH_HAVE_ERR(ret)) {
+			// leave it to uffs_BufGetEx() when the page is really needed
+			break;
+		}
+
+		buf->data_len = TAG_DATA_LEN(GET_TAG(bc, page));
+		buf->mark = UFFS_BUF_VALID;
+		buf->ext_mark |= UFFS_BUF_EXT_MARK_READ_AHEAD;
+		_MoveNodeToHead(dev, buf);
+		if (_IsBufInFreeList(dev, buf))
+			_BreakFromFreeList(dev, buf);
+		_LinkToFreeList(dev, buf, U_FALSE);
+		dev->buf.ra_pages++;
+	}
+
+	uffs_BlockInfoPut(dev, bc);
+
+	return n;
+}
+
+/**
+ * \brief let an unreferenced clean buffer be reused before others,
+ *		e.g. the page is consumed by sequential reading and unlikely
+ *		to be read again soon.
+ * \param[in] dev uffs device
+ * \param[in] buf page buffer
+ */
+void uffs_BufDropBehind(struct uffs_DeviceSt *dev, uffs_Buf *buf)
+{
+	if (_IsBufInFreeList(dev, buf)) {
+		_BreakFromFreeList(dev, buf);
+		_LinkToFreeList(dev, buf, U_TRUE);
+	}
+}
+#endif
+
 /** 
  * \brief Put back a page buffer, make reference count decrease by one
  * \param[in] dev uffs device
@@ -1574,6 +2215,7 @@ URET uffs_BufPut(uffs_Device *dev, uffs_Buf *buf)
 	}
 	else {
 		buf->ref_count--;
+		_UpdateFreeList(dev, buf);
 		ret = U_SUCC;
 	}
 
@@ -1679,8 +2321,11 @@ URET uffs_BufSetAllEmpty(struct uffs_DeviceSt *dev)
 {
 	uffs_Buf *buf = dev->buf.head;
 
+	memset(dev->buf.hash, 0, sizeof(dev->buf.hash));
 	while (buf) {
 		buf->mark = UFFS_BUF_EMPTY;
+		buf->next_hash = NULL;
+		_UpdateFreeList(dev, buf);
 		buf = buf->next;
 	}
 	return U_SUCC;
@@ -1707,6 +2352,11 @@ void uffs_BufMarkEmpty(uffs_Device *dev, uffs_Buf *buf)
 			if (buf->mark == UFFS_BUF_DIRTY)
 				_BreakFromDirty(dev, buf);
 			buf->mark = UFFS_BUF_EMPTY;
+
+			// nothing worth to keep, reuse it first
+			if (_IsBufInFreeList(dev, buf))
+				_BreakFromFreeList(dev, buf);
+			_LinkToFreeList(dev, buf, U_TRUE);
 		}
 	}
 }
@@ -1743,7 +2393,7 @@ URET uffs_BufWrite(struct uffs_DeviceSt *dev,
 		slot = uffs_BufFindFreeGroupSlot(dev);
 		if (slot < 0) {
 			// no free slot ? flush buffer
-			if (uffs_BufFlushMostDirtyGroup(dev) != U_SUCC)
+			if (_EvictGroup(dev, &(dev->buf.evict_slot)) != U_SUCC)
 				return U_FAIL;
 
 			slot = uffs_BufFindFreeGroupSlot(dev);
@@ -1764,8 +2414,13 @@ URET uffs_BufWrite(struct uffs_DeviceSt *dev,
 		buf->data_len = ofs + len;
 	
 	if (_IsBufInInDirtyList(dev, slot, buf) == U_FALSE) {
+#ifdef CONFIG_ENABLE_BG_FLUSH
+		if (dev->buf.dirtyGroup[slot].dirty == NULL)
+			dev->buf.dirtyGroup[slot].dirty_time = uffs_GetTickMs();
+#endif
 		_LinkToDirtyList(dev, slot, buf);
 	}
+	dev->buf.dirtyGroup[slot].stamp = ++dev->buf.dirty_seq;
 
 	if (dev->buf.dirtyGroup[slot].count >= dev->buf.dirty_buf_max) {
 		if (uffs_BufFlushGroup(dev, buf->parent, buf->serial) != U_SUCC) {
@@ -0,0 +1,681 @@
+/*
+  This file is part of UFFS, the Ultra-low-cost Flash File System.
+  
+  Copyright (C) 2005-2009 Ricky Zheng <ricky_gz_zheng@yahoo.co.nz>
+
+  UFFS is free software; you can redistribute it and/or modify it under
+  the GNU Library General Public License as published by the Free Software 
+  Foundation; either version 2 of the License, or (at your option) any
+  later version.
+
+  UFFS is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+  or GNU Library General Public License, as applicable, for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  and GNU Library General Public License along with UFFS; if not, write
+  to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA  02110-1301, USA.
+
+  As a special exception, if other files instantiate templates or use
+  macros or inline functions from this file, or you compile this file
+  and link it with other works to produce a work based on this file,
+  this file does not by itself cause the resulting work to be covered
+  by the GNU General Public License. However the source code for this
+  file must still be made available in accordance with section (3) of
+  the GNU General Public License v2.
+ 
+  This exception does not invalidate any other reasons why a work based
+  on this file might be covered by the GNU General Public License.
+*/
+
+/**
+ * \file uffs_checkpoint.c
+ * \brief save the tree to reserved blocks and load it back when mount,
+ *        so that mount don't need to scan every block.
+ * \author Ricky Zheng
+ */
+
+#include "uffs_config.h"
+#include "uffs/uffs_public.h"
+#include "uffs/uffs_tree.h"
+#include "uffs/uffs_flash.h"
+#include "uffs/uffs_badblock.h"
+#include "uffs/uffs_checkpoint.h"
+#include "uffs/uffs_crc.h"
+#include <string.h>
+
+#ifdef CONFIG_ENABLE_TREE_CHECKPOINT
+
+#define PFX "ckpt: "
+
+#define TPOOL(dev) &((dev)->mem.tree_pool)
+
+#define CHECKPOINT_MAGIC		0x504b4355		//!< "UCKP"
+#ifdef CONFIG_ENABLE_WIDE_BLOCK
+#define CHECKPOINT_VERSION		2		//!< 32 bit block numbers and counts
+#else
+#define CHECKPOINT_VERSION		1
+#endif
+
+/**
+ * checkpoint layout (byte stream over the pages of checkpoint blocks):
+ *	[header] + [DIR records] + [FILE records] + [DATA records]
+ *		+ [erased block records] + [bad block records] + [tail]
+ */
+struct uffs_CheckpointHeaderSt {
+	u32 magic;
+	u16 version;
+	UBLOCK par_start;
+	UBLOCK par_end;
+	UBLOCK dir_count;
+	UBLOCK file_count;
+	UBLOCK data_count;
+	UBLOCK erased_count;
+	UBLOCK bad_count;
+};
+
+struct uffs_CheckpointRecSt {	/* 12 bytes, 16 bytes with CONFIG_ENABLE_WIDE_BLOCK */
+	UBLOCK block;
+	u16 parent;
+	u16 serial;
+	u16 sum;		/* name checksum for DIR/FILE, need_check for erased block */
+	u32 len;		/* file length for FILE, data length for DATA */
+};
+
+struct uffs_CheckpointTailSt {
+	u32 magic;
+	u16 crc;		/* CRC16 of header and records */
+};
+
+struct CheckpointStreamSt {
+	uffs_Device *dev;
+	uffs_Buf *buf;
+	int block;		//!< current block, -1 if not started
+	int page;		//!< current page of block
+	int pos;		//!< read/write position of page data
+	int len;		//!< data length of current page (reading)
+	u16 seq;		//!< page sequence number, saved in tag serial
+	u16 crc;		//!< CRC16 of data stream
+};
+
+/* return next good block reserved for checkpoint, -1 if no more */
+static int _NextBlock(uffs_Device *dev, int block)
+{
+	block = (block < 0 ? dev->ckpt.start : block + 1);
+
+	for (; block < dev->ckpt.start + dev->ckpt.blocks; block++) {
+		if (uffs_FlashIsBadBlock(dev, block) == U_FALSE)
+			return block;
+	}
+
+	return -1;
+}
+
+static URET _EraseBlock(uffs_Device *dev, int block)
+{
+	int ret;
+
+	ret = uffs_FlashEraseBlock(dev, block);
+	if (UFFS_FLASH_IS_BAD_BLOCK(ret)) {
+		// checkpoint block is not in the tree, just mark it 'bad'.
+		uffs_FlashMarkBadBlock(dev, block);
+		return U_FAIL;
+	}
+
+	return UFFS_FLASH_HAVE_ERR(ret) ? U_FAIL : U_SUCC;
+}
+
+/* erase checkpoint blocks which are not clean */
+static void _EraseUsedBlocks(uffs_Device *dev)
+{
+	int block;
+	uffs_Tags tag;
+	int ret;
+
+	for (block = _NextBlock(dev, -1); block >= 0; block = _NextBlock(dev, block)) {
+		ret = uffs_FlashReadPageTag(dev, block, 0, &tag);
+		if (UFFS_FLASH_HAVE_ERR(ret) || TAG_IS_DIRTY(&tag))
+			_EraseBlock(dev, block);
+	}
+}
+
+/* move stream to next page, erase the block when step into a new block for writing */
+static URET _StreamNextPage(struct CheckpointStreamSt *s, UBOOL write)
+{
+	uffs_Device *dev = s->dev;
+
+	if (s->block >= 0 && s->page + 1 < dev->attr->pages_per_block) {
+		s->page++;
+		return U_SUCC;
+	}
+
+	s->page = 0;
+	do {
+		s->block = _NextBlock(dev, s->block);
+		if (s->block < 0) {
+			uffs_Perror(UFFS_MSG_NORMAL, "run out of checkpoint blocks");
+			return U_FAIL;
+		}
+	} while (write && _EraseBlock(dev, s->block) != U_SUCC);
+
+	return U_SUCC;
+}
+
+static URET _StreamFlushPage(struct CheckpointStreamSt *s)
+{
+	uffs_Device *dev = s->dev;
+	uffs_Tags tag;
+	int ret;
+
+	if (s->pos == 0)
+		return U_SUCC;
+
+	if (_StreamNextPage(s, U_TRUE) != U_SUCC)
+		return U_FAIL;
+
+	memset(&tag, 0xFF, sizeof(tag));
+	TAG_BLOCK_TS(&tag) = 0;
+	TAG_TYPE(&tag) = UFFS_TYPE_RESV;
+	TAG_SET_PARENT(&tag, 0);
+	TAG_SERIAL(&tag) = s->seq & MAX_UFFS_FDN;
+	TAG_PAGE_ID(&tag) = s->page;
+	TAG_SET_DATA_LEN(&tag, s->pos);
+
+	ret = uffs_FlashWritePageCombine(dev, s->block, s->page, s->buf, &tag);
+	if (UFFS_FLASH_HAVE_ERR(ret)) {
+		uffs_Perror(UFFS_MSG_NORMAL,
+					"write checkpoint block %d page %d fail, error = %d",
+					s->block, s->page, ret);
+		return U_FAIL;
+	}
+
+	s->seq++;
+	s->pos = 0;
+	memset(s->buf->data, 0xFF, dev->com.pg_data_size);
+
+	return U_SUCC;
+}
+
+static URET _StreamWrite(struct CheckpointStreamSt *s, const void *data, int len)
+{
+	const u8 *p = (const u8 *)data;
+	int size;
+
+	s->crc = uffs_crc16update(data, len, s->crc);
+
+	while (len > 0) {
+		size = s->dev->com.pg_data_size - s->pos;
+		size = (len < size ? len : size);
+		memcpy(s->buf->data + s->pos, p, size);
+		s->pos += size;
+		p += size;
+		len -= size;
+
+		if (s->pos == s->dev->com.pg_data_size) {
+			if (_StreamFlushPage(s) != U_SUCC)
+				return U_FAIL;
+		}
+	}
+
+	return U_SUCC;
+}
+
+static URET _StreamLoadPage(struct CheckpointStreamSt *s)
+{
+	uffs_Device *dev = s->dev;
+	uffs_Tags tag;
+	int ret;
+
+	if (_StreamNextPage(s, U_FALSE) != U_SUCC)
+		return U_FAIL;
+
+	ret = uffs_FlashReadPageTag(dev, s->block, s->page, &tag);
+	if (UFFS_FLASH_HAVE_ERR(ret))
+		return U_FAIL;
+
+	if (!TAG_IS_GOOD(&tag) ||
+		TAG_TYPE(&tag) != UFFS_TYPE_RESV ||
+		TAG_SERIAL(&tag) != (s->seq & MAX_UFFS_FDN) ||
+		TAG_PAGE_ID(&tag) != s->page ||
+		TAG_DATA_LEN(&tag) == 0 ||
+		TAG_DATA_LEN(&tag) > dev->com.pg_data_size) {
+		uffs_Perror(UFFS_MSG_NORMAL,
+					"unexpected checkpoint page (block %d page %d)",
+					s->block, s->page);
+		return U_FAIL;
+	}
+
+	ret = uffs_FlashReadPage(dev, s->block, s->page, s->buf, U_FALSE);
+	if (UFFS_FLASH_HAVE_ERR(ret))
+		return U_FAIL;
+
+	s->len = TAG_DATA_LEN(&tag);
+	s->pos = 0;
+	s->seq++;
+
+	return U_SUCC;
+}
+
+static URET _StreamRead(struct CheckpointStreamSt *s, void *data, int len)
+{
+	u8 *p = (u8 *)data;
+	int size;
+	int total = len;
+
+	while (len > 0) {
+		if (s->pos >= s->len) {
+			if (_StreamLoadPage(s) != U_SUCC)
+				return U_FAIL;
+		}
+		size = s->len - s->pos;
+		size = (len < size ? len : size);
+		memcpy(p, s->buf->data + s->pos, size);
+		s->pos += size;
+		p += size;
+		len -= size;
+	}
+
+	s->crc = uffs_crc16update(data, total, s->crc);
+
+	return U_SUCC;
+}
+
+static URET _StreamInit(struct CheckpointStreamSt *s, uffs_Device *dev)
+{
+	memset(s, 0, sizeof(struct CheckpointStreamSt));
+	s->dev = dev;
+	s->block = -1;
+	s->buf = uffs_BufClone(dev, NULL);
+	if (s->buf == NULL) {
+		uffs_Perror(UFFS_MSG_SERIOUS, "fail to clone buffer for checkpoint");
+		return U_FAIL;
+	}
+	memset(s->buf->data, 0xFF, dev->com.pg_data_size);
+
+	return U_SUCC;
+}
+
+static void _StreamRelease(struct CheckpointStreamSt *s)
+{
+	if (s->buf)
+		uffs_BufFreeClone(s->dev, s->buf);
+	s->buf = NULL;
+}
+
+static int _CountEntry(uffs_Device *dev, UNODE *entry, int len)
+{
+	int i, count = 0;
+	UNODE x;
+
+	for (i = 0; i < len; i++) {
+		for (x = entry[i]; x != EMPTY_NODE; x = FROM_IDX(x, TPOOL(dev))->hash_next)
+			count++;
+	}
+
+	return count;
+}
+
+static URET _SaveEntry(struct CheckpointStreamSt *s, UNODE *entry, int len, int type)
+{
+	struct uffs_CheckpointRecSt rec;
+	TreeNode *node;
+	int i;
+	UNODE x;
+
+	for (i = 0; i < len; i++) {
+		for (x = entry[i]; x != EMPTY_NODE; x = node->hash_next) {
+			node = FROM_IDX(x, TPOOL(s->dev));
+			memset(&rec, 0, sizeof(rec));
+			switch (type) {
+			case UFFS_TYPE_DIR:
+				rec.block = node->u.dir.block;
+				rec.parent = node->u.dir.parent;
+				rec.serial = node->u.dir.serial;
+				rec.sum = node->u.dir.checksum;
+				break;
+			case UFFS_TYPE_FILE:
+				rec.block = node->u.file.block;
+				rec.parent = node->u.file.parent;
+				rec.serial = node->u.file.serial;
+				rec.sum = node->u.file.checksum;
+				rec.len = node->u.file.len;
+				break;
+			case UFFS_TYPE_DATA:
+				rec.block = node->u.data.block;
+				rec.parent = node->u.data.parent;
+				rec.serial = node->u.data.serial;
+				rec.len = node->u.data.len;
+				break;
+			}
+			if (_StreamWrite(s, &rec, sizeof(rec)) != U_SUCC)
+				return U_FAIL;
+		}
+	}
+
+	return U_SUCC;
+}
+
+#ifdef CONFIG_ENABLE_TREE_BLOCK_BITMAP
+/* save blocks in bitmap <map>, need_check bits from <check_map> if not NULL */
+static URET _SaveMap(struct CheckpointStreamSt *s, const u8 *map, const u8 *check_map)
+{
+	uffs_Device *dev = s->dev;
+	struct uffs_CheckpointRecSt rec;
+	int i, num = dev->par.end - dev->par.start + 1;
+
+	for (i = 0; i < num; i++) {
+		if (!TREE_MAP_TEST(map, i))
+			continue;
+		memset(&rec, 0, sizeof(rec));
+		rec.block = dev->par.start + i;
+		rec.sum = (check_map ? TREE_MAP_TEST(check_map, i) : 0);
+		if (_StreamWrite(s, &rec, sizeof(rec)) != U_SUCC)
+			return U_FAIL;
+	}
+
+	return U_SUCC;
+}
+#else
+static URET _SaveList(struct CheckpointStreamSt *s, TreeNode *node)
+{
+	struct uffs_CheckpointRecSt rec;
+
+	for (; node; node = node->u.list.next) {
+		memset(&rec, 0, sizeof(rec));
+		rec.block = node->u.list.block;
+		rec.sum = node->u.list.u.need_check;
+		if (_StreamWrite(s, &rec, sizeof(rec)) != U_SUCC)
+			return U_FAIL;
+	}
+
+	return U_SUCC;
+}
+#endif
+
+/**
+ * \brief save the tree to checkpoint blocks
+ * \param[in] dev uffs device
+ * \return U_SUCC if checkpoint saved or already up to date.
+ * \note all dirty buffers will be flushed before saving.
+ */
+URET uffs_CheckpointSave(uffs_Device *dev)
+{
+	struct CheckpointStreamSt s;
+	struct uffs_CheckpointHeaderSt hdr;
+	struct uffs_CheckpointTailSt tail;
+	struct uffs_TreeSt *tree = &(dev->tree);
+	int total;
+	URET ret = U_FAIL;
+
+	if (dev->ckpt.blocks == 0)
+		return U_FAIL;
+
+	if (uffs_TreeLazyComplete(dev) != U_SUCC)
+		return U_FAIL;
+
+	if (uffs_BufFlushAll(dev) != U_SUCC) {
+		uffs_Perror(UFFS_MSG_NORMAL, "fail to flush buffers, checkpoint not saved");
+		return U_FAIL;
+	}
+
+	if (HAVE_BADBLOCK(dev))
+		uffs_BadBlockRecover(dev);
+
+	if (dev->ckpt.valid)
+		return U_SUCC;	// nothing changed since last checkpoint
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = CHECKPOINT_MAGIC;
+	hdr.version = CHECKPOINT_VERSION;
+	hdr.par_start = dev->par.start;
+	hdr.par_end = dev->par.end;
+	hdr.dir_count = _CountEntry(dev, tree->dir_entry, DIR_NODE_ENTRY_LEN(dev));
+	hdr.file_count = _CountEntry(dev, tree->file_entry, FILE_NODE_ENTRY_LEN(dev));
+	hdr.data_count = _CountEntry(dev, tree->data_entry, DATA_NODE_ENTRY_LEN(dev));
+	hdr.erased_count = tree->erased_count;
+	hdr.bad_count = tree->bad_count;
+
+	total = hdr.dir_count + hdr.file_count + hdr.data_count + hdr.erased_count + hdr.bad_count;
+	if (HAVE_BADBLOCK(dev) || total != dev->par.end - dev->par.start + 1) {
+		// some blocks are pending or suspended, the tree is not stable
+		uffs_Perror(UFFS_MSG_NORMAL,
+					"tree is busy (%d nodes, %d blocks), checkpoint not saved",
+					total, dev->par.end - dev->par.start + 1);
+		return U_FAIL;
+	}
+
+	if (_StreamInit(&s, dev) != U_SUCC)
+		return U_FAIL;
+
+	if (_StreamWrite(&s, &hdr, sizeof(hdr)) == U_SUCC &&
+		_SaveEntry(&s, tree->dir_entry, DIR_NODE_ENTRY_LEN(dev), UFFS_TYPE_DIR) == U_SUCC &&
+		_SaveEntry(&s, tree->file_entry, FILE_NODE_ENTRY_LEN(dev), UFFS_TYPE_FILE) == U_SUCC &&
+		_SaveEntry(&s, tree->data_entry, DATA_NODE_ENTRY_LEN(dev), UFFS_TYPE_DATA) == U_SUCC &&
+#ifdef CONFIG_ENABLE_TREE_BLOCK_BITMAP
+		_SaveMap(&s, tree->erased_map, tree->check_map) == U_SUCC &&
+		_SaveMap(&s, tree->bad_map, NULL) == U_SUCC) {
+#else
+		_SaveList(&s, tree->erased) == U_SUCC &&
+		_SaveList(&s, tree->bad) == U_SUCC) {
+#endif
+
+		memset(&tail, 0, sizeof(tail));
+		tail.magic = CHECKPOINT_MAGIC;
+		tail.crc = s.crc;
+		if (_StreamWrite(&s, &tail, sizeof(tail)) == U_SUCC &&
+			_StreamFlushPage(&s) == U_SUCC)
+			ret = U_SUCC;
+	}
+
+	_StreamRelease(&s);
+
+	if (ret == U_SUCC) {
+		uffs_Perror(UFFS_MSG_NOISY, "checkpoint saved, %d pages", s.seq);
+		dev->ckpt.valid = U_TRUE;
+	}
+	else {
+		uffs_Perror(UFFS_MSG_NORMAL, "fail to save checkpoint");
+		_EraseUsedBlocks(dev);
+	}
+
+	return ret;
+}
+
+static UBOOL _IsRecValid(uffs_Device *dev, struct uffs_CheckpointRecSt *rec, int type)
+{
+	if (rec->block < dev->par.start || rec->block > dev->par.end)
+		return U_FALSE;
+
+	switch (type) {
+	case UFFS_TYPE_DIR:
+	case UFFS_TYPE_FILE:
+		return (rec->serial <= MAX_UFFS_FSN && rec->parent <= MAX_UFFS_FSN) ? U_TRUE : U_FALSE;
+	case UFFS_TYPE_DATA:
+		return (rec->serial <= MAX_UFFS_FDN && rec->parent <= MAX_UFFS_FSN) ? U_TRUE : U_FALSE;
+	}
+
+	return U_TRUE;
+}
+
+/* load <count> records of <type>, type UFFS_TYPE_RESV for erased list,
+	UFFS_TYPE_INVALID for bad block list */
+static URET _LoadNodes(struct CheckpointStreamSt *s, int count, int type)
+{
+	uffs_Device *dev = s->dev;
+	struct uffs_CheckpointRecSt rec;
+	TreeNode *node;
+
+	while (count-- > 0) {
+		if (_StreamRead(s, &rec, sizeof(rec)) != U_SUCC)
+			return U_FAIL;
+
+		if (_IsRecValid(dev, &rec, type) == U_FALSE) {
+			uffs_Perror(UFFS_MSG_NORMAL, "invalid checkpoint record, block %d", rec.block);
+			return U_FAIL;
+		}
+
+		node = (TreeNode *)uffs_PoolGet(TPOOL(dev));
+		if (node == NULL) {
+			uffs_Perror(UFFS_MSG_SERIOUS, "insufficient tree node!");
+			return U_FAIL;
+		}
+
+		switch (type) {
+		case UFFS_TYPE_DIR:
+			node->u.dir.block = rec.block;
+			node->u.dir.parent = rec.parent;
+			node->u.dir.serial = rec.serial;
+			node->u.dir.checksum = rec.sum;
+			uffs_InsertNodeToTree(dev, type, node);
+			break;
+		case UFFS_TYPE_FILE:
+			node->u.file.block = rec.block;
+			node->u.file.parent = rec.parent;
+			node->u.file.serial = rec.serial;
+			node->u.file.checksum = rec.sum;
+			node->u.file.len = rec.len;
+			uffs_InsertNodeToTree(dev, type, node);
+			break;
+		case UFFS_TYPE_DATA:
+			node->u.data.block = rec.block;
+			node->u.data.parent = rec.parent;
+			node->u.data.serial = rec.serial;
+			node->u.data.len = rec.len;
+			uffs_InsertNodeToTree(dev, type, node);
+			break;
+		case UFFS_TYPE_RESV:
+			node->u.list.block = rec.block;
+			uffs_TreeInsertToErasedListTailEx(dev, node, rec.sum ? 1 : 0);
+			break;
+		default:
+			node->u.list.block = rec.block;
+			uffs_TreeInsertToBadBlockList(dev, node);
+			break;
+		}
+	}
+
+	return U_SUCC;
+}
+
+/**
+ * \brief build the tree from checkpoint
+ * \param[in] dev uffs device
+ * \return U_SUCC if the tree is loaded from checkpoint,
+ *         U_FAIL if there is no valid checkpoint, the tree is left empty.
+ * \note the invalid checkpoint will be erased.
+ */
+URET uffs_CheckpointLoad(uffs_Device *dev)
+{
+	struct CheckpointStreamSt s;
+	struct uffs_CheckpointHeaderSt hdr;
+	struct uffs_CheckpointTailSt tail;
+	uffs_Tags tag;
+	int block;
+	int flash_ret;
+	u16 crc;
+	URET ret = U_FAIL;
+
+	dev->ckpt.valid = U_FALSE;
+
+	block = _NextBlock(dev, -1);
+	if (block < 0)
+		return U_FAIL;
+
+	flash_ret = uffs_FlashReadPageTag(dev, block, 0, &tag);
+	if (!UFFS_FLASH_HAVE_ERR(flash_ret) && !TAG_IS_DIRTY(&tag)) {
+		uffs_Perror(UFFS_MSG_NOISY, "no checkpoint");
+		return U_FAIL;
+	}
+
+	if (_StreamInit(&s, dev) != U_SUCC)
+		return U_FAIL;
+
+	if (_StreamRead(&s, &hdr, sizeof(hdr)) == U_SUCC &&
+		hdr.magic == CHECKPOINT_MAGIC &&
+		hdr.version == CHECKPOINT_VERSION &&
+		hdr.par_start == dev->par.start &&
+		hdr.par_end == dev->par.end &&
+		hdr.dir_count + hdr.file_count + hdr.data_count +
+			hdr.erased_count + hdr.bad_count == dev->par.end - dev->par.start + 1) {
+
+		if (_LoadNodes(&s, hdr.dir_count, UFFS_TYPE_DIR) == U_SUCC &&
+			_LoadNodes(&s, hdr.file_count, UFFS_TYPE_FILE) == U_SUCC &&
+			_LoadNodes(&s, hdr.data_count, UFFS_TYPE_DATA) == U_SUCC &&
+			_LoadNodes(&s, hdr.erased_count, UFFS_TYPE_RESV) == U_SUCC &&
+			_LoadNodes(&s, hdr.bad_count, UFFS_TYPE_INVALID) == U_SUCC) {
+
+			crc = s.crc;
+			if (_StreamRead(&s, &tail, sizeof(tail)) == U_SUCC &&
+				tail.magic == CHECKPOINT_MAGIC &&
+				tail.crc == crc)
+				ret = U_SUCC;
+		}
+	}
+
+	_StreamRelease(&s);
+
+	if (ret == U_SUCC) {
+		uffs_Perror(UFFS_MSG_NORMAL,
+					"tree loaded from checkpoint: DIR %d, FILE %d, DATA %d",
+					hdr.dir_count, hdr.file_count, hdr.data_count);
+		dev->ckpt.valid = U_TRUE;
+	}
+	else {
+		uffs_Perror(UFFS_MSG_NORMAL, "invalid checkpoint, discard it.");
+
+		// start over with an empty tree
+		uffs_TreeRelease(dev);
+		if (uffs_TreeInit(dev) != U_SUCC)
+			uffs_Perror(UFFS_MSG_SERIOUS, "fail to init tree buffers");
+
+		_EraseUsedBlocks(dev);
+	}
+
+	return ret;
+}
+
+/**
+ * \brief discard checkpoint.
+ *        must be called before the partition is modified (write/erase/mark bad).
+ */
+void uffs_CheckpointDiscard(uffs_Device *dev)
+{
+	if (dev->ckpt.valid) {
+		dev->ckpt.valid = U_FALSE;
+		uffs_Perror(UFFS_MSG_NOISY, "discard checkpoint");
+		_EraseUsedBlocks(dev);
+	}
+}
+
+/**
+ * \brief reserve checkpoint blocks from the end of partition.
+ *        should be called before uffs_TreeInit().
+ */
+URET uffs_CheckpointInit(uffs_Device *dev)
+{
+	dev->ckpt.valid = U_FALSE;
+	dev->ckpt.blocks = 0;
+
+	if (dev->par.end - dev->par.start + 1 <= CONFIG_TREE_CHECKPOINT_BLOCKS + MINIMUN_ERASED_BLOCK) {
+		uffs_Perror(UFFS_MSG_DEAD, "partition is too small for checkpoint!");
+		return U_FAIL;
+	}
+
+	dev->ckpt.blocks = CONFIG_TREE_CHECKPOINT_BLOCKS;
+	dev->par.end -= dev->ckpt.blocks;
+	dev->ckpt.start = dev->par.end + 1;
+
+	return U_SUCC;
+}
+
+/** give back checkpoint blocks to partition */
+void uffs_CheckpointRelease(uffs_Device *dev)
+{
+	dev->par.end += dev->ckpt.blocks;
+	dev->ckpt.blocks = 0;
+	dev->ckpt.valid = U_FALSE;
+}
+
+#endif
@@ -0,0 +1,354 @@
+/*
+  This file is part of UFFS, the Ultra-low-cost Flash File System.
+  
+  Copyright (C) 2005-2009 Ricky Zheng <ricky_gz_zheng@yahoo.co.nz>
+
+  UFFS is free software; you can redistribute it and/or modify it under
+  the GNU Library General Public License as published by the Free Software 
+  Foundation; either version 2 of the License, or (at your option) any
+  later version.
+
+  UFFS is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+  or GNU Library General Public License, as applicable, for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  and GNU Library General Public License along with UFFS; if not, write
+  to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA  02110-1301, USA.
+
+  As a special exception, if other files instantiate templates or use
+  macros or inline functions from this file, or you compile this file
+  and link it with other works to produce a work based on this file,
+  this file does not by itself cause the resulting work to be covered
+  by the GNU General Public License. However the source code for this
+  file must still be made available in accordance with section (3) of
+  the GNU General Public License v2.
+ 
+  This exception does not invalidate any other reasons why a work based
+  on this file might be covered by the GNU General Public License.
+*/
+
+/**
+ * \file uffs_dentry.c
+ * \brief cache results of looking up names under dirs, so that resolving
+ *        a path which was resolved recently does not walk the tree, and
+ *        looking up a name which does not exist does not walk the tree again.
+ * \author Ricky Zheng
+ */
+
+#include "uffs_config.h"
+#include "uffs/uffs_public.h"
+#include "uffs/uffs_tree.h"
+#include "uffs/uffs_dentry.h"
+#include <string.h>
+
+#ifdef CONFIG_ENABLE_DENTRY_CACHE
+
+#define PFX "dcch: "
+
+#define DC_EMPTY	0xffff
+
+#define TPOOL(dev) &((dev)->mem.tree_pool)
+
+static u16 _Find(struct uffs_DentryCacheSt *dc, u8 type, u16 parent, u16 sum,
+					const char *name, u32 len)
+{
+	u16 x = dc->bucket[GET_DENTRY_CACHE_HASH(parent, sum)];
+	uffs_DentryEntry *e;
+
+	while (x != DC_EMPTY) {
+		e = &(dc->entries[x]);
+		if (e->type == type && e->parent == parent && e->sum == sum &&
+				e->name_len == len && memcmp(e->name, name, len) == 0)
+			break;
+		x = e->hash_next;
+	}
+
+	return x;
+}
+
+static void _BreakFromBucket(struct uffs_DentryCacheSt *dc, u16 x)
+{
+	uffs_DentryEntry *e = &(dc->entries[x]);
+	u16 *p = &(dc->bucket[GET_DENTRY_CACHE_HASH(e->parent, e->sum)]);
+
+	while (*p != DC_EMPTY) {
+		if (*p == x) {
+			*p = e->hash_next;
+			break;
+		}
+		p = &(dc->entries[*p].hash_next);
+	}
+	e->type = UFFS_TYPE_INVALID;
+}
+
+static void _BreakFromList(struct uffs_DentryCacheSt *dc, u16 x)
+{
+	uffs_DentryEntry *e = &(dc->entries[x]);
+
+	if (e->prev != DC_EMPTY)
+		dc->entries[e->prev].next = e->next;
+	else
+		dc->head = e->next;
+
+	if (e->next != DC_EMPTY)
+		dc->entries[e->next].prev = e->prev;
+	else
+		dc->tail = e->prev;
+}
+
+static void _MoveToHead(struct uffs_DentryCacheSt *dc, u16 x)
+{
+	uffs_DentryEntry *e = &(dc->entries[x]);
+
+	if (dc->head == x)
+		return;
+
+	_BreakFromList(dc, x);
+	e->prev = DC_EMPTY;
+	e->next = dc->head;
+	dc->entries[dc->head].prev = x;
+	dc->head = x;
+}
+
+static void _MoveToTail(struct uffs_DentryCacheSt *dc, u16 x)
+{
+	uffs_DentryEntry *e = &(dc->entries[x]);
+
+	if (dc->tail == x)
+		return;
+
+	_BreakFromList(dc, x);
+	e->next = DC_EMPTY;
+	e->prev = dc->tail;
+	dc->entries[dc->tail].next = x;
+	dc->tail = x;
+}
+
+static void _Drop(struct uffs_DentryCacheSt *dc, u16 x)
+{
+	_BreakFromBucket(dc, x);
+	_MoveToTail(dc, x);
+}
+
+/** 
+ * \brief allocate dentry cache entries
+ * \param[in] dev uffs device
+ * \param[in] max_entries maximum entries to be cached, 0 for disabling the cache
+ * \return U_SUCC, the cache is disabled if there is no enough memory
+ */
+URET uffs_DentryCacheInit(uffs_Device *dev, int max_entries)
+{
+	struct uffs_DentryCacheSt *dc = &(dev->dc);
+
+	memset(dc, 0, sizeof(struct uffs_DentryCacheSt));
+	dc->head = dc->tail = DC_EMPTY;
+	memset(dc->bucket, 0xff, sizeof(dc->bucket));
+
+	if (max_entries <= 0 || dev->mem.malloc == NULL)
+		return U_SUCC;
+
+	if (max_entries >= DC_EMPTY)
+		max_entries = DC_EMPTY - 1;
+
+	dc->entries = (uffs_DentryEntry *)
+					dev->mem.malloc(dev, sizeof(uffs_DentryEntry) * max_entries);
+	if (dc->entries == NULL) {
+		uffs_Perror(UFFS_MSG_NORMAL, "no memory for dentry cache, disabled.");
+		return U_SUCC;
+	}
+
+	uffs_Perror(UFFS_MSG_NOISY, "alloc dentry cache %d bytes.",
+				sizeof(uffs_DentryEntry) * max_entries);
+
+	dc->count = max_entries;
+	uffs_DentryCacheFlush(dev);
+
+	return U_SUCC;
+}
+
+/** 
+ * \brief release dentry cache entries
+ */
+URET uffs_DentryCacheRelease(uffs_Device *dev)
+{
+	struct uffs_DentryCacheSt *dc = &(dev->dc);
+
+	if (dc->entries && dev->mem.free)
+		dev->mem.free(dev, dc->entries);
+
+	dc->entries = NULL;
+	dc->count = 0;
+
+	return U_SUCC;
+}
+
+/** 
+ * \brief drop all entries, call this when the tree is rebuilt (format, etc.)
+ */
+void uffs_DentryCacheFlush(uffs_Device *dev)
+{
+	struct uffs_DentryCacheSt *dc = &(dev->dc);
+	int i;
+
+	memset(dc->bucket, 0xff, sizeof(dc->bucket));
+
+	for (i = 0; i < dc->count; i++) {
+		dc->entries[i].type = UFFS_TYPE_INVALID;
+		dc->entries[i].hash_next = DC_EMPTY;
+		dc->entries[i].prev = (i == 0 ? DC_EMPTY : i - 1);
+		dc->entries[i].next = (i == dc->count - 1 ? DC_EMPTY : i + 1);
+	}
+	dc->head = (dc->count > 0 ? 0 : DC_EMPTY);
+	dc->tail = (dc->count > 0 ? dc->count - 1 : DC_EMPTY);
+}
+
+/** 
+ * \brief look up name under parent dir from cache
+ * \param[in] dev uffs device
+ * \param[in] type UFFS_TYPE_DIR or UFFS_TYPE_FILE
+ * \param[in] parent parent dir serial num
+ * \param[in] sum name checksum
+ * \param[in] name name to be looked up
+ * \param[in] len name length
+ * \param[out] node tree node found, NULL if the name does not exist
+ * \return U_TRUE if the result is decided by cache,
+ *			U_FALSE if caller need to search the tree.
+ */
+UBOOL uffs_DentryCacheLookup(uffs_Device *dev, u8 type, u16 parent, u16 sum,
+								const char *name, u32 len, TreeNode **node)
+{
+	struct uffs_DentryCacheSt *dc = &(dev->dc);
+	uffs_DentryEntry *e;
+	TreeNode *p = NULL;
+	u16 x;
+
+	if (dc->entries == NULL || len > CONFIG_DENTRY_CACHE_NAME_LEN)
+		return U_FALSE;
+
+	x = _Find(dc, type, parent, sum, name, len);
+	if (x == DC_EMPTY) {
+		dc->miss++;
+		return U_FALSE;
+	}
+
+	e = &(dc->entries[x]);
+	if (e->node != EMPTY_NODE) {
+		p = FROM_IDX(e->node, TPOOL(dev));
+		if ((type == UFFS_TYPE_DIR &&
+				(p->u.dir.parent != parent || p->u.dir.checksum != sum)) ||
+			(type == UFFS_TYPE_FILE &&
+				(p->u.file.parent != parent || p->u.file.checksum != sum))) {
+			// node is changed behind the cache ?
+			_Drop(dc, x);
+			dc->miss++;
+			return U_FALSE;
+		}
+		dc->hit++;
+	}
+	else {
+		dc->neg_hit++;
+	}
+
+	_MoveToHead(dc, x);
+	*node = p;
+
+	return U_TRUE;
+}
+
+/** 
+ * \brief put the result of looking up name under parent dir to cache,
+ *			replace the least recently used entry
+ * \param[in] dev uffs device
+ * \param[in] type UFFS_TYPE_DIR or UFFS_TYPE_FILE
+ * \param[in] parent parent dir serial num
+ * \param[in] sum name checksum
+ * \param[in] name name which was looked up
+ * \param[in] len name length
+ * \param[in] node tree node found, NULL if the name does not exist
+ */
+void uffs_DentryCachePut(uffs_Device *dev, u8 type, u16 parent, u16 sum,
+							const char *name, u32 len, TreeNode *node)
+{
+	struct uffs_DentryCacheSt *dc = &(dev->dc);
+	uffs_DentryEntry *e;
+	u16 x;
+
+	if (dc->entries == NULL || len == 0 || len > CONFIG_DENTRY_CACHE_NAME_LEN)
+		return;
+
+#ifdef CONFIG_ENABLE_LAZY_MOUNT
+	// the name might be in the blocks not scanned yet
+	if (node == NULL && !dev->tree.scan.done)
+		return;
+#endif
+
+	x = _Find(dc, type, parent, sum, name, len);
+	if (x == DC_EMPTY) {
+		x = dc->tail;
+		e = &(dc->entries[x]);
+		if (e->type != UFFS_TYPE_INVALID)
+			_BreakFromBucket(dc, x);
+		e->type = type;
+		e->parent = parent;
+		e->sum = sum;
+		e->name_len = (u8)len;
+		memcpy(e->name, name, len);
+		e->hash_next = dc->bucket[GET_DENTRY_CACHE_HASH(parent, sum)];
+		dc->bucket[GET_DENTRY_CACHE_HASH(parent, sum)] = x;
+	}
+
+	dc->entries[x].node = (node ? TO_IDX(node, TPOOL(dev)) : EMPTY_NODE);
+	_MoveToHead(dc, x);
+}
+
+/** 
+ * \brief drop entries of tree node, call this when the node is
+ *			removed from tree or renamed.
+ */
+void uffs_DentryCacheRemoveNode(uffs_Device *dev, TreeNode *node)
+{
+	struct uffs_DentryCacheSt *dc = &(dev->dc);
+	UNODE idx;
+	int i;
+
+	if (dc->entries == NULL)
+		return;
+
+	idx = TO_IDX(node, TPOOL(dev));
+	for (i = 0; i < dc->count; i++) {
+		if (dc->entries[i].type != UFFS_TYPE_INVALID && dc->entries[i].node == idx)
+			_Drop(dc, (u16)i);
+	}
+}
+
+/** 
+ * \brief drop negative entries which may match a new dir/file,
+ *			call this when a dir/file node is added to tree or renamed.
+ * \param[in] dev uffs device
+ * \param[in] parent parent dir serial num of the new dir/file
+ * \param[in] sum name checksum of the new dir/file
+ */
+void uffs_DentryCacheNewName(uffs_Device *dev, u16 parent, u16 sum)
+{
+	struct uffs_DentryCacheSt *dc = &(dev->dc);
+	uffs_DentryEntry *e;
+	u16 x, next;
+
+	if (dc->entries == NULL)
+		return;
+
+	x = dc->bucket[GET_DENTRY_CACHE_HASH(parent, sum)];
+	while (x != DC_EMPTY) {
+		e = &(dc->entries[x]);
+		next = e->hash_next;
+		// a dir and a file can't have the same name, drop both types
+		if (e->node == EMPTY_NODE && e->parent == parent && e->sum == sum)
+			_Drop(dc, x);
+		x = next;
+	}
+}
+
+#endif
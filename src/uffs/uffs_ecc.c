@@ -106,20 +106,32 @@ static const u8 column_parity_tbl[256] = {
 };
 
 /**
- * calculate 3 bytes ECC for 256 bytes data.
+ * calculate 3 bytes ECC for 256 bytes data, the data may come in two pieces.
  *
- * \param[in] data input data
+ * \param[in] head first piece of data, could be NULL if head_len is 0
+ * \param[in] head_len length of the first piece
+ * \param[in] data rest of data
  * \param[out] ecc output ecc
- * \param[in] length of data in bytes
+ * \param[in] length of data in bytes (include head_len)
  */
-static void uffs_EccMakeChunk256(const void *data, void *ecc, u16 len)
+static void uffs_EccMakeChunk256Ex(const void *head, u16 head_len,
+								   const void *data, void *ecc, u16 len)
 {
 	u8 *pecc = (u8 *)ecc;
-	const u8 *p = (const u8 *)data;
+	const u8 *p = (const u8 *)head;
 	u8 b, col_parity = 0, line_parity = 0, line_parity_prime = 0;
 	u16 i;
 
-	for (i = 0; i < len; i++) {
+	for (i = 0; i < head_len; i++) {
+		b = column_parity_tbl[*p++];
+		col_parity ^= b;
+		if (b & 0x01) { // odd number of bits in the byte
+			line_parity ^= i;
+			line_parity_prime ^= ~i;
+		}
+	}
+
+	for (p = (const u8 *)data; i < len; i++) {
 		b = column_parity_tbl[*p++];
 		col_parity ^= b;
 		if (b & 0x01) { // odd number of bits in the byte
@@ -140,6 +152,18 @@ static void uffs_EccMakeChunk256(const void *data, void *ecc, u16 len)
 
 }
 
+/**
+ * calculate 3 bytes ECC for 256 bytes data.
+ *
+ * \param[in] data input data
+ * \param[out] ecc output ecc
+ * \param[in] length of data in bytes
+ */
+static void uffs_EccMakeChunk256(const void *data, void *ecc, u16 len)
+{
+	uffs_EccMakeChunk256Ex(NULL, 0, data, ecc, len);
+}
+
 
 /**
  * calculate ECC. (3 bytes ECC per 256 data)
@@ -170,6 +194,41 @@ int uffs_EccMake(const void *data, int data_len, void *ecc)
 	return p_ecc - (u8 *)ecc;
 }
 
+/**
+ * calculate ECC of data in two pieces. (3 bytes ECC per 256 data)
+ *
+ * \param[in] head first piece of data, head_len must be less than 256
+ * \param[in] head_len length of the first piece in byte
+ * \param[in] data rest of data
+ * \param[in] data_len length of the rest of data in byte
+ * \param[out] ecc output ecc
+ *
+ * \return length of ECC in byte, the same as uffs_EccMake() for
+ *			the contiguous head_len + data_len bytes.
+ */
+int uffs_EccMakeEx(const void *head, int head_len,
+				   const void *data, int data_len, void *ecc)
+{
+	const u8 *p_data = (const u8 *)data;
+	u8 *p_ecc = (u8 *)ecc;
+	int len;
+
+	if (head == NULL || head_len >= 256)
+		return 0;
+
+	if (data == NULL || ecc == NULL)
+		return 0;
+
+	// only the first chunk spans the two pieces
+	len = head_len + data_len > 256 ? 256 : head_len + data_len;
+	uffs_EccMakeChunk256Ex(head, (u16)head_len, p_data, p_ecc, len);
+	p_data += len - head_len;
+	data_len -= len - head_len;
+	p_ecc += 3;
+
+	return (p_ecc - (u8 *)ecc) + uffs_EccMake(p_data, data_len, p_ecc);
+}
+
 /**
  * perform ECC error correct for 256 bytes data chunk.
  *
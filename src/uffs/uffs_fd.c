@@ -45,6 +45,10 @@
 #include "uffs/uffs_mtb.h"
 #include "uffs/uffs_public.h"
 #include "uffs/uffs_find.h"
+#include "uffs/uffs_checkpoint.h"
+#include "uffs/uffs_wear.h"
+#include "uffs/uffs_badblock.h"
+#include "uffs/uffs_os.h"
 
 #define PFX "fd  : "
 
@@ -742,9 +746,238 @@ void uffs_flush_all(const char *mount_point)
 	uffs_GlobalFsLockLock();
 	dev = uffs_GetDeviceFromMountPoint(mount_point);
 	if (dev) {
-		uffs_BufFlushAll(dev);
+		if (uffs_BufFlushAll(dev) == U_SUCC) {
+			uffs_WearLevelStatic(dev, U_FALSE);
+			uffs_WearSync(dev, U_FALSE);
+		}
+		uffs_PutDevice(dev);
+	}
+	uffs_GlobalFsLockUnlock();
+}
+
+/**
+ * save tree checkpoint of <mount_point>, so that next mount could be faster.
+ * \return 0 if succ, -1 if fail or checkpoint is not enabled.
+ */
+int uffs_checkpoint(const char *mount_point)
+{
+	uffs_Device *dev = NULL;
+	URET ret = U_FAIL;
+
+	uffs_GlobalFsLockLock();
+	dev = uffs_GetDeviceFromMountPoint(mount_point);
+	if (dev) {
+#ifdef CONFIG_ENABLE_TREE_CHECKPOINT
+		ret = uffs_CheckpointSave(dev);
+#endif
+		uffs_PutDevice(dev);
+	}
+	uffs_GlobalFsLockUnlock();
+
+	return ret == U_SUCC ? 0 : -1;
+}
+
+/**
+ * get erase count of <block> of <mount_point>.
+ * \return erase count, -1 if block is out of partition or erase counters are not available.
+ */
+long uffs_erase_count(const char *mount_point, int block)
+{
+	uffs_Device *dev = NULL;
+	long ret = -1;
+
+	uffs_GlobalFsLockLock();
+	dev = uffs_GetDeviceFromMountPoint(mount_point);
+	if (dev) {
+#ifdef CONFIG_ENABLE_ERASE_COUNT_ALLOC
+		if (dev->wear.erase_count && block >= dev->par.start && block <= dev->par.end)
+			ret = (long) uffs_WearGetEraseCount(dev, block);
+#endif
 		uffs_PutDevice(dev);
 	}
 	uffs_GlobalFsLockUnlock();
+
+	return ret;
 }
 
+/**
+ * run a static wear leveling pass on <mount_point> now.
+ * \return 1 if a cold block is moved, 0 if nothing to move, -1 if not available.
+ */
+int uffs_wear_level(const char *mount_point)
+{
+	uffs_Device *dev = NULL;
+	int ret = -1;
+
+	uffs_GlobalFsLockLock();
+	dev = uffs_GetDeviceFromMountPoint(mount_point);
+	if (dev) {
+#ifdef CONFIG_ENABLE_STATIC_WEAR_LEVELING
+		if (dev->wear.erase_count && dev->cfg.static_wl_threshold >= 0) {
+			ret = (uffs_WearLevelStatic(dev, U_TRUE) == U_SUCC ? 1 : 0);
+			uffs_WearSync(dev, U_FALSE);
+		}
+#endif
+		uffs_PutDevice(dev);
+	}
+	uffs_GlobalFsLockUnlock();
+
+	return ret;
+}
+
+/**
+ * continue the deferred tree building of <mount_point>,
+ * scan up to <blocks> blocks, or all remaining blocks if <blocks> <= 0.
+ * \return number of blocks not scanned yet, -1 if fail.
+ */
+int uffs_scan_step(const char *mount_point, int blocks)
+{
+	uffs_Device *dev = NULL;
+	int ret = -1;
+
+	uffs_GlobalFsLockLock();
+	dev = uffs_GetDeviceFromMountPoint(mount_point);
+	if (dev) {
+#ifdef CONFIG_ENABLE_LAZY_MOUNT
+		if (uffs_TreeLazyScan(dev, blocks) == U_SUCC)
+			ret = (dev->tree.scan.done ? 0 : dev->par.end - dev->tree.scan.next + 1);
+#else
+		ret = 0;
+#endif
+		uffs_PutDevice(dev);
+	}
+	uffs_GlobalFsLockUnlock();
+
+	return ret;
+}
+
+#ifdef CONFIG_ENABLE_BG_FLUSH
+/**
+ * write back one dirty group of <dev> with device lock held,
+ * and recover bad blocks found during write back.
+ */
+static int _FlushStep(uffs_Device *dev)
+{
+	int ret;
+
+	uffs_DeviceLock(dev);
+	ret = uffs_BufFlushStep(dev);
+	if (HAVE_BADBLOCK(dev))
+		uffs_BadBlockRecover(dev);
+	uffs_DeviceUnLock(dev);
+
+	return ret;
+}
+#endif
+
+/**
+ * write back one dirty group of <mount_point> which has been dirty for
+ * longer than uffs_Config.flush_expire_ms, or when dirty page buffers
+ * are above uffs_Config.flush_high_water.
+ * call it periodically (e.g. from an idle task) until it returns 0,
+ * the fs lock is released between calls.
+ * \return 1 if a group is flushed, 0 if nothing to flush, -1 if fail or not enabled.
+ */
+int uffs_flush_step(const char *mount_point)
+{
+	uffs_Device *dev = NULL;
+	int ret = -1;
+
+	uffs_GlobalFsLockLock();
+	dev = uffs_GetDeviceFromMountPoint(mount_point);
+	if (dev) {
+#ifdef CONFIG_ENABLE_BG_FLUSH
+		ret = _FlushStep(dev);
+#endif
+		uffs_PutDevice(dev);
+	}
+	uffs_GlobalFsLockUnlock();
+
+	return ret;
+}
+
+#ifdef CONFIG_BG_FLUSH_THREAD
+static struct {
+	OSTASK task;				// flusher thread, NULL if not started
+	int interval_ms;			// sleep time between write back rounds
+	volatile int running;		// cleared by uffs_flusher_stop()
+} _flusher = { NULL, 0, 0 };
+
+static void _FlusherTask(void *arg)
+{
+	uffs_MountTable *mtb;
+	int flushed;
+
+	while (_flusher.running) {
+		// one group of each partition for each lock, until nothing to flush
+		do {
+			flushed = 0;
+			uffs_GlobalFsLockLock();
+			for (mtb = uffs_MtbGetMounted(); mtb; mtb = mtb->next) {
+				if (_FlushStep(mtb->dev) > 0)
+					flushed++;
+			}
+			uffs_GlobalFsLockUnlock();
+		} while (flushed > 0 && _flusher.running);
+
+		uffs_TaskSleep(_flusher.interval_ms);
+	}
+}
+#endif
+
+/**
+ * start the flusher thread, which calls uffs_flush_step() on all mounted
+ * partitions every <interval_ms> ms.
+ * \return 0 if succ, -1 if fail, already started or not enabled.
+ */
+int uffs_flusher_start(int interval_ms)
+{
+	int ret = -1;
+
+#ifdef CONFIG_BG_FLUSH_THREAD
+	uffs_GlobalFsLockLock();
+	if (_flusher.task == NULL && interval_ms > 0) {
+		_flusher.interval_ms = interval_ms;
+		_flusher.running = 1;
+		if (uffs_TaskCreate(&_flusher.task, _FlusherTask, NULL) == 0)
+			ret = 0;
+		else {
+			_flusher.task = NULL;
+			_flusher.running = 0;
+		}
+	}
+	uffs_GlobalFsLockUnlock();
+#endif
+
+	return ret;
+}
+
+/**
+ * stop the flusher thread and wait for it to exit,
+ * this may take up to the <interval_ms> given to uffs_flusher_start().
+ * \return 0 if succ, -1 if flusher is not started.
+ */
+int uffs_flusher_stop(void)
+{
+	int ret = -1;
+
+#ifdef CONFIG_BG_FLUSH_THREAD
+	OSTASK task = NULL;
+
+	uffs_GlobalFsLockLock();
+	if (_flusher.running) {
+		_flusher.running = 0;
+		task = _flusher.task;
+	}
+	uffs_GlobalFsLockUnlock();
+
+	if (task) {
+		ret = (uffs_TaskJoin(task) == 0 ? 0 : -1);
+		uffs_GlobalFsLockLock();
+		_flusher.task = NULL;
+		uffs_GlobalFsLockUnlock();
+	}
+#endif
+
+	return ret;
+}
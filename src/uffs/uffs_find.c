@@ -51,6 +51,21 @@ static void ResetFindInfo(uffs_FindInfo *f)
 	f->pos = 0;
 }
 
+#ifdef CONFIG_ENABLE_TREE_CHILD_INDEX
+/* children of the dir are all linked in one child chain */
+#define DIR_FIND_ENTRY_LEN(dev)		1
+#define FILE_FIND_ENTRY_LEN(dev)	1
+#define FIND_ENTRY(f, type)		uffs_TreeChildFirst((f)->dev, type, (f)->serial)
+#define FIND_NEXT(dev, node)	uffs_TreeChildNext(dev, node)
+#else
+#define DIR_FIND_ENTRY_LEN(dev)		DIR_NODE_ENTRY_LEN(dev)
+#define FILE_FIND_ENTRY_LEN(dev)	FILE_NODE_ENTRY_LEN(dev)
+#define FIND_ENTRY(f, type)		((type) == UFFS_TYPE_DIR ? \
+									(f)->dev->tree.dir_entry[(f)->hash] : \
+									(f)->dev->tree.file_entry[(f)->hash])
+#define FIND_NEXT(dev, node)	((node)->hash_next)
+#endif
+
 static URET _LoadObjectInfo(uffs_Device *dev,
 							TreeNode *node,
 							uffs_ObjectInfo *info,
@@ -68,6 +83,9 @@ static URET _LoadObjectInfo(uffs_Device *dev,
 	}
 
 	memcpy(&(info->info), buf->data, sizeof(uffs_FileInfo));
+	uffs_NameCachePut(dev, TO_IDX(node, TPOOL(dev)), (u8)type,
+						uffs_MakeSum16(info->info.name, info->info.name_len),
+						info->info.name, info->info.name_len);
 
 	if (type == UFFS_TYPE_DIR) {
 		info->len = 0;
@@ -177,7 +195,7 @@ URET uffs_FindObjectOpenEx(uffs_FindInfo *f, uffs_Device *dev, int dir)
 }
 
 
-static URET do_FindObject(uffs_FindInfo *f, uffs_ObjectInfo *info, u16 x)
+static URET do_FindObject(uffs_FindInfo *f, uffs_ObjectInfo *info, UNODE x)
 {
 	URET ret = U_SUCC;
 	TreeNode *node;
@@ -193,13 +211,13 @@ static URET do_FindObject(uffs_FindInfo *f, uffs_ObjectInfo *info, u16 x)
 					ret = _LoadObjectInfo(dev, node, info, UFFS_TYPE_DIR, NULL);
 				goto ext;
 			}
-			x = node->hash_next;
+			x = FIND_NEXT(dev, node);
 		}
 
 		f->hash++; //come to next hash entry
 
-		for (; f->hash < DIR_NODE_ENTRY_LEN; f->hash++) {
-			x = dev->tree.dir_entry[f->hash];
+		for (; f->hash < DIR_FIND_ENTRY_LEN(dev); f->hash++) {
+			x = FIND_ENTRY(f, UFFS_TYPE_DIR);
 			while (x != EMPTY_NODE) {
 				node = FROM_IDX(x, TPOOL(dev));
 				if (node->u.dir.parent == f->serial) {
@@ -209,14 +227,14 @@ static URET do_FindObject(uffs_FindInfo *f, uffs_ObjectInfo *info, u16 x)
 						ret = _LoadObjectInfo(dev, node, info, UFFS_TYPE_DIR, NULL);
 					goto ext;
 				}
-				x = node->hash_next;
+				x = FIND_NEXT(dev, node);
 			}
 		}
 
 		//no subdirs, then lookup files ..
 		f->step++;
 		f->hash = 0;
-		x = dev->tree.file_entry[f->hash];
+		x = FIND_ENTRY(f, UFFS_TYPE_FILE);
 	}
 
 	if (f->step == 1) {
@@ -230,13 +248,13 @@ static URET do_FindObject(uffs_FindInfo *f, uffs_ObjectInfo *info, u16 x)
 					ret = _LoadObjectInfo(dev, node, info, UFFS_TYPE_FILE, NULL);
 				goto ext;
 			}
-			x = node->hash_next;
+			x = FIND_NEXT(dev, node);
 		}
 
 		f->hash++; //come to next hash entry
 
-		for (; f->hash < FILE_NODE_ENTRY_LEN; f->hash++) {
-			x = dev->tree.file_entry[f->hash];
+		for (; f->hash < FILE_FIND_ENTRY_LEN(dev); f->hash++) {
+			x = FIND_ENTRY(f, UFFS_TYPE_FILE);
 			while (x != EMPTY_NODE) {
 				node = FROM_IDX(x, TPOOL(dev));
 				if (node->u.file.parent == f->serial) {
@@ -246,7 +264,7 @@ static URET do_FindObject(uffs_FindInfo *f, uffs_ObjectInfo *info, u16 x)
 						ret = _LoadObjectInfo(dev, node, info, UFFS_TYPE_FILE, NULL);
 					goto ext;
 				}
-				x = node->hash_next;
+				x = FIND_NEXT(dev, node);
 			}
 		}
 
@@ -278,7 +296,10 @@ URET uffs_FindObjectFirst(uffs_ObjectInfo * info, uffs_FindInfo * f)
 
 	uffs_DeviceLock(dev);
 	ResetFindInfo(f);
-	ret = do_FindObject(f, info, dev->tree.dir_entry[0]);
+	if (uffs_TreeLazyComplete(dev) != U_SUCC)
+		ret = U_FAIL;
+	else
+		ret = do_FindObject(f, info, FIND_ENTRY(f, UFFS_TYPE_DIR));
 	uffs_DeviceUnLock(dev);
 
 	return ret;
@@ -307,7 +328,7 @@ URET uffs_FindObjectNext(uffs_ObjectInfo *info, uffs_FindInfo * f)
 		return uffs_FindObjectFirst(info, f);
 
 	uffs_DeviceLock(dev);
-	ret = do_FindObject(f, info, f->work->hash_next);
+	ret = do_FindObject(f, info, FIND_NEXT(dev, f->work));
 	uffs_DeviceUnLock(dev);
 
 	return ret;
@@ -41,7 +41,9 @@
 #include "uffs/uffs_flash.h"
 #include "uffs/uffs_device.h"
 #include "uffs/uffs_badblock.h"
+#include "uffs/uffs_checkpoint.h"
 #include "uffs/uffs_crc.h"
+#include "uffs/uffs_wear.h"
 #include <string.h>
 
 #define PFX "flsh: "
@@ -54,6 +56,15 @@
 
 #define TAG_STORE_SIZE	(sizeof(struct uffs_TagStoreSt))
 
+/** spare buffer: page spare, then ECC buffer and ECC store of a page */
+#define SPARE_BUF_ALIGN(n)	(((n) + 7) & ~7)
+#define SPARE_BUF_ECC_SIZE(dev) \
+			SPARE_BUF_ALIGN(ECC_SIZE(dev) > NOMINAL_ECC_SIZE(dev) ? ECC_SIZE(dev) : NOMINAL_ECC_SIZE(dev))
+#define SPARE_BUF_SIZE(dev)	\
+			(SPARE_BUF_ALIGN((dev)->attr->spare_size) + SPARE_BUF_ECC_SIZE(dev) * 2)
+#define SPARE_BUF_ECC(dev, spare)	((spare) + SPARE_BUF_ALIGN((dev)->attr->spare_size))
+#define SPARE_BUF_ECC_STORE(dev, spare)	(SPARE_BUF_ECC(dev, spare) + SPARE_BUF_ECC_SIZE(dev))
+
 #define SEAL_BYTE(dev, spare)  spare[(dev)->mem.spare_data_size - 1]	// seal byte is the last byte of spare data
 
 #if defined(CONFIG_UFFS_AUTO_LAYOUT_USE_MTD_SCHEME)
@@ -194,29 +205,9 @@ URET uffs_FlashInterfaceInit(uffs_Device *dev)
 	URET ret = U_FAIL;
 	struct uffs_StorageAttrSt *attr = dev->attr;
 	uffs_Pool *pool = SPOOL(dev);
+	int size;
 
-	if (dev->mem.spare_pool_size == 0) {
-		if (dev->mem.malloc) {
-			dev->mem.spare_pool_buf = dev->mem.malloc(dev, UFFS_SPARE_BUFFER_SIZE);
-			if (dev->mem.spare_pool_buf)
-				dev->mem.spare_pool_size = UFFS_SPARE_BUFFER_SIZE;
-		}
-	}
-
-	if (UFFS_SPARE_BUFFER_SIZE > dev->mem.spare_pool_size) {
-		uffs_Perror(UFFS_MSG_DEAD,
-					"Spare buffer require %d but only %d available.",
-					UFFS_SPARE_BUFFER_SIZE, dev->mem.spare_pool_size);
-		memset(pool, 0, sizeof(uffs_Pool));
-		goto ext;
-	}
-
-	uffs_Perror(UFFS_MSG_NOISY,
-					"alloc spare buffers %d bytes.",
-					UFFS_SPARE_BUFFER_SIZE);
-	uffs_PoolInit(pool, dev->mem.spare_pool_buf,
-					dev->mem.spare_pool_size,
-					UFFS_MAX_SPARE_SIZE, MAX_SPARE_BUFFERS, U_FALSE);
+	memset(pool, 0, sizeof(uffs_Pool));
 
 	// init flash driver
 	if (dev->ops->InitFlash) {
@@ -243,6 +234,15 @@ URET uffs_FlashInterfaceInit(uffs_Device *dev)
 
 		uffs_Perror(UFFS_MSG_NORMAL, "ECC size %d", dev->attr->ecc_size);
 
+		if (dev->attr->ecc_opt != UFFS_ECC_NONE &&
+			TAG_STORE_SIZE + 1 + dev->attr->ecc_size >= 0xFF) {
+			// spare layout offset is u8 and 0xFF is the end mark
+			uffs_Perror(UFFS_MSG_SERIOUS,
+						"ECC size %d too big for UFFS spare layout, "
+						"please use UFFS_LAYOUT_FLASH", dev->attr->ecc_size);
+			goto ext;
+		}
+
 		if ((dev->attr->data_layout && !dev->attr->ecc_layout) ||
 			(!dev->attr->data_layout && dev->attr->ecc_layout)) {
 			uffs_Perror(UFFS_MSG_SERIOUS,
@@ -297,6 +297,29 @@ URET uffs_FlashInterfaceInit(uffs_Device *dev)
 		goto ext;
 	}
 
+	// spare buffers are sized by page spare and ECC size of this device
+	size = SPARE_BUF_SIZE(dev) * MAX_SPARE_BUFFERS;
+
+	if (dev->mem.spare_pool_size == 0) {
+		if (dev->mem.malloc) {
+			dev->mem.spare_pool_buf = dev->mem.malloc(dev, size);
+			if (dev->mem.spare_pool_buf)
+				dev->mem.spare_pool_size = size;
+		}
+	}
+
+	if (size > dev->mem.spare_pool_size) {
+		uffs_Perror(UFFS_MSG_DEAD,
+					"Spare buffer require %d but only %d available.",
+					size, dev->mem.spare_pool_size);
+		goto ext;
+	}
+
+	uffs_Perror(UFFS_MSG_NOISY,
+					"alloc spare buffers %d bytes.", size);
+	uffs_PoolInit(pool, dev->mem.spare_pool_buf, size,
+					SPARE_BUF_SIZE(dev), MAX_SPARE_BUFFERS, U_FALSE);
+
 	ret = U_SUCC;
 ext:
 	return ret;
@@ -364,6 +387,51 @@ void uffs_FlashUnloadSpare(uffs_Device *dev,
 	}
 }
 
+/**
+ * check result of reading page tag, do tag ECC correction
+ *
+ * \param[in] ret flash result of reading the tag
+ * \return flash result after tag ECC correction
+ */
+static int _CheckPageTag(uffs_Device *dev, int block, int page, uffs_Tags *tag, int ret)
+{
+	int ret_tmp;
+
+	if (UFFS_FLASH_HAVE_ERR(ret))
+		goto ext;
+
+	if (tag) {
+		if (!TAG_IS_SEALED(tag))	// not sealed ? don't try tag ECC correction
+			goto ext;
+
+		// do tag ecc correction
+		if (dev->attr->ecc_opt != UFFS_ECC_NONE) {
+			ret_tmp = TagEccCorrect(&tag->s);
+			ret_tmp = (ret_tmp < 0 ? UFFS_FLASH_ECC_FAIL :
+					(ret_tmp > 0 ? UFFS_FLASH_ECC_OK : UFFS_FLASH_NO_ERR));
+
+			if (UFFS_FLASH_HAVE_ERR(ret_tmp) || ret_tmp == UFFS_FLASH_ECC_OK) {
+				// overwrite ret with ret_tmp only when tag ECC failed or corrected bit flip(s),
+				// so that if flash driver has the capability of ECC, the result will propagete to upper level.
+				ret = ret_tmp;
+			}
+		}
+	}
+
+ext:
+	if (UFFS_FLASH_IS_BAD_BLOCK(ret)) {
+		uffs_Perror(UFFS_MSG_NORMAL, "new bad block %d found while reading page %d tag", block, page);
+	}
+	else if (ret == UFFS_FLASH_ECC_OK) {
+		uffs_Perror(UFFS_MSG_NOISY, "block %d page %d tag has bit flip and corrected by ECC", block, page);
+	}
+	else if (UFFS_FLASH_HAVE_ERR(ret)) {
+		uffs_Perror(UFFS_MSG_NORMAL, "read block %d page %d tag failed, error = %d", block, page, ret);
+	}
+
+	return ret;
+}
+
 /**
  * Read tag from page spare
  *
@@ -383,12 +451,34 @@ void uffs_FlashUnloadSpare(uffs_Device *dev,
 int uffs_FlashReadPageTag(uffs_Device *dev,
 							int block, int page, uffs_Tags *tag)
 {
-	uffs_FlashOps *ops = dev->ops;
 	u8 * spare_buf;
-	int ret = UFFS_FLASH_UNKNOWN_ERR;
-	int ret_tmp;
+	int ret;
 
 	spare_buf = (u8 *) uffs_PoolGet(SPOOL(dev));
+	ret = uffs_FlashReadPageTagEx(dev, block, page, tag, spare_buf);
+	if (spare_buf)
+		uffs_PoolPut(SPOOL(dev), spare_buf);
+
+	return ret;
+}
+
+/**
+ * Read tag from page spare, with caller's spare buffer
+ *
+ * \param[in] spare_buf spare buffer of at least dev->mem.spare_data_size bytes.
+ *
+ * \note this function does not touch shared buffers of dev, it's safe to
+ *		read tags of different blocks from multiple threads as long as
+ *		the flash driver is.
+ *
+ * \see uffs_FlashReadPageTag()
+ */
+int uffs_FlashReadPageTagEx(uffs_Device *dev,
+							int block, int page, uffs_Tags *tag, u8 *spare_buf)
+{
+	uffs_FlashOps *ops = dev->ops;
+	int ret = UFFS_FLASH_UNKNOWN_ERR;
+
 	if (spare_buf == NULL)
 		goto ext;
 
@@ -411,72 +501,81 @@ int uffs_FlashReadPageTag(uffs_Device *dev,
 		}
 	}
 
-
-	if (UFFS_FLASH_HAVE_ERR(ret))
-		goto ext;
-
-	if (tag) {
-		if (!TAG_IS_SEALED(tag))	// not sealed ? don't try tag ECC correction
-			goto ext;
-
-		// do tag ecc correction
-		if (dev->attr->ecc_opt != UFFS_ECC_NONE) {
-			ret_tmp = TagEccCorrect(&tag->s);
-			ret_tmp = (ret_tmp < 0 ? UFFS_FLASH_ECC_FAIL :
-					(ret_tmp > 0 ? UFFS_FLASH_ECC_OK : UFFS_FLASH_NO_ERR));
-
-			if (UFFS_FLASH_HAVE_ERR(ret_tmp) || ret_tmp == UFFS_FLASH_ECC_OK) {
-				// overwrite ret with ret_tmp only when tag ECC failed or corrected bit flip(s),
-				// so that if flash driver has the capability of ECC, the result will propagete to upper level.
-				ret = ret_tmp;
-			}
-		}
-	}
-
 ext:
-	if (spare_buf)
-		uffs_PoolPut(SPOOL(dev), spare_buf);
-
-	if (UFFS_FLASH_IS_BAD_BLOCK(ret)) {
-		uffs_Perror(UFFS_MSG_NORMAL, "new bad block %d found while reading page %d tag", block, page);
-	}
-	else if (ret == UFFS_FLASH_ECC_OK) {
-		uffs_Perror(UFFS_MSG_NOISY, "block %d page %d tag has bit flip and corrected by ECC", block, page);
-	}
-	else if (UFFS_FLASH_HAVE_ERR(ret)) {
-		uffs_Perror(UFFS_MSG_NORMAL, "read block %d page %d tag failed, error = %d", block, page, ret);
-	}
+	return _CheckPageTag(dev, block, page, tag, ret);
+}
 
-	return ret;
+/**
+ * get seal byte from spare
+ *
+ * \note for flash driver which implements 'ReadBlockTags()' with UFFS layout.
+ */
+u8 uffs_FlashGetSealByte(uffs_Device *dev, const u8 *spare)
+{
+	return SEAL_BYTE(dev, spare);
 }
 
 /**
- * Read page data to buf (do ECC error correction if needed)
+ * Read tag stores and seal bytes of n pages in a block with driver's 'ReadBlockTags()'.
+ *
  * \param[in] dev uffs device
  * \param[in] block flash block num
- * \param[in] page flash page num of the block
- * \param[out] buf holding the read out data
- * \param[in] skip_ecc skip ecc when reading data from flash
+ * \param[in] page first page num
+ * \param[in] n number of pages
+ * \param[out] ts tag store array of n pages
+ * \param[out] seal seal byte array of n pages
  *
- * \return	#UFFS_FLASH_NO_ERR: success and/or has no flip bits
- *			#UFFS_FLASH_ECC_OK: spare data has flip bits and corrected by ecc
- *			#UFFS_FLASH_IO_ERR: I/O error, expect retry ?
- *			#UFFS_FLASH_ECC_FAIL: spare data has flip bits and ecc correct failed
- *			#UFFS_FLASH_BAD_BLK: this is a bad block
- *			#UFFS_FLASH_CRC_ERR: CRC verification failed
- *			#UFFS_FLASH_UNKNOWN_ERR: memory allocation failure, etc.
+ * \return	#UFFS_FLASH_NO_ERR: success, all pages are read without any flip bits
+ *			#UFFS_FLASH_UNKNOWN_ERR: driver doesn't implement 'ReadBlockTags()'
+ *			others: result of driver, the result of each page is not known.
  *
- * \note if skip_ecc is U_TRUE, skip CRC as well.
+ * \note on any result other than #UFFS_FLASH_NO_ERR, caller should read tags
+ *		page by page with uffs_FlashReadPageTag() to get the result of each page.
+ *		tag ECC is not checked, call uffs_FlashUnpackTag() for each page.
  */
-int uffs_FlashReadPage(uffs_Device *dev, int block, int page, uffs_Buf *buf, UBOOL skip_ecc)
+int uffs_FlashReadBlockTags(uffs_Device *dev, int block, int page, int n,
+							uffs_TagStore *ts, u8 *seal)
+{
+	uffs_FlashOps *ops = dev->ops;
+
+	if (ops->ReadBlockTags == NULL)
+		return UFFS_FLASH_UNKNOWN_ERR;
+
+	return ops->ReadBlockTags(dev, block, page, n, ts, seal);
+}
+
+/**
+ * Fill tag with tag store and seal byte read by uffs_FlashReadBlockTags(),
+ * do tag ECC correction. Only for tags read with #UFFS_FLASH_NO_ERR result.
+ *
+ * \return	#UFFS_FLASH_NO_ERR: success and has no flip bits
+ *			#UFFS_FLASH_ECC_OK: tag has flip bits and corrected by ecc
+ *			#UFFS_FLASH_ECC_FAIL: tag has flip bits and ecc correct failed
+ */
+int uffs_FlashUnpackTag(uffs_Device *dev, int block, int page,
+						const uffs_TagStore *ts, u8 seal, uffs_Tags *tag)
+{
+	memcpy(&tag->s, ts, sizeof(uffs_TagStore));
+	tag->seal_byte = seal;
+
+	return _CheckPageTag(dev, block, page, tag, UFFS_FLASH_NO_ERR);
+}
+
+/**
+ * Read whole page (mini header + data) to <header>, do ECC error correction
+ * and CRC check if needed. see uffs_FlashReadPage() for return values.
+ */
+static int _FlashReadPage(uffs_Device *dev, int block, int page, u8 *header, UBOOL skip_ecc)
 {
 	uffs_FlashOps *ops = dev->ops;
 	struct uffs_StorageAttrSt *attr = dev->attr;
 	int size = dev->com.pg_size;
-	u8 ecc_buf[UFFS_MAX_ECC_SIZE];
-	u8 ecc_store[UFFS_MAX_ECC_SIZE];
+	u8 *ecc_buf;
+	u8 *ecc_store;
 #ifdef CONFIG_ENABLE_PAGE_DATA_CRC
 	UBOOL crc_ok = U_TRUE;
+	struct uffs_MiniHeaderSt mh;	// <header> may not be aligned
+	u8 *data = header + dev->com.header_size;
 #endif
 	u8 * spare;
 
@@ -487,17 +586,20 @@ int uffs_FlashReadPage(uffs_Device *dev, int block, int page, uffs_Buf *buf, UBO
 	if (spare == NULL)
 		goto ext;
 
+	ecc_buf = SPARE_BUF_ECC(dev, spare);
+	ecc_store = SPARE_BUF_ECC_STORE(dev, spare);
+
 	if (ops->ReadPageWithLayout) {
 		if (skip_ecc)
-			ret = ops->ReadPageWithLayout(dev, block, page, buf->header, size, NULL, NULL, NULL);
+			ret = ops->ReadPageWithLayout(dev, block, page, header, size, NULL, NULL, NULL);
 		else
-			ret = ops->ReadPageWithLayout(dev, block, page, buf->header, size, ecc_buf, NULL, ecc_store);
+			ret = ops->ReadPageWithLayout(dev, block, page, header, size, ecc_buf, NULL, ecc_store);
 	}
 	else {
 		if (skip_ecc)
-			ret = ops->ReadPage(dev, block, page, buf->header, size, NULL, NULL, 0);
+			ret = ops->ReadPage(dev, block, page, header, size, NULL, NULL, 0);
 		else
-			ret = ops->ReadPage(dev, block, page, buf->header, size, ecc_buf, spare, dev->mem.spare_data_size);
+			ret = ops->ReadPage(dev, block, page, header, size, ecc_buf, spare, dev->mem.spare_data_size);
 	}
 
 	if (UFFS_FLASH_HAVE_ERR(ret))
@@ -508,7 +610,8 @@ int uffs_FlashReadPage(uffs_Device *dev, int block, int page, uffs_Buf *buf, UBO
 
 #ifdef CONFIG_ENABLE_PAGE_DATA_CRC
 	if (!skip_ecc) {
-		crc_ok = (HEADER(buf)->crc == uffs_crc16sum(buf->data, size - sizeof(struct uffs_MiniHeaderSt)) ? U_TRUE : U_FALSE);
+		memcpy(&mh, header, sizeof(mh));
+		crc_ok = (mh.crc == uffs_crc16sum(data, size - sizeof(struct uffs_MiniHeaderSt)) ? U_TRUE : U_FALSE);
 
 		if (crc_ok)
 			goto ext;	// CRC is matched, no need to do ECC correction.
@@ -525,7 +628,7 @@ int uffs_FlashReadPage(uffs_Device *dev, int block, int page, uffs_Buf *buf, UBO
 
 	// make ECC for UFFS_ECC_SOFT
 	if (attr->ecc_opt == UFFS_ECC_SOFT && !skip_ecc)
-		uffs_EccMake(buf->header, size, ecc_buf);
+		uffs_EccMake(header, size, ecc_buf);
 
 	// unload ecc_store if driver doesn't do the layout
 	if (ops->ReadPageWithLayout == NULL) {
@@ -536,7 +639,7 @@ int uffs_FlashReadPage(uffs_Device *dev, int block, int page, uffs_Buf *buf, UBO
 	// check page data ecc
 	if (!skip_ecc && (dev->attr->ecc_opt == UFFS_ECC_SOFT || dev->attr->ecc_opt == UFFS_ECC_HW)) {
 
-		ret2 = uffs_EccCorrect(buf->header, size, ecc_store, ecc_buf);
+		ret2 = uffs_EccCorrect(header, size, ecc_store, ecc_buf);
 		ret2 = (ret2 < 0 ? UFFS_FLASH_ECC_FAIL :
 				(ret2 > 0 ? UFFS_FLASH_ECC_OK : UFFS_FLASH_NO_ERR));
 
@@ -552,7 +655,8 @@ int uffs_FlashReadPage(uffs_Device *dev, int block, int page, uffs_Buf *buf, UBO
 #ifdef CONFIG_ENABLE_PAGE_DATA_CRC
 	if (!skip_ecc && !UFFS_FLASH_HAVE_ERR(ret)) {
 		// Everything seems ok, do CRC check again.
-		if (HEADER(buf)->crc != uffs_crc16sum(buf->data, size - sizeof(struct uffs_MiniHeaderSt))) {
+		memcpy(&mh, header, sizeof(mh));
+		if (mh.crc != uffs_crc16sum(data, size - sizeof(struct uffs_MiniHeaderSt))) {
 			ret = UFFS_FLASH_CRC_ERR;
 			goto ext;
 		}
@@ -589,6 +693,58 @@ ext:
 	return ret;
 }
 
+/**
+ * Read page data to buf (do ECC error correction if needed)
+ * \param[in] dev uffs device
+ * \param[in] block flash block num
+ * \param[in] page flash page num of the block
+ * \param[out] buf holding the read out data
+ * \param[in] skip_ecc skip ecc when reading data from flash
+ *
+ * \return	#UFFS_FLASH_NO_ERR: success and/or has no flip bits
+ *			#UFFS_FLASH_ECC_OK: spare data has flip bits and corrected by ecc
+ *			#UFFS_FLASH_IO_ERR: I/O error, expect retry ?
+ *			#UFFS_FLASH_ECC_FAIL: spare data has flip bits and ecc correct failed
+ *			#UFFS_FLASH_BAD_BLK: this is a bad block
+ *			#UFFS_FLASH_CRC_ERR: CRC verification failed
+ *			#UFFS_FLASH_UNKNOWN_ERR: memory allocation failure, etc.
+ *
+ * \note if skip_ecc is U_TRUE, skip CRC as well.
+ */
+int uffs_FlashReadPage(uffs_Device *dev, int block, int page, uffs_Buf *buf, UBOOL skip_ecc)
+{
+	return _FlashReadPage(dev, block, page, buf->header, skip_ecc);
+}
+
+#ifdef CONFIG_ENABLE_DIRECT_READ
+/**
+ * Read page data directly to caller's buffer (do ECC error correction if needed)
+ * \param[in] dev uffs device
+ * \param[in] block flash block num
+ * \param[in] page flash page num of the block
+ * \param[out] data holding the read out page data, dev->com.pg_data_size bytes
+ * \param[in] skip_ecc skip ecc when reading data from flash
+ *
+ * \return see uffs_FlashReadPage()
+ *
+ * \note the mini header is read into dev->com.header_size bytes in front
+ *		of <data>, these bytes are restored before return, so <data> must not
+ *		be the start of caller's buffer.
+ */
+int uffs_FlashReadPageData(uffs_Device *dev, int block, int page, u8 *data, UBOOL skip_ecc)
+{
+	u8 save[sizeof(struct uffs_MiniHeaderSt)];
+	u8 *header = data - sizeof(save);
+	int ret;
+
+	memcpy(save, header, sizeof(save));
+	ret = _FlashReadPage(dev, block, page, header, skip_ecc);
+	memcpy(header, save, sizeof(save));
+
+	return ret;
+}
+#endif
+
 /**
  * make spare from tag and ecc
  *
@@ -639,45 +795,43 @@ void uffs_FlashMakeSpare(uffs_Device *dev,
 }
 
 /**
- * write the whole page, include data and tag
+ * write the whole page, include mini header, data and tag
  *
- * \param[in] dev uffs device
- * \param[in] block
- * \param[in] page
- * \param[in] buf contains data to be wrote
- * \param[in] tag tag to be wrote
+ * \param[in] header mini header, dev->com.header_size bytes
+ * \param[in] data page data, could be right after the header or separated
  *
- * \return	#UFFS_FLASH_NO_ERR: success.
- *			#UFFS_FLASH_IO_ERR: I/O error, expect retry ?
- *			#UFFS_FLASH_BAD_BLK: a new bad block detected.
+ * \note if data is not right after the header, the page is written
+ *		by driver's 'WritePageVec()'.
  */
-int uffs_FlashWritePageCombine(uffs_Device *dev,
-							   int block, int page,
-							   uffs_Buf *buf, uffs_Tags *tag)
+static int _FlashWritePage(uffs_Device *dev, int block, int page,
+						   u8 *header, const u8 *data, uffs_Tags *tag)
 {
 	uffs_FlashOps *ops = dev->ops;
 	int size = dev->com.pg_size;
-	u8 ecc_buf[UFFS_MAX_ECC_SIZE];
+	int header_size = sizeof(struct uffs_MiniHeaderSt);
+	UBOOL contiguous = (data == header + header_size ? U_TRUE : U_FALSE);
 	u8 *ecc = NULL;
 	u8 *spare;
-	struct uffs_MiniHeaderSt *header;
+	struct uffs_MiniHeaderSt *mh;
 	int ret = UFFS_FLASH_UNKNOWN_ERR;
 	UBOOL is_bad = U_FALSE;
 	uffs_Buf *verify_buf;
 #ifdef CONFIG_PAGE_WRITE_VERIFY
 	uffs_Tags chk_tag;
 #endif
+
+	CHECKPOINT_DISCARD(dev);
 	
 	spare = (u8 *) uffs_PoolGet(SPOOL(dev));
 	if (spare == NULL)
 		goto ext;
 
 	// setup header
-	header = HEADER(buf);
-	memset(header, 0xFF, sizeof(struct uffs_MiniHeaderSt));
-	header->status = 0;
+	mh = (struct uffs_MiniHeaderSt *) header;
+	memset(mh, 0xFF, sizeof(struct uffs_MiniHeaderSt));
+	mh->status = 0;
 #ifdef CONFIG_ENABLE_PAGE_DATA_CRC
-	header->crc = uffs_crc16sum(buf->data, size - sizeof(struct uffs_MiniHeaderSt));
+	mh->crc = uffs_crc16sum(data, size - header_size);
 #endif
 
 	// setup tag
@@ -691,16 +845,23 @@ int uffs_FlashWritePageCombine(uffs_Device *dev,
 		tag->s.tag_ecc = TAG_ECC_DEFAULT;
 	
 	if (dev->attr->ecc_opt == UFFS_ECC_SOFT) {
-		uffs_EccMake(buf->header, size, ecc_buf);
-		ecc = ecc_buf;
+		ecc = SPARE_BUF_ECC(dev, spare);
+		if (contiguous)
+			uffs_EccMake(header, size, ecc);
+		else
+			uffs_EccMakeEx(header, header_size, data, size - header_size, ecc);
 	}
 	else if (dev->attr->ecc_opt == UFFS_ECC_HW) {
-		ecc = ecc_buf;
+		ecc = SPARE_BUF_ECC(dev, spare);
 	}
 
 	if (ops->WritePageWithLayout) {
+		if (!uffs_Assert(contiguous, "WritePageWithLayout() can't write separated header and data")) {
+			ret = UFFS_FLASH_IO_ERR;
+			goto ext;
+		}
 		ret = ops->WritePageWithLayout(dev, block, page,
-							buf->header, size, ecc, &tag->s);
+							header, size, ecc, &tag->s);
 	}
 	else {
 
@@ -713,7 +874,15 @@ int uffs_FlashWritePageCombine(uffs_Device *dev,
 
 		uffs_FlashMakeSpare(dev, &tag->s, ecc, spare);
 
-		ret = ops->WritePage(dev, block, page, buf->header, size, spare, dev->mem.spare_data_size);
+		if (contiguous)
+			ret = ops->WritePage(dev, block, page, header, size, spare, dev->mem.spare_data_size);
+		else if (ops->WritePageVec)
+			ret = ops->WritePageVec(dev, block, page, header, header_size,
+							data, size - header_size, spare, dev->mem.spare_data_size);
+		else {
+			uffs_Perror(UFFS_MSG_SERIOUS, "WritePageVec() not implemented ?");
+			ret = UFFS_FLASH_IO_ERR;
+		}
 
 	}
 	
@@ -728,7 +897,8 @@ int uffs_FlashWritePageCombine(uffs_Device *dev,
 	if (verify_buf) {
 		ret = uffs_FlashReadPage(dev, block, page, verify_buf, U_FALSE);
 		if (!UFFS_FLASH_HAVE_ERR(ret)) {
-			if (memcmp(buf->header, verify_buf->header, size) != 0) {
+			if (memcmp(header, verify_buf->header, header_size) != 0 ||
+				memcmp(data, verify_buf->header + header_size, size - header_size) != 0) {
 				uffs_Perror(UFFS_MSG_NORMAL,
 							"Page write verify failed (block %d page %d)",
 							block, page);
@@ -769,6 +939,50 @@ ext:
 	return ret;
 }
 
+/**
+ * write the whole page, include data and tag
+ *
+ * \param[in] dev uffs device
+ * \param[in] block
+ * \param[in] page
+ * \param[in] buf contains data to be wrote
+ * \param[in] tag tag to be wrote
+ *
+ * \return	#UFFS_FLASH_NO_ERR: success.
+ *			#UFFS_FLASH_IO_ERR: I/O error, expect retry ?
+ *			#UFFS_FLASH_BAD_BLK: a new bad block detected.
+ */
+int uffs_FlashWritePageCombine(uffs_Device *dev,
+							   int block, int page,
+							   uffs_Buf *buf, uffs_Tags *tag)
+{
+	return _FlashWritePage(dev, block, page, buf->header, buf->data, tag);
+}
+
+#ifdef CONFIG_ENABLE_DIRECT_WRITE
+/**
+ * write the whole page directly from caller's buffer, include data and tag
+ *
+ * \param[in] dev uffs device
+ * \param[in] block
+ * \param[in] page
+ * \param[in] data page data to be wrote, dev->com.pg_data_size bytes
+ * \param[in] tag tag to be wrote
+ *
+ * \return see uffs_FlashWritePageCombine()
+ *
+ * \note the mini header is passed to driver's 'WritePageVec()' separately,
+ *		check uffs_FlashCanWriteDirect() before calling this function.
+ */
+int uffs_FlashWritePageData(uffs_Device *dev, int block, int page,
+							const u8 *data, uffs_Tags *tag)
+{
+	struct uffs_MiniHeaderSt mh;
+
+	return _FlashWritePage(dev, block, page, (u8 *)&mh, data, tag);
+}
+#endif
+
 /** Mark this block as bad block */
 URET uffs_FlashMarkBadBlock(uffs_Device *dev, int block)
 {
@@ -777,6 +991,8 @@ URET uffs_FlashMarkBadBlock(uffs_Device *dev, int block)
 
 	uffs_Perror(UFFS_MSG_NORMAL, "Mark bad block: %d", block);
 
+	CHECKPOINT_DISCARD(dev);
+
 	// Remove it from pending list if it's in there
 	uffs_BadBlockPendingRemove(dev, block);
 
@@ -852,10 +1068,13 @@ int uffs_FlashEraseBlock(uffs_Device *dev, int block)
 	int ret;
 	uffs_BlockInfo *bc;
 
+	CHECKPOINT_DISCARD(dev);
+
 	// this block is about to be erased, so remove it from pending list if it's added before
 	uffs_BadBlockPendingRemove(dev, block);
 
 	ret = dev->ops->EraseBlock(dev, block);
+	uffs_WearNoteErase(dev, block);
 
 	bc = uffs_BlockInfoFindInCache(dev, block);
 	if (bc) {
@@ -879,7 +1098,7 @@ URET uffs_FlashCheckErasedBlock(uffs_Device *dev, int block)
 	int ret = U_SUCC;
 	int page;
 	int flash_ret;
-	u8 ecc_store[UFFS_MAX_ECC_SIZE];
+	u8 *ecc_store;
 	uffs_TagStore ts;
 	uffs_Buf *buf = NULL;
 	int size = dev->com.pg_size;
@@ -895,6 +1114,8 @@ URET uffs_FlashCheckErasedBlock(uffs_Device *dev, int block)
 		uffs_Perror(UFFS_MSG_SERIOUS, "Can't allocate spare buf.");
 		goto ext;
 	}
+
+	ecc_store = SPARE_BUF_ECC_STORE(dev, spare);
 	
 	buf = uffs_BufClone(dev, NULL);
 	
@@ -43,6 +43,7 @@
 #include "uffs/uffs_os.h"
 #include "uffs/uffs_mtb.h"
 #include "uffs/uffs_utils.h"
+#include "uffs/uffs_wear.h"
 #include <string.h> 
 #include <stdio.h>
 
@@ -328,6 +329,11 @@ URET uffs_CreateObjectEx(uffs_Object *obj, uffs_Device *dev,
 
 	uffs_ObjectDevLock(obj);
 
+	if (uffs_TreeLazyComplete(dev) != U_SUCC) {
+		obj->err = UEIOERR;
+		goto ext_1;
+	}
+
 	if (obj->type == UFFS_TYPE_DIR) {
 		//find out whether have file with the same name
 		node = uffs_TreeFindFileNodeByName(obj->dev, obj->name,
@@ -474,6 +480,13 @@ URET uffs_OpenObjectEx(uffs_Object *obj, uffs_Device *dev,
 	obj->parent = dir;
 	obj->type = (oflag & UO_DIR ? UFFS_TYPE_DIR : UFFS_TYPE_FILE);
 	obj->pos = 0;
+#ifdef CONFIG_ENABLE_OBJECT_DNODE_CACHE
+	obj->dnode = NULL;
+#endif
+#ifdef CONFIG_ENABLE_READ_AHEAD
+	obj->ra_pos = 0;
+	obj->ra_pages = 0;
+#endif
 	obj->dev = dev;
 	obj->name = name;
 	obj->name_len = name_len;
@@ -509,6 +522,13 @@ URET uffs_OpenObjectEx(uffs_Object *obj, uffs_Device *dev,
 
 	uffs_ObjectDevLock(obj);
 
+	// writing needs the whole tree, read only access can go on with a partial tree.
+	if ((obj->oflag & (UO_WRONLY | UO_RDWR | UO_CREATE | UO_TRUNC)) &&
+		uffs_TreeLazyComplete(dev) != U_SUCC) {
+		obj->err = UEIOERR;
+		goto ext_1;
+	}
+
 	if (obj->type == UFFS_TYPE_DIR) {
 		obj->node = uffs_TreeFindDirNodeByName(obj->dev, obj->name,
 												obj->name_len, obj->sum,
@@ -540,6 +560,12 @@ URET uffs_OpenObjectEx(uffs_Object *obj, uffs_Device *dev,
 		goto ext_1;
 	}
 
+	if (obj->type == UFFS_TYPE_FILE &&
+		uffs_TreeLazyLoadFile(dev, obj->node) != U_SUCC) {
+		obj->err = UEIOERR;
+		goto ext_1;
+	}
+
 	obj->serial = GET_OBJ_NODE_SERIAL(obj);
 	obj->open_succ = U_TRUE;
 
@@ -718,6 +744,10 @@ URET uffs_FlushObject(uffs_Object *obj)
 
 	if (do_FlushObject(obj) != U_SUCC)
 		obj->err = UEIOERR;
+	else {
+		uffs_WearLevelStatic(obj->dev, U_FALSE);
+		uffs_WearSync(obj->dev, U_FALSE);
+	}
 
 	uffs_ObjectDevUnLock(obj);
 
@@ -770,7 +800,10 @@ URET uffs_CloseObject(uffs_Object *obj)
 			uffs_BufPut(dev, buf);
 		}
 #endif
-		do_FlushObject(obj);
+		if (do_FlushObject(obj) == U_SUCC) {
+			uffs_WearLevelStatic(obj->dev, U_FALSE);
+			uffs_WearSync(obj->dev, U_FALSE);
+		}
 	}
 
 	uffs_ObjectDevUnLock(obj);
@@ -807,6 +840,33 @@ static u32 GetStartOfDataBlock(uffs_Object *obj, u16 fdn)
 	}
 }
 
+/**
+ * find data node of the file, fdn > 0
+ * the last found data node is remembered by obj, so sequential
+ * reading/writing does not need to search the tree for every page.
+ */
+static TreeNode * GetDataNode(uffs_Object *obj, u16 fdn)
+{
+	uffs_Device *dev = obj->dev;
+	u16 serial = obj->node->u.file.serial;
+#ifdef CONFIG_ENABLE_OBJECT_DNODE_CACHE
+	TreeNode *dnode = obj->dnode;
+
+	if (dnode && obj->dnode_fdn == fdn && obj->dnode_gen == dev->tree.data_gen &&
+			dnode->u.data.parent == serial && dnode->u.data.serial == fdn)
+		return dnode;
+
+	dnode = uffs_TreeFindDataNode(dev, serial, fdn);
+	obj->dnode = dnode;
+	obj->dnode_fdn = fdn;
+	obj->dnode_gen = dev->tree.data_gen;
+
+	return dnode;
+#else
+	return uffs_TreeFindDataNode(dev, serial, fdn);
+#endif
+}
+
 
 static int do_WriteNewBlock(uffs_Object *obj,
 						  const void *data, u32 len,
@@ -846,6 +906,46 @@ static int do_WriteNewBlock(uffs_Object *obj,
 	return wroteSize;
 }
 
+#ifdef CONFIG_ENABLE_DIRECT_WRITE
+/**
+ * write whole pages of a new data block directly from caller's buffer.
+ *
+ * \return bytes wrote, 0 if data should be written through page buffers.
+ */
+static int do_WriteNewBlockDirect(uffs_Object *obj,
+								  const void *data, u32 len,
+								  u16 parent,
+								  u16 serial)
+{
+	uffs_Device *dev = obj->dev;
+	TreeNode *fnode = obj->node;
+	u32 pages;
+
+	if (data == NULL || !uffs_FlashCanWriteDirect(dev))
+		return 0;
+
+	pages = len / dev->com.pg_data_size;
+	if (pages > dev->attr->pages_per_block)
+		pages = dev->attr->pages_per_block;
+
+	if (pages == 0 || uffs_BufFindGroupSlot(dev, parent, serial) >= 0)
+		return 0;
+
+	// make sure the previous data block (if exist) been flushed first.
+	if (serial > 1)
+		uffs_BufFlushGroup(dev, parent, serial - 1);
+	else
+		uffs_BufFlushGroup(dev, fnode->u.file.parent, fnode->u.file.serial);
+
+	if (uffs_BufWriteBlockDirect(dev, parent, serial, (const u8 *)data, pages) != U_SUCC)
+		return 0;
+
+	fnode->u.file.len += pages * dev->com.pg_data_size;
+
+	return pages * dev->com.pg_data_size;
+}
+#endif
+
 static int do_WriteInternalBlock(uffs_Object *obj,
 							   TreeNode *node,
 							   u16 fdn,
@@ -963,6 +1063,14 @@ static int do_WriteObject(uffs_Object *obj, const void *data, int len)
 				uffs_Perror(UFFS_MSG_NOISY, "insufficient block in write obj, new block");
 				break;
 			}
+#ifdef CONFIG_ENABLE_DIRECT_WRITE
+			size = do_WriteNewBlockDirect(obj, data ? (u8 *)data + len - remain : NULL,
+										remain, fnode->u.file.serial, fdn);
+			if (size > 0) {
+				remain -= size;
+				continue;
+			}
+#endif
 			size = do_WriteNewBlock(obj, data ? (u8 *)data + len - remain : NULL,
 										remain, fnode->u.file.serial, fdn);
 
@@ -992,7 +1100,7 @@ static int do_WriteObject(uffs_Object *obj, const void *data, int len)
 			if(fdn == 0)
 				dnode = obj->node;
 			else
-				dnode = uffs_TreeFindDataNode(dev, fnode->u.file.serial, fdn);
+				dnode = GetDataNode(obj, fdn);
 
 			if(dnode == NULL) {
 				uffs_Perror(UFFS_MSG_SERIOUS, "can't find data node in tree ?");
@@ -1090,6 +1198,95 @@ ext:
 	return wrote;
 }
 
+#ifdef CONFIG_ENABLE_READ_AHEAD
+/**
+ * reading continues from where last reading stopped: double the
+ * read ahead window, otherwise stop reading ahead.
+ * the window never exceeds 1/4 of page buffers, so that reading ahead
+ * won't push all other pages out of buffers.
+ */
+static void UpdateReadAheadWindow(uffs_Object *obj)
+{
+	uffs_Device *dev = obj->dev;
+	int max_pages = dev->cfg.read_ahead_pages;
+
+	if (max_pages > dev->buf.buf_max / 4)
+		max_pages = dev->buf.buf_max / 4;
+	if (max_pages > dev->attr->pages_per_block)
+		max_pages = dev->attr->pages_per_block;
+
+	if (obj->pos != obj->ra_pos || max_pages < 2)
+		obj->ra_pages = 0;
+	else if (obj->ra_pages == 0)
+		obj->ra_pages = 2;
+	else if (obj->ra_pages * 2 <= max_pages)
+		obj->ra_pages *= 2;
+	else
+		obj->ra_pages = max_pages;
+}
+#endif
+
+#ifdef CONFIG_ENABLE_DIRECT_READ
+/**
+ * read a whole page of file data from flash directly to <data>,
+ * if the page is not in page buffers and holds full page data.
+ *
+ * \return page data size if the page is read,
+ *		0 if the page should be read through page buffers,
+ *		-1 on error.
+ */
+static int do_ReadPageDirect(uffs_Object *obj, u8 type, TreeNode *node, u16 page_id, u8 *data)
+{
+	uffs_Device *dev = obj->dev;
+	uffs_BlockInfo *bc;
+	u16 parent, serial, page, data_len = 0;
+	UBLOCK block;
+	int ret, pending_type;
+
+	if (type == UFFS_TYPE_FILE) {
+		parent = node->u.file.parent;
+		serial = node->u.file.serial;
+		block = node->u.file.block;
+	}
+	else {
+		parent = node->u.data.parent;
+		serial = node->u.data.serial;
+		block = node->u.data.block;
+	}
+
+	if (uffs_BufFind(dev, parent, serial, page_id))
+		return 0;	// buffered or dirty
+
+	bc = uffs_BlockInfoGet(dev, block);
+	if (bc == NULL)
+		return 0;
+
+	page = uffs_FindPageInBlockWithPageId(dev, bc, page_id);
+	if (page != UFFS_INVALID_PAGE)
+		page = uffs_FindBestPageInBlock(dev, bc, page);
+	if (page != UFFS_INVALID_PAGE)
+		data_len = TAG_DATA_LEN(GET_TAG(bc, page));
+
+	uffs_BlockInfoPut(dev, bc);
+
+	if (data_len != dev->com.pg_data_size)
+		return 0;
+
+	ret = uffs_FlashReadPageData(dev, block, page, data, obj->oflag & UO_NOECC ? U_TRUE : U_FALSE);
+
+	pending_type = uffs_BadBlockAddByFlashResult(dev, block, ret);
+	if (pending_type == UFFS_PENDING_BLK_MARKBAD ||
+		(pending_type == UFFS_PENDING_BLK_NONE && UFFS_FLASH_HAVE_ERR(ret))) {
+		uffs_Perror(UFFS_MSG_SERIOUS, "can't read page from flash, block %d page %d", block, page);
+		return -1;
+	}
+
+	dev->st.page_direct_read_count++;
+
+	return data_len;
+}
+#endif
+
 /**
  * read data from obj
  *
@@ -1113,6 +1310,9 @@ int uffs_ReadObject(uffs_Object *obj, void *data, int len)
 	u16 page_id;
 	u8 type;
 	u32 pageOfs;
+#ifdef CONFIG_ENABLE_DIRECT_READ
+	int ret;
+#endif
 
 	if (obj == NULL)
 		return 0;
@@ -1141,6 +1341,10 @@ int uffs_ReadObject(uffs_Object *obj, void *data, int len)
 
 	uffs_ObjectDevLock(obj);
 
+#ifdef CONFIG_ENABLE_READ_AHEAD
+	UpdateReadAheadWindow(obj);
+#endif
+
 	while (remain > 0) {
 		read_start = obj->pos + len - remain;
 		if (read_start >= fnode->u.file.len) {
@@ -1155,7 +1359,7 @@ int uffs_ReadObject(uffs_Object *obj, void *data, int len)
 		}
 		else {
 			type = UFFS_TYPE_DATA;
-			dnode = uffs_TreeFindDataNode(dev, fnode->u.file.serial, fdn);
+			dnode = GetDataNode(obj, fdn);
 			if (dnode == NULL) {
 				uffs_Perror(UFFS_MSG_SERIOUS, "can't get data node in entry!");
 				obj->err = UEUNKNOWN_ERR;
@@ -1174,6 +1378,29 @@ int uffs_ReadObject(uffs_Object *obj, void *data, int len)
 			page_id++;
 		}
 
+#ifdef CONFIG_ENABLE_DIRECT_READ
+		// a whole page goes to caller's buffer directly, the bytes
+		// in front of it (already read) hold the mini header temporarily.
+		if (read_start % dev->com.pg_data_size == 0 &&
+			remain >= dev->com.pg_data_size &&
+			len - remain >= dev->com.header_size) {
+			ret = do_ReadPageDirect(obj, type, dnode, (u16)page_id, (u8 *)data + len - remain);
+			if (ret < 0) {
+				obj->err = UEIOERR;
+				break;
+			}
+			if (ret > 0) {
+				remain -= ret;
+				continue;
+			}
+		}
+#endif
+
+#ifdef CONFIG_ENABLE_READ_AHEAD
+		if (obj->ra_pages > 1)
+			uffs_BufReadAhead(dev, type, dnode, (u16)page_id, obj->ra_pages, obj->oflag);
+#endif
+
 		buf = uffs_BufGetEx(dev, type, dnode, (u16)page_id, obj->oflag);
 		if (buf == NULL) {
 			uffs_Perror(UFFS_MSG_SERIOUS, "can't get buffer when read obj.");
@@ -1192,10 +1419,20 @@ int uffs_ReadObject(uffs_Object *obj, void *data, int len)
 		uffs_BufRead(dev, buf, (u8 *)data + len - remain, pageOfs, size);
 		uffs_BufPut(dev, buf);
 
+#ifdef CONFIG_ENABLE_READ_AHEAD
+		// page consumed by sequential reading, reuse it first
+		if (obj->ra_pages > 0 && pageOfs + size == buf->data_len &&
+			buf->ref_count == 0 && buf->mark == UFFS_BUF_VALID)
+			uffs_BufDropBehind(dev, buf);
+#endif
+
 		remain -= size;
 	}
 
 	obj->pos += (len - remain);
+#ifdef CONFIG_ENABLE_READ_AHEAD
+	obj->ra_pos = obj->pos;
+#endif
 
 	if (HAVE_BADBLOCK(dev)) 
 		uffs_BadBlockRecover(dev);
@@ -1641,7 +1878,7 @@ URET uffs_DeleteObject(const char * name, int *err)
 	uffs_Object *obj, *work;
 	TreeNode *node, *d_node;
 	uffs_Device *dev = NULL;
-	u16 block;
+	UBLOCK block;
 	u16 serial, parent, last_serial;
 	URET ret = U_FAIL;
 
@@ -1803,7 +2040,7 @@ URET uffs_MoveObjectEx(uffs_Object *obj,
 		fi.name_len = name_len;
 		fi.last_modify = uffs_GetCurDateTime();
 
-		buf->parent = new_parent;	// !! need to manually change the 'parent' !!
+		uffs_BufSetParent(dev, buf, new_parent);	// !! need to manually change the 'parent' !!
 		uffs_BufWrite(dev, buf, &fi, 0, sizeof(uffs_FileInfo));
 		uffs_BufPut(dev, buf);
 
@@ -1815,17 +2052,23 @@ URET uffs_MoveObjectEx(uffs_Object *obj,
 		obj->name = new_name;
 		obj->name_len = name_len;
 		obj->sum = uffs_MakeSum16(fi.name, fi.name_len);
+
+		uffs_NameCachePut(dev, (UNODE)uffs_PoolGetIndex(&(dev->mem.tree_pool), node),
+							obj->type, obj->sum, fi.name, fi.name_len);
 	}
 
 	//update the check sum and new parent of tree node
 	if (obj->type == UFFS_TYPE_DIR) {
 		obj->node->u.dir.checksum = obj->sum;
-		obj->node->u.dir.parent = new_parent;
 	}
 	else {
 		obj->node->u.file.checksum = obj->sum;
-		obj->node->u.file.parent = new_parent;
 	}
+	uffs_TreeSetNodeParent(dev, obj->type, obj->node, new_parent);
+
+	// old name is gone, new name is taken
+	uffs_DentryCacheRemoveNode(dev, obj->node);
+	uffs_DentryCacheNewName(dev, (u16)new_parent, obj->sum);
 
 ext_1:
 	uffs_ObjectDevUnLock(obj);
@@ -43,38 +43,146 @@
 #include "uffs/uffs_fs.h"
 #include "uffs/uffs_badblock.h"
 #include "uffs/uffs_utils.h"
+#include "uffs/uffs_checkpoint.h"
+#include "uffs/uffs_namecache.h"
+#include "uffs/uffs_dentry.h"
+#include "uffs/uffs_wear.h"
 #include <string.h>
 
 #define PFX "init: "
 
+#if CONFIG_USE_STATIC_MEMORY_ALLOCATOR == 0
+/* derive default tree hash bucket number from partition size:
+ * (blocks >> shift) rounded up to power of 2, limited to [min, max] */
+static int _DefaultHashBuckets(uffs_Device *dev, int shift, int min, int max)
+{
+	int blocks = dev->par.end - dev->par.start + 1;
+	int n = min;
+
+	while (n < max && n < (blocks >> shift))
+		n <<= 1;
+
+	return n;
+}
+#endif
+
+static UBOOL _IsValidHashBuckets(int n)
+{
+	return (n > 0 && n <= 0x8000 && (n & (n - 1)) == 0) ? U_TRUE : U_FALSE;
+}
+
 static URET uffs_InitDeviceConfig(uffs_Device *dev)
 {
-    if (dev->cfg.dirty_groups == 0)
-        dev->cfg.dirty_groups = MAX_DIRTY_BUF_GROUPS;
+#ifdef CONFIG_MOUNT_SCAN_THREADS
+	if (dev->cfg.scan_threads == 0)
+		dev->cfg.scan_threads = CONFIG_MOUNT_SCAN_THREADS;
 
-	if (!uffs_Assert(dev->cfg.dirty_groups >= 1 && dev->cfg.dirty_groups <= MAX_DIRTY_BUF_GROUPS,
-						"invalid config: dirty_groups = %d\n", dev->cfg.dirty_groups))
+	if (!uffs_Assert(dev->cfg.scan_threads >= 1 && dev->cfg.scan_threads <= CONFIG_MOUNT_SCAN_THREADS,
+						"invalid config: scan_threads = %d\n", dev->cfg.scan_threads))
 		return U_FAIL;
+#endif
+
+#ifdef CONFIG_ENABLE_NAME_CACHE
+#if CONFIG_USE_STATIC_MEMORY_ALLOCATOR > 0
+	dev->cfg.name_caches = MAX_CACHED_NAMES;
+#else
+	if (dev->cfg.name_caches == 0)
+		dev->cfg.name_caches = MAX_CACHED_NAMES;
+#endif
+#endif
+
+#ifdef CONFIG_ENABLE_DENTRY_CACHE
+#if CONFIG_USE_STATIC_MEMORY_ALLOCATOR > 0
+	dev->cfg.dentry_caches = MAX_CACHED_DENTRIES;
+#else
+	if (dev->cfg.dentry_caches == 0)
+		dev->cfg.dentry_caches = MAX_CACHED_DENTRIES;
+#endif
+#endif
+
+#ifdef CONFIG_ENABLE_ERASE_COUNT_TABLE
+	if (dev->cfg.erase_count_save_interval <= 0)
+		dev->cfg.erase_count_save_interval = CONFIG_ERASE_COUNT_SAVE_INTERVAL;
+#endif
+
+#ifdef CONFIG_ENABLE_STATIC_WEAR_LEVELING
+	if (dev->cfg.static_wl_threshold == 0)
+		dev->cfg.static_wl_threshold = CONFIG_STATIC_WL_THRESHOLD;
+	if (dev->cfg.static_wl_interval <= 0)
+		dev->cfg.static_wl_interval = CONFIG_STATIC_WL_INTERVAL;
+#endif
+
+#ifdef CONFIG_ENABLE_READ_AHEAD
+	if (dev->cfg.read_ahead_pages == 0)
+		dev->cfg.read_ahead_pages = CONFIG_READ_AHEAD_MAX_PAGES;
+#endif
 
 #if CONFIG_USE_STATIC_MEMORY_ALLOCATOR > 0
 	dev->cfg.bc_caches = MAX_CACHED_BLOCK_INFO;
 	dev->cfg.page_buffers = MAX_PAGE_BUFFERS;
 	dev->cfg.dirty_pages = MAX_DIRTY_PAGES_IN_A_BLOCK;
+	dev->cfg.dirty_groups = MAX_DIRTY_BUF_GROUPS;
 	dev->cfg.reserved_free_blocks = MINIMUN_ERASED_BLOCK;
+	dev->cfg.dir_hash_buckets = CONFIG_TREE_DIR_HASH_BUCKETS;
+	dev->cfg.file_hash_buckets = CONFIG_TREE_FILE_HASH_BUCKETS;
+	dev->cfg.data_hash_buckets = CONFIG_TREE_DATA_HASH_BUCKETS;
 #else
+	// 1K blocks partition gets 32/64/512 buckets, larger partition gets more.
+	// dir/file serial num never exceed MAX_UFFS_FSN so they don't need too many.
+	if (dev->cfg.dir_hash_buckets == 0)
+		dev->cfg.dir_hash_buckets = _DefaultHashBuckets(dev, 5, 8, (MAX_UFFS_FSN + 1) / 4);
+	if (dev->cfg.file_hash_buckets == 0)
+		dev->cfg.file_hash_buckets = _DefaultHashBuckets(dev, 4, 16, (MAX_UFFS_FSN + 1) / 2);
+	if (dev->cfg.data_hash_buckets == 0)
+		dev->cfg.data_hash_buckets = _DefaultHashBuckets(dev, 1, 64, 8192);
 	if (dev->cfg.bc_caches == 0)
 		dev->cfg.bc_caches = MAX_CACHED_BLOCK_INFO;
 	if (dev->cfg.page_buffers == 0)
 		dev->cfg.page_buffers = MAX_PAGE_BUFFERS;
 	if (dev->cfg.dirty_pages == 0)
 		dev->cfg.dirty_pages = MAX_DIRTY_PAGES_IN_A_BLOCK;
+	if (dev->cfg.dirty_groups == 0)
+		dev->cfg.dirty_groups = MAX_DIRTY_BUF_GROUPS;
 	if (dev->cfg.reserved_free_blocks == 0)
 		dev->cfg.reserved_free_blocks = MINIMUN_ERASED_BLOCK;
 
 	if (!uffs_Assert(dev->cfg.page_buffers - CLONE_BUFFERS_THRESHOLD >= 3, "invalid config: page_buffers = %d\n", dev->cfg.page_buffers))
 		return U_FAIL;
 
+	// each dirty group holds at least one page buffer
+	if (!uffs_Assert(dev->cfg.dirty_groups >= 1 &&
+						dev->cfg.dirty_groups <= dev->cfg.page_buffers - CLONE_BUFFERS_THRESHOLD,
+						"invalid config: dirty_groups = %d\n", dev->cfg.dirty_groups))
+		return U_FAIL;
+
+#endif
+
+#ifdef CONFIG_ENABLE_BG_FLUSH
+	if (dev->cfg.flush_expire_ms == 0)
+		dev->cfg.flush_expire_ms = CONFIG_BG_FLUSH_EXPIRE_MS;
+	if (dev->cfg.flush_high_water == 0)
+		dev->cfg.flush_high_water = (dev->cfg.page_buffers - CLONE_BUFFERS_THRESHOLD) / 2;
+	if (dev->cfg.flush_low_water == 0)
+		dev->cfg.flush_low_water = dev->cfg.flush_high_water / 2;
+
+	if (!uffs_Assert(dev->cfg.flush_high_water < 0 ||
+						(dev->cfg.flush_low_water >= 0 &&
+						 dev->cfg.flush_low_water < dev->cfg.flush_high_water),
+						"invalid config: flush watermarks = %d/%d\n",
+						dev->cfg.flush_high_water, dev->cfg.flush_low_water))
+		return U_FAIL;
 #endif
+
+	if (dev->cfg.data_hash == NULL)
+		dev->cfg.data_hash = uffs_TreeDataHash;
+
+	if (!uffs_Assert(_IsValidHashBuckets(dev->cfg.dir_hash_buckets) &&
+						_IsValidHashBuckets(dev->cfg.file_hash_buckets) &&
+						_IsValidHashBuckets(dev->cfg.data_hash_buckets),
+						"invalid config: hash buckets = %d/%d/%d\n",
+						dev->cfg.dir_hash_buckets, dev->cfg.file_hash_buckets, dev->cfg.data_hash_buckets))
+		return U_FAIL;
+
 	return U_SUCC;
 }
 
@@ -88,6 +196,12 @@ URET uffs_InitDevice(uffs_Device *dev)
         return U_FAIL;
     }
 
+	// page data length must fit in tag
+	if (dev->attr->page_data_size > UFFS_MAX_PAGE_SIZE) {
+		uffs_Perror(UFFS_MSG_DEAD, "page_data_size should not exceed %d !", UFFS_MAX_PAGE_SIZE);
+		return U_FAIL;
+	}
+
 	ret = uffs_InitDeviceConfig(dev);
 	if (ret != U_SUCC)
 		return U_FAIL;
@@ -123,12 +237,35 @@ URET uffs_InitDevice(uffs_Device *dev)
 		goto fail;
 	}
 
+#ifdef CONFIG_ENABLE_TREE_CHECKPOINT
+	ret = uffs_CheckpointInit(dev);
+	if (ret != U_SUCC) {
+		uffs_Perror(UFFS_MSG_SERIOUS, "fail to reserve checkpoint blocks");
+		goto fail;
+	}
+#endif
+
+#ifdef CONFIG_ENABLE_ERASE_COUNT_ALLOC
+	ret = uffs_WearInit(dev);
+	if (ret != U_SUCC) {
+		uffs_Perror(UFFS_MSG_SERIOUS, "fail to init erase counters");
+		goto fail;
+	}
+#endif
+
 	ret = uffs_TreeInit(dev);
 	if (ret != U_SUCC) {
 		uffs_Perror(UFFS_MSG_SERIOUS, "fail to init tree buffers");
 		goto fail;
 	}
 
+#ifdef CONFIG_ENABLE_NAME_CACHE
+	uffs_NameCacheInit(dev, dev->cfg.name_caches);
+#endif
+#ifdef CONFIG_ENABLE_DENTRY_CACHE
+	uffs_DentryCacheInit(dev, dev->cfg.dentry_caches);
+#endif
+
 	ret = uffs_BuildTree(dev);
 	if (ret != U_SUCC) {
 		uffs_Perror(UFFS_MSG_SERIOUS, "fail to build tree");
@@ -138,6 +275,18 @@ URET uffs_InitDevice(uffs_Device *dev)
 	return U_SUCC;
 
 fail:
+#ifdef CONFIG_ENABLE_ERASE_COUNT_ALLOC
+	uffs_WearRelease(dev);
+#endif
+#ifdef CONFIG_ENABLE_NAME_CACHE
+	uffs_NameCacheRelease(dev);
+#endif
+#ifdef CONFIG_ENABLE_DENTRY_CACHE
+	uffs_DentryCacheRelease(dev);
+#endif
+#ifdef CONFIG_ENABLE_TREE_CHECKPOINT
+	uffs_CheckpointRelease(dev);
+#endif
 	uffs_DeviceReleaseLock(dev);
 
 	return U_FAIL;
@@ -147,6 +296,14 @@ URET uffs_ReleaseDevice(uffs_Device *dev)
 {
 	URET ret;
 
+	// save erase counters before checkpoint, saving erases table blocks.
+	uffs_WearSync(dev, U_TRUE);
+
+#ifdef CONFIG_ENABLE_TREE_CHECKPOINT
+	// save checkpoint for next mount, it's not fatal if fail.
+	uffs_CheckpointSave(dev);
+#endif
+
 	ret = uffs_BlockInfoReleaseCache(dev);
 	if (ret != U_SUCC) {
 		uffs_Perror(UFFS_MSG_SERIOUS,  "fail to release block info.");
@@ -165,6 +322,16 @@ URET uffs_ReleaseDevice(uffs_Device *dev)
 		goto ext;
 	}
 
+#ifdef CONFIG_ENABLE_ERASE_COUNT_ALLOC
+	uffs_WearRelease(dev);
+#endif
+#ifdef CONFIG_ENABLE_NAME_CACHE
+	uffs_NameCacheRelease(dev);
+#endif
+#ifdef CONFIG_ENABLE_DENTRY_CACHE
+	uffs_DentryCacheRelease(dev);
+#endif
+
 	ret = uffs_FlashInterfaceRelease(dev);
 	if (ret != U_SUCC) {
 		uffs_Perror(UFFS_MSG_SERIOUS, "fail to release tree buffers!");
@@ -178,6 +345,9 @@ URET uffs_ReleaseDevice(uffs_Device *dev)
 		uffs_Perror(UFFS_MSG_SERIOUS, "fail to release memory allocator!");
 	}
 
+#ifdef CONFIG_ENABLE_TREE_CHECKPOINT
+	uffs_CheckpointRelease(dev);
+#endif
 	uffs_DeviceReleaseLock(dev);
 
 ext:
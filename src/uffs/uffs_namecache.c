@@ -0,0 +1,321 @@
+/*
+  This file is part of UFFS, the Ultra-low-cost Flash File System.
+  
+  Copyright (C) 2005-2009 Ricky Zheng <ricky_gz_zheng@yahoo.co.nz>
+
+  UFFS is free software; you can redistribute it and/or modify it under
+  the GNU Library General Public License as published by the Free Software 
+  Foundation; either version 2 of the License, or (at your option) any
+  later version.
+
+  UFFS is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+  or GNU Library General Public License, as applicable, for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  and GNU Library General Public License along with UFFS; if not, write
+  to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA  02110-1301, USA.
+
+  As a special exception, if other files instantiate templates or use
+  macros or inline functions from this file, or you compile this file
+  and link it with other works to produce a work based on this file,
+  this file does not by itself cause the resulting work to be covered
+  by the GNU General Public License. However the source code for this
+  file must still be made available in accordance with section (3) of
+  the GNU General Public License v2.
+ 
+  This exception does not invalidate any other reasons why a work based
+  on this file might be covered by the GNU General Public License.
+*/
+
+/**
+ * \file uffs_namecache.c
+ * \brief cache dir/file names in RAM, so that looking up an object by name
+ *        does not need to read page 0 of every node which has the same checksum.
+ * \author Ricky Zheng
+ */
+
+#include "uffs_config.h"
+#include "uffs/uffs_public.h"
+#include "uffs/uffs_tree.h"
+#include "uffs/uffs_namecache.h"
+#include <string.h>
+
+#ifdef CONFIG_ENABLE_NAME_CACHE
+
+#define PFX "ncch: "
+
+#define NC_EMPTY	0xffff
+
+/* FNV-1a, a stronger hash than the 16 bits name checksum in tree node */
+static u32 _NameHash(const char *name, u32 len)
+{
+	u32 hash = 2166136261UL;
+
+	while (len-- > 0) {
+		hash ^= (u8)(*name++);
+		hash *= 16777619UL;
+	}
+
+	return hash;
+}
+
+static u16 _Find(struct uffs_NameCacheSt *nc, UNODE node)
+{
+	u16 x = nc->bucket[GET_NAME_CACHE_HASH(node)];
+
+	while (x != NC_EMPTY && nc->entries[x].node != node)
+		x = nc->entries[x].hash_next;
+
+	return x;
+}
+
+static void _BreakFromBucket(struct uffs_NameCacheSt *nc, u16 x)
+{
+	u16 *p = &(nc->bucket[GET_NAME_CACHE_HASH(nc->entries[x].node)]);
+
+	while (*p != NC_EMPTY) {
+		if (*p == x) {
+			*p = nc->entries[x].hash_next;
+			break;
+		}
+		p = &(nc->entries[*p].hash_next);
+	}
+	nc->entries[x].node = EMPTY_NODE;
+}
+
+static void _BreakFromList(struct uffs_NameCacheSt *nc, u16 x)
+{
+	uffs_NameCacheEntry *e = &(nc->entries[x]);
+
+	if (e->prev != NC_EMPTY)
+		nc->entries[e->prev].next = e->next;
+	else
+		nc->head = e->next;
+
+	if (e->next != NC_EMPTY)
+		nc->entries[e->next].prev = e->prev;
+	else
+		nc->tail = e->prev;
+}
+
+static void _MoveToHead(struct uffs_NameCacheSt *nc, u16 x)
+{
+	uffs_NameCacheEntry *e = &(nc->entries[x]);
+
+	if (nc->head == x)
+		return;
+
+	_BreakFromList(nc, x);
+	e->prev = NC_EMPTY;
+	e->next = nc->head;
+	nc->entries[nc->head].prev = x;
+	nc->head = x;
+}
+
+static void _MoveToTail(struct uffs_NameCacheSt *nc, u16 x)
+{
+	uffs_NameCacheEntry *e = &(nc->entries[x]);
+
+	if (nc->tail == x)
+		return;
+
+	_BreakFromList(nc, x);
+	e->next = NC_EMPTY;
+	e->prev = nc->tail;
+	nc->entries[nc->tail].next = x;
+	nc->tail = x;
+}
+
+/** 
+ * \brief allocate name cache entries
+ * \param[in] dev uffs device
+ * \param[in] max_entries maximum names to be cached, 0 for disabling the cache
+ * \return U_SUCC, the cache is disabled if there is no enough memory
+ */
+URET uffs_NameCacheInit(uffs_Device *dev, int max_entries)
+{
+	struct uffs_NameCacheSt *nc = &(dev->nc);
+	int i;
+
+	memset(nc, 0, sizeof(struct uffs_NameCacheSt));
+	nc->head = nc->tail = NC_EMPTY;
+	for (i = 0; i < NAME_CACHE_ENTRY_LEN; i++)
+		nc->bucket[i] = NC_EMPTY;
+
+	if (max_entries <= 0 || dev->mem.malloc == NULL)
+		return U_SUCC;
+
+	if (max_entries >= NC_EMPTY)
+		max_entries = NC_EMPTY - 1;
+
+	nc->entries = (uffs_NameCacheEntry *)
+					dev->mem.malloc(dev, sizeof(uffs_NameCacheEntry) * max_entries);
+	if (nc->entries == NULL) {
+		uffs_Perror(UFFS_MSG_NORMAL, "no memory for name cache, disabled.");
+		return U_SUCC;
+	}
+
+	uffs_Perror(UFFS_MSG_NOISY, "alloc name cache %d bytes.",
+				sizeof(uffs_NameCacheEntry) * max_entries);
+
+	nc->count = max_entries;
+	uffs_NameCacheFlush(dev);
+
+	return U_SUCC;
+}
+
+/** 
+ * \brief drop all cached names, call this when the tree is rebuilt (format, etc.)
+ */
+void uffs_NameCacheFlush(uffs_Device *dev)
+{
+	struct uffs_NameCacheSt *nc = &(dev->nc);
+	int i;
+
+	for (i = 0; i < NAME_CACHE_ENTRY_LEN; i++)
+		nc->bucket[i] = NC_EMPTY;
+
+	for (i = 0; i < nc->count; i++) {
+		nc->entries[i].node = EMPTY_NODE;
+		nc->entries[i].hash_next = NC_EMPTY;
+		nc->entries[i].prev = (i == 0 ? NC_EMPTY : i - 1);
+		nc->entries[i].next = (i == nc->count - 1 ? NC_EMPTY : i + 1);
+	}
+	nc->head = (nc->count > 0 ? 0 : NC_EMPTY);
+	nc->tail = (nc->count > 0 ? nc->count - 1 : NC_EMPTY);
+}
+
+/** 
+ * \brief release name cache entries
+ */
+URET uffs_NameCacheRelease(uffs_Device *dev)
+{
+	struct uffs_NameCacheSt *nc = &(dev->nc);
+
+	if (nc->entries && dev->mem.free)
+		dev->mem.free(dev, nc->entries);
+
+	nc->entries = NULL;
+	nc->count = 0;
+
+	return U_SUCC;
+}
+
+/** 
+ * \brief compare name with the cached name of tree node
+ * \param[in] dev uffs device
+ * \param[in] node tree node index
+ * \param[in] type UFFS_TYPE_DIR or UFFS_TYPE_FILE
+ * \param[in] sum name checksum of tree node
+ * \param[in] name name to be compared
+ * \param[in] len name length
+ * \param[out] matched compare result
+ * \return U_TRUE if the result is decided by cache,
+ *			U_FALSE if caller need to load the name from flash.
+ */
+UBOOL uffs_NameCacheCompare(uffs_Device *dev, UNODE node, u8 type, u16 sum,
+							const char *name, u32 len, UBOOL *matched)
+{
+	struct uffs_NameCacheSt *nc = &(dev->nc);
+	uffs_NameCacheEntry *e;
+	u16 x;
+
+	if (nc->entries == NULL)
+		return U_FALSE;
+
+	x = _Find(nc, node);
+	if (x == NC_EMPTY) {
+		nc->miss++;
+		return U_FALSE;
+	}
+
+	e = &(nc->entries[x]);
+	if (e->type != type || e->sum != sum) {
+		// node is changed behind the cache ?
+		_BreakFromBucket(nc, x);
+		_MoveToTail(nc, x);
+		nc->miss++;
+		return U_FALSE;
+	}
+
+	if (len != e->name_len || _NameHash(name, len) != e->hash) {
+		*matched = U_FALSE;
+	}
+	else if (len <= CONFIG_NAME_CACHE_NAME_LEN) {
+		*matched = (memcmp(name, e->name, len) == 0 ? U_TRUE : U_FALSE);
+	}
+	else {
+		// long name is not cached, only the hash.
+		nc->miss++;
+		return U_FALSE;
+	}
+
+	_MoveToHead(nc, x);
+	nc->hit++;
+
+	return U_TRUE;
+}
+
+/** 
+ * \brief put name of tree node to cache, replace the least recently used entry
+ * \param[in] dev uffs device
+ * \param[in] node tree node index
+ * \param[in] type UFFS_TYPE_DIR or UFFS_TYPE_FILE
+ * \param[in] sum name checksum of tree node
+ * \param[in] name name of the object
+ * \param[in] len name length
+ */
+void uffs_NameCachePut(uffs_Device *dev, UNODE node, u8 type, u16 sum,
+						const char *name, u32 len)
+{
+	struct uffs_NameCacheSt *nc = &(dev->nc);
+	uffs_NameCacheEntry *e;
+	u16 x;
+
+	if (nc->entries == NULL || len > MAX_FILENAME_LENGTH)
+		return;
+
+	x = _Find(nc, node);
+	if (x == NC_EMPTY) {
+		x = nc->tail;
+		e = &(nc->entries[x]);
+		if (e->node != EMPTY_NODE)
+			_BreakFromBucket(nc, x);
+		e->node = node;
+		e->hash_next = nc->bucket[GET_NAME_CACHE_HASH(node)];
+		nc->bucket[GET_NAME_CACHE_HASH(node)] = x;
+	}
+
+	e = &(nc->entries[x]);
+	e->type = type;
+	e->sum = sum;
+	e->name_len = (u8)len;
+	e->hash = _NameHash(name, len);
+	if (len <= CONFIG_NAME_CACHE_NAME_LEN)
+		memcpy(e->name, name, len);
+
+	_MoveToHead(nc, x);
+}
+
+/** 
+ * \brief drop cached name of tree node, call this when the node is removed from tree.
+ */
+void uffs_NameCacheRemove(uffs_Device *dev, UNODE node)
+{
+	struct uffs_NameCacheSt *nc = &(dev->nc);
+	u16 x;
+
+	if (nc->entries == NULL)
+		return;
+
+	x = _Find(nc, node);
+	if (x != NC_EMPTY) {
+		_BreakFromBucket(nc, x);
+		_MoveToTail(nc, x);
+	}
+}
+
+#endif
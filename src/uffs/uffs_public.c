@@ -275,9 +275,9 @@ URET uffs_CreateNewFile(uffs_Device *dev,
 	uffs_BlockInfoLoad(dev, bc, 0);
 
 	tag = GET_TAG(bc, 0);
-	TAG_PARENT(tag) = parent;
+	TAG_SET_PARENT(tag, parent);
 	TAG_SERIAL(tag) = serial;
-	TAG_DATA_LEN(tag) = sizeof(uffs_FileInfo);
+	TAG_SET_DATA_LEN(tag, sizeof(uffs_FileInfo));
 
 	buf = uffs_BufGet(dev, parent, serial, 0);
 	if (buf == NULL) {
@@ -356,12 +356,19 @@ int uffs_GetBlockFileDataLength(uffs_Device *dev, uffs_BlockInfo *bc, u8 type)
  * get free pages number
  * \param[in] dev uffs device
  * \param[in] bc block info
+ * \note block with summary has no free page: pages can't be programmed
+ *		below the summary page, the block will be recovered instead.
  */
 int uffs_GetFreePagesCount(uffs_Device *dev, uffs_BlockInfo *bc)
 {
 	int count = 0;
 	int i;
 
+#ifdef CONFIG_ENABLE_BLOCK_SUMMARY
+	if (uffs_BlockInfoHasSummary(dev, bc))
+		return 0;
+#endif
+
 	// search from the last page ... to first page
 	for (i = dev->attr->pages_per_block - 1; i >= 0; i--) {
 		uffs_BlockInfoLoad(dev, bc, i);
@@ -406,6 +413,10 @@ UBOOL uffs_IsPageErased(uffs_Device *dev, uffs_BlockInfo *bc, u16 page)
  */
 int uffs_GetDeviceUsed(uffs_Device *dev)
 {
+#ifdef CONFIG_ENABLE_LAZY_MOUNT
+	uffs_TreeLazyComplete(dev);
+#endif
+
 	return (dev->par.end - dev->par.start + 1 -
 			dev->tree.bad_count	- dev->tree.erased_count
 			) *
@@ -418,6 +429,10 @@ int uffs_GetDeviceUsed(uffs_Device *dev)
  */
 int uffs_GetDeviceFree(uffs_Device *dev)
 {
+#ifdef CONFIG_ENABLE_LAZY_MOUNT
+	uffs_TreeLazyComplete(dev);
+#endif
+
 	return dev->tree.erased_count *
 			dev->attr->page_data_size *
 				dev->attr->pages_per_block;
@@ -42,6 +42,10 @@
 #include "uffs/uffs_pool.h"
 #include "uffs/uffs_flash.h"
 #include "uffs/uffs_badblock.h"
+#include "uffs/uffs_checkpoint.h"
+#include "uffs/uffs_namecache.h"
+#include "uffs/uffs_dentry.h"
+#include "uffs/uffs_wear.h"
 
 #include <string.h>
 
@@ -55,12 +59,36 @@ static void uffs_InsertToDataEntry(uffs_Device *dev, TreeNode *node);
 
 static TreeNode * uffs_TreeGetErasedNodeNoCheck(uffs_Device *dev);
 
+#ifdef CONFIG_ENABLE_LAZY_MOUNT
+static UBOOL _LazyScanMore(uffs_Device *dev, u8 type);
+#define LAZY_SCAN_MORE(dev, type)	_LazyScanMore(dev, type)
+#else
+#define LAZY_SCAN_MORE(dev, type)	U_FALSE
+#endif
 
-struct BlockTypeStatSt {
-	int dir;
-	int file;
-	int data;
-};
+
+/** 
+ * \brief empty erased block and bad block list/bitmap
+ */
+static void _InitBlockSets(uffs_Device *dev)
+{
+	struct uffs_TreeSt *tree = &(dev->tree);
+#ifdef CONFIG_ENABLE_TREE_BLOCK_BITMAP
+	int n = TREE_MAP_BYTES(dev->par.end - dev->par.start + 1);
+
+	memset(tree->erased_map, 0, n);
+	memset(tree->check_map, 0, n);
+	memset(tree->bad_map, 0, n);
+	tree->erased_next = 0;
+#else
+	tree->erased = NULL;
+	tree->erased_tail = NULL;
+	tree->bad = NULL;
+#endif
+	tree->erased_count = 0;
+	tree->bad_count = 0;
+	uffs_WearHeapReset(dev);
+}
 
 /** 
  * \brief initialize tree buffers
@@ -70,52 +98,102 @@ URET uffs_TreeInit(uffs_Device *dev)
 {
 	int size;
 	int num;
+	int total;
 	uffs_Pool *pool;
 	int i;
+	int buckets;
+	u8 *index;
 
 	size = sizeof(TreeNode);
 	num = dev->par.end - dev->par.start + 1;
+	buckets = dev->cfg.dir_hash_buckets + dev->cfg.file_hash_buckets + dev->cfg.data_hash_buckets;
+	total = size * num;
+#ifdef CONFIG_ENABLE_TREE_CHILD_INDEX
+	total += sizeof(UNODE) * num;				// child chain links follow tree nodes
+#endif
+	total += sizeof(UNODE) * buckets;			// then the hash buckets
+#ifdef CONFIG_ENABLE_TREE_BLOCK_INDEX
+	total += (sizeof(UNODE) + sizeof(u8)) * num;	// then the block index
+#endif
+#ifdef CONFIG_ENABLE_TREE_BLOCK_BITMAP
+	total += TREE_MAP_BYTES(num) * 3;			// then erased, need check and bad block bitmaps
+#endif
 	
 	pool = &(dev->mem.tree_pool);
 
 	if (dev->mem.tree_nodes_pool_size == 0) {
 		if (dev->mem.malloc) {
-			dev->mem.tree_nodes_pool_buf = dev->mem.malloc(dev, size * num);
+			dev->mem.tree_nodes_pool_buf = dev->mem.malloc(dev, total);
 			if (dev->mem.tree_nodes_pool_buf)
-				dev->mem.tree_nodes_pool_size = size * num;
+				dev->mem.tree_nodes_pool_size = total;
 		}
 	}
-	if (size * num > dev->mem.tree_nodes_pool_size) {
+	if (total > dev->mem.tree_nodes_pool_size) {
 		uffs_Perror(UFFS_MSG_DEAD,
 					"Tree buffer require %d but only %d available.",
-					size * num, dev->mem.tree_nodes_pool_size);
+					total, dev->mem.tree_nodes_pool_size);
 		memset(pool, 0, sizeof(uffs_Pool));
 		return U_FAIL;
 	}
-	uffs_Perror(UFFS_MSG_NOISY, "alloc tree nodes %d bytes.", size * num);
+	uffs_Perror(UFFS_MSG_NOISY, "alloc tree nodes %d bytes.", total);
 	
 	uffs_PoolInit(pool, dev->mem.tree_nodes_pool_buf,
-					dev->mem.tree_nodes_pool_size, size, num, U_FALSE);
+					size * num, size, num, U_FALSE);
 
-	dev->tree.erased = NULL;
-	dev->tree.erased_tail = NULL;
-	dev->tree.erased_count = 0;
-	dev->tree.bad = NULL;
-	dev->tree.bad_count = 0;
+	index = (u8 *)dev->mem.tree_nodes_pool_buf + size * num;
 
-	for (i = 0; i < DIR_NODE_ENTRY_LEN; i++) {
-		dev->tree.dir_entry[i] = EMPTY_NODE;
+#ifdef CONFIG_ENABLE_TREE_CHILD_INDEX
+	dev->tree.child_next = (UNODE *)index;
+	index += sizeof(UNODE) * num;
+	for (i = 0; i < num; i++) {
+		dev->tree.child_next[i] = EMPTY_NODE;
 	}
+	for (i = 0; i < CHILD_NODE_ENTRY_LEN; i++) {
+		dev->tree.dir_child[i] = EMPTY_NODE;
+		dev->tree.file_child[i] = EMPTY_NODE;
+	}
+#endif
 
-	for (i = 0; i < FILE_NODE_ENTRY_LEN; i++) {
-		dev->tree.file_entry[i] = EMPTY_NODE;
+	dev->tree.dir_entry = (UNODE *)index;
+	dev->tree.file_entry = dev->tree.dir_entry + dev->cfg.dir_hash_buckets;
+	dev->tree.data_entry = dev->tree.file_entry + dev->cfg.file_hash_buckets;
+	dev->tree.dir_mask = dev->cfg.dir_hash_buckets - 1;
+	dev->tree.file_mask = dev->cfg.file_hash_buckets - 1;
+	dev->tree.data_mask = dev->cfg.data_hash_buckets - 1;
+	dev->tree.data_hash = dev->cfg.data_hash;
+	index += sizeof(UNODE) * buckets;
+	for (i = 0; i < buckets; i++) {
+		dev->tree.dir_entry[i] = EMPTY_NODE;
 	}
 
-	for (i = 0; i < DATA_NODE_ENTRY_LEN; i++) {
-		dev->tree.data_entry[i] = EMPTY_NODE;
+#ifdef CONFIG_ENABLE_TREE_BLOCK_INDEX
+	dev->tree.block_node = (UNODE *)index;
+	dev->tree.block_region = (u8 *)(dev->tree.block_node + num);
+	for (i = 0; i < num; i++) {
+		dev->tree.block_node[i] = EMPTY_NODE;
 	}
+	index += (sizeof(UNODE) + sizeof(u8)) * num;
+#endif
+
+#ifdef CONFIG_ENABLE_TREE_BLOCK_BITMAP
+	dev->tree.erased_map = index;
+	dev->tree.check_map = index + TREE_MAP_BYTES(num);
+	dev->tree.bad_map = index + TREE_MAP_BYTES(num) * 2;
+#endif
+
+	_InitBlockSets(dev);
 
 	dev->tree.max_serial = ROOT_DIR_SERIAL;
+
+#ifdef CONFIG_ENABLE_OBJECT_DNODE_CACHE
+	// don't reset it, data nodes cached by objects before format are all gone
+	dev->tree.data_gen++;
+#endif
+
+#ifdef CONFIG_ENABLE_FSN_BITMAP
+	memset(dev->tree.fsn_bitmap, 0, sizeof(dev->tree.fsn_bitmap));
+	dev->tree.fsn_hint = ROOT_DIR_SERIAL + 1;
+#endif
 	
 	return U_SUCC;
 }
@@ -176,7 +254,7 @@ static UBOOL uffs_TreeProcessPendingBadBlock(uffs_Device *dev, TreeNode *node, i
     return U_FALSE;
 }
 
-static u16 _GetBlockFromNode(u8 type, TreeNode *node)
+static UBLOCK _GetBlockFromNode(u8 type, TreeNode *node)
 {
 	switch (type) {
 	case UFFS_TYPE_DIR:
@@ -190,6 +268,219 @@ static u16 _GetBlockFromNode(u8 type, TreeNode *node)
 	return UFFS_INVALID_BLOCK;
 }
 
+#ifdef CONFIG_ENABLE_TREE_BLOCK_INDEX
+/** 
+ * \brief map block to the node in given region
+ */
+static void _SetBlockIndex(uffs_Device *dev, UBLOCK block, TreeNode *node, int region)
+{
+	int i = block - dev->par.start;
+
+	if (block < dev->par.start || block > dev->par.end)
+		return;
+
+	dev->tree.block_node[i] = TO_IDX(node, TPOOL(dev));
+	dev->tree.block_region[i] = region;
+}
+
+/** 
+ * \brief remove block map, if the block is mapped to given node
+ */
+static void _ClearBlockIndex(uffs_Device *dev, UBLOCK block, TreeNode *node)
+{
+	int i = block - dev->par.start;
+
+	if (block < dev->par.start || block > dev->par.end)
+		return;
+
+	if (dev->tree.block_node[i] == TO_IDX(node, TPOOL(dev)))
+		dev->tree.block_node[i] = EMPTY_NODE;
+}
+
+/** 
+ * \brief find node by block from block index
+ * \param[in] dev uffs device
+ * \param[in] block block number
+ * \param[in|out] region search region, if node found, return the region of node
+ * \param[out] node the node found in search region, or NULL
+ * \return U_TRUE if block index is available, the result is in node.
+ *			U_FALSE if block is not indexed or the index is out of date,
+ *			the caller should search the tree.
+ */
+static UBOOL _LookupBlockIndex(uffs_Device *dev, UBLOCK block, int *region, TreeNode **node)
+{
+	int i = block - dev->par.start;
+	TreeNode *work;
+	UNODE x;
+	UBLOCK b;
+	u8 r;
+
+	if (block < dev->par.start || block > dev->par.end)
+		return U_FALSE;
+
+	x = dev->tree.block_node[i];
+	if (x == EMPTY_NODE)
+		return U_FALSE;
+
+	work = FROM_IDX(x, TPOOL(dev));
+	r = dev->tree.block_region[i];
+
+	switch (r) {
+	case SEARCH_REGION_DIR:
+		b = work->u.dir.block;
+		break;
+	case SEARCH_REGION_FILE:
+		b = work->u.file.block;
+		break;
+	case SEARCH_REGION_DATA:
+		b = work->u.data.block;
+		break;
+	default:
+		b = work->u.list.block;
+		break;
+	}
+
+	if (b != block)
+		return U_FALSE;		// node block changed behind the index
+
+	if (*region & r) {
+		*region = r;
+		*node = work;
+	}
+	else {
+		*node = NULL;
+	}
+
+	return U_TRUE;
+}
+
+/** 
+ * \brief update block index of node in tree, call this after the block of node is changed.
+ * \param[in] dev uffs device
+ * \param[in] type type of node
+ * \param[in] node node in tree
+ */
+void uffs_TreeIndexNode(uffs_Device *dev, u8 type, TreeNode *node)
+{
+	switch (type) {
+	case UFFS_TYPE_DIR:
+		_SetBlockIndex(dev, node->u.dir.block, node, SEARCH_REGION_DIR);
+		break;
+	case UFFS_TYPE_FILE:
+		_SetBlockIndex(dev, node->u.file.block, node, SEARCH_REGION_FILE);
+		break;
+	case UFFS_TYPE_DATA:
+		_SetBlockIndex(dev, node->u.data.block, node, SEARCH_REGION_DATA);
+		break;
+	}
+}
+#else
+#define _SetBlockIndex(dev, block, node, region)
+#define _ClearBlockIndex(dev, block, node)
+#define _LookupBlockIndex(dev, block, region, node)	((void)(region), U_FALSE)
+#endif
+
+#ifdef CONFIG_ENABLE_TREE_CHILD_INDEX
+static UNODE * _GetChildEntry(uffs_Device *dev, u8 type, u16 parent)
+{
+	if (type == UFFS_TYPE_DIR)
+		return &(dev->tree.dir_child[GET_CHILD_HASH(parent)]);
+	else
+		return &(dev->tree.file_child[GET_CHILD_HASH(parent)]);
+}
+
+/**
+ * \brief link dir/file node to the child chain of parent
+ */
+static void _InsertToChildEntry(uffs_Device *dev, u8 type, TreeNode *node, u16 parent)
+{
+	UNODE *entry = _GetChildEntry(dev, type, parent);
+	UNODE x = TO_IDX(node, TPOOL(dev));
+
+	dev->tree.child_next[x] = *entry;
+	*entry = x;
+}
+
+/**
+ * \brief unlink dir/file node from the child chain of parent
+ * \return U_TRUE if the node was in the chain, otherwise U_FALSE
+ */
+static UBOOL _BreakFromChildEntry(uffs_Device *dev, u8 type, TreeNode *node, u16 parent)
+{
+	UNODE *p = _GetChildEntry(dev, type, parent);
+	UNODE x = TO_IDX(node, TPOOL(dev));
+
+	while (*p != EMPTY_NODE) {
+		if (*p == x) {
+			*p = dev->tree.child_next[x];
+			dev->tree.child_next[x] = EMPTY_NODE;
+			return U_TRUE;
+		}
+		p = &(dev->tree.child_next[*p]);
+	}
+
+	return U_FALSE;
+}
+
+/**
+ * \brief move dir/file node in tree to the child chain of new parent
+ */
+static void _MoveChildEntry(uffs_Device *dev, u8 type, TreeNode *node, u16 old_parent, u16 parent)
+{
+	if (old_parent != parent && _BreakFromChildEntry(dev, type, node, old_parent) == U_TRUE)
+		_InsertToChildEntry(dev, type, node, parent);
+}
+
+/**
+ * \brief get the first node of the child chain which the children of parent are linked to.
+ * \note nodes of other parents may share the same chain, caller should check node parent.
+ * \param[in] dev uffs device
+ * \param[in] type UFFS_TYPE_DIR or UFFS_TYPE_FILE
+ * \param[in] parent parent dir serial num
+ * \return node index, or EMPTY_NODE
+ */
+UNODE uffs_TreeChildFirst(uffs_Device *dev, u8 type, u16 parent)
+{
+	return *_GetChildEntry(dev, type, parent);
+}
+
+/**
+ * \brief get the next node index in the child chain
+ */
+UNODE uffs_TreeChildNext(uffs_Device *dev, TreeNode *node)
+{
+	return dev->tree.child_next[TO_IDX(node, TPOOL(dev))];
+}
+#else
+#define _InsertToChildEntry(dev, type, node, parent)
+#define _BreakFromChildEntry(dev, type, node, parent)
+#define _MoveChildEntry(dev, type, node, old_parent, parent)
+#endif
+
+#ifdef CONFIG_ENABLE_FSN_BITMAP
+/** 
+ * \brief mark dir/file serial num as used or free in serial num bitmap
+ */
+static void _MarkFsnSerial(uffs_Device *dev, u16 serial, UBOOL used)
+{
+	struct uffs_TreeSt *tree = &(dev->tree);
+
+	if (serial > MAX_UFFS_FSN)
+		return;
+
+	if (used) {
+		tree->fsn_bitmap[serial / 8] |= (1 << (serial % 8));
+	}
+	else {
+		tree->fsn_bitmap[serial / 8] &= ~(1 << (serial % 8));
+		if (serial > ROOT_DIR_SERIAL && serial < tree->fsn_hint)
+			tree->fsn_hint = serial;
+	}
+}
+#else
+#define _MarkFsnSerial(dev, serial, used)
+#endif
+
 #if 0
 static u16 _GetParentFromNode(u8 type, TreeNode *node)
 {
@@ -278,7 +569,8 @@ static URET _BuildValidTreeNode(uffs_Device *dev,
 {
 	uffs_Tags *tag;
 	TreeNode *node_alt;
-	u16 block, parent, serial, block_alt;
+	UBLOCK block, block_alt;
+	u16 parent, serial;
 	uffs_BlockInfo *bc_alt;
 	u8 type;
 	int page;
@@ -423,6 +715,7 @@ static URET _BuildValidTreeNode(uffs_Device *dev,
 
 		info = (uffs_FileInfo *) (buf->data);
 		data_sum = uffs_MakeSum16(info->name, info->name_len);
+		uffs_NameCachePut(dev, TO_IDX(node, TPOOL(dev)), type, data_sum, info->name, info->name_len);
 		uffs_BufFreeClone(dev, buf);
 	}
 
@@ -486,7 +779,26 @@ static URET _ScanAndFixUnCleanPage(uffs_Device *dev, uffs_BlockInfo *bc)
 		The worse case: read (pages_per_block - 1) * (mini header + spares) !
 		most case: read one spare.
 	*/
-	for (page = dev->attr->pages_per_block - 1; page > 0; page--) {
+	page = dev->attr->pages_per_block - 1;
+
+	/* flash driver reads tags in bulk ? load all pages at once if the last page is not sealed,
+		fall back to page by page loading on error so that the failed page can be identified.
+	*/
+	if (dev->ops->ReadBlockTags &&
+		uffs_BlockInfoLoad(dev, bc, page) == U_SUCC && !TAG_IS_SEALED(GET_TAG(bc, page))) {
+		if (uffs_BlockInfoLoad(dev, bc, UFFS_ALL_PAGES) == U_FAIL)
+			uffs_BlockInfoExpire(dev, bc, UFFS_ALL_PAGES);
+	}
+
+#ifdef CONFIG_ENABLE_BLOCK_SUMMARY
+	/* the last page carries block summary ? it's written after all other pages
+		and no page is appended to the block later, there is no unclean page.
+	*/
+	if (uffs_BlockInfoHasSummary(dev, bc))
+		return U_SUCC;
+#endif
+
+	for (; page > 0; page--) {
 		loadStatus = uffs_BlockInfoLoad(dev, bc, page);
 		tag = GET_TAG(bc, page);
 
@@ -536,156 +848,369 @@ static URET _ScanAndFixUnCleanPage(uffs_Device *dev, uffs_BlockInfo *bc)
 }
 
 
-static URET _BuildTreeStepOne(uffs_Device *dev)
+/** 
+ * \struct BlockProbeSt
+ * \brief block status read by scan threads before building the tree
+ */
+struct BlockProbeSt {
+	UBOOL bad;						//!< known bad block ?
+	int ret[2];						//!< flash result of reading first/last page tag
+	uffs_Tags tag[2];				//!< tag of first/last page
+	URET hdr_ret;					//!< result of loading first page mini header
+	struct uffs_MiniHeaderSt hdr;	//!< first page mini header, for erased block
+};
+
+#if defined(CONFIG_MOUNT_SCAN_THREADS) && !defined(CONFIG_ENABLE_LAZY_MOUNT)
+/** 
+ * \struct ScanWorkerSt
+ * \brief scan thread context, each thread reads a separated block range
+ */
+struct ScanWorkerSt {
+	uffs_Device dev;				//!< private copy of device, for flash statistic
+	int start;						//!< first block to read
+	int end;						//!< last block to read
+	struct BlockProbeSt *probe;		//!< probe of the first block
+	u8 *spare_buf;					//!< spare buffer of this thread
+	OSTASK task;					//!< scan thread
+};
+
+/** 
+ * \brief read bad block mark, tags (and mini header) of a block range.
+ * \note only flash driver is called here, shared buffers of dev are not touched.
+ */
+static void _ProbeBlocks(void *arg)
 {
+	struct ScanWorkerSt *w = (struct ScanWorkerSt *)arg;
+	uffs_Device *dev = &(w->dev);
+	struct BlockProbeSt *p = w->probe;
+	u8 *spare_buf = w->spare_buf;
+	u16 lastPage = dev->attr->pages_per_block - 1;
+	uffs_Tags *tag;
 	int block;
-	uffs_BlockInfo *bc = NULL;
-	TreeNode *node;
-	struct uffs_TreeSt *tree;
-	uffs_Pool *pool;
-	struct uffs_MiniHeaderSt header;
-	URET ret = U_SUCC;
-	struct BlockTypeStatSt st = {0, 0, 0};
-	int flash_ret;
-	
-	tree = &(dev->tree);
-	pool = TPOOL(dev);
 
-	tree->bad = NULL;
-	tree->bad_count = 0;
-	tree->erased = NULL;
-	tree->erased_tail = NULL;
-	tree->erased_count = 0;
+	for (block = w->start; block <= w->end; block++, p++) {
+		p->ret[0] = p->ret[1] = UFFS_FLASH_UNKNOWN_ERR;
+		p->hdr_ret = U_FAIL;
 
-	uffs_Perror(UFFS_MSG_NOISY, "build tree step one");
+		p->bad = uffs_FlashIsBadBlock(dev, block);
+		if (p->bad)
+			continue;
 
-//	printf("s:%d e:%d\n", dev->par.start, dev->par.end);
-	for (block = dev->par.start; block <= dev->par.end; block++) {
-		bc = uffs_BlockInfoGet(dev, block);
-		if (bc == NULL) {
-			uffs_Perror(UFFS_MSG_SERIOUS, "step one:fail to get block info");
-			ret = U_FAIL;
-			break;
-		}
-		node = (TreeNode *)uffs_PoolGet(pool);
-		if (node == NULL) {
-			uffs_Perror(UFFS_MSG_SERIOUS, "insufficient tree node!");
-			ret = U_FAIL;
-			break;
-		}
+		tag = &(p->tag[0]);
+		p->ret[0] = uffs_FlashReadPageTagEx(dev, block, 0, tag, spare_buf);
+		if (p->ret[0] != UFFS_FLASH_NO_ERR)
+			continue;
 
-		// First, need to check bad block mark (known bad block)
-		if (uffs_FlashIsBadBlock(dev, block) == U_TRUE) {
-			node->u.list.block = block;
-			uffs_TreeInsertToBadBlockList(dev, node);
-			uffs_Perror(UFFS_MSG_NORMAL, "found bad block %d", block);
-		}
-		else if (uffs_IsPageErased(dev, bc, 0) == U_TRUE) { //@ read one spare: 0
-			// page 0 tag shows it's an erased block, we need to check the mini header status to make sure it is clean.
-			if (uffs_LoadMiniHeader(dev, block, 0, &header) == U_FAIL) {
-				uffs_Perror(UFFS_MSG_SERIOUS,
-							"I/O error when reading mini header !"
-							"block %d page %d",
-							block, 0);
-				ret = U_FAIL;
-				break;
-			}
+		if (!TAG_IS_SEALED(tag) && !TAG_IS_DIRTY(tag) && !TAG_IS_VALID(tag))
+			p->hdr_ret = uffs_LoadMiniHeader(dev, block, 0, &(p->hdr));
+		else
+			p->ret[1] = uffs_FlashReadPageTagEx(dev, block, lastPage, &(p->tag[1]), spare_buf);
+	}
+}
 
-			flash_ret = UFFS_FLASH_NO_ERR;
-			if (header.status != 0xFF) {
-				// page 0 tag is clean but page data is dirty ???
-				// this block should be erased immediately !
-				uffs_Perror(UFFS_MSG_NORMAL,
-							"first page in block %d is unclean, will be erased now!", bc->block);
-				flash_ret = uffs_FlashEraseBlock(dev, block);
-			}
-			node->u.list.block = block;
-			if (UFFS_FLASH_IS_BAD_BLOCK(flash_ret)) {
-				uffs_Perror(UFFS_MSG_NORMAL,
-							"New bad block (%d) discovered.", block);
-				uffs_BadBlockProcessNode(dev, node);
-			}
-			else {
-				// page 0 is clean does not means all pages in this block are clean,
-				// need to check this block later before use it.
-				uffs_TreeInsertToErasedListTailEx(dev, node, 1);
-			}
-		}
-		else {
-			// make sure it's not a non-recoverable bad block ...
-			if (uffs_TreeProcessPendingBadBlock(dev, node, block) == U_FALSE) {
+static void _AddFlashStat(uffs_FlashStat *st, const uffs_FlashStat *s)
+{
+	st->block_erase_count += s->block_erase_count;
+	st->page_write_count += s->page_write_count;
+	st->page_read_count += s->page_read_count;
+	st->page_header_read_count += s->page_header_read_count;
+	st->spare_write_count += s->spare_write_count;
+	st->spare_read_count += s->spare_read_count;
+	st->io_read += s->io_read;
+	st->io_write += s->io_write;
+}
 
-				// this block have valid data page(s).
-				ret = _ScanAndFixUnCleanPage(dev, bc);
-				if (ret == U_FAIL)
-					break;
+/** 
+ * \brief read all blocks of partition with dev->cfg.scan_threads threads
+ * \return probe array of all blocks, should be freed by dev->mem.free().
+ * \retval NULL multiple threads not enabled or not enough memory,
+ *			should read blocks in sequence.
+ */
+static struct BlockProbeSt * _ProbeAllBlocks(uffs_Device *dev)
+{
+	struct ScanWorkerSt *workers;
+	struct BlockProbeSt *probe;
+	u8 *spare;
+	int total = dev->par.end - dev->par.start + 1;
+	int threads = dev->cfg.scan_threads;
+	int i, n;
+
+	if (threads > total)
+		threads = total;
+
+	if (threads <= 1 || dev->mem.malloc == NULL || dev->mem.free == NULL)
+		return NULL;
+
+	probe = (struct BlockProbeSt *) dev->mem.malloc(dev, sizeof(struct BlockProbeSt) * total);
+	workers = (struct ScanWorkerSt *) dev->mem.malloc(dev, sizeof(struct ScanWorkerSt) * threads);
+	spare = (u8 *) dev->mem.malloc(dev, dev->mem.spare_data_size * threads);
+	if (probe == NULL || workers == NULL || spare == NULL) {
+		if (probe)
+			dev->mem.free(dev, probe);
+		if (workers)
+			dev->mem.free(dev, workers);
+		if (spare)
+			dev->mem.free(dev, spare);
+		return NULL;
+	}
 
-				// _ScanAndFixUnCleanPage() might add new pending block, we need to process it first.
-                if (uffs_TreeProcessPendingBadBlock(dev, node, block) == U_FALSE) {
-					ret = _BuildValidTreeNode(dev, node, bc, &st);
-					if (ret == U_FAIL)
-						break;
-				}
-			}
+	uffs_Perror(UFFS_MSG_NOISY, "read %d blocks with %d threads", total, threads);
+
+	for (i = 0, n = 0; i < threads; i++) {
+		struct ScanWorkerSt *w = &workers[i];
+
+		memcpy(&(w->dev), dev, sizeof(uffs_Device));
+		memset(&(w->dev.st), 0, sizeof(uffs_FlashStat));
+		w->start = dev->par.start + n;
+		n += (total - n) / (threads - i);
+		w->end = dev->par.start + n - 1;
+		w->probe = probe + (w->start - dev->par.start);
+		w->spare_buf = spare + dev->mem.spare_data_size * i;
+
+		// the last range is read by current thread
+		if (i == threads - 1 || uffs_TaskCreate(&(w->task), _ProbeBlocks, w) != 0) {
+			w->task = NULL;
+			_ProbeBlocks(w);
 		}
-		uffs_BlockInfoPut(dev, bc);
-	} //end of for
+	}
 
-	if(ret == U_FAIL) 
-		uffs_BlockInfoPut(dev, bc);
+	for (i = 0; i < threads; i++) {
+		if (workers[i].task)
+			uffs_TaskJoin(workers[i].task);
+		_AddFlashStat(&(dev->st), &(workers[i].dev.st));
+	}
 
-	uffs_Perror(UFFS_MSG_NORMAL,
-				"DIR %d, FILE %d, DATA %d", st.dir, st.file, st.data);
+	dev->mem.free(dev, workers);
+	dev->mem.free(dev, spare);
 
-	return ret;
+	return probe;
 }
 
-static URET _BuildTreeStepTwo(uffs_Device *dev)
+/** 
+ * \brief fill block info cache with tags read by scan threads
+ */
+static void _ProbeFillBlockInfo(uffs_Device *dev, uffs_BlockInfo *bc,
+								const struct BlockProbeSt *probe)
 {
-	//Randomise the start point of erased block to implement wear levelling
-	u32 startCount = 0;
-	u32 endPoint;
-	TreeNode *node;
+	if (probe) {
+		if (probe->ret[0] == UFFS_FLASH_NO_ERR)
+			uffs_BlockInfoFill(dev, bc, 0, &(probe->tag[0]));
+		if (probe->ret[1] == UFFS_FLASH_NO_ERR)
+			uffs_BlockInfoFill(dev, bc, dev->attr->pages_per_block - 1, &(probe->tag[1]));
+	}
+}
 
-	uffs_Perror(UFFS_MSG_NOISY, "build tree step two");
+static UBOOL _ProbeIsBadBlock(uffs_Device *dev, int block,
+								const struct BlockProbeSt *probe)
+{
+	return probe ? probe->bad : uffs_FlashIsBadBlock(dev, block);
+}
 
-	endPoint = uffs_GetCurDateTime() % (dev->tree.erased_count + 1);
-	while (startCount < endPoint) {
-		node = uffs_TreeGetErasedNodeNoCheck(dev);
-		if (node == NULL) {
-			uffs_Perror(UFFS_MSG_SERIOUS, "No erased block ?");
-			return U_FAIL;
-		}
-		uffs_TreeInsertToErasedListTailEx(dev, node, -1);
-		startCount++;
+static URET _ProbeLoadMiniHeader(uffs_Device *dev, int block,
+								const struct BlockProbeSt *probe,
+								struct uffs_MiniHeaderSt *header)
+{
+	if (probe && probe->hdr_ret == U_SUCC) {
+		memcpy(header, &(probe->hdr), sizeof(struct uffs_MiniHeaderSt));
+		return U_SUCC;
 	}
 
-	return U_SUCC;
+	return uffs_LoadMiniHeader(dev, block, 0, header);
 }
+#else
+#define _ProbeFillBlockInfo(dev, bc, probe)
+#define _ProbeIsBadBlock(dev, block, probe)				uffs_FlashIsBadBlock(dev, block)
+#define _ProbeLoadMiniHeader(dev, block, probe, header)	uffs_LoadMiniHeader(dev, block, 0, header)
+#endif
 
-TreeNode * uffs_TreeFindFileNode(uffs_Device *dev, u16 serial)
+/** 
+ * \brief scan a block, put it into erased/bad block list or tree.
+ * \param[in] dev uffs device
+ * \param[in] block block number
+ * \param[in|out] st statistic of scanned blocks
+ * \param[in] probe block status already read by scan threads, or NULL
+ */
+static URET _BuildTreeScanBlock(uffs_Device *dev, int block,
+								struct BlockTypeStatSt *st,
+								const struct BlockProbeSt *probe)
 {
-	int hash;
-	u16 x;
+	uffs_BlockInfo *bc;
 	TreeNode *node;
-	struct uffs_TreeSt *tree = &(dev->tree);
+	struct uffs_MiniHeaderSt header;
+	URET ret = U_SUCC;
+	int flash_ret;
 
-	hash = serial & FILE_NODE_HASH_MASK;
-	x = tree->file_entry[hash];
-	while (x != EMPTY_NODE) {
-		node = FROM_IDX(x, TPOOL(dev));
-		if (node->u.file.serial == serial) {
-			return node;
-		}
-		else {
-			x = node->hash_next;
-		}
+	bc = uffs_BlockInfoGet(dev, block);
+	if (bc == NULL) {
+		uffs_Perror(UFFS_MSG_SERIOUS, "step one:fail to get block info");
+		return U_FAIL;
+	}
+	node = (TreeNode *)uffs_PoolGet(TPOOL(dev));
+	if (node == NULL) {
+		uffs_Perror(UFFS_MSG_SERIOUS, "insufficient tree node!");
+		ret = U_FAIL;
+		goto ext;
 	}
-	return NULL;
-}
 
-/** add a node into suspend list */
-void uffs_TreeSuspendAdd(uffs_Device *dev, TreeNode *node)
+	_ProbeFillBlockInfo(dev, bc, probe);
+
+	// First, need to check bad block mark (known bad block)
+	if (_ProbeIsBadBlock(dev, block, probe) == U_TRUE) {
+		node->u.list.block = block;
+		uffs_TreeInsertToBadBlockList(dev, node);
+		uffs_Perror(UFFS_MSG_NORMAL, "found bad block %d", block);
+	}
+	else if (uffs_IsPageErased(dev, bc, 0) == U_TRUE) { //@ read one spare: 0
+		// page 0 tag shows it's an erased block, we need to check the mini header status to make sure it is clean.
+		if (_ProbeLoadMiniHeader(dev, block, probe, &header) == U_FAIL) {
+			uffs_Perror(UFFS_MSG_SERIOUS,
+						"I/O error when reading mini header !"
+						"block %d page %d",
+						block, 0);
+			ret = U_FAIL;
+			goto ext;
+		}
+
+		flash_ret = UFFS_FLASH_NO_ERR;
+		if (header.status != 0xFF) {
+			// page 0 tag is clean but page data is dirty ???
+			// this block should be erased immediately !
+			uffs_Perror(UFFS_MSG_NORMAL,
+						"first page in block %d is unclean, will be erased now!", bc->block);
+			flash_ret = uffs_FlashEraseBlock(dev, block);
+		}
+		node->u.list.block = block;
+		if (UFFS_FLASH_IS_BAD_BLOCK(flash_ret)) {
+			uffs_Perror(UFFS_MSG_NORMAL,
+						"New bad block (%d) discovered.", block);
+			uffs_BadBlockProcessNode(dev, node);
+		}
+		else {
+			// page 0 is clean does not means all pages in this block are clean,
+			// need to check this block later before use it.
+			uffs_TreeInsertToErasedListTailEx(dev, node, 1);
+		}
+	}
+	else {
+		// make sure it's not a non-recoverable bad block ...
+		if (uffs_TreeProcessPendingBadBlock(dev, node, block) == U_FALSE) {
+
+			// this block have valid data page(s).
+			ret = _ScanAndFixUnCleanPage(dev, bc);
+			if (ret == U_FAIL)
+				goto ext;
+
+			// _ScanAndFixUnCleanPage() might add new pending block, we need to process it first.
+			if (uffs_TreeProcessPendingBadBlock(dev, node, block) == U_FALSE) {
+				ret = _BuildValidTreeNode(dev, node, bc, st);
+			}
+		}
+	}
+
+ext:
+	uffs_BlockInfoPut(dev, bc);
+
+	return ret;
+}
+
+#ifndef CONFIG_ENABLE_LAZY_MOUNT
+static URET _BuildTreeStepOne(uffs_Device *dev)
+{
+	int block;
+	URET ret = U_SUCC;
+	struct BlockTypeStatSt st = {0, 0, 0};
+	struct BlockProbeSt *probe = NULL;
+	
+	_InitBlockSets(dev);
+
+	uffs_Perror(UFFS_MSG_NOISY, "build tree step one");
+
+#ifdef CONFIG_MOUNT_SCAN_THREADS
+	probe = _ProbeAllBlocks(dev);
+#endif
+
+//	printf("s:%d e:%d\n", dev->par.start, dev->par.end);
+	for (block = dev->par.start; block <= dev->par.end; block++) {
+		ret = _BuildTreeScanBlock(dev, block, &st,
+								  probe ? &probe[block - dev->par.start] : NULL);
+		if (ret == U_FAIL)
+			break;
+	}
+
+#ifdef CONFIG_MOUNT_SCAN_THREADS
+	if (probe)
+		dev->mem.free(dev, probe);
+#endif
+
+	uffs_Perror(UFFS_MSG_NORMAL,
+				"DIR %d, FILE %d, DATA %d", st.dir, st.file, st.data);
+
+	return ret;
+}
+#endif
+
+static URET _BuildTreeStepTwo(uffs_Device *dev)
+{
+	//Randomise the start point of erased block to implement wear levelling
+#ifndef CONFIG_ENABLE_TREE_BLOCK_BITMAP
+	u32 startCount = 0;
+	TreeNode *node;
+#endif
+	u32 endPoint;
+
+	uffs_Perror(UFFS_MSG_NOISY, "build tree step two");
+
+#ifdef CONFIG_ENABLE_ERASE_COUNT_ALLOC
+	if (dev->wear.erase_count)
+		return U_SUCC;	// erased blocks are taken by erase count, no need to rotate
+#endif
+
+#ifdef CONFIG_ENABLE_TREE_BLOCK_BITMAP
+	// erased blocks are taken in block order, just start from a random block
+	endPoint = uffs_GetCurDateTime() % (dev->par.end - dev->par.start + 1);
+	dev->tree.erased_next = (UBLOCK)endPoint;
+#else
+	endPoint = uffs_GetCurDateTime() % (dev->tree.erased_count + 1);
+	while (startCount < endPoint) {
+		node = uffs_TreeGetErasedNodeNoCheck(dev);
+		if (node == NULL) {
+			uffs_Perror(UFFS_MSG_SERIOUS, "No erased block ?");
+			return U_FAIL;
+		}
+		uffs_TreeInsertToErasedListTailEx(dev, node, -1);
+		startCount++;
+	}
+#endif
+
+	return U_SUCC;
+}
+
+TreeNode * uffs_TreeFindFileNode(uffs_Device *dev, u16 serial)
+{
+	int hash;
+	UNODE x;
+	TreeNode *node;
+	struct uffs_TreeSt *tree = &(dev->tree);
+
+	do {
+		hash = GET_FILE_HASH(dev, serial);
+		x = tree->file_entry[hash];
+		while (x != EMPTY_NODE) {
+			node = FROM_IDX(x, TPOOL(dev));
+			if (node->u.file.serial == serial) {
+				return node;
+			}
+			else {
+				x = node->hash_next;
+			}
+		}
+	} while (LAZY_SCAN_MORE(dev, UFFS_TYPE_FILE));
+
+	return NULL;
+}
+
+/** add a node into suspend list */
+void uffs_TreeSuspendAdd(uffs_Device *dev, TreeNode *node)
 {
 	node->u.list.next = dev->tree.suspend;
 	node->u.list.prev = NULL;
@@ -693,6 +1218,8 @@ void uffs_TreeSuspendAdd(uffs_Device *dev, TreeNode *node)
 	if (dev->tree.suspend)
 		dev->tree.suspend->u.list.prev = node;
 	dev->tree.suspend = node;
+
+	_MarkFsnSerial(dev, node->u.list.u.serial, U_TRUE);
 }
 
 /** search suspend list */
@@ -718,27 +1245,46 @@ void uffs_TreeRemoveSuspendNode(uffs_Device *dev, TreeNode *node)
 		node->u.list.next->u.list.prev = node->u.list.prev;
 	if (node == dev->tree.suspend)
 		dev->tree.suspend = NULL;
+
+	_MarkFsnSerial(dev, node->u.list.u.serial, U_FALSE);
 }
 
 TreeNode * uffs_TreeFindFileNodeWithParent(uffs_Device *dev, u16 parent)
 {
+#ifndef CONFIG_ENABLE_TREE_CHILD_INDEX
 	int hash;
-	u16 x;
+#endif
+	UNODE x;
 	TreeNode *node;
 	struct uffs_TreeSt *tree = &(dev->tree);
 
-	for (hash = 0; hash < FILE_NODE_ENTRY_LEN; hash++) {
-		x = tree->file_entry[hash];
+	do {
+#ifdef CONFIG_ENABLE_TREE_CHILD_INDEX
+		x = tree->file_child[GET_CHILD_HASH(parent)];
 		while (x != EMPTY_NODE) {
 			node = FROM_IDX(x, TPOOL(dev));
 			if (node->u.file.parent == parent) {
 				return node;
 			}
 			else {
-				x = node->hash_next;
+				x = tree->child_next[x];
 			}
 		}
-	}
+#else
+		for (hash = 0; hash < FILE_NODE_ENTRY_LEN(dev); hash++) {
+			x = tree->file_entry[hash];
+			while (x != EMPTY_NODE) {
+				node = FROM_IDX(x, TPOOL(dev));
+				if (node->u.file.parent == parent) {
+					return node;
+				}
+				else {
+					x = node->hash_next;
+				}
+			}
+		}
+#endif
+	} while (LAZY_SCAN_MORE(dev, UFFS_TYPE_FILE));
 
 	return NULL;
 }
@@ -746,59 +1292,82 @@ TreeNode * uffs_TreeFindFileNodeWithParent(uffs_Device *dev, u16 parent)
 TreeNode * uffs_TreeFindDirNode(uffs_Device *dev, u16 serial)
 {
 	int hash;
-	u16 x;
+	UNODE x;
 	TreeNode *node;
 	struct uffs_TreeSt *tree = &(dev->tree);
 
-	hash = serial & DIR_NODE_HASH_MASK;
-	x = tree->dir_entry[hash];
-	while (x != EMPTY_NODE) {
-		node = FROM_IDX(x, TPOOL(dev));
-		if (node->u.dir.serial == serial) {
-			return node;
-		}
-		else {
-			x = node->hash_next;
+	do {
+		hash = GET_DIR_HASH(dev, serial);
+		x = tree->dir_entry[hash];
+		while (x != EMPTY_NODE) {
+			node = FROM_IDX(x, TPOOL(dev));
+			if (node->u.dir.serial == serial) {
+				return node;
+			}
+			else {
+				x = node->hash_next;
+			}
 		}
-	}
+	} while (LAZY_SCAN_MORE(dev, UFFS_TYPE_DIR));
+
 	return NULL;
 }
 
 TreeNode * uffs_TreeFindDirNodeWithParent(uffs_Device *dev, u16 parent)
 {
+#ifndef CONFIG_ENABLE_TREE_CHILD_INDEX
 	int hash;
-	u16 x;
+#endif
+	UNODE x;
 	TreeNode *node;
 	struct uffs_TreeSt *tree = &(dev->tree);
 
-	for (hash = 0; hash < DIR_NODE_ENTRY_LEN; hash++) {
-		x = tree->dir_entry[hash];
+	do {
+#ifdef CONFIG_ENABLE_TREE_CHILD_INDEX
+		x = tree->dir_child[GET_CHILD_HASH(parent)];
 		while (x != EMPTY_NODE) {
 			node = FROM_IDX(x, TPOOL(dev));
 			if (node->u.dir.parent == parent) {
 				return node;
 			}
 			else {
-				x = node->hash_next;
+				x = tree->child_next[x];
 			}
 		}
-	}
-	
+#else
+		for (hash = 0; hash < DIR_NODE_ENTRY_LEN(dev); hash++) {
+			x = tree->dir_entry[hash];
+			while (x != EMPTY_NODE) {
+				node = FROM_IDX(x, TPOOL(dev));
+				if (node->u.dir.parent == parent) {
+					return node;
+				}
+				else {
+					x = node->hash_next;
+				}
+			}
+		}
+#endif
+	} while (LAZY_SCAN_MORE(dev, UFFS_TYPE_DIR));
+
 	return NULL;
 }
 
-TreeNode * uffs_TreeFindFileNodeByName(uffs_Device *dev,
+static TreeNode * _FindFileNodeByName(uffs_Device *dev,
 										const char *name,
 										u32 len,
 										u16 sum, u16 parent)
 {
+#ifndef CONFIG_ENABLE_TREE_CHILD_INDEX
 	int i;
-	u16 x;
+#endif
+	UNODE x;
 	TreeNode *node;
 	struct uffs_TreeSt *tree = &(dev->tree);
 	
-	for (i = 0; i < FILE_NODE_ENTRY_LEN; i++) {
-		x = tree->file_entry[i];
+	do {
+#ifdef CONFIG_ENABLE_TREE_CHILD_INDEX
+		x = tree->file_child[GET_CHILD_HASH(parent)];
 		while (x != EMPTY_NODE) {
 			node = FROM_IDX(x, TPOOL(dev));
 			if (node->u.file.checksum == sum && node->u.file.parent == parent) {
@@ -809,48 +1378,91 @@ TreeNode * uffs_TreeFindFileNodeByName(uffs_Device *dev,
 					return node;
 				}
 			}
-			x = node->hash_next;
+			x = tree->child_next[x];
 		}
-	}
+#else
+		for (i = 0; i < FILE_NODE_ENTRY_LEN(dev); i++) {
+			x = tree->file_entry[i];
+			while (x != EMPTY_NODE) {
+				node = FROM_IDX(x, TPOOL(dev));
+				if (node->u.file.checksum == sum && node->u.file.parent == parent) {
+					//read file name from flash, and compare...
+					if (uffs_TreeCompareFileName(dev, name, len, sum, 
+													node, UFFS_TYPE_FILE) == U_TRUE) {
+						//Got it!
+						return node;
+					}
+				}
+				x = node->hash_next;
+			}
+		}
+#endif
+	} while (LAZY_SCAN_MORE(dev, UFFS_TYPE_FILE));
 
 	return NULL;
 }
 
+/**
+ * \brief default data node hash function
+ * \param[in] parent serial num of the file
+ * \param[in] serial serial num of the data node in the file
+ * \return hash value, will be masked by the data node hash mask
+ * \note data nodes of one file have consecutive serial nums, the parent is
+ *		scrambled so that data nodes of different files do not start from
+ *		the same (or neighbouring) buckets.
+ */
+u16 uffs_TreeDataHash(u16 parent, u16 serial)
+{
+	u32 h = (u32)parent * 0x9e37;
+
+	h ^= h >> 7;
+
+	return (u16)(h + serial);
+}
+
 TreeNode * uffs_TreeFindDataNode(uffs_Device *dev, u16 parent, u16 serial)
 {
 	int hash;
 	TreeNode *node;
 	struct uffs_TreeSt *tree = &(dev->tree);
-	u16 x;
+	UNODE x;
 
-	hash = GET_DATA_HASH(parent, serial);
-	x = tree->data_entry[hash];
-	while(x != EMPTY_NODE) {
-		node = FROM_IDX(x, TPOOL(dev));
+	do {
+		hash = GET_DATA_HASH(dev, parent, serial);
+		x = tree->data_entry[hash];
+		while(x != EMPTY_NODE) {
+			node = FROM_IDX(x, TPOOL(dev));
 
-		if(node->u.data.parent == parent &&
-			node->u.data.serial == serial)
-				return node;
+			if(node->u.data.parent == parent &&
+				node->u.data.serial == serial)
+					return node;
 
-		x = node->hash_next;
-	}
+			x = node->hash_next;
+		}
+	} while (LAZY_SCAN_MORE(dev, UFFS_TYPE_DATA));
 
 	return NULL;
 }
 
-TreeNode * uffs_TreeFindDirNodeByBlock(uffs_Device *dev, u16 block)
+TreeNode * uffs_TreeFindDirNodeByBlock(uffs_Device *dev, UBLOCK block)
 {
 	int hash;
 	TreeNode *node;
 	struct uffs_TreeSt *tree = &(dev->tree);
-	u16 x;
+	UNODE x;
+	int region = SEARCH_REGION_DIR;
+
+	if (_LookupBlockIndex(dev, block, &region, &node) == U_TRUE)
+		return node;
 
-	for (hash = 0; hash < DIR_NODE_ENTRY_LEN; hash++) {
+	for (hash = 0; hash < DIR_NODE_ENTRY_LEN(dev); hash++) {
 		x = tree->dir_entry[hash];
 		while (x != EMPTY_NODE) {
 			node = FROM_IDX(x, TPOOL(dev));
-			if (node->u.dir.block == block)
+			if (node->u.dir.block == block) {
+				_SetBlockIndex(dev, block, node, SEARCH_REGION_DIR);
 				return node;
+			}
 			x = node->hash_next;
 		}
 	}
@@ -858,47 +1470,93 @@ TreeNode * uffs_TreeFindDirNodeByBlock(uffs_Device *dev, u16 block)
 	return NULL;
 }
 
-TreeNode * uffs_TreeFindErasedNodeByBlock(uffs_Device *dev, u16 block)
+#ifndef CONFIG_ENABLE_TREE_BLOCK_BITMAP
+TreeNode * uffs_TreeFindErasedNodeByBlock(uffs_Device *dev, UBLOCK block)
 {
 	TreeNode *node;
+	int region = SEARCH_REGION_ERASED;
+
+	if (_LookupBlockIndex(dev, block, &region, &node) == U_TRUE)
+		return node;
+
 	node = dev->tree.erased;
 
 	while (node) {
-		if (node->u.list.block == block) 
+		if (node->u.list.block == block) {
+			_SetBlockIndex(dev, block, node, SEARCH_REGION_ERASED);
 			return node;
+		}
 		node = node->u.list.next;
 	}
 		
 	return NULL;
 }
 
-TreeNode * uffs_TreeFindBadNodeByBlock(uffs_Device *dev, u16 block)
+TreeNode * uffs_TreeFindBadNodeByBlock(uffs_Device *dev, UBLOCK block)
 {
 	TreeNode *node;
+	int region = SEARCH_REGION_BAD;
+
+	if (_LookupBlockIndex(dev, block, &region, &node) == U_TRUE)
+		return node;
+
 	node = dev->tree.bad;
 
 	while (node) {
-		if (node->u.list.block == block) 
+		if (node->u.list.block == block) {
+			_SetBlockIndex(dev, block, node, SEARCH_REGION_BAD);
 			return node;
+		}
 		node = node->u.list.next;
 	}
 		
 	return NULL;
 }
+#endif
+
+/** is the block in erased block list/bitmap ? */
+UBOOL uffs_TreeIsErasedBlock(uffs_Device *dev, UBLOCK block)
+{
+#ifdef CONFIG_ENABLE_TREE_BLOCK_BITMAP
+	if (block < dev->par.start || block > dev->par.end)
+		return U_FALSE;
+	return TREE_MAP_TEST(dev->tree.erased_map, block - dev->par.start) ? U_TRUE : U_FALSE;
+#else
+	return uffs_TreeFindErasedNodeByBlock(dev, block) ? U_TRUE : U_FALSE;
+#endif
+}
+
+/** is the block in bad block list/bitmap ? */
+UBOOL uffs_TreeIsBadBlock(uffs_Device *dev, UBLOCK block)
+{
+#ifdef CONFIG_ENABLE_TREE_BLOCK_BITMAP
+	if (block < dev->par.start || block > dev->par.end)
+		return U_FALSE;
+	return TREE_MAP_TEST(dev->tree.bad_map, block - dev->par.start) ? U_TRUE : U_FALSE;
+#else
+	return uffs_TreeFindBadNodeByBlock(dev, block) ? U_TRUE : U_FALSE;
+#endif
+}
 
-TreeNode * uffs_TreeFindFileNodeByBlock(uffs_Device *dev, u16 block)
+TreeNode * uffs_TreeFindFileNodeByBlock(uffs_Device *dev, UBLOCK block)
 {
 	int hash;
 	TreeNode *node;
 	struct uffs_TreeSt *tree = &(dev->tree);
-	u16 x;
+	UNODE x;
+	int region = SEARCH_REGION_FILE;
 
-	for (hash = 0; hash < FILE_NODE_ENTRY_LEN; hash++) {
+	if (_LookupBlockIndex(dev, block, &region, &node) == U_TRUE)
+		return node;
+
+	for (hash = 0; hash < FILE_NODE_ENTRY_LEN(dev); hash++) {
 		x = tree->file_entry[hash];
 		while (x != EMPTY_NODE) {
 			node = FROM_IDX(x, TPOOL(dev));
-			if (node->u.file.block == block)
+			if (node->u.file.block == block) {
+				_SetBlockIndex(dev, block, node, SEARCH_REGION_FILE);
 				return node;
+			}
 			x = node->hash_next;
 		}
 	}
@@ -906,19 +1564,25 @@ TreeNode * uffs_TreeFindFileNodeByBlock(uffs_Device *dev, u16 block)
 	return NULL;
 }
 
-TreeNode * uffs_TreeFindDataNodeByBlock(uffs_Device *dev, u16 block)
+TreeNode * uffs_TreeFindDataNodeByBlock(uffs_Device *dev, UBLOCK block)
 {
 	int hash;
 	TreeNode *node;
 	struct uffs_TreeSt *tree = &(dev->tree);
-	u16 x;
+	UNODE x;
+	int region = SEARCH_REGION_DATA;
 
-	for (hash = 0; hash < DATA_NODE_ENTRY_LEN; hash++) {
+	if (_LookupBlockIndex(dev, block, &region, &node) == U_TRUE)
+		return node;
+
+	for (hash = 0; hash < DATA_NODE_ENTRY_LEN(dev); hash++) {
 		x = tree->data_entry[hash];
 		while (x != EMPTY_NODE) {
 			node = FROM_IDX(x, TPOOL(dev));
-			if (node->u.data.block == block)
+			if (node->u.data.block == block) {
+				_SetBlockIndex(dev, block, node, SEARCH_REGION_DATA);
 				return node;
+			}
 			x = node->hash_next;
 		}
 	}
@@ -926,10 +1590,22 @@ TreeNode * uffs_TreeFindDataNodeByBlock(uffs_Device *dev, u16 block)
 	return NULL;
 }
 
-TreeNode * uffs_TreeFindNodeByBlock(uffs_Device *dev, u16 block, int *region)
+TreeNode * uffs_TreeFindNodeByBlock(uffs_Device *dev, UBLOCK block, int *region)
 {
 	TreeNode *node = NULL;
 
+	if (uffs_TreeLazyComplete(dev) != U_SUCC)
+		return NULL;
+
+#ifdef CONFIG_ENABLE_TREE_BLOCK_BITMAP
+	// erased or bad block has no node
+	if (uffs_TreeIsErasedBlock(dev, block) || uffs_TreeIsBadBlock(dev, block))
+		return NULL;
+#endif
+
+	if (_LookupBlockIndex(dev, block, region, &node) == U_TRUE)
+		return node;
+
 	if (*region & SEARCH_REGION_DATA) {
 		node = uffs_TreeFindDataNodeByBlock(dev, block);
 		if (node) {
@@ -951,6 +1627,7 @@ TreeNode * uffs_TreeFindNodeByBlock(uffs_Device *dev, u16 block, int *region)
 			return node;
 		}
 	}
+#ifndef CONFIG_ENABLE_TREE_BLOCK_BITMAP
 	if (*region & SEARCH_REGION_ERASED) {
 		node = uffs_TreeFindErasedNodeByBlock(dev, block);
 		if (node) {
@@ -965,21 +1642,25 @@ TreeNode * uffs_TreeFindNodeByBlock(uffs_Device *dev, u16 block, int *region)
 			return node;
 		}
 	}
+#endif
 
 	return node;
 }
 
-TreeNode * uffs_TreeFindDirNodeByName(uffs_Device *dev,
+static TreeNode * _FindDirNodeByName(uffs_Device *dev,
 									  const char *name, u32 len,
 									  u16 sum, u16 parent)
 {
+#ifndef CONFIG_ENABLE_TREE_CHILD_INDEX
 	int i;
-	u16 x;
+#endif
+	UNODE x;
 	TreeNode *node;
 	struct uffs_TreeSt *tree = &(dev->tree);
 	
-	for (i = 0; i < DIR_NODE_ENTRY_LEN; i++) {
-		x = tree->dir_entry[i];
+	do {
+#ifdef CONFIG_ENABLE_TREE_CHILD_INDEX
+		x = tree->dir_child[GET_CHILD_HASH(parent)];
 		while (x != EMPTY_NODE) {
 			node = FROM_IDX(x, TPOOL(dev));
 			if (node->u.dir.checksum == sum &&
@@ -991,12 +1672,58 @@ TreeNode * uffs_TreeFindDirNodeByName(uffs_Device *dev,
 					return node;
 				}
 			}
-			x = node->hash_next;
+			x = tree->child_next[x];
 		}
-	}
+#else
+		for (i = 0; i < DIR_NODE_ENTRY_LEN(dev); i++) {
+			x = tree->dir_entry[i];
+			while (x != EMPTY_NODE) {
+				node = FROM_IDX(x, TPOOL(dev));
+				if (node->u.dir.checksum == sum &&
+						node->u.dir.parent == parent) {
+					//read file name from flash, and compare...
+					if (uffs_TreeCompareFileName(dev, name, len, sum,
+												node, UFFS_TYPE_DIR) == U_TRUE) {
+						//Got it!
+						return node;
+					}
+				}
+				x = node->hash_next;
+			}
+		}
+#endif
+	} while (LAZY_SCAN_MORE(dev, UFFS_TYPE_DIR));
 
 	return NULL;
+}
+
+TreeNode * uffs_TreeFindFileNodeByName(uffs_Device *dev,
+										const char *name,
+										u32 len,
+										u16 sum, u16 parent)
+{
+	TreeNode *node;
+
+	if (uffs_DentryCacheLookup(dev, UFFS_TYPE_FILE, parent, sum, name, len, &node) == U_FALSE) {
+		node = _FindFileNodeByName(dev, name, len, sum, parent);
+		uffs_DentryCachePut(dev, UFFS_TYPE_FILE, parent, sum, name, len, node);
+	}
 
+	return node;
+}
+
+TreeNode * uffs_TreeFindDirNodeByName(uffs_Device *dev,
+									  const char *name, u32 len,
+									  u16 sum, u16 parent)
+{
+	TreeNode *node;
+
+	if (uffs_DentryCacheLookup(dev, UFFS_TYPE_DIR, parent, sum, name, len, &node) == U_FALSE) {
+		node = _FindDirNodeByName(dev, name, len, sum, parent);
+		uffs_DentryCachePut(dev, UFFS_TYPE_DIR, parent, sum, name, len, node);
+	}
+
+	return node;
 }
 
 UBOOL uffs_CompareFileName(const char *src, int src_len, const char *des)
@@ -1020,6 +1747,12 @@ UBOOL uffs_TreeCompareFileName(uffs_Device *dev,
 	uffs_Buf *buf;
 	u16 data_sum;
 
+#ifdef CONFIG_ENABLE_NAME_CACHE
+	if (uffs_NameCacheCompare(dev, TO_IDX(node, TPOOL(dev)), (u8)type, sum,
+								name, len, &matched) == U_TRUE)
+		return matched;
+#endif
+
 	buf = uffs_BufGetEx(dev, type, node, 0, 0);
 	if (buf == NULL) {
 		uffs_Perror(UFFS_MSG_SERIOUS, "can't get buf !\n ");
@@ -1027,6 +1760,7 @@ UBOOL uffs_TreeCompareFileName(uffs_Device *dev,
 	}
 	fi = (uffs_FileInfo *)(buf->data);
 	data_sum = uffs_MakeSum16(fi->name, fi->name_len);
+	uffs_NameCachePut(dev, TO_IDX(node, TPOOL(dev)), (u8)type, data_sum, fi->name, fi->name_len);
 
 	if (data_sum != sum) {
 		uffs_Perror(UFFS_MSG_NORMAL,
@@ -1051,12 +1785,12 @@ ext:
 static URET _BuildTreeStepThree(uffs_Device *dev)
 {
 	int i;
-	u16 x;
+	UNODE x;
 	TreeNode *work;
 	TreeNode *node;
 	struct uffs_TreeSt *tree;
 	uffs_Pool *pool;
-	u16 blockSave;
+	UBLOCK blockSave;
 	int ret;
 
 	TreeNode *cache = NULL;
@@ -1067,7 +1801,7 @@ static URET _BuildTreeStepThree(uffs_Device *dev)
 
 	uffs_Perror(UFFS_MSG_NOISY, "build tree step three");
 
-	for (i = 0; i < DATA_NODE_ENTRY_LEN; i++) {
+	for (i = 0; i < DATA_NODE_ENTRY_LEN(dev); i++) {
 		x = tree->data_entry[i];
 		while (x != EMPTY_NODE) {
 			work = FROM_IDX(x, pool);
@@ -1112,22 +1846,10 @@ static URET _BuildTreeStepThree(uffs_Device *dev)
  * \brief build tree structure from flash
  * \param[in] dev uffs device
  */
-URET uffs_BuildTree(uffs_Device *dev)
+static URET _BuildTreeFinish(uffs_Device *dev)
 {
 	URET ret;
 
-	/***** step one: scan all page spares, classify DIR/FILE/DATA nodes,
-		check bad blocks/uncompleted(conflicted) blocks as well *****/
-
-	/* if the disk is big and full filled of data this step could be
-		the most time consuming .... */
-
-	ret = _BuildTreeStepOne(dev);
-	if (ret != U_SUCC) {
-		uffs_Perror(UFFS_MSG_SERIOUS, "build tree step one fail!");
-		return ret;
-	}
-	
 	/* process pending bad blocks/uncompleted blocks */
 	if (HAVE_BADBLOCK(dev))
 		uffs_BadBlockRecover(dev);
@@ -1156,6 +1878,157 @@ URET uffs_BuildTree(uffs_Device *dev)
 	return U_SUCC;
 }
 
+URET uffs_BuildTree(uffs_Device *dev)
+{
+#ifdef CONFIG_ENABLE_LAZY_MOUNT
+	struct uffs_TreeSt *tree = &(dev->tree);
+
+	memset(&tree->scan, 0, sizeof(tree->scan));
+	tree->scan.next = dev->par.start;
+#else
+	URET ret;
+#endif
+
+#ifdef CONFIG_ENABLE_TREE_CHECKPOINT
+	/* load the tree from checkpoint if there is a valid one,
+		so we don't need to do step one and step three. */
+	if (uffs_CheckpointLoad(dev) == U_SUCC) {
+#ifdef CONFIG_ENABLE_LAZY_MOUNT
+		tree->scan.done = U_TRUE;
+#endif
+		return _BuildTreeStepTwo(dev);
+	}
+#endif
+
+#ifdef CONFIG_ENABLE_LAZY_MOUNT
+	/* defer step one: blocks are scanned on demand by tree lookups,
+		or in background by uffs_TreeLazyScan(). */
+	return U_SUCC;
+#else
+	/***** step one: scan all page spares, classify DIR/FILE/DATA nodes,
+		check bad blocks/uncompleted(conflicted) blocks as well *****/
+
+	/* if the disk is big and full filled of data this step could be
+		the most time consuming .... */
+
+	ret = _BuildTreeStepOne(dev);
+	if (ret != U_SUCC) {
+		uffs_Perror(UFFS_MSG_SERIOUS, "build tree step one fail!");
+		return ret;
+	}
+
+	return _BuildTreeFinish(dev);
+#endif
+}
+
+#ifdef CONFIG_ENABLE_LAZY_MOUNT
+/** 
+ * \brief continue the deferred step one, then finish building the tree
+ *			when all blocks are scanned.
+ * \param[in] dev uffs device
+ * \param[in] blocks max blocks to be scanned, <= 0 for all remaining blocks
+ * \return U_SUCC if success (or nothing to do), U_FAIL on error
+ */
+URET uffs_TreeLazyScan(uffs_Device *dev, int blocks)
+{
+	struct uffs_TreeScanSt *scan = &(dev->tree.scan);
+	URET ret = U_SUCC;
+	int count = 0;
+
+	if (scan->failed)
+		return U_FAIL;
+
+	if (scan->done || scan->busy)
+		return U_SUCC;
+
+	scan->busy = U_TRUE;
+
+	while (scan->next <= dev->par.end && (blocks <= 0 || count++ < blocks)) {
+		ret = _BuildTreeScanBlock(dev, scan->next, &scan->st, NULL);
+		if (ret == U_FAIL) {
+			uffs_Perror(UFFS_MSG_SERIOUS, "build tree step one fail!");
+			break;
+		}
+		scan->next++;
+	}
+
+	if (ret == U_SUCC && scan->next > dev->par.end) {
+		uffs_Perror(UFFS_MSG_NORMAL,
+					"DIR %d, FILE %d, DATA %d",
+					scan->st.dir, scan->st.file, scan->st.data);
+		scan->done = U_TRUE;
+		ret = _BuildTreeFinish(dev);
+	}
+
+	if (ret == U_FAIL)
+		scan->failed = U_TRUE;
+
+	scan->busy = U_FALSE;
+
+	return ret;
+}
+
+/** 
+ * \brief scan more blocks until a new node of given type is found
+ *			or all blocks are scanned.
+ * \return U_TRUE if caller should search the tree again
+ */
+static UBOOL _LazyScanMore(uffs_Device *dev, u8 type)
+{
+	struct uffs_TreeScanSt *scan = &(dev->tree.scan);
+	int *count;
+	int old;
+
+	if (scan->done || scan->busy || scan->failed)
+		return U_FALSE;
+
+	count = (type == UFFS_TYPE_DIR ? &scan->st.dir :
+				(type == UFFS_TYPE_FILE ? &scan->st.file : &scan->st.data));
+	old = *count;
+
+	while (!scan->done && !scan->failed) {
+		uffs_TreeLazyScan(dev, 1);
+		if (*count != old)
+			return U_TRUE;
+	}
+
+	return scan->done;
+}
+
+/** 
+ * \brief finish the deferred tree building now
+ * \return U_FAIL if the tree can't be completed, otherwise U_SUCC
+ */
+URET uffs_TreeLazyComplete(uffs_Device *dev)
+{
+	// called from tree building itself ? nothing more we can do.
+	if (dev->tree.scan.done || dev->tree.scan.busy)
+		return U_SUCC;
+
+	uffs_TreeLazyScan(dev, 0);
+
+	return dev->tree.scan.done && !dev->tree.scan.failed ? U_SUCC : U_FAIL;
+}
+
+/** 
+ * \brief make sure file length is correct before using the file node.
+ *
+ * file length of a file node is not complete until all of it's data nodes
+ * are scanned, only a full filled file block can have data blocks.
+ */
+URET uffs_TreeLazyLoadFile(uffs_Device *dev, TreeNode *node)
+{
+	if (dev->tree.scan.done)
+		return U_SUCC;
+
+	if (node->u.file.len < (u32)dev->com.pg_data_size * (dev->attr->pages_per_block - 1))
+		return U_SUCC;
+
+	return uffs_TreeLazyComplete(dev);
+}
+#endif
+
+
 /** 
  * find a free file or dir serial NO
  * \param[in] dev uffs device
@@ -1164,10 +2037,28 @@ URET uffs_BuildTree(uffs_Device *dev)
 u16 uffs_FindFreeFsnSerial(uffs_Device *dev)
 {
 	u16 i;
+#ifdef CONFIG_ENABLE_FSN_BITMAP
+	struct uffs_TreeSt *tree = &(dev->tree);
+
+	if (uffs_TreeLazyComplete(dev) != U_SUCC)
+		return INVALID_UFFS_SERIAL;
+
+	for (i = tree->fsn_hint; i < MAX_UFFS_FSN; i++) {
+		if (tree->fsn_bitmap[i / 8] == 0xFF) {
+			i |= 7;		// skip the whole byte
+			continue;
+		}
+		if ((tree->fsn_bitmap[i / 8] & (1 << (i % 8))) == 0) {
+			tree->fsn_hint = i;
+			return i;
+		}
+	}
+	tree->fsn_hint = MAX_UFFS_FSN;
+#else
 	TreeNode *node;
 
-	//TODO!! Do we need a faster serial number generating method?
-	//		 it depends on how often creating files or directories
+	if (uffs_TreeLazyComplete(dev) != U_SUCC)
+		return INVALID_UFFS_SERIAL;
 
 	for (i = ROOT_DIR_SERIAL + 1; i < MAX_UFFS_FSN; i++) {
 		node = uffs_TreeFindDirNode(dev, i);
@@ -1180,15 +2071,121 @@ u16 uffs_FindFreeFsnSerial(uffs_Device *dev)
 			}
 		}
 	}
+#endif
 
 	return INVALID_UFFS_SERIAL;
 }
 
+#ifdef CONFIG_ENABLE_TREE_BLOCK_BITMAP
+/* find next erased block offset, start from tree->erased_next and wrap around.
+	return -1 if there is no erased block. */
+static int _NextErasedBlock(uffs_Device *dev)
+{
+	struct uffs_TreeSt *tree = &(dev->tree);
+	int num = dev->par.end - dev->par.start + 1;
+	int i, n;
+
+	if (tree->erased_count == 0)
+		return -1;
+
+	for (i = tree->erased_next, n = 0; n < num; ) {
+		if (i >= num)
+			i = 0;
+		if ((i & 7) == 0 && i + 8 <= num && tree->erased_map[i >> 3] == 0) {
+			i += 8;		// skip the whole byte
+			n += 8;
+			continue;
+		}
+		if (TREE_MAP_TEST(tree->erased_map, i))
+			return i;
+		i++;
+		n++;
+	}
+
+	return -1;
+}
+
+/* take erased block <i> (offset in partition) out of bitmap, and give it a tree node */
+static TreeNode * _TakeErasedBlock(uffs_Device *dev, int i)
+{
+	struct uffs_TreeSt *tree = &(dev->tree);
+	TreeNode *node;
+
+	node = (TreeNode *)uffs_PoolGet(TPOOL(dev));
+	if (node == NULL) {
+		uffs_Perror(UFFS_MSG_SERIOUS, "insufficient tree node!");
+		return NULL;
+	}
+
+	node->u.list.block = dev->par.start + i;
+	node->u.list.u.need_check = TREE_MAP_TEST(tree->check_map, i);
+	node->u.list.next = NULL;
+	node->u.list.prev = NULL;
+
+	TREE_MAP_CLR(tree->erased_map, i);
+	TREE_MAP_CLR(tree->check_map, i);
+	tree->erased_count--;
+	tree->erased_next = (i + 1 < dev->par.end - dev->par.start + 1 ? i + 1 : 0);
+
+	return node;
+}
+
+static TreeNode * uffs_TreeGetErasedNodeNoCheck(uffs_Device *dev)
+{
+	TreeNode *node;
+	UBLOCK entry;
+	int i;
+
+	// take the least worn one if erase counters are available
+	entry = uffs_WearHeapPop(dev);
+	i = (entry != WEAR_HEAP_NONE ? (int)entry : _NextErasedBlock(dev));
+	if (i < 0)
+		return NULL;
+
+	node = _TakeErasedBlock(dev, i);
+	if (node == NULL && entry != WEAR_HEAP_NONE)
+		uffs_WearHeapPush(dev, entry);
+
+	return node;
+}
+
+#else
+
+#ifdef CONFIG_ENABLE_ERASE_COUNT_ALLOC
+/* unlink a node from anywhere in erased list */
+static void _UnlinkErasedNode(uffs_Device *dev, TreeNode *node)
+{
+	_ClearBlockIndex(dev, node->u.list.block, node);
+	if (node->u.list.prev)
+		node->u.list.prev->u.list.next = node->u.list.next;
+	else
+		dev->tree.erased = node->u.list.next;
+	if (node->u.list.next)
+		node->u.list.next->u.list.prev = node->u.list.prev;
+	else
+		dev->tree.erased_tail = node->u.list.prev;
+	dev->tree.erased_count--;
+}
+#endif
+
 static TreeNode * uffs_TreeGetErasedNodeNoCheck(uffs_Device *dev)
 {
 	TreeNode *node = NULL;
+
+#ifdef CONFIG_ENABLE_ERASE_COUNT_ALLOC
+	UBLOCK entry = uffs_WearHeapPop(dev);
+
+	if (entry != WEAR_HEAP_NONE) {
+		// take the least worn one out of erased list
+		node = FROM_IDX(entry, TPOOL(dev));
+		_UnlinkErasedNode(dev, node);
+		return node;
+	}
+#endif
+
 	if (dev->tree.erased) {
 		node = dev->tree.erased;
+		_ClearBlockIndex(dev, node->u.list.block, node);
 		dev->tree.erased->u.list.prev = NULL;
 		dev->tree.erased = dev->tree.erased->u.list.next;
 		if(dev->tree.erased == NULL) 
@@ -1199,33 +2196,79 @@ static TreeNode * uffs_TreeGetErasedNodeNoCheck(uffs_Device *dev)
 	return node;
 }
 
-TreeNode * uffs_TreeGetErasedNode(uffs_Device *dev)
+#endif
+
+/* make sure the node taken out of erased list is ready to be written */
+static TreeNode * _PrepareErasedNode(uffs_Device *dev, TreeNode *node)
 {
-	TreeNode *node = uffs_TreeGetErasedNodeNoCheck(dev);
-	u16 block;
+	UBLOCK block;
 	uffs_BlockInfo *bc;
-	
-	if (node) {
-		if (node->u.list.u.need_check) {
-			block = node->u.list.block;
-			if (uffs_FlashCheckErasedBlock(dev, block) != U_SUCC) {
-				// Hmm, this block is not fully erased ? erase it immediately.
-				if (uffs_TreeEraseNode(dev, node) != U_SUCC)
-					return NULL;
-
-				node->u.list.u.need_check = 0;
-			}
-		}
-		// prepare block info cache for erased block - we don't need to load tag from flash for erased block
-		bc = uffs_BlockInfoGet(dev, node->u.list.block);
-		if (bc) {
-			uffs_BlockInfoInitErased(dev, bc);
-			uffs_BlockInfoPut(dev, bc);
+
+	if (node->u.list.u.need_check) {
+		block = node->u.list.block;
+		if (uffs_FlashCheckErasedBlock(dev, block) != U_SUCC) {
+			// Hmm, this block is not fully erased ? erase it immediately.
+			if (uffs_TreeEraseNode(dev, node) != U_SUCC)
+				return NULL;
+
+			node->u.list.u.need_check = 0;
 		}
 	}
+	// prepare block info cache for erased block - we don't need to load tag from flash for erased block
+	bc = uffs_BlockInfoGet(dev, node->u.list.block);
+	if (bc) {
+		uffs_BlockInfoInitErased(dev, bc);
+		uffs_BlockInfoPut(dev, bc);
+	}
+
+	return node;
+}
+
+TreeNode * uffs_TreeGetErasedNode(uffs_Device *dev)
+{
+	TreeNode *node;
+
+	if (uffs_TreeLazyComplete(dev) != U_SUCC)
+		return NULL;
+
+	node = uffs_TreeGetErasedNodeNoCheck(dev);
+	
+	if (node)
+		node = _PrepareErasedNode(dev, node);
+
 	return node;
 }
 
+#ifdef CONFIG_ENABLE_ERASE_COUNT_ALLOC
+/**
+ * take the given erased block out of erased list, instead of the least worn one.
+ * \return the node ready to be written, or NULL if failed.
+ */
+TreeNode * uffs_TreeTakeErasedNode(uffs_Device *dev, UBLOCK block)
+{
+	TreeNode *node;
+
+	if (uffs_TreeLazyComplete(dev) != U_SUCC)
+		return NULL;
+
+#ifdef CONFIG_ENABLE_TREE_BLOCK_BITMAP
+	if (uffs_TreeIsErasedBlock(dev, block) == U_FALSE)
+		return NULL;
+	node = _TakeErasedBlock(dev, block - dev->par.start);
+#else
+	node = uffs_TreeFindErasedNodeByBlock(dev, block);
+	if (node)
+		_UnlinkErasedNode(dev, node);
+#endif
+	if (node == NULL)
+		return NULL;
+
+	uffs_WearHeapRemove(dev, block);
+
+	return _PrepareErasedNode(dev, node);
+}
+#endif
+
 /**
  * Erase a flash block and check the bad block.
  * If the block is 'bad', then swap it with a good block and put the bad block into bad block list.
@@ -1263,7 +2306,7 @@ URET uffs_TreeEraseNode(uffs_Device *dev, TreeNode *node)
 	}
 }
 
-static void _InsertToEntry(uffs_Device *dev, u16 *entry,
+static void _InsertToEntry(uffs_Device *dev, UNODE *entry,
 						   int hash, TreeNode *node)
 {
 	node->hash_next = entry[hash];
@@ -1280,21 +2323,21 @@ static void _InsertToEntry(uffs_Device *dev, u16 *entry,
  */
 void uffs_BreakFromEntry(uffs_Device *dev, u8 type, TreeNode *node)
 {
-	u16 *entry;
+	UNODE *entry;
 	int hash;
 	TreeNode *work;
 
 	switch (type) {
 	case UFFS_TYPE_DIR:
-		hash = GET_DIR_HASH(node->u.dir.serial);
+		hash = GET_DIR_HASH(dev, node->u.dir.serial);
 		entry = &(dev->tree.dir_entry[hash]);
 		break;
 	case UFFS_TYPE_FILE:
-		hash = GET_FILE_HASH(node->u.file.serial);
+		hash = GET_FILE_HASH(dev, node->u.file.serial);
 		entry = &(dev->tree.file_entry[hash]);
 		break;
 	case UFFS_TYPE_DATA:
-		hash = GET_DATA_HASH(node->u.data.parent, node->u.data.serial);
+		hash = GET_DATA_HASH(dev, node->u.data.parent, node->u.data.serial);
 		entry = &(dev->tree.data_entry[hash]);
 		break;
 	default:
@@ -1314,29 +2357,148 @@ void uffs_BreakFromEntry(uffs_Device *dev, u8 type, TreeNode *node)
 	if (*entry == TO_IDX(node, &(dev->mem.tree_pool))) {
 		*entry = node->hash_next;
 	}
+
+#ifdef CONFIG_ENABLE_TREE_CHILD_INDEX
+	if (type == UFFS_TYPE_DIR)
+		_BreakFromChildEntry(dev, type, node, node->u.dir.parent);
+	else if (type == UFFS_TYPE_FILE)
+		_BreakFromChildEntry(dev, type, node, node->u.file.parent);
+#endif
+
+#ifdef CONFIG_ENABLE_FSN_BITMAP
+	if (type == UFFS_TYPE_DIR)
+		_MarkFsnSerial(dev, node->u.dir.serial, U_FALSE);
+	else if (type == UFFS_TYPE_FILE)
+		_MarkFsnSerial(dev, node->u.file.serial, U_FALSE);
+#endif
+
+#ifdef CONFIG_ENABLE_NAME_CACHE
+	if (type != UFFS_TYPE_DATA)
+		uffs_NameCacheRemove(dev, TO_IDX(node, TPOOL(dev)));
+#endif
+
+#ifdef CONFIG_ENABLE_DENTRY_CACHE
+	if (type != UFFS_TYPE_DATA)
+		uffs_DentryCacheRemoveNode(dev, node);
+#endif
+
+#ifdef CONFIG_ENABLE_OBJECT_DNODE_CACHE
+	if (type == UFFS_TYPE_DATA)
+		dev->tree.data_gen++;
+#endif
+
+	_ClearBlockIndex(dev, _GetBlockFromNode(type, node), node);
 }
 
 static void uffs_InsertToFileEntry(uffs_Device *dev, TreeNode *node)
 {
 	_InsertToEntry(dev, dev->tree.file_entry,
-					GET_FILE_HASH(node->u.file.serial),
+					GET_FILE_HASH(dev, node->u.file.serial),
 					node);
+	_InsertToChildEntry(dev, UFFS_TYPE_FILE, node, node->u.file.parent);
+	_MarkFsnSerial(dev, node->u.file.serial, U_TRUE);
+	uffs_DentryCacheNewName(dev, node->u.file.parent, node->u.file.checksum);
+	_SetBlockIndex(dev, node->u.file.block, node, SEARCH_REGION_FILE);
 }
 
 static void uffs_InsertToDirEntry(uffs_Device *dev, TreeNode *node)
 {
 	_InsertToEntry(dev, dev->tree.dir_entry,
-					GET_DIR_HASH(node->u.dir.serial),
+					GET_DIR_HASH(dev, node->u.dir.serial),
 					node);
+	_InsertToChildEntry(dev, UFFS_TYPE_DIR, node, node->u.dir.parent);
+	_MarkFsnSerial(dev, node->u.dir.serial, U_TRUE);
+	uffs_DentryCacheNewName(dev, node->u.dir.parent, node->u.dir.checksum);
+	_SetBlockIndex(dev, node->u.dir.block, node, SEARCH_REGION_DIR);
 }
 
 static void uffs_InsertToDataEntry(uffs_Device *dev, TreeNode *node)
 {
 	_InsertToEntry(dev, dev->tree.data_entry,
-					GET_DATA_HASH(node->u.data.parent, node->u.data.serial),
+					GET_DATA_HASH(dev, node->u.data.parent, node->u.data.serial),
 					node);
+	_SetBlockIndex(dev, node->u.data.block, node, SEARCH_REGION_DATA);
+}
+
+#ifdef CONFIG_ENABLE_TREE_BLOCK_BITMAP
+/* put block of node to erased bitmap, the node is released */
+static void _PutErasedBlock(uffs_Device *dev, TreeNode *node, int need_check)
+{
+	struct uffs_TreeSt *tree = &(dev->tree);
+	UBLOCK block = node->u.list.block;
+	int i = block - dev->par.start;
+
+	if (need_check < 0)
+		need_check = node->u.list.u.need_check;
+
+	uffs_PoolPut(TPOOL(dev), node);
+
+	if (block < dev->par.start || block > dev->par.end ||
+		TREE_MAP_TEST(tree->erased_map, i)) {
+		uffs_Perror(UFFS_MSG_SERIOUS, "invalid erased block %d !", block);
+		return;
+	}
+
+	TREE_MAP_SET(tree->erased_map, i);
+	if (need_check)
+		TREE_MAP_SET(tree->check_map, i);
+	else
+		TREE_MAP_CLR(tree->check_map, i);
+	tree->erased_count++;
+#ifdef CONFIG_ENABLE_TREE_BLOCK_INDEX
+	tree->block_node[i] = EMPTY_NODE;	// erased block has no node
+#endif
+	uffs_WearHeapPush(dev, (UBLOCK)i);
+}
+
+void uffs_InsertToErasedListHead(uffs_Device *dev, TreeNode *node)
+{
+	int i = node->u.list.block - dev->par.start;
+
+	_PutErasedBlock(dev, node, -1);
+	dev->tree.erased_next = (UBLOCK)i;	// to be taken next
+}
+
+/**
+ * put block of node to erased bitmap, the node is released.
+ * \param need_check: 0 - no need to check later
+ *                    1 - need to check later
+ *                  < 0 - keep 'node->u.list.need_check' value
+ */
+void uffs_TreeInsertToErasedListTailEx(uffs_Device *dev, TreeNode *node, int need_check)
+{
+	_PutErasedBlock(dev, node, need_check);
+}
+
+void uffs_TreeInsertToErasedListTail(uffs_Device *dev, TreeNode *node)
+{
+	// this function is called after the block is erased, so don't need to check.
+	uffs_TreeInsertToErasedListTailEx(dev, node, 0);
 }
 
+void uffs_TreeInsertToBadBlockList(uffs_Device *dev, TreeNode *node)
+{
+	struct uffs_TreeSt *tree = &(dev->tree);
+	UBLOCK block = node->u.list.block;
+	int i = block - dev->par.start;
+
+	uffs_PoolPut(TPOOL(dev), node);
+
+	if (block < dev->par.start || block > dev->par.end ||
+		TREE_MAP_TEST(tree->bad_map, i)) {
+		uffs_Perror(UFFS_MSG_SERIOUS, "invalid bad block %d !", block);
+		return;
+	}
+
+	TREE_MAP_SET(tree->bad_map, i);
+	tree->bad_count++;
+#ifdef CONFIG_ENABLE_TREE_BLOCK_INDEX
+	tree->block_node[i] = EMPTY_NODE;	// bad block has no node
+#endif
+}
+
+#else
+
 void uffs_InsertToErasedListHead(uffs_Device *dev, TreeNode *node)
 {
 	struct uffs_TreeSt *tree;
@@ -1354,6 +2516,8 @@ void uffs_InsertToErasedListHead(uffs_Device *dev, TreeNode *node)
 		tree->erased_tail = node;
 	}
 	tree->erased_count++;
+	_SetBlockIndex(dev, node->u.list.block, node, SEARCH_REGION_ERASED);
+	uffs_WearHeapPush(dev, TO_IDX(node, TPOOL(dev)));
 }
 
 /**
@@ -1381,6 +2545,8 @@ void uffs_TreeInsertToErasedListTailEx(uffs_Device *dev, TreeNode *node, int nee
 		tree->erased = node;
 	}
 	tree->erased_count++;
+	_SetBlockIndex(dev, node->u.list.block, node, SEARCH_REGION_ERASED);
+	uffs_WearHeapPush(dev, TO_IDX(node, TPOOL(dev)));
 }
 
 void uffs_TreeInsertToErasedListTail(uffs_Device *dev, TreeNode *node)
@@ -1403,12 +2569,15 @@ void uffs_TreeInsertToBadBlockList(uffs_Device *dev, TreeNode *node)
 
 	tree->bad = node;
 	tree->bad_count++;
+	_SetBlockIndex(dev, node->u.list.block, node, SEARCH_REGION_BAD);
 }
 
+#endif
+
 /** 
  * set tree node block value
  */
-void uffs_TreeSetNodeBlock(u8 type, TreeNode *node, u16 block)
+void uffs_TreeSetNodeBlock(u8 type, TreeNode *node, UBLOCK block)
 {
 	switch (type) {
 	case UFFS_TYPE_FILE:
@@ -1423,3 +2592,24 @@ void uffs_TreeSetNodeBlock(u8 type, TreeNode *node, u16 block)
 	}
 }
 
+/** 
+ * set parent of tree node, relink the node to the child chain of new parent
+ * if the node is in tree.
+ */
+void uffs_TreeSetNodeParent(uffs_Device *dev, u8 type, TreeNode *node, u16 parent)
+{
+	switch (type) {
+	case UFFS_TYPE_FILE:
+		_MoveChildEntry(dev, type, node, node->u.file.parent, parent);
+		node->u.file.parent = parent;
+		break;
+	case UFFS_TYPE_DIR:
+		_MoveChildEntry(dev, type, node, node->u.dir.parent, parent);
+		node->u.dir.parent = parent;
+		break;
+	case UFFS_TYPE_DATA:
+		node->u.data.parent = parent;
+		break;
+	}
+}
+
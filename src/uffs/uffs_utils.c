@@ -51,6 +51,7 @@
 #define PFX "util: "
 
 #define SPOOL(dev) &((dev)->mem.spare_pool)
+#define TPOOL(dev) &((dev)->mem.tree_pool)
 
 #ifdef CONFIG_USE_GLOBAL_FS_LOCK
 static OSSEM _global_lock = OSSEM_NOT_INITED;
@@ -211,7 +212,8 @@ ext:
 
 URET uffs_FormatDeviceEx(uffs_Device *dev, UBOOL force, UBOOL lock)
 {
-	u16 i, slot;
+	UBLOCK i;
+	u16 slot;
 	URET ret = U_SUCC;
 	
 	if (dev == NULL)
@@ -290,6 +292,12 @@ URET uffs_FormatDeviceEx(uffs_Device *dev, UBOOL force, UBOOL lock)
 		ret = U_FAIL;
 	}
 
+	if (ret == U_SUCC) {
+		// tree nodes are all reused, forget cached names and lookups
+		uffs_NameCacheFlush(dev);
+		uffs_DentryCacheFlush(dev);
+	}
+
 	if (ret == U_SUCC && uffs_BuildTree(dev) == U_FAIL) {
 		ret = U_FAIL;
 	}
@@ -354,7 +362,7 @@ static int DumpTag(struct uffs_DeviceSt *dev, int block, int page, uffs_Tags *ta
 		return -1;
 	}
 	
-	dump(dev, " - page %2d/%2d %s %d/%d len%4d\n", page, s->page_id, GetTagName(s), s->serial, s->parent, s->data_len);
+	dump(dev, " - page %2d/%2d %s %d/%d len%4d\n", page, s->page_id, GetTagName(s), s->serial, TAG_PARENT(tag), TAG_DATA_LEN(tag));
 	
 	return 0;
 }
@@ -403,10 +411,53 @@ static void DumpBlock(struct uffs_DeviceSt *dev, int block, dump_msg_cb *dump)
 	dump(dev, "\n");
 }
 
+#define HASH_CHAIN_HISTOGRAM_LEN	8
+
+static void DumpHashChains(struct uffs_DeviceSt *dev, const char *name,
+							UNODE *entry, int len, dump_msg_cb *dump)
+{
+	int hist[HASH_CHAIN_HISTOGRAM_LEN + 1];
+	int i, n, nodes = 0, max = 0;
+	UNODE x;
+
+	memset(hist, 0, sizeof(hist));
+
+	for (i = 0; i < len; i++) {
+		n = 0;
+		for (x = entry[i]; x != EMPTY_NODE; x = FROM_IDX(x, TPOOL(dev))->hash_next)
+			n++;
+		nodes += n;
+		if (n > max)
+			max = n;
+		hist[n > HASH_CHAIN_HISTOGRAM_LEN ? HASH_CHAIN_HISTOGRAM_LEN : n]++;
+	}
+
+	dump(dev, "%-5s buckets %5d nodes %5d max chain %3d, chain length histogram:",
+			name, len, nodes, max);
+	for (i = 0; i < HASH_CHAIN_HISTOGRAM_LEN; i++)
+		dump(dev, " %d:%d", i, hist[i]);
+	dump(dev, " %d+:%d\n", HASH_CHAIN_HISTOGRAM_LEN, hist[HASH_CHAIN_HISTOGRAM_LEN]);
+}
+
+/**
+ * \brief dump chain length histogram of tree hash tables
+ * \param[in] dev uffs device
+ * \param[in] dump message output callback
+ */
+void uffs_DumpTreeHash(struct uffs_DeviceSt *dev, dump_msg_cb *dump)
+{
+	dump(dev, "--- Tree hash ---\n");
+	DumpHashChains(dev, "dir", dev->tree.dir_entry, DIR_NODE_ENTRY_LEN(dev), dump);
+	DumpHashChains(dev, "file", dev->tree.file_entry, FILE_NODE_ENTRY_LEN(dev), dump);
+	DumpHashChains(dev, "data", dev->tree.data_entry, DATA_NODE_ENTRY_LEN(dev), dump);
+	dump(dev, "\n");
+}
+
 void uffs_DumpDevice(struct uffs_DeviceSt *dev, dump_msg_cb *dump)
 {
 	int i;
 	for (i = dev->par.start; i <= dev->par.end; i++) {
 		DumpBlock(dev, i, dump);
 	}	
+	uffs_DumpTreeHash(dev, dump);
 }
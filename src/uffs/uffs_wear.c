@@ -0,0 +1,729 @@
+/*
+  This file is part of UFFS, the Ultra-low-cost Flash File System.
+  
+  Copyright (C) 2005-2009 Ricky Zheng <ricky_gz_zheng@yahoo.co.nz>
+
+  UFFS is free software; you can redistribute it and/or modify it under
+  the GNU Library General Public License as published by the Free Software 
+  Foundation; either version 2 of the License, or (at your option) any
+  later version.
+
+  UFFS is distributed in the hope that it will be useful, but WITHOUT
+  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+  or GNU Library General Public License, as applicable, for more details.
+ 
+  You should have received a copy of the GNU General Public License
+  and GNU Library General Public License along with UFFS; if not, write
+  to the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  Boston, MA  02110-1301, USA.
+
+  As a special exception, if other files instantiate templates or use
+  macros or inline functions from this file, or you compile this file
+  and link it with other works to produce a work based on this file,
+  this file does not by itself cause the resulting work to be covered
+  by the GNU General Public License. However the source code for this
+  file must still be made available in accordance with section (3) of
+  the GNU General Public License v2.
+ 
+  This exception does not invalidate any other reasons why a work based
+  on this file might be covered by the GNU General Public License.
+*/
+
+/**
+ * \file uffs_wear.c
+ * \brief count block erasures, and hand out erased blocks in the order
+ *        of erase count, so that the least worn block is always used first.
+ *        The counters are kept in RAM and optionally saved to an erase
+ *        count table at the end of partition, loaded back at mount.
+ * \author Ricky Zheng
+ */
+
+#include "uffs_config.h"
+#include "uffs/uffs_public.h"
+#include "uffs/uffs_os.h"
+#include "uffs/uffs_tree.h"
+#include "uffs/uffs_flash.h"
+#include "uffs/uffs_crc.h"
+#include "uffs/uffs_badblock.h"
+#include "uffs/uffs_wear.h"
+#include <string.h>
+
+#ifdef CONFIG_ENABLE_ERASE_COUNT_ALLOC
+
+#define PFX "wear: "
+
+#define TPOOL(dev) &((dev)->mem.tree_pool)
+
+#ifdef CONFIG_ENABLE_ERASE_COUNT_TABLE
+
+#define WEAR_TABLE_MAGIC		0x54434555		//!< "UECT"
+#ifdef CONFIG_ENABLE_WIDE_BLOCK
+#define WEAR_TABLE_VERSION		2		//!< 32 bit block numbers
+#else
+#define WEAR_TABLE_VERSION		1
+#endif
+
+/**
+ * erase count table layout (byte stream over the pages of a slot):
+ *	[header] + [u32 erase count of each block of partition] + [u16 CRC16]
+ *
+ * The table blocks are split into two slots, a new table is always written
+ * to the slot which does not hold the latest one, so a power loss during
+ * saving leaves the previous table intact.
+ */
+struct uffs_WearTableHeaderSt {
+	u32 magic;
+	u16 version;
+	UBLOCK par_start;
+	UBLOCK par_end;
+	u16 reserved;
+	u32 seq;		/* bigger is newer */
+};
+
+/* bytes of the whole table */
+static int _TableSize(int num)
+{
+	return sizeof(struct uffs_WearTableHeaderSt) + sizeof(u32) * num + sizeof(u16);
+}
+
+/* blocks of a slot to hold the table of <num> blocks */
+static int _SlotBlocks(uffs_Device *dev, int num)
+{
+	int pages = (_TableSize(num) + dev->com.pg_data_size - 1) / dev->com.pg_data_size;
+
+	return (pages + dev->attr->pages_per_block - 1) / dev->attr->pages_per_block;
+}
+
+/* copy <len> bytes at <ofs> of table stream from/to page data */
+static void _TableCopy(uffs_Device *dev, struct uffs_WearTableHeaderSt *hdr, u16 *crc,
+						int ofs, u8 *data, int len, UBOOL to_page)
+{
+	struct { u8 *p; int size; } parts[3];
+	int i, n;
+
+	parts[0].p = (u8 *)hdr;
+	parts[0].size = sizeof(struct uffs_WearTableHeaderSt);
+	parts[1].p = (u8 *)dev->wear.erase_count;
+	parts[1].size = sizeof(u32) * dev->wear.num;
+	parts[2].p = (u8 *)crc;
+	parts[2].size = sizeof(u16);
+
+	for (i = 0; i < 3 && len > 0; i++) {
+		if (ofs >= parts[i].size) {
+			ofs -= parts[i].size;
+			continue;
+		}
+		n = parts[i].size - ofs;
+		n = (len < n ? len : n);
+		if (to_page)
+			memcpy(data, parts[i].p + ofs, n);
+		else
+			memcpy(parts[i].p + ofs, data, n);
+		data += n;
+		len -= n;
+		ofs = 0;
+	}
+}
+
+static URET _EraseBlock(uffs_Device *dev, int block)
+{
+	int ret;
+
+	ret = uffs_FlashEraseBlock(dev, block);
+	if (UFFS_FLASH_IS_BAD_BLOCK(ret)) {
+		// table block is not in the tree, just mark it 'bad'.
+		uffs_FlashMarkBadBlock(dev, block);
+		return U_FAIL;
+	}
+
+	return UFFS_FLASH_HAVE_ERR(ret) ? U_FAIL : U_SUCC;
+}
+
+/* read first <len> bytes of table from <slot>, only the header if <len> is the header size */
+static URET _ReadSlot(uffs_Device *dev, int slot, uffs_Buf *buf,
+						struct uffs_WearTableHeaderSt *hdr, u16 *crc, int len)
+{
+	struct uffs_WearSt *w = &(dev->wear);
+	int total = _TableSize(w->num);
+	int slot_blocks = w->table_blocks / 2;
+	int ofs, n, page, block;
+	uffs_Tags tag;
+	int ret;
+
+	for (ofs = 0, page = 0; ofs < len; ofs += n, page++) {
+		block = w->table_start + slot * slot_blocks + page / dev->attr->pages_per_block;
+		n = total - ofs;
+		n = (n < dev->com.pg_data_size ? n : dev->com.pg_data_size);
+
+		if (uffs_FlashIsBadBlock(dev, block) == U_TRUE)
+			return U_FAIL;
+
+		ret = uffs_FlashReadPageTag(dev, block, page % dev->attr->pages_per_block, &tag);
+		if (UFFS_FLASH_HAVE_ERR(ret) ||
+			!TAG_IS_GOOD(&tag) ||
+			TAG_TYPE(&tag) != UFFS_TYPE_RESV ||
+			TAG_SERIAL(&tag) != (page & MAX_UFFS_FDN) ||
+			TAG_DATA_LEN(&tag) != n)
+			return U_FAIL;
+
+		ret = uffs_FlashReadPage(dev, block, page % dev->attr->pages_per_block, buf, U_FALSE);
+		if (UFFS_FLASH_HAVE_ERR(ret))
+			return U_FAIL;
+
+		_TableCopy(dev, hdr, crc, ofs, buf->data, (len - ofs < n ? len - ofs : n), U_FALSE);
+	}
+
+	return U_SUCC;
+}
+
+static UBOOL _IsHeaderValid(uffs_Device *dev, struct uffs_WearTableHeaderSt *hdr)
+{
+	return (hdr->magic == WEAR_TABLE_MAGIC &&
+			hdr->version == WEAR_TABLE_VERSION &&
+			hdr->par_start == dev->par.start &&
+			hdr->par_end == dev->par.end) ? U_TRUE : U_FALSE;
+}
+
+/* load erase counters from the latest valid table, counters are all 0 if there is none */
+static void _LoadTable(uffs_Device *dev)
+{
+	struct uffs_WearSt *w = &(dev->wear);
+	struct uffs_WearTableHeaderSt hdr[2];
+	UBOOL valid[2];
+	uffs_Buf *buf;
+	u16 crc;
+	int i, slot;
+
+	w->slot = -1;
+	w->seq = 0;
+	w->unsaved = 0;
+	memset(w->erase_count, 0, sizeof(u32) * w->num);
+
+	buf = uffs_BufClone(dev, NULL);
+	if (buf == NULL) {
+		uffs_Perror(UFFS_MSG_SERIOUS, "fail to clone buffer for erase count table");
+		return;
+	}
+
+	for (slot = 0; slot < 2; slot++) {
+		valid[slot] = (_ReadSlot(dev, slot, buf, &hdr[slot], NULL,
+									sizeof(struct uffs_WearTableHeaderSt)) == U_SUCC &&
+						_IsHeaderValid(dev, &hdr[slot]) == U_TRUE) ? U_TRUE : U_FALSE;
+	}
+
+	// try the newer one first
+	slot = (valid[1] && (!valid[0] || hdr[1].seq > hdr[0].seq)) ? 1 : 0;
+	for (i = 0; i < 2; i++, slot = !slot) {
+		if (!valid[slot])
+			continue;
+		if (_ReadSlot(dev, slot, buf, &hdr[slot], &crc, _TableSize(w->num)) == U_SUCC &&
+			_IsHeaderValid(dev, &hdr[slot]) == U_TRUE &&
+			crc == uffs_crc16update(w->erase_count, sizeof(u32) * w->num,
+						uffs_crc16update(&hdr[slot], sizeof(hdr[slot]), 0))) {
+			w->slot = slot;
+			w->seq = hdr[slot].seq;
+			uffs_Perror(UFFS_MSG_NOISY, "erase count table loaded from slot %d, seq %u",
+						slot, (unsigned int)w->seq);
+			break;
+		}
+		uffs_Perror(UFFS_MSG_NORMAL, "invalid erase count table in slot %d", slot);
+		memset(w->erase_count, 0, sizeof(u32) * w->num);
+	}
+
+	uffs_BufFreeClone(dev, buf);
+}
+
+/** 
+ * \brief save erase counters to the slot which does not hold the latest table.
+ * \return U_SUCC if the table is saved.
+ */
+URET uffs_WearSave(uffs_Device *dev)
+{
+	struct uffs_WearSt *w = &(dev->wear);
+	struct uffs_WearTableHeaderSt hdr;
+	int total = _TableSize(w->num);
+	int slot, slot_blocks;
+	int ofs, n, page, block;
+	uffs_Buf *buf;
+	uffs_Tags tag;
+	u16 crc;
+	int ret;
+	URET result = U_FAIL;
+
+	if (w->erase_count == NULL || w->table_blocks == 0)
+		return U_FAIL;
+
+	slot = (w->slot == 0 ? 1 : 0);
+	slot_blocks = w->table_blocks / 2;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = WEAR_TABLE_MAGIC;
+	hdr.version = WEAR_TABLE_VERSION;
+	hdr.par_start = dev->par.start;
+	hdr.par_end = dev->par.end;
+	hdr.seq = w->seq + 1;
+	crc = uffs_crc16update(&hdr, sizeof(hdr), 0);
+	crc = uffs_crc16update(w->erase_count, sizeof(u32) * w->num, crc);
+
+	buf = uffs_BufClone(dev, NULL);
+	if (buf == NULL) {
+		uffs_Perror(UFFS_MSG_SERIOUS, "fail to clone buffer for erase count table");
+		return U_FAIL;
+	}
+
+	for (block = 0; block < slot_blocks; block++) {
+		if (_EraseBlock(dev, w->table_start + slot * slot_blocks + block) != U_SUCC)
+			goto ext;
+	}
+
+	for (ofs = 0, page = 0; ofs < total; ofs += n, page++) {
+		block = w->table_start + slot * slot_blocks + page / dev->attr->pages_per_block;
+		n = total - ofs;
+		n = (n < dev->com.pg_data_size ? n : dev->com.pg_data_size);
+
+		memset(buf->data, 0xFF, dev->com.pg_data_size);
+		_TableCopy(dev, &hdr, &crc, ofs, buf->data, n, U_TRUE);
+
+		memset(&tag, 0xFF, sizeof(tag));
+		TAG_BLOCK_TS(&tag) = 0;
+		TAG_TYPE(&tag) = UFFS_TYPE_RESV;
+		TAG_SET_PARENT(&tag, 0);
+		TAG_SERIAL(&tag) = page & MAX_UFFS_FDN;
+		TAG_PAGE_ID(&tag) = page % dev->attr->pages_per_block;
+		TAG_SET_DATA_LEN(&tag, n);
+
+		ret = uffs_FlashWritePageCombine(dev, block, page % dev->attr->pages_per_block, buf, &tag);
+		if (UFFS_FLASH_HAVE_ERR(ret)) {
+			uffs_Perror(UFFS_MSG_NORMAL,
+						"write erase count table block %d page %d fail, error = %d",
+						block, page % dev->attr->pages_per_block, ret);
+			goto ext;
+		}
+	}
+
+	w->slot = slot;
+	w->seq = hdr.seq;
+	w->unsaved = 0;
+	result = U_SUCC;
+
+	uffs_Perror(UFFS_MSG_NOISY, "erase count table saved to slot %d, seq %u",
+				slot, (unsigned int)w->seq);
+ext:
+	uffs_BufFreeClone(dev, buf);
+
+	if (result != U_SUCC)
+		uffs_Perror(UFFS_MSG_NORMAL, "fail to save erase count table");
+
+	return result;
+}
+
+/** 
+ * \brief save erase counters when there are dev->cfg.erase_count_save_interval
+ *        erasures since last save, or any erasure if <force> is U_TRUE.
+ *        called at flush/close/unmount, not in the middle of writing.
+ */
+void uffs_WearSync(uffs_Device *dev, UBOOL force)
+{
+	struct uffs_WearSt *w = &(dev->wear);
+
+	if (w->erase_count == NULL || w->unsaved == 0)
+		return;
+
+	if (force || w->unsaved >= (u32)dev->cfg.erase_count_save_interval)
+		uffs_WearSave(dev);
+}
+
+#endif
+
+/* block offset of heap entry */
+static UBLOCK _BlockOf(uffs_Device *dev, UBLOCK idx)
+{
+#ifdef CONFIG_ENABLE_TREE_BLOCK_BITMAP
+	return idx;
+#else
+	TreeNode *node = FROM_IDX(idx, TPOOL(dev));
+
+	return node->u.list.block - dev->par.start;
+#endif
+}
+
+/* node 'a' should be used before node 'b' ? */
+static UBOOL _Before(uffs_Device *dev, UBLOCK a, UBLOCK b)
+{
+	struct uffs_WearSt *w = &(dev->wear);
+	UBLOCK ba = _BlockOf(dev, a);
+	UBLOCK bb = _BlockOf(dev, b);
+
+	if (w->erase_count[ba] != w->erase_count[bb])
+		return w->erase_count[ba] < w->erase_count[bb] ? U_TRUE : U_FALSE;
+
+	// same erase count, start from a random block picked at mount time
+	return ((ba + w->num - w->rot) % w->num) < ((bb + w->num - w->rot) % w->num) ?
+			U_TRUE : U_FALSE;
+}
+
+static void _Place(uffs_Device *dev, UBLOCK pos, UBLOCK idx)
+{
+	struct uffs_WearSt *w = &(dev->wear);
+
+	w->heap[pos] = idx;
+	w->heap_pos[_BlockOf(dev, idx)] = pos;
+}
+
+static void _SiftUp(uffs_Device *dev, UBLOCK pos)
+{
+	struct uffs_WearSt *w = &(dev->wear);
+	UBLOCK idx = w->heap[pos];
+	UBLOCK parent;
+
+	while (pos > 0) {
+		parent = (pos - 1) / 2;
+		if (_Before(dev, idx, w->heap[parent]) == U_FALSE)
+			break;
+		_Place(dev, pos, w->heap[parent]);
+		pos = parent;
+	}
+	_Place(dev, pos, idx);
+}
+
+static void _SiftDown(uffs_Device *dev, UBLOCK pos)
+{
+	struct uffs_WearSt *w = &(dev->wear);
+	UBLOCK idx = w->heap[pos];
+	u32 child;
+
+	for (;;) {
+		child = (u32)pos * 2 + 1;
+		if (child >= w->heap_len)
+			break;
+		if (child + 1 < w->heap_len &&
+			_Before(dev, w->heap[child + 1], w->heap[child]) == U_TRUE)
+			child++;
+		if (_Before(dev, w->heap[child], idx) == U_FALSE)
+			break;
+		_Place(dev, pos, w->heap[child]);
+		pos = (UBLOCK)child;
+	}
+	_Place(dev, pos, idx);
+}
+
+/** 
+ * \brief reserve erase count table blocks from the end of partition,
+ *        allocate erase counters and heap, and load counters from table.
+ *        should be called before uffs_TreeInit().
+ * \return U_FAIL if partition is too small for the table,
+ *         U_SUCC otherwise, erased blocks are handed out in list order
+ *         if there is no enough memory
+ */
+URET uffs_WearInit(uffs_Device *dev)
+{
+	struct uffs_WearSt *w = &(dev->wear);
+	int num = dev->par.end - dev->par.start + 1;
+	int size;
+	u8 *p;
+
+	memset(w, 0, sizeof(struct uffs_WearSt));
+
+#ifdef CONFIG_ENABLE_ERASE_COUNT_TABLE
+	w->slot = -1;
+	w->table_blocks = _SlotBlocks(dev, num) * 2;
+	if (num <= w->table_blocks + MINIMUN_ERASED_BLOCK) {
+		uffs_Perror(UFFS_MSG_DEAD, "partition is too small for erase count table!");
+		w->table_blocks = 0;
+		return U_FAIL;
+	}
+	dev->par.end -= w->table_blocks;
+	w->table_start = dev->par.end + 1;
+	num = dev->par.end - dev->par.start + 1;
+#endif
+
+	if (dev->mem.malloc == NULL)
+		return U_SUCC;
+
+	size = (sizeof(u32) + sizeof(UBLOCK) * 2) * num;
+	p = (u8 *) dev->mem.malloc(dev, size);
+	if (p == NULL) {
+		uffs_Perror(UFFS_MSG_NORMAL, "no memory for erase counters, disabled.");
+		return U_SUCC;
+	}
+
+	uffs_Perror(UFFS_MSG_NOISY, "alloc erase counters %d bytes.", size);
+
+	w->erase_count = (u32 *)p;
+	w->heap = (UBLOCK *)(w->erase_count + num);
+	w->heap_pos = w->heap + num;
+	w->num = num;
+
+	memset(w->erase_count, 0, sizeof(u32) * num);
+	uffs_WearHeapReset(dev);
+
+#ifdef CONFIG_ENABLE_ERASE_COUNT_TABLE
+	_LoadTable(dev);
+#endif
+
+	return U_SUCC;
+}
+
+/** 
+ * \brief release erase counters and heap, give back erase count table blocks
+ */
+URET uffs_WearRelease(uffs_Device *dev)
+{
+	struct uffs_WearSt *w = &(dev->wear);
+
+	if (w->erase_count && dev->mem.free)
+		dev->mem.free(dev, w->erase_count);
+
+#ifdef CONFIG_ENABLE_ERASE_COUNT_TABLE
+	dev->par.end += w->table_blocks;
+#endif
+
+	memset(w, 0, sizeof(struct uffs_WearSt));
+
+	return U_SUCC;
+}
+
+/** 
+ * \brief empty the heap, erase counters are kept.
+ */
+void uffs_WearHeapReset(uffs_Device *dev)
+{
+	struct uffs_WearSt *w = &(dev->wear);
+
+	if (w->erase_count == NULL)
+		return;
+
+	w->heap_len = 0;
+	memset(w->heap_pos, 0xff, sizeof(UBLOCK) * w->num);
+	w->rot = uffs_GetCurDateTime() % w->num;
+}
+
+/** 
+ * \brief put an erased block entry (tree node index, or block offset
+ *        in bitmap mode) to heap, O(log n).
+ */
+void uffs_WearHeapPush(uffs_Device *dev, UBLOCK entry)
+{
+	struct uffs_WearSt *w = &(dev->wear);
+
+	if (w->erase_count == NULL)
+		return;
+
+	if (w->heap_pos[_BlockOf(dev, entry)] != WEAR_HEAP_NONE) {
+		uffs_Perror(UFFS_MSG_SERIOUS, "block %d is already in heap !",
+					_BlockOf(dev, entry) + dev->par.start);
+		return;
+	}
+
+	w->heap[w->heap_len] = entry;
+	w->heap_len++;
+	_SiftUp(dev, w->heap_len - 1);
+}
+
+/** 
+ * \brief take the least worn erased block entry from heap, O(log n).
+ * \return heap entry, WEAR_HEAP_NONE if heap is empty or disabled
+ */
+UBLOCK uffs_WearHeapPop(uffs_Device *dev)
+{
+	struct uffs_WearSt *w = &(dev->wear);
+	UBLOCK idx;
+
+	if (w->erase_count == NULL || w->heap_len == 0)
+		return WEAR_HEAP_NONE;
+
+	idx = w->heap[0];
+	w->heap_pos[_BlockOf(dev, idx)] = WEAR_HEAP_NONE;
+	w->heap_len--;
+	if (w->heap_len > 0) {
+		w->heap[0] = w->heap[w->heap_len];
+		_SiftDown(dev, 0);
+	}
+
+	return idx;
+}
+
+/** 
+ * \brief take the erased block out of heap, O(log n).
+ */
+void uffs_WearHeapRemove(uffs_Device *dev, UBLOCK block)
+{
+	struct uffs_WearSt *w = &(dev->wear);
+	UBLOCK pos, idx;
+
+	if (w->erase_count == NULL || block < dev->par.start || block > dev->par.end)
+		return;
+
+	block -= dev->par.start;
+	pos = w->heap_pos[block];
+	if (pos == WEAR_HEAP_NONE)
+		return;
+
+	w->heap_pos[block] = WEAR_HEAP_NONE;
+	w->heap_len--;
+	if (pos < w->heap_len) {
+		// fill the hole with the last one, it may go either up or down
+		idx = w->heap[w->heap_len];
+		w->heap[pos] = idx;
+		_SiftUp(dev, pos);
+		if (w->heap_pos[_BlockOf(dev, idx)] == pos)
+			_SiftDown(dev, pos);
+	}
+}
+
+/** 
+ * \brief increase erase count of block, call this after block is erased.
+ */
+void uffs_WearNoteErase(uffs_Device *dev, int block)
+{
+	struct uffs_WearSt *w = &(dev->wear);
+	UBLOCK pos;
+
+	if (w->erase_count == NULL || block < dev->par.start || block > dev->par.end)
+		return;
+
+	block -= dev->par.start;
+	if (w->erase_count[block] != 0xFFFFFFFF)
+		w->erase_count[block]++;
+#ifdef CONFIG_ENABLE_ERASE_COUNT_TABLE
+	w->unsaved++;
+#endif
+#ifdef CONFIG_ENABLE_STATIC_WEAR_LEVELING
+	w->wl_erases++;
+#endif
+
+	// block is erased while still in erased list (format), move it down
+	pos = w->heap_pos[block];
+	if (pos != WEAR_HEAP_NONE)
+		_SiftDown(dev, pos);
+}
+
+/** 
+ * \brief get erase count of block.
+ */
+u32 uffs_WearGetEraseCount(uffs_Device *dev, int block)
+{
+	struct uffs_WearSt *w = &(dev->wear);
+
+	if (w->erase_count == NULL || block < dev->par.start || block > dev->par.end)
+		return 0;
+
+	return w->erase_count[block - dev->par.start];
+}
+
+/** 
+ * \brief get min/max/total erase counts of partition.
+ * \return U_FAIL if erase counters are not available
+ */
+URET uffs_WearGetStat(uffs_Device *dev, u32 *min, u32 *max, u32 *total)
+{
+	struct uffs_WearSt *w = &(dev->wear);
+	u32 lo = 0xFFFFFFFF, hi = 0, sum = 0;
+	int i;
+
+	if (w->erase_count == NULL)
+		return U_FAIL;
+
+	for (i = 0; i < w->num; i++) {
+		if (w->erase_count[i] < lo)
+			lo = w->erase_count[i];
+		if (w->erase_count[i] > hi)
+			hi = w->erase_count[i];
+		sum += w->erase_count[i];
+	}
+
+	if (min)
+		*min = lo;
+	if (max)
+		*max = hi;
+	if (total)
+		*total = sum;
+
+	return U_SUCC;
+}
+
+#ifdef CONFIG_ENABLE_STATIC_WEAR_LEVELING
+/** 
+ * \brief static wear leveling: blocks holding data which is never rewritten
+ *        (cold blocks) are not erased, so dynamic wear leveling can't level them.
+ *        If the least worn block in use is dev->cfg.static_wl_threshold erasures
+ *        behind the most worn erased block, move its data to the most worn block,
+ *        then the least worn block is erased and goes back to the erased blocks.
+ *
+ *        Only one block is moved each time, and only after there are
+ *        dev->cfg.static_wl_interval erasures since last pass (unless <force>),
+ *        so the cost is spread over normal writing.
+ *        Called at flush/close, not in the middle of writing.
+ *
+ * \return U_SUCC if a block is moved, U_FAIL otherwise.
+ */
+URET uffs_WearLevelStatic(uffs_Device *dev, UBOOL force)
+{
+	struct uffs_WearSt *w = &(dev->wear);
+	TreeNode *node;
+	u32 worn_count = 0, cold_count = 0xFFFFFFFF;
+	int i, worn = -1, cold = -1;
+	int region;
+
+	if (w->erase_count == NULL || dev->cfg.static_wl_threshold < 0)
+		return U_FAIL;
+
+	if (!force && w->wl_erases < (u32)dev->cfg.static_wl_interval)
+		return U_FAIL;
+
+	// don't bother if there are blocks waiting for recover, or tree is not ready
+	if (dev->pending.count > 0 || uffs_TreeLazyComplete(dev) != U_SUCC)
+		return U_FAIL;
+
+	w->wl_erases = 0;
+
+	// most worn erased block
+	for (i = 0; i < w->heap_len; i++) {
+		if (worn < 0 || w->erase_count[_BlockOf(dev, w->heap[i])] > worn_count) {
+			worn = _BlockOf(dev, w->heap[i]);
+			worn_count = w->erase_count[worn];
+		}
+	}
+
+	if (worn < 0 || dev->tree.erased_count <= MINIMUN_ERASED_BLOCK)
+		return U_FAIL;
+
+	worn += dev->par.start;
+
+	// least worn block in use: not in erased list, and not a bad block
+	for (i = 0; i < w->num; i++) {
+		if (w->heap_pos[i] == WEAR_HEAP_NONE && w->erase_count[i] < cold_count &&
+			uffs_TreeIsBadBlock(dev, (UBLOCK)(i + dev->par.start)) == U_FALSE) {
+			cold = i;
+			cold_count = w->erase_count[i];
+		}
+	}
+
+	if (cold < 0 || worn_count < cold_count ||
+		worn_count - cold_count < (u32)dev->cfg.static_wl_threshold)
+		return U_FAIL;
+
+	cold += dev->par.start;
+	region = SEARCH_REGION_DIR | SEARCH_REGION_FILE | SEARCH_REGION_DATA;
+	if (uffs_TreeFindNodeByBlock(dev, (UBLOCK)cold, &region) == NULL)
+		return U_FAIL;	// not in the tree ?
+
+	uffs_Perror(UFFS_MSG_NOISY, "move block %d (erase count %u) to block %d (erase count %u)",
+				cold, (unsigned int)cold_count,
+				worn, (unsigned int)worn_count);
+
+	node = uffs_TreeTakeErasedNode(dev, (UBLOCK)worn);
+	if (node == NULL)
+		return U_FAIL;
+
+	if (uffs_BadBlockRefresh(dev, cold, node) != U_SUCC)
+		return U_FAIL;
+
+	w->wl_moves++;
+
+	return U_SUCC;
+}
+#endif
+
+#endif
@@ -46,6 +46,7 @@
 #include "uffs/uffs_utils.h"
 #include "uffs/uffs_core.h"
 #include "uffs/uffs_mtb.h"
+#include "uffs/uffs_fd.h"
 
 #include "cmdline.h"
 #include "uffs_fileem.h"
@@ -96,6 +97,7 @@ static int conf_status_byte_offset = STATUS_BYTE_OFFSET_DEFAULT;
 static int conf_total_blocks = TOTAL_BLOCKS_DEFAULT;
 static int conf_ecc_option = ECC_OPTION_DEFAULT;
 static int conf_ecc_size = 0; // 0 - Let UFFS choose the size
+static int conf_dirty_groups = 0; // 0 - Let UFFS choose the number
 
 static const char *g_ecc_option_strings[] = UFFS_ECC_OPTION_STRING;
 
@@ -142,6 +144,8 @@ static int init_uffs_fs(void)
 		0,			// reserved_free_blocks - default
 	};
 
+	cfg.dirty_groups = conf_dirty_groups;
+
 	if (bIsFileSystemInited)
 		return -4;
 
@@ -172,6 +176,8 @@ static int release_uffs_fs(void)
 	int ret = 0;
 	uffs_MountTable *mtb;
 
+	uffs_flusher_stop();
+
 	for (mtb = &(conf_mounts[0]); ret == 0 && mtb->mount != NULL; mtb++) {
 		uffs_UnMount(mtb->mount);
 	}
@@ -340,6 +346,16 @@ static int parse_options(int argc, char *argv[])
 					usage++;
 				}
 			}
+			else if (!strcmp(arg, "-g") || !strcmp(arg, "--dirty-groups")) {
+                if (++iarg >= argc)
+					usage++;
+                else if (sscanf(argv[iarg], "%i", &conf_dirty_groups) < 1)
+					usage++;
+				if (conf_dirty_groups < 0) {
+					MSGLN("ERROR: Invalid dirty groups");
+					usage++;
+				}
+			}
             else {
                 MSGLN("Unknown option: %s, try %s --help", arg, argv[0]);
 				return -1;
@@ -365,6 +381,7 @@ static int parse_options(int argc, char *argv[])
         MSGLN("  -m  --mount          <mount_point,start,end> , for example: -m /,0,-1");
 		MSGLN("  -x  --ecc-option     <none|soft|hw|auto>  ECC option, default=%s", g_ecc_option_strings[ECC_OPTION_DEFAULT]);
 		MSGLN("  -z  --ecc-size       <n>                  ECC size, default=0 (auto)");
+		MSGLN("  -g  --dirty-groups   <n>                  dirty buffer groups, default=0 (auto)");
         MSGLN("  -e  --exec           <file>               execute a script file");
         MSGLN("");
 
@@ -401,6 +418,7 @@ static void print_params(void)
 	MSGLN("  total blocks: %d", conf_total_blocks);
 	MSGLN("  ecc option: %d (%s)", conf_ecc_option, g_ecc_option_strings[conf_ecc_option]);
 	MSGLN("  ecc size: %d%s", conf_ecc_size, conf_ecc_size == 0 ? " (auto)" : "");
+	MSGLN("  dirty groups: %d%s", conf_dirty_groups, conf_dirty_groups == 0 ? " (auto)" : "");
 	MSGLN("  bad block status offset: %d", conf_status_byte_offset);
 	MSGLN("");
 }